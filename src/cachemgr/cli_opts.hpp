@@ -117,6 +117,89 @@ static constexpr const auto cli_opt_verify_cache_mappings =
 static constexpr const auto cli_opt_usage_stats =
     cli_option("usage", "u", "", "show the usage statistics of caches", cli_option::boolean_type);
 
+// number of threads used to scan cache directories
+static constexpr const auto cli_opt_threads =
+    cli_option("threads", "j", "", "number of threads for scanning cache directories (0 = all hardware threads)",
+        cli_option::string_type);
+
+// ignore the directory index of previous scans
+static constexpr const auto cli_opt_full_rescan =
+    cli_option("full-rescan", "", "", "scan all cache directories completely, ignoring the results of previous scans",
+        cli_option::boolean_type);
+
+// print the usage statistics while scanning
+static constexpr const auto cli_opt_stream =
+    cli_option("stream", "", "", "print every cache directory as soon as it is scanned and show the scan progress",
+        cli_option::boolean_type);
+
+// query the usage statistics from the daemon
+static constexpr const auto cli_opt_from_daemon =
+    cli_option("from-daemon", "", "", "query the usage statistics from cachemgrd, scan the caches if it is not running",
+        cli_option::boolean_type);
+
+// estimate the usage statistics by sampling
+static constexpr const auto cli_opt_estimate =
+    cli_option("estimate", "", "", "estimate the usage statistics by sampling instead of scanning everything",
+        cli_option::boolean_type);
+static constexpr const auto cli_opt_estimate_budget =
+    cli_option("estimate-budget", "", "", "budget of the estimator: a time (e.g. 2s, 500ms) or a number of stat calls",
+        cli_option::string_type);
+
+// largest subdirectories of every cache directory
+static constexpr const auto cli_opt_breakdown =
+    cli_option("breakdown", "", "", "show the given number of largest subdirectories of every cache directory",
+        cli_option::string_type);
+static constexpr const auto cli_opt_depth =
+    cli_option("depth", "", "", "number of subdirectory levels to break down (default: 1)",
+        cli_option::string_type);
+
+// age and size histograms of every cache directory
+static constexpr const auto cli_opt_histogram =
+    cli_option("histogram", "", "", "show the age and size histograms of every cache directory",
+        cli_option::boolean_type);
+
+// size which is displayed in the usage statistics
+static constexpr const auto cli_opt_apparent_size =
+    cli_option("apparent-size", "", "", "show the sum of the file sizes in the usage statistics (default)",
+        cli_option::boolean_type);
+static constexpr const auto cli_opt_allocated_size =
+    cli_option("allocated-size", "", "", "show the allocated space on disk in the usage statistics",
+        cli_option::boolean_type);
+
+// delete the least recently used files of cache directories which exceed their size limit
+static constexpr const auto cli_opt_enforce =
+    cli_option("enforce", "", "", "delete the least recently used files of cache directories which exceed their max_size",
+        cli_option::boolean_type);
+static constexpr const auto cli_opt_dry_run =
+    cli_option("dry-run", "", "", "only show which files would be deleted, replaced or packed, together with '--enforce', '--dedupe' or '--pack'",
+        cli_option::boolean_type);
+
+// replace identical files across cache directories with reflinks
+static constexpr const auto cli_opt_dedupe =
+    cli_option("dedupe", "", "", "replace identical files across all cache directories with reflinks",
+        cli_option::boolean_type);
+static constexpr const auto cli_opt_hardlinks =
+    cli_option("hardlinks", "", "", "replace duplicates with hardlinks when reflinks are not supported, together with '--dedupe'",
+        cli_option::boolean_type);
+
+// empty a cache directory
+static constexpr const auto cli_opt_clean =
+    cli_option("clean", "", "", "empty the cache directory of the given cache mapping id, deleted in the background",
+        cli_option::string_type);
+
+// compressibility of every cache directory
+static constexpr const auto cli_opt_compressibility =
+    cli_option("compressibility", "", "", "estimate how well every cache directory compresses by sampling its files",
+        cli_option::boolean_type);
+
+// pack subtrees which were not used for a while into archives, and unpack them again
+static constexpr const auto cli_opt_pack =
+    cli_option("pack", "", "", "pack subtrees of the cache directories which were not used for the given number of days into archives",
+        cli_option::string_type);
+static constexpr const auto cli_opt_restore =
+    cli_option("restore", "", "", "unpack all archives in the cache directory of the given cache mapping id",
+        cli_option::string_type);
+
 // print the predicted cache location of package managers
 static constexpr const auto cli_opt_print_pm_cache_locations =
     cli_option("print-pm-cache-locations", "", "", "print the predicted cache location of package managers",
@@ -126,12 +209,31 @@ static constexpr const auto cli_opt_print_pm_cache_location =
         cli_option::string_type);
 
 // array of command line options for easy registration in the parser
-static constexpr const std::array<observer_ptr<cli_option>, 7> cli_options = {
+static constexpr const std::array<observer_ptr<cli_option>, 26> cli_options = {
     &cli_opt_help,
     &cli_opt_version,
     &cli_opt_config,
     &cli_opt_usage_stats,
+    &cli_opt_threads,
+    &cli_opt_full_rescan,
+    &cli_opt_stream,
+    &cli_opt_from_daemon,
+    &cli_opt_estimate,
+    &cli_opt_estimate_budget,
+    &cli_opt_breakdown,
+    &cli_opt_depth,
+    &cli_opt_histogram,
+    &cli_opt_apparent_size,
+    &cli_opt_allocated_size,
     &cli_opt_verify_cache_mappings,
+    &cli_opt_enforce,
+    &cli_opt_dry_run,
+    &cli_opt_dedupe,
+    &cli_opt_hardlinks,
+    &cli_opt_clean,
+    &cli_opt_compressibility,
+    &cli_opt_pack,
+    &cli_opt_restore,
     &cli_opt_print_pm_cache_locations,
     &cli_opt_print_pm_cache_location,
 };
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <vector>
 #include <string>
 #include <filesystem>
 
@@ -6,9 +12,15 @@
 #include <fmt/ostream.h>
 
 #include <utils/os_utils.hpp>
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/disk_usage/inode_set.hpp>
+#include <utils/disk_usage/directory_index.hpp>
+#include <utils/disk_usage/subtree_breakdown.hpp>
 #include <utils/datetime_utils.hpp>
+#include <utils/number_utils.hpp>
 #include <utils/types/file_size_units.hpp>
 #include <utils/freedesktop/xdg_paths.hpp>
+#include <utils/threading/work_stealing_pool.hpp>
 
 #include <libcachemgr/logging.hpp>
 #include <libcachemgr/config.hpp>
@@ -17,9 +29,11 @@
 #include <libcachemgr/messages.hpp>
 #include <libcachemgr/package_manager_support/pm_registry.hpp>
 #include <libcachemgr/database/cache_db.hpp>
+#include <libcachemgr/daemon/client.hpp>
 
 #include "basic_utils_logger.hpp"
 #include "cli_opts.hpp"
+#include "progress_line.hpp"
 
 using human_readable_file_size = file_size_units::human_readable_file_size;
 template<> struct fmt::formatter<human_readable_file_size> : ostream_formatter{};
@@ -28,49 +42,599 @@ using namespace libcachemgr::messages;
 using program_metadata = libcachemgr::program_metadata;
 using configuration_t = libcachemgr::configuration_t;
 
-/// small helper function to calculate disk usage and handle errors
-static std::uintmax_t get_used_disk_space_of_safe(const std::string &path)
+/**
+ * The size which is displayed and used for sorting in the usage statistics.
+ */
+static libcachemgr::disk_size_type_t displayed_size_type()
+{
+    return libcachemgr::user_configuration()->show_allocated_size() ?
+        libcachemgr::disk_size_type_t::allocated_size : libcachemgr::disk_size_type_t::apparent_size;
+}
+
+/**
+ * Padding of the lines in the usage statistics.
+ *
+ * Only depends on the paths of the mapped cache directories, so it is known before any size is calculated.
+ */
+struct usage_line_layout_t final
+{
+    std::string::size_type max_length_of_source_path{0};
+    std::string::size_type max_length_of_target_path{0};
+    std::string::size_type max_length_of_display_line{0};
+};
+
+static usage_line_layout_t make_usage_line_layout(
+    const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories)
+{
+    usage_line_layout_t layout;
+    for (const auto &dir : mapped_cache_directories)
+    {
+        // calculate the padding required for pretty printing
+        if (dir.directory_type == libcachemgr::directory_type_t::symbolic_link)
+        {
+            layout.max_length_of_source_path = std::max(layout.max_length_of_source_path, dir.original_path.size());
+            layout.max_length_of_target_path = std::max(layout.max_length_of_target_path, dir.target_path.size());
+        }
+        layout.max_length_of_display_line = std::max(layout.max_length_of_display_line,
+            dir.line_display_entry().size());
+    }
+    return layout;
+}
+
+/**
+ * Formats the usage statistics line of a single mapped cache directory.
+ *
+ * @param margin margin of error of an estimated size, 0 for exact sizes
+ */
+static std::string format_usage_line(const libcachemgr::mapped_cache_directory_t &dir,
+    const usage_line_layout_t &layout, libcachemgr::disk_size_type_t size_type, std::uintmax_t margin = 0)
+{
+    std::string line_display_entry;
+    if (dir.directory_type == libcachemgr::directory_type_t::symbolic_link)
+    {
+        line_display_entry = fmt::format("{}",
+            dir.line_display_entry(layout.max_length_of_source_path, layout.max_length_of_target_path));
+    }
+    else
+    {
+        line_display_entry = fmt::format("{}",
+            dir.line_display_entry(layout.max_length_of_display_line + 2));
+    }
+
+    // the attributed size counts every hardlink, the unique size only counts hardlinks
+    // which were not already accounted in a previous cache mapping
+    const auto disk_size = dir.disk_size_of(size_type);
+    const auto unique_disk_size = dir.unique_disk_size_of(size_type);
+    if (margin > 0)
+    {
+        return fmt::format("{} : {:>8} ({} bytes, ± {})\n",
+            line_display_entry,
+            human_readable_file_size{disk_size}, disk_size,
+            human_readable_file_size{margin});
+    }
+    else if (unique_disk_size == disk_size)
+    {
+        return fmt::format("{} : {:>8} ({} bytes)\n",
+            line_display_entry,
+            human_readable_file_size{disk_size}, disk_size);
+    }
+    else
+    {
+        return fmt::format("{} : {:>8} ({} bytes, unique: {} bytes)\n",
+            line_display_entry,
+            human_readable_file_size{disk_size}, disk_size, unique_disk_size);
+    }
+}
+
+/**
+ * Prints the usage statistics of the given mapped cache directories, sorted by disk usage.
+ *
+ * @param estimates optional estimates in the order of @p mapped_cache_directories, their margins are printed
+ */
+static void print_usage_statistics(
+    const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    std::uintmax_t available_disk_space,
+    const std::vector<disk_usage::estimate_result> *estimates = nullptr)
 {
-    static const auto log_warning = [&path](const std::error_code &ec){
-        LOG_WARNING(libcachemgr::log_main, "failed to get used disk space of '{}': {}", path, ec);
+    std::uintmax_t total_size = 0;
+    std::uintmax_t total_unique_size = 0;
+
+    const auto size_type = displayed_size_type();
+
+    // used to pad the output
+    const auto layout = make_usage_line_layout(mapped_cache_directories);
+
+    // margins of the estimated sizes by mapped cache directory
+    std::unordered_map<const libcachemgr::mapped_cache_directory_t*, std::uintmax_t> margins;
+    double total_margin_squared = 0.0;
+
+    // collect usage statistics
+    auto estimate = estimates != nullptr ? estimates->cbegin() : decltype(estimates->cbegin()){};
+    for (const auto &dir : mapped_cache_directories)
+    {
+        if (estimates != nullptr)
+        {
+            const auto margin = size_type == libcachemgr::disk_size_type_t::allocated_size ?
+                estimate->allocated_size_margin : estimate->apparent_size_margin;
+            margins.emplace(&dir, margin);
+            ++estimate;
+
+            // the estimates are independent, their variances add up
+            total_margin_squared += static_cast<double>(margin) * static_cast<double>(margin);
+        }
+
+        total_size += dir.disk_size_of(size_type);
+        total_unique_size += dir.unique_disk_size_of(size_type);
+    }
+
+    // print the results of individual directories
+    for (const auto &dir : cachemgr_t::sorted_mapped_cache_directories(
+        mapped_cache_directories, cachemgr_t::sort_behavior::disk_usage_descending, size_type))
+    {
+        const auto it = margins.find(dir);
+        fmt::print("{}", format_usage_line(*dir, layout, size_type, it != margins.end() ? it->second : 0));
+    }
+
+    const auto padding = layout.max_length_of_source_path + layout.max_length_of_target_path;
+
+    // print the total size of all cache directories
+    if (const auto total_margin = static_cast<std::uintmax_t>(std::sqrt(total_margin_squared)); total_margin > 0)
+    {
+        fmt::print("{:>{}} total size : {:>8} ({} bytes, ± {})\n", " ",
+            padding - 7,
+            human_readable_file_size{total_size}, total_size,
+            human_readable_file_size{total_margin});
+    }
+    else
+    {
+        fmt::print("{:>{}} total size : {:>8} ({} bytes)\n", " ",
+            padding - 7,
+            human_readable_file_size{total_size}, total_size);
+    }
+
+    // print the total size without duplicate hardlinks, this is the real usage on disk
+    fmt::print("{:>{}} total unique size : {:>8} ({} bytes)\n", " ",
+        padding - 14,
+        human_readable_file_size{total_unique_size}, total_unique_size);
+
+    // print the available space on the filesystem where cache_root resides
+    fmt::print("{:>{}} available space on cache root : {:>8} ({} bytes)\n", " ",
+        padding - 26,
+        human_readable_file_size{available_disk_space}, available_disk_space);
+}
+
+/**
+ * Prints the largest subdirectories of every mapped cache directory, see {cachemgr_t::enable_breakdown}.
+ */
+static void print_breakdown(const cachemgr_t &cachemgr, std::size_t count)
+{
+    const auto size_type = displayed_size_type();
+    const bool by_allocated_size = size_type == libcachemgr::disk_size_type_t::allocated_size;
+
+    const auto print_children = [by_allocated_size](const auto &self,
+        const disk_usage::subtree_breakdown_t::entry_t &entry, std::size_t indent) -> void {
+        for (const auto &child : entry.children)
+        {
+            const auto size = by_allocated_size ? child.allocated_size : child.apparent_size;
+            fmt::print("{:>{}}{:>8}  {}\n", "", indent, human_readable_file_size{size}, child.path);
+            self(self, child, indent + 2);
+        }
     };
 
-    std::error_code ec;
+    for (const auto &dir : cachemgr.sorted_mapped_cache_directories(
+        cachemgr_t::sort_behavior::disk_usage_descending, size_type))
+    {
+        const auto *breakdown = cachemgr.breakdown_of(*dir);
+        if (breakdown == nullptr)
+        {
+            continue;
+        }
+
+        const auto report = breakdown->top(count, by_allocated_size);
+        fmt::print("\nlargest subdirectories of {} ({}):\n", dir->id, report.path);
+        print_children(print_children, report, 2);
+    }
+}
+
+/**
+ * Prints the age and size histograms of every mapped cache directory, see {cachemgr_t::enable_histograms}.
+ */
+static void print_histograms(const cachemgr_t &cachemgr)
+{
+    using disk_usage::file_histograms;
+    static constexpr std::array<std::string_view, file_histograms::age_bucket_count> age_labels = {
+        "< 1 day", "< 7 days", "< 30 days", "< 90 days", ">= 90 days",
+    };
 
-    // the given path is more likely to be a directory
-    [[likely]] if (std::filesystem::is_directory(path, ec))
+    for (const auto &dir : cachemgr.sorted_mapped_cache_directories(
+        cachemgr_t::sort_behavior::disk_usage_descending, displayed_size_type()))
     {
-        const auto [dir_size, ec_dir] = os_utils::get_used_disk_space_of(path);
-        if (ec_dir)
+        const auto *histograms = cachemgr.histograms_of(*dir);
+        if (histograms == nullptr)
         {
-            log_warning(ec);
+            continue;
+        }
+
+        fmt::print("\nhistograms of {} ({}):\n", dir->id, dir->target_path);
+        fmt::print("  {:<12}  {:>8}  {:>8}\n", "age", "accessed", "modified");
+        for (std::size_t i = 0; i < file_histograms::age_bucket_count; ++i)
+        {
+            fmt::print("  {:<12}  {:>8}  {:>8}\n", age_labels[i],
+                human_readable_file_size{histograms->accessed_bytes[i]},
+                human_readable_file_size{histograms->modified_bytes[i]});
+        }
+
+        // empty buckets of the size histogram are skipped, most of them are never used
+        fmt::print("  {:<12}  {:>8}  {:>8}\n", "size", "files", "bytes");
+        for (std::size_t i = 0; i < file_histograms::size_bucket_count; ++i)
+        {
+            if (histograms->size_files[i] == 0)
+            {
+                continue;
+            }
+
+            std::string label;
+            if (i == 0)
+            {
+                label = "empty";
+            }
+            else if (i + 1 == file_histograms::size_bucket_count)
+            {
+                label = fmt::format(">= {}", human_readable_file_size{std::uintmax_t{1} << (i - 1)});
+            }
+            else
+            {
+                label = fmt::format("< {}", human_readable_file_size{std::uintmax_t{1} << i});
+            }
+            fmt::print("  {:<12}  {:>8}  {:>8}\n", label, histograms->size_files[i],
+                human_readable_file_size{histograms->size_bytes[i]});
         }
-        return dir_size;
     }
-    else if (ec)
+}
+
+/**
+ * Converts the histograms of a mapped cache directory into database records.
+ *
+ * All buckets of the age histograms are stored, the size histogram only stores the buckets which are used.
+ */
+static std::vector<libcachemgr::database::cache_histogram_bucket> make_histogram_buckets(
+    std::uint64_t timestamp, const std::string &cache_mapping_id, const disk_usage::file_histograms &histograms)
+{
+    using libcachemgr::database::cache_histogram_bucket;
+
+    std::vector<cache_histogram_bucket> buckets;
+    for (std::uint32_t i = 0; i < disk_usage::file_histograms::age_bucket_count; ++i)
     {
-        log_warning(ec);
+        buckets.emplace_back(cache_histogram_bucket{
+            .timestamp = timestamp,
+            .cache_mapping_id = cache_mapping_id,
+            .histogram = "accessed",
+            .bucket = i,
+            .file_count = std::nullopt,
+            .byte_count = histograms.accessed_bytes[i],
+        });
+        buckets.emplace_back(cache_histogram_bucket{
+            .timestamp = timestamp,
+            .cache_mapping_id = cache_mapping_id,
+            .histogram = "modified",
+            .bucket = i,
+            .file_count = std::nullopt,
+            .byte_count = histograms.modified_bytes[i],
+        });
+    }
+    for (std::uint32_t i = 0; i < disk_usage::file_histograms::size_bucket_count; ++i)
+    {
+        if (histograms.size_files[i] > 0)
+        {
+            buckets.emplace_back(cache_histogram_bucket{
+                .timestamp = timestamp,
+                .cache_mapping_id = cache_mapping_id,
+                .histogram = "size",
+                .bucket = i,
+                .file_count = histograms.size_files[i],
+                .byte_count = histograms.size_bytes[i],
+            });
+        }
     }
+    return buckets;
+}
 
-    else if (std::filesystem::is_regular_file(path, ec))
+/**
+ * Prints the outcome of the size limit enforcement of every cache directory with a size limit.
+ *
+ * In a dry run, every file which would be deleted is listed with its size and the days since its last use.
+ *
+ * @return false if a cache directory is still over its limit
+ */
+static bool print_size_limit_enforcements(
+    const std::vector<cachemgr_t::size_limit_enforcement_t> &enforcements, bool dry_run)
+{
+    if (enforcements.empty())
     {
-        const auto file_size = std::filesystem::file_size(path, ec);
-        if (ec)
+        fmt::print("no cache mapping has a max_size\n");
+        return true;
+    }
+
+    constexpr std::int64_t day = 24 * 3600;
+    const auto now = static_cast<std::int64_t>(datetime_utils::get_current_system_timestamp_in_utc());
+
+    bool is_under_limit = true;
+    for (const auto &enforcement : enforcements)
+    {
+        const auto &dir = *enforcement.directory;
+        const auto &plan = enforcement.plan;
+
+        if (!plan.is_over_limit())
+        {
+            fmt::print("{}: {} of {}, nothing to delete\n", dir.id,
+                human_readable_file_size{plan.current_size}, human_readable_file_size{plan.max_size});
+            continue;
+        }
+
+        if (dry_run)
+        {
+            fmt::print("{}: {} of {}, would delete {} files ({}) to reach {}\n", dir.id,
+                human_readable_file_size{plan.current_size}, human_readable_file_size{plan.max_size},
+                plan.files.size(), human_readable_file_size{plan.planned_size},
+                human_readable_file_size{plan.target_size});
+            for (const auto &file : plan.files)
+            {
+                fmt::print("  {:>8}  {:>5}d  {}/{}\n", human_readable_file_size{file.size},
+                    std::max<std::int64_t>(0, now - file.last_used) / day, plan.root, file.relative_path);
+            }
+        }
+        else
+        {
+            fmt::print("{}: {} of {}, deleted {} files ({}), {} now\n", dir.id,
+                human_readable_file_size{plan.current_size}, human_readable_file_size{plan.max_size},
+                enforcement.result.deleted_files, human_readable_file_size{enforcement.result.freed_size},
+                human_readable_file_size{enforcement.final_size});
+        }
+
+        if (enforcement.final_size > plan.max_size)
+        {
+            is_under_limit = false;
+            fmt::print(stderr, "{}: can't get under the limit of {}, the remaining files are hardlinked or in use\n",
+                dir.id, human_readable_file_size{plan.max_size});
+        }
+    }
+
+    return is_under_limit;
+}
+
+/**
+ * Prints the packed subtrees of every mapped cache directory.
+ *
+ * The archives stay inside of the cache directories, the mapping totals of the usage statistics
+ * count them as regular files at their size on disk. The saved inodes are the packed entries
+ * minus the archives which replace them. In a dry run, every subtree which would be packed is listed.
+ *
+ * @return false if a cache directory couldn't be searched or a subtree couldn't be packed
+ */
+static bool print_cold_packing(const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    const std::vector<disk_usage::packing_result> &results, bool dry_run)
+{
+    bool is_ok = true;
+    std::uint64_t total_archives = 0;
+    std::uint64_t total_entries = 0;
+    std::uintmax_t total_archive_size = 0;
+
+    auto result = results.begin();
+    for (const auto &dir : mapped_cache_directories)
+    {
+        const auto &packing = *result++;
+        if (packing.ec)
+        {
+            is_ok = false;
+            fmt::print(stderr, "{}: failed to search cold subtrees: {}\n", dir.id, packing.ec.message());
+        }
+
+        std::uint64_t archives = 0;
+        std::uint64_t entries = 0;
+        std::uintmax_t apparent_size = 0;
+        std::uintmax_t archive_size = 0;
+        for (const auto &subtree : packing.subtrees)
+        {
+            if (!dry_run && subtree.ec)
+            {
+                is_ok = false;
+                fmt::print(stderr, "{}: failed to pack '{}': {}\n", dir.id, subtree.path, subtree.ec.message());
+                if (!subtree.staging_path.empty())
+                {
+                    fmt::print(stderr, "{}: '{}' was recreated, the previous contents are left in '{}'\n",
+                        dir.id, subtree.path, subtree.staging_path);
+                }
+                continue;
+            }
+            archives += 1;
+            entries += subtree.entries;
+            apparent_size += subtree.apparent_size;
+            archive_size += subtree.archive_size;
+        }
+        if (archives == 0)
+        {
+            continue;
+        }
+
+        if (dry_run)
         {
-            log_warning(ec);
+            fmt::print("{}: would pack {} subtrees with {} entries ({})\n", dir.id,
+                archives, entries, human_readable_file_size{apparent_size});
+            for (const auto &subtree : packing.subtrees)
+            {
+                fmt::print("  {:>8}  {:>8}  {}\n", human_readable_file_size{subtree.apparent_size},
+                    subtree.entries, subtree.path);
+            }
+        }
+        else
+        {
+            fmt::print("{}: packed {} entries ({}) into {} archives ({}), {} inodes freed\n", dir.id,
+                entries, human_readable_file_size{apparent_size}, archives,
+                human_readable_file_size{archive_size}, entries - archives);
         }
-        return file_size;
+
+        total_archives += archives;
+        total_entries += entries;
+        total_archive_size += archive_size;
     }
-    else if (ec)
+
+    if (total_archives == 0)
     {
-        log_warning(ec);
+        fmt::print("no cold subtrees found\n");
+    }
+    else if (!dry_run)
+    {
+        fmt::print("total: {} archives ({}), {} inodes freed\n", total_archives,
+            human_readable_file_size{total_archive_size}, total_entries - total_archives);
     }
 
-    return 0;
+    return is_ok;
+}
+
+/**
+ * Prints the estimated compressibility of every mapped cache directory.
+ *
+ * Directories which compress well are recommended for a compressed `cache_root`.
+ */
+static void print_compressibility(const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    const std::vector<disk_usage::compressibility_result> &estimates)
+{
+    // estimated ratio from which a compressed filesystem is worth its CPU time
+    constexpr double recommended_ratio = 1.5;
+
+    auto estimate = estimates.begin();
+    for (const auto &dir : mapped_cache_directories)
+    {
+        const auto &result = *estimate++;
+        if (!result.has_samples())
+        {
+            fmt::print("{}: no samples\n", dir.id);
+            continue;
+        }
+
+        fmt::print("{}: {:.2f}x, entropy {:.2f} bits/byte, {:.0f}% incompressible, {} sampled from {} files -> {}\n",
+            dir.id, result.compression_ratio, result.entropy, result.incompressible_share * 100,
+            human_readable_file_size{result.sampled_size}, result.sampled_files,
+            result.compression_ratio >= recommended_ratio ? "compressed cache_root" : "plain disk");
+    }
+}
+
+/**
+ * Finds the mapped cache directory of the given cache mapping id for an action on its target directory.
+ *
+ * Prints an error if there is no such mapped cache directory or if it has no single target directory.
+ *
+ * @param action the action in the error message, e.g. "cleaned"
+ * @return the mapped cache directory, nullptr if it can't be used for the action
+ */
+static const libcachemgr::mapped_cache_directory_t *find_target_directory(
+    const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    const std::string &cache_mapping_id, std::string_view action)
+{
+    const auto dir = std::find_if(mapped_cache_directories.begin(), mapped_cache_directories.end(),
+        [&cache_mapping_id](const auto &dir){
+            return dir.id == cache_mapping_id;
+        });
+    if (dir == mapped_cache_directories.end())
+    {
+        fmt::print(stderr, "error: no valid cache mapping with id '{}'\n", cache_mapping_id);
+        return nullptr;
+    }
+    else if (!dir->has_target_directory())
+    {
+        fmt::print(stderr, "error: cache mapping '{}' has no single target directory which can be {}\n",
+            cache_mapping_id, action);
+        return nullptr;
+    }
+    return &*dir;
+}
+
+/**
+ * Prints the duplicates and the reclaimed space of every deduplicated cache directory.
+ *
+ * @return false if an error occurred
+ */
+static bool print_deduplication(const cachemgr_t::deduplication_t &deduplication, bool dry_run)
+{
+    const auto &result = deduplication.result;
+
+    std::uintmax_t reclaimed_size = 0;
+    for (std::size_t i = 0; i < deduplication.directories.size(); ++i)
+    {
+        const auto &root = result.roots[i];
+        reclaimed_size += root.reclaimed_size;
+        if (dry_run)
+        {
+            fmt::print("{}: {} duplicate files, {} reclaimable\n", deduplication.directories[i]->id,
+                root.duplicate_files, human_readable_file_size{root.reclaimed_size});
+        }
+        else
+        {
+            fmt::print("{}: {} duplicate files, {} reflinked, {} hardlinked, {} reclaimed\n",
+                deduplication.directories[i]->id, root.duplicate_files, root.reflinked_files,
+                root.hardlinked_files, human_readable_file_size{root.reclaimed_size});
+        }
+    }
+
+    fmt::print("total: {} {}", human_readable_file_size{reclaimed_size}, dry_run ? "reclaimable" : "reclaimed");
+    if (result.skipped_files > 0)
+    {
+        fmt::print(", {} files skipped", result.skipped_files);
+    }
+    fmt::print("\n");
+
+    if (!dry_run && result.skipped_files > 0 && !libcachemgr::user_configuration()->allow_hardlinks())
+    {
+        fmt::print(stderr, "note: duplicates on filesystems without reflink support are only replaced with '--{}'\n",
+            std::string{cli_opt_hardlinks});
+    }
+
+    if (result.ec)
+    {
+        fmt::print(stderr, "error: {}\n", result.ec.message());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Queries the usage statistics from the daemon and prints them.
+ *
+ * @return false if the daemon is not running or didn't answer, nothing is printed in this case
+ */
+static bool print_usage_statistics_from_daemon()
+{
+    const auto &socket_file = libcachemgr::user_configuration()->daemon_socket_file();
+    const libcachemgr::daemon::daemon_client_t client(socket_file);
+
+    libcachemgr::daemon::sizes_response_t response;
+    if (const auto ec = client.query_sizes(response); ec)
+    {
+        LOG_INFO(libcachemgr::log_main, "daemon not available on '{}', scanning the cache directories: {}",
+            socket_file, ec);
+        return false;
+    }
+
+    std::list<libcachemgr::mapped_cache_directory_t> mapped_cache_directories;
+    for (const auto &mapping : response.mappings)
+    {
+        mapped_cache_directories.emplace_back(libcachemgr::daemon::make_mapped_cache_directory(mapping));
+    }
+
+    print_usage_statistics(mapped_cache_directories, response.available_disk_space);
+    return true;
 }
 
 static int cachemgr_cli()
 {
+    // the daemon keeps the sizes up to date, no need to parse the configuration file or to scan anything
+    if (libcachemgr::user_configuration()->show_usage_stats() &&
+        libcachemgr::user_configuration()->from_daemon() &&
+        print_usage_statistics_from_daemon())
+    {
+        return 0;
+    }
+
     // parse the configuration file
     configuration_t::file_error file_error;
     configuration_t::parse_error parse_error;
@@ -117,9 +681,13 @@ static int cachemgr_cli()
     // create the cache manager
     cachemgr_t cachemgr;
 
+    // the command line takes precedence over the configuration file
+    const unsigned scan_threads = libcachemgr::user_configuration()->scan_threads().value_or(config.scan_threads());
+
     // find and validate all configured cache mappings
     cachemgr_t::cache_mappings_compare_results_t::difference_size_type cache_mappings_difference = 0;
-    if (const auto compare_results = cachemgr.find_mapped_cache_directories(config.cache_mappings()); compare_results)
+    if (const auto compare_results = cachemgr.find_mapped_cache_directories(config.cache_mappings(), scan_threads);
+        compare_results)
     {
         cache_mappings_difference = compare_results.count();
         LOG_WARNING(libcachemgr::log_cachemgr,
@@ -132,118 +700,243 @@ static int cachemgr_cli()
         return cache_mappings_difference > 0 ? 1 : 0;
     }
 
+    else if (libcachemgr::user_configuration()->show_usage_stats() && libcachemgr::user_configuration()->estimate())
+    {
+        fmt::print("Estimating usage statistics...\n");
+
+        // estimates are neither recorded in the database nor written into the scan snapshot
+        const auto estimates = cachemgr.estimate_disk_usage(disk_usage::estimate_options{
+            .time_budget = libcachemgr::user_configuration()->estimate_time_budget(),
+            .stat_budget = libcachemgr::user_configuration()->estimate_stat_budget(),
+            .use_io_uring = config.scan_io_uring() && disk_usage::io_uring_available(),
+        });
+
+        const auto [available_disk_space, ec] = os_utils::get_available_disk_space_of(config.cache_root());
+        if (ec)
+        {
+            LOG_WARNING(libcachemgr::log_main, "failed to get available disk space of '{}': {}", config.cache_root(), ec);
+        }
+
+        print_usage_statistics(cachemgr.mapped_cache_directories(), available_disk_space, &estimates);
+
+        return 0;
+    }
+
     else if (libcachemgr::user_configuration()->show_usage_stats())
     {
         fmt::print("Calculating usage statistics...\n");
 
-        using libcachemgr::directory_type_t;
+        const bool scan_io_uring = config.scan_io_uring() && disk_usage::io_uring_available();
+        LOG_DEBUG(libcachemgr::log_main, "directory scanner backend: {}, threads: {}, io_uring: {}",
+            disk_usage::backend_name(), scan_threads, scan_io_uring);
 
-        std::uintmax_t total_size = 0;
+        // hardlinks are deduplicated across all cache mappings
+        disk_usage::inode_set_t hardlinks;
 
-        // used to pad the output
-        using mcd_t = libcachemgr::mapped_cache_directory_t;
-        std::string::size_type max_length_of_source_path = 0;
-        std::string::size_type max_length_of_target_path = 0;
-        std::string::size_type max_length_of_display_line = 0;
+        // unchanged directories of previous scans are not scanned again
+        const auto &scan_snapshot_file = libcachemgr::user_configuration()->scan_snapshot_file();
+        disk_usage::directory_index_t directory_index;
+        if (libcachemgr::user_configuration()->full_rescan())
+        {
+            LOG_INFO(libcachemgr::log_main, "full rescan requested, ignoring the scan snapshot");
+        }
+        else if (const auto ec = cachemgr.open_snapshot(scan_snapshot_file); ec)
+        {
+            LOG_DEBUG(libcachemgr::log_main, "scan snapshot '{}' not loaded, scanning everything: {}",
+                scan_snapshot_file, ec);
+        }
+        else
+        {
+            directory_index.attach(cachemgr.snapshot().directories(), cachemgr.snapshot().generation());
+            LOG_DEBUG(libcachemgr::log_main, "loaded scan snapshot '{}' with {} directories (generation {})",
+                scan_snapshot_file, directory_index.size(), directory_index.generation());
+        }
 
-        // collect usage statistics and print the results of individual directories
-        for (const auto &dir : cachemgr.mapped_cache_directories())
+        // attribute the sizes to subdirectories during the same walk
+        cachemgr.enable_breakdown(libcachemgr::user_configuration()->breakdown_count() > 0 ?
+            libcachemgr::user_configuration()->breakdown_depth() : 0);
+        cachemgr.enable_histograms(libcachemgr::user_configuration()->show_histograms());
+
+        // scan all cache directories concurrently, grouped by the device they reside on
+        const disk_usage::scan_options scan_options{
+            .thread_count = scan_threads,
+            .hardlinks = &hardlinks,
+            .use_io_uring = scan_io_uring,
+            .index = &directory_index,
+        };
+        if (libcachemgr::user_configuration()->stream_usage_stats())
         {
-            if (dir.has_target_directory())
-            {
-                LOG_INFO(libcachemgr::log_main, "calculating usage statistics for directory: {}", dir.target_path);
-            }
-            else if (dir.has_wildcard_matches())
-            {
-                LOG_CALCULATING_USAGE_STATISTICS_FOR_WILDCARD_PATTERN_WITH_FILE_COUNT(
-                    // message arguments
-                    libcachemgr::log_main, dir.resolved_source_files.size(),
-                    // log message arguments
-                    dir.wildcard_pattern, dir.resolved_source_files.size());
-            }
+            // print every cache directory as soon as it is scanned, the sorted summary follows at the end
+            disk_usage::scan_progress progress;
+            auto streaming_options = scan_options;
+            streaming_options.progress = &progress;
+
+            const auto layout = make_usage_line_layout(cachemgr.mapped_cache_directories());
+            const auto size_type = displayed_size_type();
+
+            progress_line_t progress_line(progress);
+            cachemgr.calculate_disk_usage(streaming_options,
+                [&progress_line, &layout, size_type](const libcachemgr::mapped_cache_directory_t &dir){
+                    progress_line.print(format_usage_line(dir, layout, size_type));
+                });
+            progress_line.stop();
 
-            // calculate the padding required for pretty printing
-            if (dir.directory_type == directory_type_t::symbolic_link)
-            {
-                if (dir.original_path.size() > max_length_of_source_path)
-                {
-                    max_length_of_source_path = dir.original_path.size();
-                }
-                if (dir.target_path.size() > max_length_of_target_path)
-                {
-                    max_length_of_target_path = dir.target_path.size();
-                }
-            }
-            if (const auto line_display_entry_size = dir.line_display_entry().size();
-                line_display_entry_size > max_length_of_display_line)
-            {
-                max_length_of_display_line = line_display_entry_size;
-            }
+            fmt::print("\n");
+        }
+        else
+        {
+            cachemgr.calculate_disk_usage(scan_options);
+        }
 
-            // only obtain used disk space if the target path is not empty
-            if (dir.has_target_directory())
-            {
-                const auto dir_size = get_used_disk_space_of_safe(dir.target_path);
-                total_size += dir_size;
-                dir.disk_size = dir_size;
-            }
-            // obtain used disk space for a list of source files
-            else if (dir.has_wildcard_matches())
-            {
-                for (const auto &source_file : dir.resolved_source_files)
-                {
-                    const auto file_size = get_used_disk_space_of_safe(source_file);
-                    total_size += file_size;
-                    dir.disk_size += file_size;
-                }
-            }
+        if (const auto ec = cachemgr.write_snapshot(scan_snapshot_file, directory_index); ec)
+        {
+            LOG_WARNING(libcachemgr::log_main, "failed to write scan snapshot '{}': {}", scan_snapshot_file, ec);
+        }
 
-            if (is_db_open)
+        // record the sizes of the individual directories
+        if (is_db_open)
+        {
+            for (const auto &dir : cachemgr.mapped_cache_directories())
             {
                 // select datetime(timestamp, 'unixepoch'), * from cache_trends;
+                const auto timestamp = datetime_utils::get_current_system_timestamp_in_utc();
                 db.insert_cache_trend(libcachemgr::database::cache_trend{
-                    .timestamp = datetime_utils::get_current_system_timestamp_in_utc(),
+                    .timestamp = timestamp,
                     .cache_mapping_id = dir.id,
                     .package_manager = dir.package_manager ?
                         std::optional{std::string{dir.package_manager()->pm_name()}} : std::nullopt,
                     .cache_size = dir.disk_size,
+                    .allocated_size = dir.allocated_disk_size,
                 });
+
+                // select * from cache_histograms where timestamp = ? and cache_mapping_id = ?;
+                if (const auto *histograms = cachemgr.histograms_of(dir); histograms != nullptr)
+                {
+                    db.insert_cache_histogram(make_histogram_buckets(timestamp, dir.id, *histograms));
+                }
             }
         }
-        for (const auto &dir : cachemgr.sorted_mapped_cache_directories())
+
+        // get the available space on the filesystem where cache_root resides
+        const auto [available_disk_space, ec] = os_utils::get_available_disk_space_of(config.cache_root());
+        if (ec)
+        {
+            LOG_WARNING(libcachemgr::log_main, "failed to get available disk space of '{}': {}", config.cache_root(), ec);
+        }
+
+        print_usage_statistics(cachemgr.mapped_cache_directories(), available_disk_space);
+
+        if (const auto count = libcachemgr::user_configuration()->breakdown_count(); count > 0)
         {
-            std::string line_display_entry;
-            if (dir->directory_type == directory_type_t::symbolic_link)
-            {
-                line_display_entry = fmt::format("{}",
-                    dir->line_display_entry(max_length_of_source_path, max_length_of_target_path));
-            }
-            else
-            {
-                line_display_entry = fmt::format("{}",
-                    dir->line_display_entry(max_length_of_display_line + 2));
-            }
+            print_breakdown(cachemgr, count);
+        }
 
-            fmt::print("{} : {:>8} ({} bytes)\n",
-                line_display_entry,
-                human_readable_file_size{dir->disk_size}, dir->disk_size);
+        if (libcachemgr::user_configuration()->show_histograms())
+        {
+            print_histograms(cachemgr);
         }
 
-        // print the total size of all cache directories
-        fmt::print("{:>{}} total size : {:>8} ({} bytes)\n", " ",
-            max_length_of_source_path + max_length_of_target_path - 7,
-            human_readable_file_size{total_size}, total_size);
+        return 0;
+    }
 
-        // print the available space on the filesystem where cache_root resides
-        const auto [available_disk_space, ec] = os_utils::get_available_disk_space_of(config.cache_root());
-        if (ec)
+    else if (libcachemgr::user_configuration()->enforce_size_limits())
+    {
+        const bool dry_run = libcachemgr::user_configuration()->dry_run();
+        const auto enforcements = cachemgr.enforce_size_limits(disk_usage::eviction_options{
+            .allocated_size = displayed_size_type() == libcachemgr::disk_size_type_t::allocated_size,
+            .thread_count = scan_threads,
+        }, dry_run);
+
+        return print_size_limit_enforcements(enforcements, dry_run) ? 0 : 1;
+    }
+
+    else if (libcachemgr::user_configuration()->dedupe())
+    {
+        const bool dry_run = libcachemgr::user_configuration()->dry_run();
+        const auto deduplication = cachemgr.deduplicate(disk_usage::dedupe_options{
+            .allow_hardlinks = libcachemgr::user_configuration()->allow_hardlinks(),
+            .thread_count = scan_threads,
+            .dry_run = dry_run,
+        });
+
+        return print_deduplication(deduplication, dry_run) ? 0 : 1;
+    }
+
+    else if (libcachemgr::user_configuration()->show_compressibility())
+    {
+        const auto estimates = cachemgr.estimate_compressibility(disk_usage::compressibility_options{
+            .thread_count = scan_threads,
+        });
+        print_compressibility(cachemgr.mapped_cache_directories(), estimates);
+        return 0;
+    }
+
+    else if (const auto days = libcachemgr::user_configuration()->pack_after_days(); days > 0)
+    {
+        const bool dry_run = libcachemgr::user_configuration()->dry_run();
+        const auto results = cachemgr.pack_cold_subtrees(disk_usage::packing_options{
+            .min_idle_time = std::chrono::seconds{std::int64_t{days} * 24 * 3600},
+            .thread_count = scan_threads,
+            .dry_run = dry_run,
+        });
+
+        return print_cold_packing(cachemgr.mapped_cache_directories(), results, dry_run) ? 0 : 1;
+    }
+
+    else if (const auto &cache_mapping_id = libcachemgr::user_configuration()->restore_cache_mapping();
+        !cache_mapping_id.empty())
+    {
+        const auto *dir = find_target_directory(cachemgr.mapped_cache_directories(), cache_mapping_id, "restored");
+        if (dir == nullptr)
         {
-            LOG_WARNING(libcachemgr::log_main, "failed to get available disk space of '{}': {}", config.cache_root(), ec);
+            return 1;
+        }
+
+        const auto restoration = cachemgr_t::restore_cold_archives(*dir, scan_threads);
+        bool is_ok = !restoration.ec;
+        if (restoration.ec)
+        {
+            fmt::print(stderr, "error: failed to search archives in '{}': {}\n", dir->target_path,
+                restoration.ec.message());
+        }
+
+        std::uint64_t archives = 0;
+        std::uint64_t entries = 0;
+        std::uintmax_t apparent_size = 0;
+        for (std::size_t i = 0; i < restoration.archives.size(); ++i)
+        {
+            const auto &result = restoration.results[i];
+            if (result.ec)
+            {
+                is_ok = false;
+                fmt::print(stderr, "error: failed to unpack '{}': {}\n", restoration.archives[i], result.ec.message());
+                continue;
+            }
+            archives += 1;
+            entries += result.entries;
+            apparent_size += result.apparent_size;
+        }
+        fmt::print("{}: unpacked {} archives with {} entries ({})\n", dir->id,
+            archives, entries, human_readable_file_size{apparent_size});
+        return is_ok ? 0 : 1;
+    }
+
+    else if (const auto &cache_mapping_id = libcachemgr::user_configuration()->clean_cache_mapping();
+        !cache_mapping_id.empty())
+    {
+        const auto *dir = find_target_directory(cachemgr.mapped_cache_directories(), cache_mapping_id, "cleaned");
+        if (dir == nullptr)
+        {
+            return 1;
         }
-        fmt::print("{:>{}} available space on cache root : {:>8} ({} bytes)\n", " ",
-            max_length_of_source_path + max_length_of_target_path - 26,
-            human_readable_file_size{available_disk_space}, available_disk_space);
 
+        if (const auto ec = cachemgr_t::clean_cache_directory(*dir, scan_threads); ec)
+        {
+            fmt::print(stderr, "error: failed to clean '{}': {}\n", dir->target_path, ec.message());
+            return 1;
+        }
+        fmt::print("cleaned '{}' ({}), the previous contents are deleted in the background\n",
+            dir->id, dir->target_path);
         return 0;
     }
 
@@ -418,6 +1111,287 @@ static int parse_cli_options(int argc, char **argv, bool *abort)
         libcachemgr::user_configuration()->set_show_usage_stats(true);
     }
 
+    // number of threads for directory scanning
+    if (parser.exists(cli_opt_threads))
+    {
+        bool is_ok = false;
+        const auto threads = number_utils::parse_integer<std::uint32_t>(parser.get(cli_opt_threads), &is_ok);
+        if (!is_ok || threads > threading::work_stealing_pool_t::max_thread_count())
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' expects a number of threads up to {}, 0 uses all hardware threads\n",
+                std::string{cli_opt_threads}, threading::work_stealing_pool_t::max_thread_count());
+            return 1;
+        }
+        libcachemgr::user_configuration()->set_scan_threads(threads);
+    }
+
+    // ignore the directory index of previous scans
+    if (parser.exists(cli_opt_full_rescan) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_full_rescan}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    libcachemgr::user_configuration()->set_full_rescan(parser.exists(cli_opt_full_rescan));
+
+    // print the usage statistics of every cache directory as soon as it is scanned
+    if (parser.exists(cli_opt_stream) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_stream}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    libcachemgr::user_configuration()->set_stream_usage_stats(parser.exists(cli_opt_stream));
+
+    // query the usage statistics from the daemon
+    if (parser.exists(cli_opt_from_daemon) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_from_daemon}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    if (parser.exists(cli_opt_from_daemon))
+    {
+        // the daemon only reports the totals of its last scan
+        for (const auto *option : {&cli_opt_estimate, &cli_opt_breakdown, &cli_opt_histogram})
+        {
+            if (parser.exists(*option))
+            {
+                *abort = true;
+                fmt::print(stderr, "error: option '{}' can't be used with '{}'\n",
+                    std::string{*option}, std::string{cli_opt_from_daemon});
+                return 1;
+            }
+        }
+    }
+    libcachemgr::user_configuration()->set_from_daemon(parser.exists(cli_opt_from_daemon));
+
+    // estimate the usage statistics by sampling
+    if (parser.exists(cli_opt_estimate) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_estimate}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    if (parser.exists(cli_opt_estimate_budget) && !parser.exists(cli_opt_estimate))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_estimate_budget}, std::string{cli_opt_estimate});
+        return 1;
+    }
+    libcachemgr::user_configuration()->set_estimate(parser.exists(cli_opt_estimate));
+    if (parser.exists(cli_opt_estimate_budget))
+    {
+        // a time with unit suffix or a plain number of stat calls
+        std::string budget = parser.get(cli_opt_estimate_budget);
+        std::chrono::milliseconds::rep multiplier = 0;
+        if (budget.ends_with("ms"))
+        {
+            budget.resize(budget.size() - 2);
+            multiplier = 1;
+        }
+        else if (budget.ends_with("s"))
+        {
+            budget.resize(budget.size() - 1);
+            multiplier = 1000;
+        }
+
+        bool is_ok = false;
+        const auto value = number_utils::parse_integer<std::uint32_t>(budget, &is_ok);
+        if (!is_ok || value == 0)
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' expects a time (e.g. 2s, 500ms) or a positive number of stat calls\n",
+                std::string{cli_opt_estimate_budget});
+            return 1;
+        }
+
+        if (multiplier > 0)
+        {
+            libcachemgr::user_configuration()->set_estimate_budget(
+                std::chrono::milliseconds{static_cast<std::chrono::milliseconds::rep>(value) * multiplier}, 0);
+        }
+        else
+        {
+            libcachemgr::user_configuration()->set_estimate_budget(std::chrono::milliseconds{0}, value);
+        }
+    }
+
+    // largest subdirectories of every cache directory
+    if (parser.exists(cli_opt_breakdown) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_breakdown}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    if (parser.exists(cli_opt_depth) && !parser.exists(cli_opt_breakdown))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_depth}, std::string{cli_opt_breakdown});
+        return 1;
+    }
+    if (parser.exists(cli_opt_breakdown))
+    {
+        bool is_count_ok = false, is_depth_ok = true;
+        const auto count = number_utils::parse_integer<std::uint32_t>(parser.get(cli_opt_breakdown), &is_count_ok);
+        const auto depth = parser.exists(cli_opt_depth) ?
+            number_utils::parse_integer<std::uint32_t>(parser.get(cli_opt_depth), &is_depth_ok) : 1;
+        if (!is_count_ok || !is_depth_ok || count == 0 || depth == 0)
+        {
+            *abort = true;
+            fmt::print(stderr, "error: options '{}' and '{}' expect a positive integer\n",
+                std::string{cli_opt_breakdown}, std::string{cli_opt_depth});
+            return 1;
+        }
+        if (parser.exists(cli_opt_estimate))
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' requires a complete scan and can't be used with '{}'\n",
+                std::string{cli_opt_breakdown}, std::string{cli_opt_estimate});
+            return 1;
+        }
+        libcachemgr::user_configuration()->set_breakdown(count, depth);
+    }
+
+    // age and size histograms of every cache directory
+    if (parser.exists(cli_opt_histogram) && !parser.exists(cli_opt_usage_stats))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_histogram}, std::string{cli_opt_usage_stats});
+        return 1;
+    }
+    if (parser.exists(cli_opt_histogram))
+    {
+        if (parser.exists(cli_opt_estimate))
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' requires a complete scan and can't be used with '{}'\n",
+                std::string{cli_opt_histogram}, std::string{cli_opt_estimate});
+            return 1;
+        }
+        libcachemgr::user_configuration()->set_show_histograms(true);
+    }
+
+    // size which is displayed in the usage statistics
+    if (parser.exists(cli_opt_apparent_size) && parser.exists(cli_opt_allocated_size))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: options '{}' and '{}' are mutually exclusive\n",
+            std::string{cli_opt_apparent_size}, std::string{cli_opt_allocated_size});
+        return 1;
+    }
+    for (const auto *option : {&cli_opt_apparent_size, &cli_opt_allocated_size})
+    {
+        if (parser.exists(*option) && !parser.exists(cli_opt_usage_stats) && !parser.exists(cli_opt_enforce))
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' can only be used with '{}' or '{}'\n",
+                std::string{*option}, std::string{cli_opt_usage_stats}, std::string{cli_opt_enforce});
+            return 1;
+        }
+    }
+    libcachemgr::user_configuration()->set_show_allocated_size(parser.exists(cli_opt_allocated_size));
+
+    // does the user want to enforce the size limits of the cache directories?
+    if (parser.exists(cli_opt_enforce))
+    {
+        has_cli_actions += 1;
+        libcachemgr::user_configuration()->set_enforce_size_limits(true);
+    }
+
+    // does the user want to deduplicate the cache directories?
+    if (parser.exists(cli_opt_dedupe))
+    {
+        has_cli_actions += 1;
+        libcachemgr::user_configuration()->set_dedupe(true);
+    }
+    if (parser.exists(cli_opt_hardlinks) && !parser.exists(cli_opt_dedupe))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}'\n",
+            std::string{cli_opt_hardlinks}, std::string{cli_opt_dedupe});
+        return 1;
+    }
+    libcachemgr::user_configuration()->set_allow_hardlinks(parser.exists(cli_opt_hardlinks));
+
+    // does the user want to pack subtrees which were not used for a while?
+    if (parser.exists(cli_opt_pack))
+    {
+        bool is_ok = false;
+        const auto days = number_utils::parse_integer<std::uint32_t>(parser.get(cli_opt_pack), &is_ok);
+        if (!is_ok || days == 0)
+        {
+            *abort = true;
+            fmt::print(stderr, "error: option '{}' expects a positive number of days\n", std::string{cli_opt_pack});
+            return 1;
+        }
+        has_cli_actions += 1;
+        libcachemgr::user_configuration()->set_pack_after_days(days);
+    }
+
+    if (parser.exists(cli_opt_dry_run) &&
+        !parser.exists(cli_opt_enforce) && !parser.exists(cli_opt_dedupe) && !parser.exists(cli_opt_pack))
+    {
+        *abort = true;
+        fmt::print(stderr, "error: option '{}' can only be used with '{}', '{}' or '{}'\n",
+            std::string{cli_opt_dry_run}, std::string{cli_opt_enforce}, std::string{cli_opt_dedupe},
+            std::string{cli_opt_pack});
+        return 1;
+    }
+    libcachemgr::user_configuration()->set_dry_run(parser.exists(cli_opt_dry_run));
+
+    // does the user want to empty a cache directory?
+    if (parser.exists(cli_opt_clean))
+    {
+        const auto cache_mapping_id = parser.get(cli_opt_clean);
+        if (cache_mapping_id.size() > 0)
+        {
+            has_cli_actions += 1;
+            libcachemgr::user_configuration()->set_clean_cache_mapping(cache_mapping_id);
+        }
+        else
+        {
+            *abort = true;
+            fmt::print(stderr, "error: no cache mapping id specified for option '{}'\n",
+                std::string{cli_opt_clean});
+            return 1;
+        }
+    }
+
+    // does the user want to unpack the archives of a cache directory?
+    if (parser.exists(cli_opt_restore))
+    {
+        const auto cache_mapping_id = parser.get(cli_opt_restore);
+        if (cache_mapping_id.size() > 0)
+        {
+            has_cli_actions += 1;
+            libcachemgr::user_configuration()->set_restore_cache_mapping(cache_mapping_id);
+        }
+        else
+        {
+            *abort = true;
+            fmt::print(stderr, "error: no cache mapping id specified for option '{}'\n",
+                std::string{cli_opt_restore});
+            return 1;
+        }
+    }
+
+    // does the user want to know how well the cache directories compress?
+    if (parser.exists(cli_opt_compressibility))
+    {
+        has_cli_actions += 1;
+        libcachemgr::user_configuration()->set_show_compressibility(true);
+    }
+
     // does the user want to print the predicted cache location of package managers?
     if (parser.exists(cli_opt_print_pm_cache_locations))
     {
@@ -465,6 +1439,16 @@ static int parse_cli_options(int argc, char **argv, bool *abort)
         std::string{libcachemgr::configuration_t::get_application_config_directory()} + "/cachemgr.db"
     );
 
+    // set the location to the scan snapshot, it can be recreated at any time
+    libcachemgr::user_configuration()->set_scan_snapshot_file(
+        std::string{libcachemgr::configuration_t::get_application_cache_directory()} + "/scan-snapshot.bin"
+    );
+
+    // set the location to the socket of the daemon
+    libcachemgr::user_configuration()->set_daemon_socket_file(
+        std::string{libcachemgr::configuration_t::get_application_cache_directory()} + "/cachemgrd.sock"
+    );
+
     return 0;
 }
 
@@ -476,6 +1460,14 @@ static int parse_cli_options(int argc, char **argv, bool *abort)
  */
 int main(int argc, char **argv)
 {
+    // background process of cachemgr_t::clean_cache_directory, nothing else is initialized for it
+    if (argc == 4 && std::string_view{argv[1]} == cachemgr_t::remove_trash_argument)
+    {
+        bool is_ok = false;
+        const auto thread_count = number_utils::parse_integer<std::uint32_t>(argv[3], &is_ok);
+        return cachemgr_t::remove_trash(argv[2], is_ok ? thread_count : 0) ? 1 : 0;
+    }
+
 #ifndef CACHEMGR_PROFILING_BUILD
     // catch errors early during first os_utils function calls
     logging_helper::set_logger(std::make_shared<basic_utils_logger>());
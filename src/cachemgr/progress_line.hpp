@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/types/file_size_units.hpp>
+
+namespace {
+
+/**
+ * Live progress line of a running scan on the terminal.
+ *
+ * A background thread redraws the line on stderr periodically from the shared progress counters
+ * of the scanner, the scanner threads never touch the terminal. Nothing is drawn when stderr is
+ * not a terminal. Other output must be written with {print} to not interfere with the progress line.
+ */
+class progress_line_t final
+{
+public:
+    explicit progress_line_t(const disk_usage::scan_progress &progress,
+        std::chrono::milliseconds interval = std::chrono::milliseconds{100})
+        : _progress(progress), _interval(interval), _is_terminal(::isatty(STDERR_FILENO) == 1),
+          _start_time(std::chrono::steady_clock::now())
+    {
+        if (this->_is_terminal)
+        {
+            this->_thread = std::thread(&progress_line_t::run, this);
+        }
+    }
+
+    ~progress_line_t()
+    {
+        this->stop();
+    }
+
+    progress_line_t(const progress_line_t&) = delete;
+    progress_line_t &operator=(const progress_line_t&) = delete;
+
+    /**
+     * Stops redrawing and removes the progress line from the terminal.
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if (this->_is_stopped)
+            {
+                return;
+            }
+            this->_is_stopped = true;
+        }
+        this->_stop_condition.notify_one();
+
+        if (this->_thread.joinable())
+        {
+            this->_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->clear();
+    }
+
+    /**
+     * Prints the given text on stdout, the progress line is redrawn below it.
+     */
+    void print(std::string_view text)
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->clear();
+        fmt::print("{}", text);
+        std::fflush(stdout);
+        if (!this->_is_stopped)
+        {
+            this->draw();
+        }
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (!this->_stop_condition.wait_for(lock, this->_interval, [this]{ return this->_is_stopped; }))
+        {
+            this->draw();
+        }
+    }
+
+    void draw()
+    {
+        if (!this->_is_terminal)
+        {
+            return;
+        }
+
+        const auto files = this->_progress.files.load(std::memory_order_relaxed);
+        const auto directories = this->_progress.directories.load(std::memory_order_relaxed);
+        const auto apparent_size = this->_progress.apparent_size.load(std::memory_order_relaxed);
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->_start_time);
+        const auto files_per_second = elapsed.count() > 0 ?
+            static_cast<std::uint64_t>(static_cast<double>(files) / elapsed.count()) : 0;
+
+        std::ostringstream size;
+        size << file_size_units::human_readable_file_size{apparent_size};
+
+        fmt::print(stderr, "\r\033[K{} files in {} directories, {} ({} files/s)",
+            files, directories, size.str(), files_per_second);
+        std::fflush(stderr);
+        this->_is_drawn = true;
+    }
+
+    void clear()
+    {
+        if (this->_is_drawn)
+        {
+            fmt::print(stderr, "\r\033[K");
+            std::fflush(stderr);
+            this->_is_drawn = false;
+        }
+    }
+
+    const disk_usage::scan_progress &_progress;
+    const std::chrono::milliseconds _interval;
+    const bool _is_terminal;
+    const std::chrono::steady_clock::time_point _start_time;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _stop_condition;
+    bool _is_stopped{false};
+    bool _is_drawn{false};
+};
+
+} // anonymous namespace
@@ -0,0 +1,367 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <argparse/argparse.hpp>
+
+#include <utils/os_utils.hpp>
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/disk_usage/inode_set.hpp>
+#include <utils/disk_usage/directory_index.hpp>
+#include <utils/datetime_utils.hpp>
+#include <utils/number_utils.hpp>
+#include <utils/threading/work_stealing_pool.hpp>
+
+#include <libcachemgr/logging.hpp>
+#include <libcachemgr/config.hpp>
+#include <libcachemgr/cachemgr.hpp>
+#include <libcachemgr/libcachemgr.hpp>
+#include <libcachemgr/database/cache_db.hpp>
+#include <libcachemgr/daemon/server.hpp>
+#include <libcachemgr/fs_watcher/fs_watcher.hpp>
+
+#include "../cachemgr/basic_utils_logger.hpp"
+
+using program_metadata = libcachemgr::program_metadata;
+using configuration_t = libcachemgr::configuration_t;
+
+namespace {
+
+/// how often pending changes of the filesystem watcher are published
+constexpr std::chrono::milliseconds live_update_interval{1000};
+
+/// default time between two incremental rescans of all cache directories
+constexpr unsigned default_refresh_interval = 600;
+
+/// upper bound of the refresh interval, one week
+constexpr unsigned max_refresh_interval = 7 * 24 * 3600;
+
+/// written to by the signal handler to wake up the main loop
+int signal_pipe[2] = {-1, -1};
+
+void handle_termination_signal(int)
+{
+    const char value = 1;
+    [[maybe_unused]] const auto written = ::write(signal_pipe[1], &value, sizeof(value));
+}
+
+/**
+ * Daemon state which survives between refreshes.
+ */
+struct daemon_context_t final
+{
+    const configuration_t &config;
+    libcachemgr::database::cache_db &db;
+    bool is_db_open;
+    cachemgr_t &cachemgr;
+    libcachemgr::daemon::daemon_server_t &server;
+    unsigned scan_threads;
+    bool scan_io_uring;
+};
+
+/**
+ * Publishes the current sizes of all cache mappings to the server.
+ */
+void publish_sizes(daemon_context_t &context, bool is_live)
+{
+    const auto [available_disk_space, ec] = os_utils::get_available_disk_space_of(context.config.cache_root());
+    if (ec)
+    {
+        LOG_WARNING(libcachemgr::log_main, "failed to get available disk space of '{}': {}",
+            context.config.cache_root(), ec);
+    }
+
+    libcachemgr::daemon::sizes_response_t sizes{
+        .timestamp = static_cast<std::int64_t>(datetime_utils::get_current_system_timestamp_in_utc()),
+        .available_disk_space = available_disk_space,
+        .is_live = is_live,
+        .mappings = {},
+    };
+    for (const auto &dir : context.cachemgr.mapped_cache_directories())
+    {
+        sizes.mappings.emplace_back(libcachemgr::daemon::make_mapping_sizes(dir));
+    }
+    context.server.publish(sizes);
+}
+
+/**
+ * Rescans all cache directories incrementally and records the sizes in the database.
+ */
+void rescan(daemon_context_t &context)
+{
+    const auto &scan_snapshot_file = libcachemgr::user_configuration()->scan_snapshot_file();
+
+    // the snapshot is replaced after every scan, always attach the latest one
+    disk_usage::directory_index_t directory_index;
+    if (const auto ec = context.cachemgr.open_snapshot(scan_snapshot_file); !ec)
+    {
+        directory_index.attach(context.cachemgr.snapshot().directories(), context.cachemgr.snapshot().generation());
+    }
+
+    disk_usage::inode_set_t hardlinks;
+    const auto start = std::chrono::steady_clock::now();
+    context.cachemgr.calculate_disk_usage(disk_usage::scan_options{
+        .thread_count = context.scan_threads,
+        .hardlinks = &hardlinks,
+        .use_io_uring = context.scan_io_uring,
+        .index = &directory_index,
+    });
+    LOG_INFO(libcachemgr::log_main, "rescanned {} cache directories in {} ms",
+        context.cachemgr.mapped_cache_directories_count(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    if (const auto ec = context.cachemgr.write_snapshot(scan_snapshot_file, directory_index); ec)
+    {
+        LOG_WARNING(libcachemgr::log_main, "failed to write scan snapshot '{}': {}", scan_snapshot_file, ec);
+    }
+
+    if (context.is_db_open)
+    {
+        for (const auto &dir : context.cachemgr.mapped_cache_directories())
+        {
+            context.db.insert_cache_trend(libcachemgr::database::cache_trend{
+                .timestamp = datetime_utils::get_current_system_timestamp_in_utc(),
+                .cache_mapping_id = dir.id,
+                .package_manager = dir.package_manager ?
+                    std::optional{std::string{dir.package_manager()->pm_name()}} : std::nullopt,
+                .cache_size = dir.disk_size,
+                .allocated_size = dir.allocated_disk_size,
+            });
+        }
+    }
+}
+
+} // anonymous namespace
+
+static int cachemgr_daemon(unsigned refresh_interval)
+{
+    // parse the configuration file
+    configuration_t::file_error file_error;
+    configuration_t::parse_error parse_error;
+    const configuration_t config(libcachemgr::user_configuration()->configuration_file(), &file_error, &parse_error);
+    if (file_error != configuration_t::file_error::no_error || parse_error != configuration_t::parse_error::no_error)
+    {
+        fmt::print(stderr, "errors occurred while parsing the configuration file.\n" \
+            "check log output for more information.\n");
+        return 1;
+    }
+
+    libcachemgr::flush_log();
+    libcachemgr::change_log_level(libcachemgr::logging_config{
+        .log_level_console = config.log_level_console(),
+        .log_level_file = config.log_level_file(),
+    });
+
+    libcachemgr::database::cache_db db(libcachemgr::user_configuration()->database_file());
+    const auto is_db_open = db.open();
+    if (is_db_open && (!db.run_migrations() || !db.check_compatibility()))
+    {
+        return 3;
+    }
+
+    // claim the socket first, only a single daemon can run at the same time
+    const auto &socket_file = libcachemgr::user_configuration()->daemon_socket_file();
+    libcachemgr::daemon::daemon_server_t server;
+    if (const auto ec = server.listen(socket_file); ec)
+    {
+        fmt::print(stderr, "failed to listen on '{}': {}\n", socket_file, ec.message());
+        return 1;
+    }
+
+    const unsigned scan_threads = libcachemgr::user_configuration()->scan_threads().value_or(config.scan_threads());
+
+    cachemgr_t cachemgr;
+    if (const auto compare_results = cachemgr.find_mapped_cache_directories(config.cache_mappings(), scan_threads);
+        compare_results)
+    {
+        LOG_WARNING(libcachemgr::log_cachemgr,
+            "found {} differences between expected and actual cache mappings",
+            compare_results.count());
+    }
+
+    daemon_context_t context{
+        .config = config,
+        .db = db,
+        .is_db_open = is_db_open,
+        .cachemgr = cachemgr,
+        .server = server,
+        .scan_threads = scan_threads,
+        .scan_io_uring = config.scan_io_uring() && disk_usage::io_uring_available(),
+    };
+
+    // queries are answered with "not ready" until the initial scan is finished
+    std::thread server_thread([&server]{
+        server.run();
+    });
+
+    rescan(context);
+
+    // keep the sizes up to date between rescans
+    libcachemgr::fs_watcher::fs_watcher_t watcher(context.scan_threads);
+    bool is_live = false;
+    if (watcher.is_available())
+    {
+        for (const auto &dir : cachemgr.mapped_cache_directories())
+        {
+            if (dir.has_target_directory())
+            {
+                watcher.watch(dir);
+            }
+        }
+        is_live = watcher.start();
+        LOG_INFO(libcachemgr::log_main, "watching {} directories with {} (degraded: {})",
+            watcher.watch_count(), libcachemgr::fs_watcher::fs_watcher_t::backend_name(), watcher.is_degraded());
+    }
+    else
+    {
+        LOG_INFO(libcachemgr::log_main, "filesystem watcher not available, sizes are updated every {} seconds",
+            refresh_interval);
+    }
+
+    publish_sizes(context, is_live);
+
+    auto last_rescan = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        struct pollfd pfd{.fd = signal_pipe[0], .events = POLLIN, .revents = 0};
+        if (::poll(&pfd, 1, static_cast<int>(live_update_interval.count())) > 0)
+        {
+            LOG_INFO(libcachemgr::log_main, "termination requested, shutting down");
+            break;
+        }
+
+        if (std::chrono::steady_clock::now() - last_rescan >= std::chrono::seconds(refresh_interval))
+        {
+            // fold in pending changes first, the rescan replaces all sizes
+            watcher.apply_deltas();
+            rescan(context);
+            publish_sizes(context, is_live);
+            last_rescan = std::chrono::steady_clock::now();
+        }
+        else if (watcher.apply_deltas())
+        {
+            publish_sizes(context, is_live);
+        }
+    }
+
+    watcher.stop();
+    server.stop();
+    server_thread.join();
+
+    return 0;
+}
+
+/**
+ * Perform the initialization and execution of the daemon.
+ *  - parse command line arguments and populate the global state
+ *  - initialize the logging subsystem
+ *  - start the daemon {cachemgr_daemon}
+ */
+int main(int argc, char **argv)
+{
+#ifndef CACHEMGR_PROFILING_BUILD
+    logging_helper::set_logger(std::make_shared<basic_utils_logger>());
+#endif
+
+    argparse::ArgumentParser parser(argc, argv);
+    parser.addArgument("h", "help", "print this help message and exit", "", argparse::Argument::Type::Boolean, false);
+    parser.addArgument("v", "version", "print the version and exit", "", argparse::Argument::Type::Boolean, false);
+    parser.addArgument("c", "config", "path to the configuration file", "", argparse::Argument::Type::String, false);
+    parser.addArgument("j", "threads", "number of threads for scanning cache directories (0 = all hardware threads)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("", "refresh-interval", "seconds between two incremental rescans of all cache directories",
+        "", argparse::Argument::Type::String, false);
+
+    if (parser.parse() != argparse::ArgumentParser::Result::Success)
+    {
+        return 2;
+    }
+
+    if (parser.exists("help"))
+    {
+        fmt::print("{}d {}\n\n  Options:\n{}\n",
+            program_metadata::application_name,
+            program_metadata::full_application_version(),
+            parser.help());
+        return 0;
+    }
+    else if (parser.exists("version"))
+    {
+        fmt::print("{}d {}\n",
+            program_metadata::application_name,
+            program_metadata::full_application_version());
+        return 0;
+    }
+
+    const bool has_config_dir = configuration_t::get_application_config_directory().size() > 0;
+    const bool has_cache_dir = configuration_t::get_application_cache_directory().size() > 0;
+    if (!has_config_dir || !has_cache_dir)
+    {
+        fmt::print(stderr, "error: required directories missing\n");
+        return 2;
+    }
+
+    const std::string config_directory{configuration_t::get_application_config_directory()};
+    const std::string cache_directory{configuration_t::get_application_cache_directory()};
+    libcachemgr::user_configuration()->set_configuration_file(
+        parser.exists("config") ? parser.get<std::string>("config") : config_directory + "/cachemgr.yaml");
+    libcachemgr::user_configuration()->set_database_file(config_directory + "/cachemgr.db");
+    libcachemgr::user_configuration()->set_scan_snapshot_file(cache_directory + "/scan-snapshot.bin");
+    libcachemgr::user_configuration()->set_daemon_socket_file(cache_directory + "/cachemgrd.sock");
+
+    if (parser.exists("threads"))
+    {
+        bool is_ok = false;
+        const auto threads = number_utils::parse_integer<std::uint32_t>(parser.get("threads"), &is_ok);
+        if (!is_ok || threads > threading::work_stealing_pool_t::max_thread_count())
+        {
+            fmt::print(stderr, "error: option 'threads' expects a number of threads up to {}, 0 uses all hardware threads\n",
+                threading::work_stealing_pool_t::max_thread_count());
+            return 1;
+        }
+        libcachemgr::user_configuration()->set_scan_threads(threads);
+    }
+
+    unsigned refresh_interval = default_refresh_interval;
+    if (parser.exists("refresh-interval"))
+    {
+        bool is_ok = false;
+        refresh_interval = number_utils::parse_integer<std::uint32_t>(parser.get("refresh-interval"), &is_ok);
+        if (!is_ok || refresh_interval == 0 || refresh_interval > max_refresh_interval)
+        {
+            fmt::print(stderr, "error: option 'refresh-interval' expects a number of seconds from 1 to {}\n",
+                max_refresh_interval);
+            return 1;
+        }
+    }
+
+    // terminate gracefully, the socket file is removed on shutdown
+    if (::pipe(signal_pipe) != 0)
+    {
+        fmt::print(stderr, "error: failed to create signal pipe\n");
+        return 2;
+    }
+    std::signal(SIGINT, handle_termination_signal);
+    std::signal(SIGTERM, handle_termination_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+#ifndef CACHEMGR_PROFILING_BUILD
+    libcachemgr::init_logging(libcachemgr::logging_config{
+        .log_level_console = quill::LogLevel::Warning,
+
+        // store the log file in $XDG_CACHE_HOME/cachemgr/cachemgrd.log
+        .log_file_path = cache_directory + "/cachemgrd.log",
+    });
+#endif
+
+    return cachemgr_daemon(refresh_interval);
+}
@@ -1,214 +1,1021 @@
 #include "cachemgr.hpp"
 #include "logging.hpp"
+#include "messages.hpp"
 
 #include <filesystem>
 #include <unordered_map>
+#include <map>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
 #include <string_view>
 #include <algorithm>
+#include <chrono>
+#include <optional>
 
+#include <utils/datetime_utils.hpp>
 #include <utils/fs_utils.hpp>
 #include <utils/os_utils.hpp>
+#include <utils/mount_table.hpp>
+#include <utils/trash.hpp>
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/threading/work_stealing_pool.hpp>
 
 namespace fs = std::filesystem;
 
 using libcachemgr::directory_type_t;
 
-cachemgr_t::cachemgr_t()
+namespace {
+
+/**
+ * Looks up the mount which is mounted exactly at the given path.
+ *
+ * The configured path is looked up first, it is only canonicalized if the lookup fails
+ * and `statx` doesn't rule out a mount point, which saves the path resolution for the common case.
+ */
+const os_utils::mount_entry_t *find_bind_mount(const os_utils::mount_table_t &mount_table, const std::string &path)
 {
+    const auto normalized_path = fs::path(path).lexically_normal().string();
+    if (const auto *mount = mount_table.find_mount_point(normalized_path))
+    {
+        return mount;
+    }
+
+    if (bool is_mount_root = false; !os_utils::is_mount_root(path, is_mount_root) && !is_mount_root)
+    {
+        return nullptr;
+    }
+
+    std::error_code ec;
+    const auto canonical_path = fs::canonical(path, ec);
+    return ec ? nullptr : mount_table.find_mount_point(canonical_path.string());
 }
 
-cachemgr_t::~cachemgr_t()
+/// maximum number of eviction rounds of a single cache directory, see {cachemgr_t::enforce_size_limits}
+constexpr unsigned max_eviction_rounds = 3;
+
+/// name of the trash directory of {cachemgr_t::clean_cache_directory}, a sibling of the cleaned directory
+constexpr const char *trash_directory_name = ".cachemgr-trash";
+
+/// number of scanner threads for a single cache directory on a rotational disk
+constexpr unsigned rotational_scan_threads = 2;
+
+/// maximum number of cache directories which are scanned at the same time on a non-rotational device
+constexpr unsigned max_concurrent_scans_per_device = 4;
+
+/**
+ * All mapped cache directories residing on the same device.
+ */
+struct io_lane_t final
+{
+    /// the device is a spinning disk
+    bool rotational{false};
+
+    /// mapped cache directories in configuration order
+    std::vector<const libcachemgr::mapped_cache_directory_t*> mapped_cache_directories;
+
+    /// index of the next mapped cache directory which is not taken by a worker yet
+    std::atomic<std::size_t> next{0};
+};
+
+/**
+ * Calculates the disk usage of the given directory or file, errors are logged.
+ */
+disk_usage::scan_result get_used_disk_space_of(const std::string &path, const disk_usage::scan_options &options)
 {
+    const auto log_warning = [&path](const std::error_code &ec){
+        LOG_WARNING(libcachemgr::log_cachemgr, "failed to get used disk space of '{}': {}", path, ec);
+    };
+
+    std::error_code ec;
+
+    // the given path is more likely to be a directory
+    [[likely]] if (std::filesystem::is_directory(path, ec))
+    {
+        const auto result = disk_usage::scan_directory(path, options);
+        if (result.ec)
+        {
+            log_warning(result.ec);
+        }
+        return result;
+    }
+    else if (ec)
+    {
+        log_warning(ec);
+    }
+
+    else if (const auto result = disk_usage::stat_file(path, options.hardlinks); result.ec)
+    {
+        log_warning(result.ec);
+    }
+    else
+    {
+        return result;
+    }
+
+    return {};
 }
 
-cachemgr_t::cache_mappings_compare_results_t cachemgr_t::find_mapped_cache_directories(
-    const libcachemgr::configuration_t::cache_mappings_t &cache_mappings) noexcept
+/**
+ * Converts the sizes which were captured while resolving a wildcard pattern into a scan result.
+ */
+disk_usage::scan_result wildcard_match_result(const fs_utils::wildcard_match_t &match, disk_usage::inode_set_t *hardlinks)
 {
-    using cache_mappings_compare_result_t = cache_mappings_compare_results_t::cache_mappings_compare_result_t;
+    const bool is_unique = hardlinks == nullptr || match.link_count <= 1 || hardlinks->insert(match.device, match.inode);
+    return disk_usage::scan_result{
+        .apparent_size = match.apparent_size,
+        .allocated_size = match.allocated_size,
+        .unique_apparent_size = is_unique ? match.apparent_size : 0,
+        .unique_allocated_size = is_unique ? match.allocated_size : 0,
+        .reused_directories = 0,
+        .ec = {},
+    };
+}
 
-    // clear previous results
-    this->_mapped_cache_directories.clear();
+/**
+ * Calculates the disk usage of a single mapped cache directory and writes the results into it.
+ */
+void calculate_disk_usage_of(const libcachemgr::mapped_cache_directory_t &dir, const disk_usage::scan_options &options)
+{
+    std::uintmax_t reused_directories = 0;
+    const auto add_scan_result = [&dir, &reused_directories](const disk_usage::scan_result &result) {
+        dir.disk_size += result.apparent_size;
+        dir.allocated_disk_size += result.allocated_size;
+        dir.unique_disk_size += result.unique_apparent_size;
+        dir.unique_allocated_disk_size += result.unique_allocated_size;
+        reused_directories += result.reused_directories;
+    };
 
-    cache_mappings_compare_results_t compare_results;
+    // only obtain used disk space if the target path is not empty
+    if (dir.has_target_directory())
+    {
+        LOG_INFO(libcachemgr::log_cachemgr, "calculating usage statistics for directory: {}", dir.target_path);
+        add_scan_result(get_used_disk_space_of(dir.target_path, options));
+
+        if (options.index != nullptr)
+        {
+            LOG_DEBUG(libcachemgr::log_cachemgr, "reused {} unchanged directories of '{}' from the index",
+                reused_directories, dir.target_path);
+        }
+    }
+    // obtain used disk space for a list of source files
+    else if (dir.has_wildcard_matches())
+    {
+        libcachemgr::messages::LOG_CALCULATING_USAGE_STATISTICS_FOR_WILDCARD_PATTERN_WITH_FILE_COUNT(
+            // message arguments
+            libcachemgr::log_cachemgr, dir.resolved_source_files.size(),
+            // log message arguments
+            dir.wildcard_pattern, dir.resolved_source_files.size());
 
-    for (const auto &mapping : cache_mappings)
+        for (const auto &match : dir.resolved_source_files)
+        {
+            add_scan_result(match.is_directory ?
+                get_used_disk_space_of(match.path, options) : wildcard_match_result(match, options.hardlinks));
+        }
+    }
+}
+
+/**
+ * Outcome of the validation of a single cache mapping.
+ */
+struct mapping_validation_t final
+{
+    /// the mapped cache directory if the mapping is valid, a list to splice it without copies
+    std::list<libcachemgr::mapped_cache_directory_t> directory;
+
+    /// the difference between the actual and the expected cache mapping if the mapping is invalid
+    std::optional<cachemgr_t::cache_mappings_compare_results_t::cache_mappings_compare_result_t> difference;
+};
+
+/**
+ * Validates a single cache mapping against the filesystem, the result doesn't depend on other mappings.
+ *
+ * @param mapping the cache mapping from the configuration file
+ * @param mount_table the mount table to validate bind mounts, nullptr if it couldn't be loaded
+ * @param result receives the mapped cache directory or the difference
+ */
+void validate_cache_mapping(const libcachemgr::configuration_t::cache_mapping_t &mapping,
+    const os_utils::mount_table_t *mount_table, mapping_validation_t &result)
+{
+    using cache_mappings_compare_result_t = cachemgr_t::cache_mappings_compare_results_t::cache_mappings_compare_result_t;
+
+    // empty source means this entry only has a target directory
+    if (mapping.type == directory_type_t::standalone)
     {
-        // empty source means this entry only has a target directory
-        if (mapping.type == directory_type_t::standalone)
+        // add source-less directory to list
+        result.directory.emplace_back(libcachemgr::mapped_cache_directory_t{
+            .id = mapping.id,
+            .directory_type = directory_type_t::standalone,
+            .original_path = {}, // standalone doesn't have an original path
+            .target_path = mapping.target,
+            .package_manager = mapping.package_manager,
+            .resolved_source_files = {},
+            .wildcard_pattern = {},
+            .bind_source = {},
+            .max_size = mapping.max_size,
+            .target_size = mapping.target_size,
+        });
+    }
+
+    // resolve wildcard pattern into a list of files
+    else if (mapping.type == directory_type_t::wildcard)
+    {
+        std::error_code ec_wildcard_resolve;
+        const fs_utils::glob_pattern_t pattern(mapping.target);
+        auto resolved_files = fs_utils::resolve_wildcard_matches(pattern, &ec_wildcard_resolve);
+
+        if (ec_wildcard_resolve)
         {
-            // add source-less directory to list
-            this->_mapped_cache_directories.emplace_back(libcachemgr::mapped_cache_directory_t{
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "failed to resolve wildcard pattern for target '{}': {}",
+                mapping.target, ec_wildcard_resolve);
+        }
+        else
+        {
+            result.directory.emplace_back(libcachemgr::mapped_cache_directory_t{
                 .id = mapping.id,
-                .directory_type = directory_type_t::standalone,
-                .original_path = {}, // standalone doesn't have an original path
-                .target_path = mapping.target,
+                .directory_type = directory_type_t::wildcard,
+                // wildcard patterns don't have an original path and are similar to standalone directories
+                .original_path = {},
+                .target_path = {}, // remove the target path as it is not technically a valid path
                 .package_manager = mapping.package_manager,
+                .resolved_source_files = std::move(resolved_files),
+                .wildcard_pattern = mapping.target, // preserve the wildcard pattern
+                .bind_source = {},
+                .max_size = mapping.max_size,
+                .target_size = mapping.target_size,
             });
         }
+    }
 
-        // resolve wildcard pattern into a list of files
-        else if (mapping.type == directory_type_t::wildcard)
+    // source must be a symbolic link
+    else if (mapping.type == directory_type_t::symbolic_link)
+    {
+        std::string symlink_target;
+        std::error_code ec_is_symlink, ec_read_symlink;
+        bool is_valid = true;
+
+        // source is not a symbolic link
+        if (!std::filesystem::is_symlink(mapping.source, ec_is_symlink))
         {
-            std::error_code ec_wildcard_resolve;
-            const auto resolved_files = fs_utils::resolve_wildcard_pattern(mapping.target, &ec_wildcard_resolve);
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "expected source '{}' to be a symbolic link, but it isn't", mapping.source);
+        }
+        else if (ec_is_symlink)
+        {
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "(is_symlink) failed to stat file '{}': {}", mapping.source, ec_is_symlink);
+        }
+        else
+        {
+            // resolve the symbolic link
+            symlink_target = fs::read_symlink(mapping.source, ec_read_symlink);
+        }
+
+        if (ec_read_symlink)
+        {
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "failed to read symbolic link '{}': {}", mapping.source, ec_read_symlink);
+        }
+        else if (symlink_target != mapping.target)
+        {
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "expected symbolic link target for source '{}' to be '{}', but found '{}' instead",
+                mapping.source, mapping.target, symlink_target);
+        }
+
+        if (!is_valid)
+        {
+            result.difference.emplace(cache_mappings_compare_result_t{
+                // cache directory is actually this
+                .actual = libcachemgr::configuration_t::cache_mapping_t{
+                    .id = mapping.id,
+                    .type = mapping.type,
+                    .package_manager = mapping.package_manager,
+                    .source = mapping.source,
+                    .target = symlink_target,
+                },
+                // cache directory expected to be this
+                .expected = libcachemgr::configuration_t::cache_mapping_t(mapping),
+            });
+        }
+        else
+        {
+            // add the symlinked directory to the list
+            result.directory.emplace_back(libcachemgr::mapped_cache_directory_t{
+                .id = mapping.id,
+                .directory_type = directory_type_t::symbolic_link,
+                .original_path = mapping.source,
+                .target_path = symlink_target,
+                .package_manager = mapping.package_manager,
+                .resolved_source_files = {},
+                .wildcard_pattern = {},
+                .bind_source = {},
+                .max_size = mapping.max_size,
+                .target_size = mapping.target_size,
+            });
+        }
+    }
 
-            if (ec_wildcard_resolve)
+    // source must be a directory
+    else if (mapping.type == directory_type_t::bind_mount)
+    {
+        std::error_code ec_is_directory;
+        bool is_valid = true;
+        std::string bind_source;
+
+        // source is not a directory
+        if (!std::filesystem::is_directory(mapping.source, ec_is_directory))
+        {
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "expected source '{}' to be a directory, but it isn't", mapping.source);
+        }
+        else if (ec_is_directory)
+        {
+            is_valid = false;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "(is_directory) failed to stat file '{}': {}", mapping.source, ec_is_directory);
+        }
+        else if (mount_table)
+        {
+            if (const auto *mount = find_bind_mount(*mount_table, mapping.source))
             {
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "failed to resolve wildcard pattern for target '{}': {}",
-                    mapping.target, ec_wildcard_resolve);
+                bind_source = mount_table->bind_source_of(*mount);
+                LOG_DEBUG(libcachemgr::log_cachemgr,
+                    "found bind mount '{}' of '{}'", mapping.source, bind_source);
             }
             else
             {
-                this->_mapped_cache_directories.emplace_back(libcachemgr::mapped_cache_directory_t{
+                is_valid = false;
+                LOG_WARNING(libcachemgr::log_cachemgr,
+                    "expected directory '{}' to be a mount point, but found a regular directory instead",
+                    mapping.source);
+            }
+        }
+        else if (!os_utils::is_mount_point(mapping.source))
+        {
+            is_valid = false;
+
+            // expected directory to be a mount point
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "expected directory '{}' to be a mount point, but found a regular directory instead",
+                mapping.source);
+        }
+
+        if (!is_valid)
+        {
+            result.difference.emplace(cache_mappings_compare_result_t{
+                // cache directory is actually this
+                .actual = libcachemgr::configuration_t::cache_mapping_t{
                     .id = mapping.id,
-                    .directory_type = directory_type_t::wildcard,
-                    // wildcard patterns don't have an original path and are similar to standalone directories
-                    .original_path = {},
-                    .target_path = {}, // remove the target path as it is not technically a valid path
+                    .type = mapping.type,
                     .package_manager = mapping.package_manager,
-                    .resolved_source_files = resolved_files,
-                    .wildcard_pattern = mapping.target, // preserve the wildcard pattern
-                });
-            }
+                    .source = mapping.source,
+                    .target = mapping.source,
+                },
+                // cache directory expected to be this
+                .expected = libcachemgr::configuration_t::cache_mapping_t(mapping),
+            });
+        }
+        else
+        {
+            // add the bind mount to the list
+            result.directory.emplace_back(libcachemgr::mapped_cache_directory_t{
+                .id = mapping.id,
+                .directory_type = directory_type_t::bind_mount,
+                .original_path = mapping.source,
+                // treat the target path as the mount point location
+                .target_path = mapping.source,
+                .package_manager = mapping.package_manager,
+                .resolved_source_files = {},
+                .wildcard_pattern = {},
+                .bind_source = std::move(bind_source),
+                .max_size = mapping.max_size,
+                .target_size = mapping.target_size,
+            });
         }
+    }
+}
+
+} // anonymous namespace
+
+cachemgr_t::cachemgr_t()
+{
+}
+
+cachemgr_t::~cachemgr_t()
+{
+}
 
-        // source must be a symbolic link
-        else if (mapping.type == directory_type_t::symbolic_link)
+cachemgr_t::cache_mappings_compare_results_t cachemgr_t::find_mapped_cache_directories(
+    const libcachemgr::configuration_t::cache_mappings_t &cache_mappings, unsigned thread_count) noexcept
+{
+    // clear previous results
+    this->_mapped_cache_directories.clear();
+
+    // the mount table is only loaded if there are bind mounts
+    std::optional<os_utils::mount_table_t> mount_table;
+    if (std::any_of(cache_mappings.begin(), cache_mappings.end(), [](const auto &mapping) {
+        return mapping.type == directory_type_t::bind_mount;
+    }))
+    {
+        mount_table.emplace();
+        if (const auto ec_load = mount_table->load(); ec_load)
         {
-            std::string symlink_target;
-            std::error_code ec_is_symlink, ec_read_symlink;
-            bool is_valid = true;
+            LOG_WARNING(libcachemgr::log_cachemgr,
+                "failed to load the mount table, bind mounts on the same filesystem can't be detected: {}",
+                ec_load);
+            mount_table.reset();
+        }
+    }
+    const os_utils::mount_table_t *mount_table_ptr = mount_table ? &*mount_table : nullptr;
 
-            // source is not a symbolic link
-            if (!std::filesystem::is_symlink(mapping.source, ec_is_symlink))
-            {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "expected source '{}' to be a symbolic link, but it isn't", mapping.source);
-            }
-            else if (ec_is_symlink)
+    // every mapping writes into its own slot, which keeps the results in configuration order
+    std::vector<mapping_validation_t> validations(cache_mappings.size());
+
+    const auto threads = std::min<std::size_t>(
+        threading::work_stealing_pool_t::resolve_thread_count(thread_count), cache_mappings.size());
+    if (threads <= 1)
+    {
+        auto validation = validations.begin();
+        for (const auto &mapping : cache_mappings)
+        {
+            validate_cache_mapping(mapping, mount_table_ptr, *validation++);
+        }
+    }
+    else
+    {
+        // the checks are dominated by storage latency, the mappings are independent of each other
+        threading::work_stealing_pool_t pool(static_cast<unsigned>(threads));
+        auto validation = validations.begin();
+        for (const auto &mapping : cache_mappings)
+        {
+            pool.submit([&mapping, mount_table_ptr, &result = *validation++](unsigned) {
+                validate_cache_mapping(mapping, mount_table_ptr, result);
+            });
+        }
+        pool.wait();
+    }
+
+    cache_mappings_compare_results_t compare_results;
+    for (auto &validation : validations)
+    {
+        this->_mapped_cache_directories.splice(this->_mapped_cache_directories.end(), validation.directory);
+        if (validation.difference)
+        {
+            compare_results.add_result(*validation.difference);
+        }
+    }
+
+    return compare_results;
+}
+
+void cachemgr_t::calculate_disk_usage(const disk_usage::scan_options &options,
+    const std::function<void(const libcachemgr::mapped_cache_directory_t&)> &on_finished) noexcept
+{
+    const auto total_threads = threading::work_stealing_pool_t::resolve_thread_count(options.thread_count);
+
+    // the breakdowns and histograms are created upfront, the lane workers only look them up
+    this->_breakdowns.clear();
+    this->_histograms.clear();
+
+    // group the mapped cache directories by device, ordered by device id for deterministic logging
+    std::map<std::uint64_t, io_lane_t> io_lanes;
+    for (auto &dir : this->_mapped_cache_directories)
+    {
+        if (this->_breakdown_depth > 0 && dir.has_target_directory())
+        {
+            this->_breakdowns.emplace(&dir, std::make_unique<disk_usage::subtree_breakdown_t>(this->_breakdown_depth));
+        }
+        if (this->_histograms_enabled && dir.has_target_directory())
+        {
+            this->_histograms.emplace(&dir, disk_usage::file_histograms{});
+        }
+
+        // reset results of previous calculations
+        dir.disk_size = 0;
+        dir.allocated_disk_size = 0;
+        dir.unique_disk_size = 0;
+        dir.unique_allocated_disk_size = 0;
+
+        const std::string *path = nullptr;
+        if (dir.has_target_directory())
+        {
+            path = &dir.target_path;
+        }
+        else if (dir.has_directory_matches())
+        {
+            path = &std::find_if(dir.resolved_source_files.cbegin(), dir.resolved_source_files.cend(),
+                [](const fs_utils::wildcard_match_t &match){ return match.is_directory; })->path;
+        }
+        else
+        {
+            // nothing to scan, the sizes of matched files are known from the resolution of the wildcard pattern
+            if (dir.has_wildcard_matches())
             {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "(is_symlink) failed to stat file '{}': {}", mapping.source, ec_is_symlink);
+                calculate_disk_usage_of(dir, options);
             }
-            else
+            if (on_finished)
             {
-                // resolve the symbolic link
-                symlink_target = fs::read_symlink(mapping.source, ec_read_symlink);
+                on_finished(dir);
             }
+            continue;
+        }
 
-            if (ec_read_symlink)
+        // unknown devices are collected in the lane with the device id 0
+        const auto [device_id, ec] = os_utils::get_device_id_of(*path);
+        if (ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to get device id of '{}': {}", *path, ec);
+        }
+        io_lanes[device_id].mapped_cache_directories.emplace_back(&dir);
+    }
+
+    // each worker thread of a lane takes the next mapped cache directory until the lane is exhausted
+    struct lane_worker_t final
+    {
+        io_lane_t *lane;
+        disk_usage::scan_options options;
+    };
+    std::vector<lane_worker_t> lane_workers;
+
+    for (auto &[device_id, lane] : io_lanes)
+    {
+        lane.rotational = os_utils::is_rotational_device(device_id).value_or(false);
+
+        // rotational disks are scanned sequentially, other devices share the thread budget
+        const unsigned concurrency = lane.rotational ? 1 : std::min<unsigned>({
+            static_cast<unsigned>(lane.mapped_cache_directories.size()),
+            max_concurrent_scans_per_device,
+            std::max(1u, total_threads / static_cast<unsigned>(io_lanes.size())),
+        });
+        const unsigned threads_per_scan = lane.rotational ?
+            std::min(total_threads, rotational_scan_threads) :
+            std::max(1u, total_threads / static_cast<unsigned>(concurrency * io_lanes.size()));
+
+        LOG_DEBUG(libcachemgr::log_cachemgr,
+            "I/O lane for device {}: {} cache directories, rotational = {}, concurrency = {}, threads per scan = {}",
+            device_id, lane.mapped_cache_directories.size(), lane.rotational, concurrency, threads_per_scan);
+
+        auto lane_options = options;
+        lane_options.thread_count = threads_per_scan;
+
+        for (unsigned i = 0; i < concurrency; ++i)
+        {
+            lane_workers.emplace_back(lane_worker_t{
+                .lane = &lane,
+                .options = lane_options,
+            });
+        }
+    }
+
+    // the callback is shared by all lane workers
+    std::mutex on_finished_mutex;
+
+    const auto run_lane_worker = [this, &on_finished, &on_finished_mutex](const lane_worker_t &worker) {
+        auto &lane = *worker.lane;
+        for (auto index = lane.next.fetch_add(1); index < lane.mapped_cache_directories.size();
+            index = lane.next.fetch_add(1))
+        {
+            const auto &dir = *lane.mapped_cache_directories[index];
+
+            auto options = worker.options;
+            if (const auto it = this->_breakdowns.find(&dir); it != this->_breakdowns.end())
             {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "failed to read symbolic link '{}': {}", mapping.source, ec_read_symlink);
+                options.breakdown = it->second.get();
             }
-            else if (symlink_target != mapping.target)
+            if (const auto it = this->_histograms.find(&dir); it != this->_histograms.end())
             {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "expected symbolic link target for source '{}' to be '{}', but found '{}' instead",
-                    mapping.source, mapping.target, symlink_target);
+                options.histograms = &it->second;
             }
+            calculate_disk_usage_of(dir, options);
 
-            if (!is_valid)
+            if (on_finished)
             {
-                compare_results.add_result(cache_mappings_compare_result_t{
-                    // cache directory is actually this
-                    .actual = libcachemgr::configuration_t::cache_mapping_t{
-                        .id = mapping.id,
-                        .type = mapping.type,
-                        .package_manager = mapping.package_manager,
-                        .source = mapping.source,
-                        .target = symlink_target,
-                    },
-                    // cache directory expected to be this
-                    .expected = libcachemgr::configuration_t::cache_mapping_t(mapping),
-                });
+                std::lock_guard<std::mutex> lock(on_finished_mutex);
+                on_finished(dir);
             }
-            else
+        }
+    };
+
+    // a single worker doesn't need a separate thread
+    if (lane_workers.size() == 1)
+    {
+        run_lane_worker(lane_workers.front());
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(lane_workers.size());
+    for (const auto &worker : lane_workers)
+    {
+        threads.emplace_back(run_lane_worker, std::cref(worker));
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void cachemgr_t::enable_breakdown(unsigned max_depth) noexcept
+{
+    this->_breakdown_depth = max_depth;
+}
+
+const disk_usage::subtree_breakdown_t *cachemgr_t::breakdown_of(
+    const libcachemgr::mapped_cache_directory_t &dir) const noexcept
+{
+    const auto it = this->_breakdowns.find(&dir);
+    return it != this->_breakdowns.end() ? it->second.get() : nullptr;
+}
+
+void cachemgr_t::enable_histograms(bool enabled) noexcept
+{
+    this->_histograms_enabled = enabled;
+}
+
+const disk_usage::file_histograms *cachemgr_t::histograms_of(
+    const libcachemgr::mapped_cache_directory_t &dir) const noexcept
+{
+    const auto it = this->_histograms.find(&dir);
+    return it != this->_histograms.end() ? &it->second : nullptr;
+}
+
+std::vector<disk_usage::estimate_result> cachemgr_t::estimate_disk_usage(
+    const disk_usage::estimate_options &options) noexcept
+{
+    std::vector<disk_usage::estimate_result> results(this->_mapped_cache_directories.size());
+
+    // target directories and matched directories of wildcard patterns share the budget
+    std::size_t remaining_directories = 0;
+    for (const auto &dir : this->_mapped_cache_directories)
+    {
+        remaining_directories += dir.has_target_directory() ? 1 : static_cast<std::size_t>(std::count_if(
+            dir.resolved_source_files.cbegin(), dir.resolved_source_files.cend(),
+            [](const fs_utils::wildcard_match_t &match){ return match.is_directory; }));
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + options.time_budget;
+    std::uint64_t used_stat_calls = 0;
+
+    const auto estimate_directory = [&](const std::string &path) {
+        // equal share of the remaining budget
+        auto dir_options = options;
+        if (options.time_budget.count() > 0)
+        {
+            const auto remaining_time = std::max(std::chrono::milliseconds{1},
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()));
+            dir_options.time_budget = remaining_time / static_cast<long>(remaining_directories);
+        }
+        if (options.stat_budget > 0)
+        {
+            const auto remaining_stat_calls = options.stat_budget - std::min(used_stat_calls, options.stat_budget);
+            dir_options.stat_budget = std::max<std::uint64_t>(1, remaining_stat_calls / remaining_directories);
+        }
+        --remaining_directories;
+
+        LOG_INFO(libcachemgr::log_cachemgr, "estimating usage statistics for directory: {}", path);
+        const auto estimate = disk_usage::estimate_directory(path, dir_options);
+        used_stat_calls += estimate.stat_calls;
+
+        if (estimate.ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to estimate used disk space of '{}': {}",
+                path, estimate.ec);
+        }
+        LOG_DEBUG(libcachemgr::log_cachemgr,
+            "estimate of '{}': {} ± {} bytes, {} probes, {} directories, {} stat calls, exact = {}",
+            path, estimate.apparent_size, estimate.apparent_size_margin,
+            estimate.probes, estimate.directories_listed, estimate.stat_calls, estimate.is_exact);
+        return estimate;
+    };
+
+    auto result = results.begin();
+    for (auto &dir : this->_mapped_cache_directories)
+    {
+        auto &estimate = *result++;
+
+        if (dir.has_target_directory())
+        {
+            estimate = estimate_directory(dir.target_path);
+        }
+        else if (dir.has_wildcard_matches())
+        {
+            // the sizes of matched files are exact, only matched directories are estimated
+            estimate.is_exact = true;
+            for (const auto &match : dir.resolved_source_files)
             {
-                // add the symlinked directory to the list
-                this->_mapped_cache_directories.emplace_back(libcachemgr::mapped_cache_directory_t{
-                    .id = mapping.id,
-                    .directory_type = directory_type_t::symbolic_link,
-                    .original_path = mapping.source,
-                    .target_path = symlink_target,
-                    .package_manager = mapping.package_manager,
-                });
+                if (!match.is_directory)
+                {
+                    estimate.apparent_size += match.apparent_size;
+                    estimate.allocated_size += match.allocated_size;
+                    continue;
+                }
+
+                const auto match_estimate = estimate_directory(match.path);
+                estimate.apparent_size += match_estimate.apparent_size;
+                estimate.allocated_size += match_estimate.allocated_size;
+                estimate.apparent_size_margin += match_estimate.apparent_size_margin;
+                estimate.allocated_size_margin += match_estimate.allocated_size_margin;
+                estimate.probes += match_estimate.probes;
+                estimate.directories_listed += match_estimate.directories_listed;
+                estimate.stat_calls += match_estimate.stat_calls;
+                estimate.is_exact = estimate.is_exact && match_estimate.is_exact;
+                if (!estimate.ec)
+                {
+                    estimate.ec = match_estimate.ec;
+                }
             }
         }
 
-        // source must be a directory
-        else if (mapping.type == directory_type_t::bind_mount)
+        dir.disk_size = estimate.apparent_size;
+        dir.allocated_disk_size = estimate.allocated_size;
+        dir.unique_disk_size = estimate.apparent_size;
+        dir.unique_allocated_disk_size = estimate.allocated_size;
+    }
+
+    return results;
+}
+
+std::vector<cachemgr_t::size_limit_enforcement_t> cachemgr_t::enforce_size_limits(
+    const disk_usage::eviction_options &options, bool dry_run) noexcept
+{
+    std::vector<size_limit_enforcement_t> enforcements;
+
+    for (const auto &dir : this->_mapped_cache_directories)
+    {
+        // config validation rejects size limits on wildcard patterns
+        if (dir.max_size == 0 || !dir.has_target_directory())
+        {
+            continue;
+        }
+
+        auto dir_options = options;
+        dir_options.max_size = dir.max_size;
+        dir_options.target_size = dir.target_size;
+
+        LOG_INFO(libcachemgr::log_cachemgr, "planning the eviction of directory: {}", dir.target_path);
+        auto &enforcement = enforcements.emplace_back(size_limit_enforcement_t{
+            .directory = &dir,
+            .plan = disk_usage::plan_eviction(dir.target_path, dir_options),
+            .result = {},
+            .final_size = 0,
+        });
+        if (enforcement.plan.ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to plan the eviction of '{}': {}",
+                dir.target_path, enforcement.plan.ec);
+        }
+        enforcement.final_size = enforcement.plan.current_size - enforcement.plan.planned_size;
+
+        if (dry_run)
         {
-            std::error_code ec_is_directory;
-            bool is_valid = true;
+            continue;
+        }
 
-            // source is not a directory
-            if (!std::filesystem::is_directory(mapping.source, ec_is_directory))
+        // files which are used while deleting are skipped, the next round plans other files instead
+        const disk_usage::eviction_plan *plan = &enforcement.plan;
+        disk_usage::eviction_plan next_plan;
+        for (unsigned round = 0; round < max_eviction_rounds && !plan->files.empty(); ++round)
+        {
+            const auto result = disk_usage::execute_eviction(*plan, options.thread_count);
+            if (result.ec)
             {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "expected source '{}' to be a directory, but it isn't", mapping.source);
+                LOG_WARNING(libcachemgr::log_cachemgr, "failed to delete files of '{}': {}",
+                    dir.target_path, result.ec);
+                if (!enforcement.result.ec)
+                {
+                    enforcement.result.ec = result.ec;
+                }
             }
-            else if (ec_is_directory)
+            LOG_DEBUG(libcachemgr::log_cachemgr, "eviction round {} of '{}': {} files deleted, {} skipped, {} bytes freed",
+                round + 1, dir.target_path, result.deleted_files, result.skipped_files, result.freed_size);
+
+            enforcement.result.deleted_files += result.deleted_files;
+            enforcement.result.skipped_files += result.skipped_files;
+            enforcement.result.freed_size += result.freed_size;
+            enforcement.final_size = plan->current_size - std::min(plan->current_size, result.freed_size);
+
+            if (result.skipped_files == 0 || result.deleted_files == 0 || enforcement.final_size <= dir.max_size)
             {
-                is_valid = false;
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "(is_directory) failed to stat file '{}': {}", mapping.source, ec_is_directory);
+                break;
             }
-            else if (!os_utils::is_mount_point(mapping.source))
-            {
-                is_valid = false;
 
-                // expected directory to be a mount point
-                LOG_WARNING(libcachemgr::log_cachemgr,
-                    "expected directory '{}' to be a mount point, but found a regular directory instead",
-                    mapping.source);
+            next_plan = disk_usage::plan_eviction(dir.target_path, dir_options);
+            plan = &next_plan;
+        }
+    }
+
+    return enforcements;
+}
+
+std::error_code cachemgr_t::clean_cache_directory(
+    const libcachemgr::mapped_cache_directory_t &directory, unsigned thread_count) noexcept
+{
+    if (!directory.has_target_directory())
+    {
+        return std::make_error_code(std::errc::operation_not_supported);
+    }
+
+    std::string trash_path;
+    if (const auto ec = fs_utils::swap_out_directory(directory.target_path, trash_directory_name, trash_path); ec)
+    {
+        LOG_WARNING(libcachemgr::log_cachemgr, "failed to swap out directory '{}': {}", directory.target_path, ec);
+        return ec;
+    }
+    LOG_INFO(libcachemgr::log_cachemgr, "moved the contents of '{}' into the trash: {}", directory.target_path, trash_path);
+
+    // the deletion runs in a new process, forking this multithreaded one isn't safe
+    const auto executable_path = os_utils::get_executable_path();
+    const auto ec = executable_path.empty() ? std::make_error_code(std::errc::not_supported) :
+        os_utils::spawn_detached({executable_path, remove_trash_argument, directory.target_path,
+            std::to_string(thread_count)});
+    if (ec)
+    {
+        // the directory is already empty, the trash is deleted by the next cleanup or packing
+        LOG_WARNING(libcachemgr::log_cachemgr, "failed to start the deletion of '{}': {}", trash_path, ec);
+    }
+    return {};
+}
+
+std::error_code cachemgr_t::remove_trash(const std::string &directory_path, unsigned thread_count) noexcept
+{
+    os_utils::set_idle_priority();
+    return fs_utils::empty_trash(directory_path, trash_directory_name, thread_count);
+}
+
+cachemgr_t::deduplication_t cachemgr_t::deduplicate(const disk_usage::dedupe_options &options) const noexcept
+{
+    deduplication_t deduplication;
+
+    std::vector<std::string> roots;
+    for (const auto &dir : this->_mapped_cache_directories)
+    {
+        if (dir.has_target_directory())
+        {
+            deduplication.directories.emplace_back(&dir);
+            roots.emplace_back(dir.target_path);
+        }
+    }
+
+    LOG_INFO(libcachemgr::log_cachemgr, "deduplicating {} cache directories", roots.size());
+    deduplication.result = disk_usage::deduplicate(roots, options);
+    if (deduplication.result.ec)
+    {
+        LOG_WARNING(libcachemgr::log_cachemgr, "failed to deduplicate cache directories: {}", deduplication.result.ec);
+    }
+    LOG_DEBUG(libcachemgr::log_cachemgr, "deduplication: {} files hashed partially, {} completely, {} skipped",
+        deduplication.result.partially_hashed_files, deduplication.result.fully_hashed_files,
+        deduplication.result.skipped_files);
+
+    return deduplication;
+}
+
+std::vector<disk_usage::compressibility_result> cachemgr_t::estimate_compressibility(
+    const disk_usage::compressibility_options &options) const noexcept
+{
+    std::vector<disk_usage::compressibility_result> results(this->_mapped_cache_directories.size());
+
+    auto result = results.begin();
+    for (const auto &dir : this->_mapped_cache_directories)
+    {
+        auto &estimate = *result++;
+        if (!dir.has_target_directory())
+        {
+            continue;
+        }
+
+        LOG_INFO(libcachemgr::log_cachemgr, "sampling the compressibility of directory: {}", dir.target_path);
+        estimate = disk_usage::estimate_compressibility(dir.target_path, options);
+        if (estimate.ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to sample the compressibility of '{}': {}",
+                dir.target_path, estimate.ec);
+        }
+        LOG_DEBUG(libcachemgr::log_cachemgr,
+            "compressibility of '{}': {} blocks of {} files ({} bytes), entropy {:.3f}, ratio {:.2f}",
+            dir.target_path, estimate.sampled_blocks, estimate.sampled_files, estimate.sampled_size,
+            estimate.entropy, estimate.compression_ratio);
+    }
+
+    return results;
+}
+
+std::vector<disk_usage::packing_result> cachemgr_t::pack_cold_subtrees(
+    const disk_usage::packing_options &options) const noexcept
+{
+    std::vector<disk_usage::packing_result> results(this->_mapped_cache_directories.size());
+
+    auto result = results.begin();
+    for (const auto &dir : this->_mapped_cache_directories)
+    {
+        auto &packing = *result++;
+        if (!dir.has_target_directory())
+        {
+            continue;
+        }
+
+        // the trash of interrupted cleanups would be packed as a cold subtree otherwise
+        if (!options.dry_run)
+        {
+            if (const auto ec = fs_utils::empty_trash(dir.target_path, trash_directory_name, options.thread_count); ec)
+            {
+                LOG_WARNING(libcachemgr::log_cachemgr, "failed to delete the trash of '{}': {}", dir.target_path, ec);
             }
+        }
 
-            if (!is_valid)
+        LOG_INFO(libcachemgr::log_cachemgr, "packing cold subtrees of directory: {}", dir.target_path);
+        packing = disk_usage::pack_cold_subtrees(dir.target_path, options);
+        if (packing.ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to search cold subtrees of '{}': {}",
+                dir.target_path, packing.ec);
+        }
+        for (const auto &subtree : packing.subtrees)
+        {
+            if (subtree.ec)
             {
-                compare_results.add_result(cache_mappings_compare_result_t{
-                    // cache directory is actually this
-                    .actual = libcachemgr::configuration_t::cache_mapping_t{
-                        .id = mapping.id,
-                        .type = mapping.type,
-                        .package_manager = mapping.package_manager,
-                        .source = mapping.source,
-                        .target = mapping.source,
-                    },
-                    // cache directory expected to be this
-                    .expected = libcachemgr::configuration_t::cache_mapping_t(mapping),
-                });
+                LOG_WARNING(libcachemgr::log_cachemgr, "failed to pack '{}': {}", subtree.path, subtree.ec);
+                if (!subtree.staging_path.empty())
+                {
+                    LOG_WARNING(libcachemgr::log_cachemgr, "'{}' was recreated while it was packed, left it in '{}'",
+                        subtree.path, subtree.staging_path);
+                }
             }
             else
             {
-                // add the bind mount to the list
-                this->_mapped_cache_directories.emplace_back(libcachemgr::mapped_cache_directory_t{
-                    .id = mapping.id,
-                    .directory_type = directory_type_t::bind_mount,
-                    .original_path = mapping.source,
-                    // treat the target path as the mount point location
-                    .target_path = mapping.source,
-                    .package_manager = mapping.package_manager,
-                });
+                LOG_DEBUG(libcachemgr::log_cachemgr, "packed '{}': {} entries, {} bytes into {} bytes",
+                    subtree.path, subtree.entries, subtree.apparent_size, subtree.archive_size);
             }
         }
     }
 
-    return compare_results;
+    return results;
+}
+
+cachemgr_t::archive_restoration_t cachemgr_t::restore_cold_archives(
+    const libcachemgr::mapped_cache_directory_t &directory, unsigned thread_count) noexcept
+{
+    archive_restoration_t restoration;
+    if (!directory.has_target_directory())
+    {
+        restoration.ec = std::make_error_code(std::errc::operation_not_supported);
+        return restoration;
+    }
+
+    restoration.ec = disk_usage::find_cold_archives(directory.target_path, restoration.archives, thread_count);
+    if (restoration.ec)
+    {
+        LOG_WARNING(libcachemgr::log_cachemgr, "failed to search archives in '{}': {}",
+            directory.target_path, restoration.ec);
+    }
+
+    for (const auto &archive : restoration.archives)
+    {
+        LOG_INFO(libcachemgr::log_cachemgr, "unpacking archive: {}", archive);
+        const auto &result = restoration.results.emplace_back(disk_usage::restore_archive(archive, thread_count));
+        if (result.ec)
+        {
+            LOG_WARNING(libcachemgr::log_cachemgr, "failed to unpack '{}': {}", archive, result.ec);
+        }
+    }
+
+    return restoration;
+}
+
+std::error_code cachemgr_t::open_snapshot(const std::string &path) noexcept
+{
+    return this->_snapshot.open(path);
+}
+
+std::error_code cachemgr_t::write_snapshot(const std::string &path,
+    const disk_usage::directory_index_t &index) const noexcept
+{
+    return libcachemgr::snapshot::scan_snapshot_t::write(path,
+        static_cast<std::int64_t>(datetime_utils::get_current_system_timestamp_in_utc()),
+        this->_mapped_cache_directories, index);
+}
+
+const std::list<observer_ptr<libcachemgr::mapped_cache_directory_t>> cachemgr_t::sorted_mapped_cache_directories(
+    sort_behavior sort_behavior, libcachemgr::disk_size_type_t size_type) const noexcept
+{
+    return sorted_mapped_cache_directories(this->_mapped_cache_directories, sort_behavior, size_type);
 }
 
 const std::list<observer_ptr<libcachemgr::mapped_cache_directory_t>> cachemgr_t::sorted_mapped_cache_directories(
-    sort_behavior sort_behavior) const noexcept
+    const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    sort_behavior sort_behavior, libcachemgr::disk_size_type_t size_type) noexcept
 {
     std::list<const libcachemgr::mapped_cache_directory_t*> sorted_list;
 
-    for (const auto &cache_dir : this->_mapped_cache_directories)
+    for (const auto &cache_dir : mapped_cache_directories)
     {
         sorted_list.emplace_back(&cache_dir);
     }
@@ -219,14 +1026,14 @@ const std::list<observer_ptr<libcachemgr::mapped_cache_directory_t>> cachemgr_t:
     }
     else if (sort_behavior == sort_behavior::disk_usage_descending)
     {
-        sorted_list.sort([](const auto *lhs, const auto *rhs){
-            return lhs->disk_size > rhs->disk_size;
+        sorted_list.sort([size_type](const auto *lhs, const auto *rhs){
+            return lhs->disk_size_of(size_type) > rhs->disk_size_of(size_type);
         });
     }
     else if (sort_behavior == sort_behavior::disk_usage_ascending)
     {
-        sorted_list.sort([](const auto *lhs, const auto *rhs){
-            return lhs->disk_size < rhs->disk_size;
+        sorted_list.sort([size_type](const auto *lhs, const auto *rhs){
+            return lhs->disk_size_of(size_type) < rhs->disk_size_of(size_type);
         });
     }
 
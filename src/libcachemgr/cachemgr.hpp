@@ -3,13 +3,25 @@
 #include "types.hpp"
 #include "config.hpp"
 #include "package_manager_support/pm_base.hpp"
+#include "snapshot/scan_snapshot.hpp"
 
+#include <functional>
 #include <string>
 #include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <initializer_list>
 #include <system_error>
 
 #include <utils/types/pointer.hpp>
+#include <utils/disk_usage/cold_archive.hpp>
+#include <utils/disk_usage/compressibility.hpp>
+#include <utils/disk_usage/dedupe.hpp>
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/disk_usage/eviction.hpp>
+#include <utils/disk_usage/inode_set.hpp>
+#include <utils/disk_usage/subtree_breakdown.hpp>
 
 /**
  * Cache Manager
@@ -82,6 +94,51 @@ public:
         difference_t _differences;
     };
 
+    /**
+     * Outcome of the size limit enforcement of a single mapped cache directory, see {enforce_size_limits}.
+     */
+    struct size_limit_enforcement_t final
+    {
+        /// the mapped cache directory with a size limit
+        const libcachemgr::mapped_cache_directory_t *directory;
+
+        /// the initial plan, its files are the ones which would be deleted in a dry run
+        disk_usage::eviction_plan plan;
+
+        /// deleted files of all rounds, empty for a dry run
+        disk_usage::eviction_result result;
+
+        /// size of the directory after the enforcement, equals the planned size for a dry run
+        std::uintmax_t final_size{0};
+    };
+
+    /**
+     * Outcome of the deduplication of all mapped cache directories, see {deduplicate}.
+     */
+    struct deduplication_t final
+    {
+        /// the deduplicated mapped cache directories, in configuration order
+        std::vector<const libcachemgr::mapped_cache_directory_t*> directories;
+
+        /// the duplicates, the roots of the result are in the order of {directories}
+        disk_usage::dedupe_result result;
+    };
+
+    /**
+     * Outcome of unpacking the archives of a mapped cache directory, see {restore_cold_archives}.
+     */
+    struct archive_restoration_t final
+    {
+        /// the archives which were found in the directory, sorted
+        std::vector<std::string> archives;
+
+        /// one result per archive, in the order of {archives}
+        std::vector<disk_usage::restore_result> results;
+
+        /// error code if the directory couldn't be searched for archives
+        std::error_code ec;
+    };
+
     /**
      * Constructs and initializes a new cache manager.
      *
@@ -116,11 +173,16 @@ public:
      * Every cache mapping which differs from the expectations, will be added to the
      * comparison results for further inspection.
      *
+     * The cache mappings are independent of each other and can be validated in parallel,
+     * which hides the storage latency of the checks. The mapped cache directories and the
+     * comparison results are always in the order of the configuration file.
+     *
      * @param cache_mappings the cache mapping list from the configuration file
+     * @param thread_count number of threads for the validation, 0 means one thread per hardware thread
      * @return comparison results (only contains differences)
      */
     cache_mappings_compare_results_t find_mapped_cache_directories(
-        const libcachemgr::configuration_t::cache_mappings_t &cache_mappings) noexcept;
+        const libcachemgr::configuration_t::cache_mappings_t &cache_mappings, unsigned thread_count = 1) noexcept;
 
     /**
      * Returns the mapped cache directories.
@@ -136,16 +198,229 @@ public:
         return this->_mapped_cache_directories.size();
     }
 
+    /**
+     * Calculates the disk usage of all mapped cache directories concurrently.
+     *
+     * The mapped cache directories are grouped by the device they reside on. Every device
+     * is scanned in its own I/O lane, and the concurrency inside of a lane depends on the device:
+     *  - rotational disks: one cache directory at a time with few threads to avoid seek thrashing
+     *  - solid state drives and unknown devices: multiple cache directories at the same time
+     *    to saturate the device queue
+     *
+     * The results are written into the size properties of the mapped cache directories,
+     * the order of the mapped cache directories is not changed.
+     *
+     * Note: when multiple cache directories share hardlinks, the unique size is attributed
+     * to the cache directory which happens to be scanned first.
+     *
+     * The {disk_usage::scan_options::thread_count} is the thread budget of all lanes together
+     * (0 = one thread per hardware thread), all other scan options are passed to every scan.
+     *
+     * The optional @p on_finished callback is invoked as soon as the sizes of a mapped cache
+     * directory are known, in the order in which the scans finish. It is called from the lane
+     * worker threads, but never concurrently.
+     *
+     * @param options scanner options
+     * @param on_finished optional callback for every finished mapped cache directory
+     */
+    void calculate_disk_usage(const disk_usage::scan_options &options = {},
+        const std::function<void(const libcachemgr::mapped_cache_directory_t&)> &on_finished = {}) noexcept;
+
+    /**
+     * Builds a subtree breakdown for every mapped cache directory during the next {calculate_disk_usage}.
+     *
+     * @param max_depth the deepest level of subdirectories which is broken down, 0 disables the breakdown
+     */
+    void enable_breakdown(unsigned max_depth) noexcept;
+
+    /**
+     * The subtree breakdown of the given mapped cache directory from the last {calculate_disk_usage}.
+     *
+     * @return nullptr if no breakdown was built for the mapped cache directory (disabled or wildcard pattern)
+     */
+    const disk_usage::subtree_breakdown_t *breakdown_of(const libcachemgr::mapped_cache_directory_t &dir) const noexcept;
+
+    /**
+     * Collects age and size histograms for every mapped cache directory during the next {calculate_disk_usage}.
+     */
+    void enable_histograms(bool enabled) noexcept;
+
+    /**
+     * The histograms of the given mapped cache directory from the last {calculate_disk_usage}.
+     *
+     * @return nullptr if no histograms were collected for the mapped cache directory (disabled or wildcard pattern)
+     */
+    const disk_usage::file_histograms *histograms_of(const libcachemgr::mapped_cache_directory_t &dir) const noexcept;
+
+    /**
+     * Estimates the disk usage of all mapped cache directories by sampling, see {disk_usage::estimate_directory}.
+     *
+     * The budget of the @p options is shared by all mapped cache directories, every directory gets
+     * an equal share of what is left over by the previous ones. Directories are estimated one after another.
+     * Wildcard matches are stat'ed individually, their sizes are exact.
+     *
+     * The point estimates are written into the size properties of the mapped cache directories,
+     * the unique sizes equal the sizes since hardlinks are not deduplicated.
+     *
+     * @param options estimator options
+     * @return estimates in the order of {mapped_cache_directories}
+     */
+    std::vector<disk_usage::estimate_result> estimate_disk_usage(const disk_usage::estimate_options &options) noexcept;
+
+    /**
+     * Shrinks every mapped cache directory which exceeds its size limit by deleting its least recently used files,
+     * see {disk_usage::plan_eviction} and {disk_usage::execute_eviction}.
+     *
+     * The size limits are taken from the mapped cache directories, the thread count and the size type
+     * of the @p options are used for every directory. Directories are enforced one after another,
+     * the files of a directory are deleted in parallel. When files were used during the enforcement,
+     * they are skipped and the directory is planned again, until it is under its limit or no progress is made.
+     *
+     * @param options eviction options, the size limits are ignored
+     * @param dry_run only plan the eviction, nothing is deleted
+     * @return enforcements of all mapped cache directories with a size limit, in configuration order
+     */
+    std::vector<size_limit_enforcement_t> enforce_size_limits(
+        const disk_usage::eviction_options &options, bool dry_run) noexcept;
+
+    /**
+     * Empties the given mapped cache directory, see {fs_utils::swap_out_directory}.
+     *
+     * The directory is atomically replaced with an empty one and its previous contents are moved into
+     * a trash directory on the same filesystem, so this returns after a few system calls regardless
+     * of the size of the directory. The trash is deleted by a detached background process with idle
+     * CPU and I/O priority, together with leftovers of earlier cleanups whose deletion was interrupted,
+     * the running executable is started again with {remove_trash_argument}.
+     *
+     * Mapped cache directories with wildcard patterns are not supported.
+     *
+     * @param directory the mapped cache directory to clean
+     * @param thread_count number of threads of the background deletion, 0 means one thread per hardware thread
+     * @return error code if the directory couldn't be emptied, errors of the background deletion are not reported
+     */
+    static std::error_code clean_cache_directory(
+        const libcachemgr::mapped_cache_directory_t &directory, unsigned thread_count = 0) noexcept;
+
+    /**
+     * Command line argument of the background process of {clean_cache_directory}, followed by the
+     * cleaned directory and the number of threads. The executable must call {remove_trash} with them.
+     */
+    static constexpr const char *remove_trash_argument = "--internal-remove-trash";
+
+    /**
+     * Deletes the trash of {clean_cache_directory} with idle CPU and I/O priority, see {fs_utils::empty_trash}.
+     *
+     * Leftovers of earlier cleanups whose deletion was interrupted are deleted as well.
+     *
+     * @param directory_path the cleaned directory
+     * @param thread_count number of threads, 0 means one thread per hardware thread
+     * @return error code if the trash couldn't be deleted completely
+     */
+    static std::error_code remove_trash(const std::string &directory_path, unsigned thread_count = 0) noexcept;
+
+    /**
+     * Replaces files with identical contents across all mapped cache directories with reflinks (or hardlinks),
+     * see {disk_usage::deduplicate}.
+     *
+     * Package managers often store the same archives and extracted files in their own caches,
+     * all target directories are therefore deduplicated together. Mapped cache directories with
+     * wildcard patterns are not deduplicated.
+     *
+     * @param options deduplication options
+     * @return the deduplicated directories and the reclaimed space of each of them
+     */
+    deduplication_t deduplicate(const disk_usage::dedupe_options &options) const noexcept;
+
+    /**
+     * Estimates how well every mapped cache directory compresses, see {disk_usage::estimate_compressibility}.
+     *
+     * Every directory reads at most {disk_usage::compressibility_options::max_read_size} bytes,
+     * the directories are sampled one after another. Mapped cache directories with wildcard patterns
+     * are not sampled.
+     *
+     * @param options sampling options
+     * @return estimates in the order of {mapped_cache_directories}
+     */
+    std::vector<disk_usage::compressibility_result> estimate_compressibility(
+        const disk_usage::compressibility_options &options) const noexcept;
+
+    /**
+     * Packs the subtrees of every mapped cache directory which were not used for a while into archives,
+     * see {disk_usage::pack_cold_subtrees}.
+     *
+     * Every archive replaces thousands of small files with a single one, which relieves the inode
+     * pressure on `cache_root`. The archives stay inside of the target directories, so they are
+     * accounted in the usage statistics at their size on disk. Directories are packed one after another.
+     * Mapped cache directories with wildcard patterns are not packed.
+     *
+     * @param options packing options
+     * @return results in the order of {mapped_cache_directories}
+     */
+    std::vector<disk_usage::packing_result> pack_cold_subtrees(
+        const disk_usage::packing_options &options) const noexcept;
+
+    /**
+     * Unpacks all archives of {pack_cold_subtrees} in the given mapped cache directory,
+     * see {disk_usage::restore_archive}.
+     *
+     * @param directory the mapped cache directory to restore
+     * @param thread_count number of worker threads, 0 means one thread per hardware thread
+     * @return the found archives and the outcome of unpacking each of them
+     */
+    static archive_restoration_t restore_cold_archives(
+        const libcachemgr::mapped_cache_directory_t &directory, unsigned thread_count = 0) noexcept;
+
+    /**
+     * Opens the scan snapshot of a previous run read-only.
+     *
+     * The snapshot is memory-mapped and used as-is, nothing is parsed or copied.
+     * Views into the snapshot stay valid until the next call or until {this} is destroyed.
+     *
+     * @param path the snapshot file
+     * @return error code if the snapshot couldn't be opened
+     */
+    std::error_code open_snapshot(const std::string &path) noexcept;
+
+    /**
+     * The scan snapshot opened with {open_snapshot}.
+     */
+    inline const libcachemgr::snapshot::scan_snapshot_t &snapshot() const noexcept {
+        return this->_snapshot;
+    }
+
+    /**
+     * Writes the results of {calculate_disk_usage} and the directory records of the scan into a new snapshot.
+     *
+     * @param path the snapshot file
+     * @param index the directory index which was used for the scan
+     * @return error code if the snapshot couldn't be written
+     */
+    std::error_code write_snapshot(const std::string &path, const disk_usage::directory_index_t &index) const noexcept;
+
     /**
      * Receive a list of mapped cache directories, sorted by disk usage.
      *
+     * The @p size_type determines if the apparent or the allocated size is compared.
+     *
      * Implementation notice:
      *   The returned list is a lightweight copy of const pointers to the original list.
      *   If {this} goes out of scope, all pointers in this list become dangling and accessing
      *   them results in undefined behavior.
      */
     const std::list<observer_ptr<libcachemgr::mapped_cache_directory_t>> sorted_mapped_cache_directories(
-        sort_behavior sort_behavior = sort_behavior::disk_usage_descending) const noexcept;
+        sort_behavior sort_behavior = sort_behavior::disk_usage_descending,
+        libcachemgr::disk_size_type_t size_type = libcachemgr::disk_size_type_t::apparent_size) const noexcept;
+
+    /**
+     * Receive a list of the given mapped cache directories, sorted by disk usage.
+     *
+     * Used for mapped cache directories which are not owned by a cache manager (e.g. received from the daemon),
+     * the same lifetime rules apply to the given list.
+     */
+    static const std::list<observer_ptr<libcachemgr::mapped_cache_directory_t>> sorted_mapped_cache_directories(
+        const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+        sort_behavior sort_behavior = sort_behavior::disk_usage_descending,
+        libcachemgr::disk_size_type_t size_type = libcachemgr::disk_size_type_t::apparent_size) noexcept;
 
     /**
      * Finds the corresponding cache mapping for the given @p pm_name (package manager).
@@ -161,4 +436,22 @@ private:
      * List of mapped cache directories.
      */
     std::list<libcachemgr::mapped_cache_directory_t> _mapped_cache_directories;
+
+    /**
+     * Memory-mapped snapshot of a previous scan.
+     */
+    libcachemgr::snapshot::scan_snapshot_t _snapshot;
+
+    /**
+     * Subtree breakdowns of the mapped cache directories, see {enable_breakdown}.
+     */
+    unsigned _breakdown_depth{0};
+    std::unordered_map<const libcachemgr::mapped_cache_directory_t*,
+        std::unique_ptr<disk_usage::subtree_breakdown_t>> _breakdowns;
+
+    /**
+     * Age and size histograms of the mapped cache directories, see {enable_histograms}.
+     */
+    bool _histograms_enabled{false};
+    std::unordered_map<const libcachemgr::mapped_cache_directory_t*, disk_usage::file_histograms> _histograms;
 };
@@ -14,7 +14,9 @@
 
 #include <utils/os_utils.hpp>
 #include <utils/fs_utils.hpp>
+#include <utils/number_utils.hpp>
 #include <utils/freedesktop/xdg_paths.hpp>
+#include <utils/threading/work_stealing_pool.hpp>
 
 /**
  * - Don't use excessive logging in this file.
@@ -36,6 +38,10 @@ namespace {
     constexpr const char *key_map_env = "env";
     constexpr const char *key_str_cache_root = "cache_root";
 
+    /// optional environment settings
+    constexpr const char *key_str_scan_threads = "scan_threads";
+    constexpr const char *key_str_scan_io_uring = "scan_io_uring";
+
     /// logging settings
     constexpr const char *key_map_logging = "logging";
     constexpr const char *key_str_log_level_console = "log_level_console";
@@ -51,6 +57,10 @@ namespace {
     constexpr const char *key_str_package_manager = "package_manager";
     constexpr const char *key_str_source = "source";
     constexpr const char *key_str_target = "target";
+
+    /// optional size limits of a cache mapping
+    constexpr const char *key_str_max_size = "max_size";
+    constexpr const char *key_str_target_size = "target_size";
 } // anonymous namespace
 
 libcachemgr::configuration_t::configuration_t(
@@ -198,6 +208,8 @@ libcachemgr::configuration_t::configuration_t(
     // check for mandatory keys in the env map and logging map
     error_collection = {
         validate_key_in_node(key_map_env, env, key_str_cache_root, key_type::string, true),
+        validate_key_in_node(key_map_env, env, key_str_scan_threads, key_type::string, false),
+        validate_key_in_node(key_map_env, env, key_str_scan_io_uring, key_type::string, false),
         validate_key_in_node(key_map_logging, logging, key_str_log_level_console, key_type::string, true),
         validate_key_in_node(key_map_logging, logging, key_str_log_level_file, key_type::string, true),
     };
@@ -213,6 +225,47 @@ libcachemgr::configuration_t::configuration_t(
         this->_env_cache_root = parse_path(std::string_view(cache_root.str, cache_root.len));
     }
 
+    // get the number of threads for directory scanning (optional)
+    if (env.has_child(key_str_scan_threads))
+    {
+        const auto &scan_threads = env[key_str_scan_threads].val();
+        const auto scan_threads_str = std::string(scan_threads.str, scan_threads.len);
+
+        bool is_ok = false;
+        this->_env_scan_threads = number_utils::parse_integer<std::uint32_t>(scan_threads_str, &is_ok);
+        if (!is_ok || this->_env_scan_threads > threading::work_stealing_pool_t::max_thread_count())
+        {
+            LOG_ERROR(libcachemgr::log_config,
+                "{}.{}: expected a number of threads up to {} (0 uses all hardware threads), but found '{}' instead",
+                key_map_env, key_str_scan_threads, threading::work_stealing_pool_t::max_thread_count(), scan_threads_str);
+            if (parse_error != nullptr) { *parse_error = parse_error::invalid_value; }
+            return;
+        }
+    }
+
+    // submit the stat calls of the directory scanner in batches to io_uring (optional)
+    if (env.has_child(key_str_scan_io_uring))
+    {
+        const auto &scan_io_uring = env[key_str_scan_io_uring].val();
+        const auto scan_io_uring_str = std::string_view(scan_io_uring.str, scan_io_uring.len);
+
+        if (scan_io_uring_str == "true")
+        {
+            this->_env_scan_io_uring = true;
+        }
+        else if (scan_io_uring_str == "false")
+        {
+            this->_env_scan_io_uring = false;
+        }
+        else
+        {
+            LOG_ERROR(libcachemgr::log_config, "{}.{}: expected 'true' or 'false', but found '{}' instead",
+                key_map_env, key_str_scan_io_uring, scan_io_uring_str);
+            if (parse_error != nullptr) { *parse_error = parse_error::invalid_value; }
+            return;
+        }
+    }
+
     // parse logging settings
     {
         const auto &log_level_console = logging[key_str_log_level_console].val();
@@ -281,6 +334,8 @@ libcachemgr::configuration_t::configuration_t(
                 validate_key_in_node(key_seq_cache_mappings, cache_mapping, key_str_id, key_type::string, true),
                 validate_key_in_node(key_seq_cache_mappings, cache_mapping, key_str_type, key_type::string, true),
                 validate_key_in_node(key_seq_cache_mappings, cache_mapping, key_str_target, key_type::string, true),
+                validate_key_in_node(key_seq_cache_mappings, cache_mapping, key_str_max_size, key_type::string, false),
+                validate_key_in_node(key_seq_cache_mappings, cache_mapping, key_str_target_size, key_type::string, false),
             };
 
             // get a reference to the id key
@@ -323,6 +378,47 @@ libcachemgr::configuration_t::configuration_t(
                 error_collection.emplace_back(false);
             }
 
+            // parse the optional size limits
+            const auto parse_size = [&](const char *key) -> std::uint64_t {
+                const auto value = std::string{get_value(key)};
+                if (value.empty())
+                {
+                    return 0;
+                }
+
+                bool is_ok = false;
+                const auto size = number_utils::parse_file_size(value, &is_ok);
+                if (!is_ok)
+                {
+                    LOG_ERROR(libcachemgr::log_config,
+                        "{}.{}: expected a size (e.g. 512M, 32G, 10GiB), but found '{}' for entry at position {}",
+                        key_seq_cache_mappings, key, value, i);
+                    if (parse_error != nullptr) { *parse_error = parse_error::invalid_value; }
+                    error_collection.emplace_back(false);
+                }
+                return size;
+            };
+            const auto max_size = parse_size(key_str_max_size);
+            const auto target_size = parse_size(key_str_target_size);
+
+            if (target_size > 0 && (max_size == 0 || target_size > max_size))
+            {
+                LOG_ERROR(libcachemgr::log_config,
+                    "{}.{}: must not exceed '{}' for entry at position {}",
+                    key_seq_cache_mappings, key_str_target_size, key_str_max_size, i);
+                if (parse_error != nullptr) { *parse_error = parse_error::invalid_value; }
+                error_collection.emplace_back(false);
+            }
+            else if (max_size > 0 && !error && directory_type_enum == directory_type_t::wildcard)
+            {
+                // the matches of a wildcard pattern don't share a directory which could be enforced
+                LOG_ERROR(libcachemgr::log_config,
+                    "{}.{}: not supported for wildcard mappings, entry at position {}",
+                    key_seq_cache_mappings, key_str_max_size, i);
+                if (parse_error != nullptr) { *parse_error = parse_error::invalid_value; }
+                error_collection.emplace_back(false);
+            }
+
             // if any of the mandatory keys are missing, abort
             if (detail::has_any_errors(error_collection)) {
                 // clear previously added cache mappings and abort
@@ -350,6 +446,8 @@ libcachemgr::configuration_t::configuration_t(
                 .package_manager = libcachemgr::package_manager_t(pm),
                 .source = parse_path(source),
                 .target = parse_path(target),
+                .max_size = max_size,
+                .target_size = target_size > 0 ? target_size : max_size,
             });
 
             // log the added cache mapping with a pretty format
@@ -3,6 +3,7 @@
 #include "logging.hpp"
 #include "types.hpp"
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <list>
@@ -25,6 +26,12 @@ public:
         const package_manager_t package_manager;
         const std::string source;
         const std::string target;
+
+        /// the size limit of the cache directory in bytes, 0 means unlimited
+        const std::uint64_t max_size{0};
+
+        /// files are evicted until the cache directory is not larger than this size, defaults to {max_size}
+        const std::uint64_t target_size{0};
     };
 
     /**
@@ -88,6 +95,24 @@ public:
         return this->_env_cache_root;
     }
 
+    /**
+     * Returns the user-configured number of threads for directory scanning.
+     *
+     * 0 means one thread per hardware thread.
+     */
+    inline constexpr unsigned scan_threads() const noexcept {
+        return this->_env_scan_threads;
+    }
+
+    /**
+     * Returns true when the directory scanner should submit its stat calls to io_uring.
+     *
+     * Ignored on systems without io_uring support.
+     */
+    inline constexpr bool scan_io_uring() const noexcept {
+        return this->_env_scan_io_uring;
+    }
+
     /**
      * Returns all registered cache mappings.
      */
@@ -166,6 +191,16 @@ private:
      */
     std::string _env_cache_root;
 
+    /**
+     * Number of threads for directory scanning (0 = one thread per hardware thread).
+     */
+    unsigned _env_scan_threads{0};
+
+    /**
+     * Submit the stat calls of the directory scanner in batches to io_uring.
+     */
+    bool _env_scan_io_uring{false};
+
     /**
      * List of all registered cache mappings.
      */
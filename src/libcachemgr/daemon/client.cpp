@@ -0,0 +1,73 @@
+#include "client.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace libcachemgr {
+namespace daemon {
+
+daemon_client_t::daemon_client_t(const std::string &socket_path, std::chrono::milliseconds timeout)
+    : _socket_path(socket_path),
+      _timeout(timeout)
+{
+}
+
+std::error_code daemon_client_t::query_sizes(sizes_response_t &response) const noexcept
+{
+    std::string message;
+    if (const auto ec = this->send_request(request_t{.type = request_type_t::sizes, .mapping_id = {}}, message); ec)
+    {
+        return ec;
+    }
+    return decode_response(message, response);
+}
+
+std::error_code daemon_client_t::query_trend(const std::string &mapping_id, trend_response_t &response) const noexcept
+{
+    std::string message;
+    if (const auto ec = this->send_request(request_t{
+        .type = request_type_t::trend,
+        .mapping_id = mapping_id,
+    }, message); ec)
+    {
+        return ec;
+    }
+    return decode_response(message, response);
+}
+
+std::error_code daemon_client_t::send_request(const request_t &request, std::string &response) const noexcept
+{
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->_socket_path.size() >= sizeof(address.sun_path))
+    {
+        return std::make_error_code(std::errc::filename_too_long);
+    }
+    std::memcpy(address.sun_path, this->_socket_path.c_str(), this->_socket_path.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return std::error_code{errno, std::system_category()};
+    }
+
+    std::error_code ec;
+    if (::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ec = std::error_code{errno, std::system_category()};
+    }
+    else if (ec = write_message(fd, encode_request(request), this->_timeout); !ec)
+    {
+        ec = read_message(fd, response, this->_timeout);
+    }
+
+    ::close(fd);
+    return ec;
+}
+
+} // namespace daemon
+} // namespace libcachemgr
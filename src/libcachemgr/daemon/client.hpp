@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <system_error>
+
+#include "protocol.hpp"
+
+namespace libcachemgr {
+namespace daemon {
+
+/**
+ * Client side of the `cachemgrd` query API.
+ *
+ * Every query opens a new connection, sends a single request and waits for the response.
+ * When no daemon is running, connecting fails immediately (`ENOENT` or `ECONNREFUSED`)
+ * and the caller can fall back to scanning the cache directories itself.
+ */
+class daemon_client_t final
+{
+public:
+    /// default time to wait for a response of the daemon
+    static constexpr std::chrono::milliseconds default_timeout{250};
+
+    /**
+     * @param socket_path path to the Unix domain socket of the daemon
+     * @param timeout maximum time to wait for a response
+     */
+    explicit daemon_client_t(const std::string &socket_path, std::chrono::milliseconds timeout = default_timeout);
+
+    /**
+     * Queries the current sizes of all cache mappings.
+     *
+     * @return error code if the daemon is not running or the query failed
+     */
+    std::error_code query_sizes(sizes_response_t &response) const noexcept;
+
+    /**
+     * Queries the recorded size history of the given cache mapping.
+     *
+     * @return error code if the daemon is not running or the query failed
+     */
+    std::error_code query_trend(const std::string &mapping_id, trend_response_t &response) const noexcept;
+
+private:
+    /**
+     * Sends the request and receives the undecoded response.
+     */
+    std::error_code send_request(const request_t &request, std::string &response) const noexcept;
+
+    const std::string _socket_path;
+    const std::chrono::milliseconds _timeout;
+};
+
+} // namespace daemon
+} // namespace libcachemgr
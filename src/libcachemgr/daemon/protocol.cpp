@@ -0,0 +1,442 @@
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <type_traits>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace {
+
+using libcachemgr::daemon::response_status_t;
+namespace protocol = libcachemgr::daemon::protocol;
+
+/**
+ * Appends native-endian integers and length-prefixed strings to a message.
+ *
+ * The header is written first with a placeholder payload size, {finish} fills it in.
+ */
+class message_writer_t final
+{
+public:
+    explicit message_writer_t(std::uint16_t kind)
+    {
+        this->write<std::uint32_t>(protocol::magic);
+        this->write<std::uint16_t>(protocol::version);
+        this->write<std::uint16_t>(kind);
+        this->write<std::uint32_t>(0);
+    }
+
+    template<typename T>
+    void write(T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto offset = this->_message.size();
+        this->_message.resize(offset + sizeof(T));
+        std::memcpy(this->_message.data() + offset, &value, sizeof(T));
+    }
+
+    void write_string(std::string_view value)
+    {
+        this->write<std::uint32_t>(static_cast<std::uint32_t>(value.size()));
+        this->_message.append(value);
+    }
+
+    std::string finish()
+    {
+        const auto payload_size = static_cast<std::uint32_t>(this->_message.size() - protocol::header_size);
+        std::memcpy(this->_message.data() + 8, &payload_size, sizeof(payload_size));
+        return std::move(this->_message);
+    }
+
+private:
+    std::string _message;
+};
+
+/**
+ * Reads native-endian integers and length-prefixed strings from a message with bounds checking.
+ *
+ * Reading past the end of the message sets the error flag and returns zeros and empty strings.
+ */
+class message_reader_t final
+{
+public:
+    explicit message_reader_t(std::string_view message)
+        : _message(message)
+    {
+    }
+
+    template<typename T>
+    T read() noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value{};
+        if (this->_message.size() - this->_offset < sizeof(T))
+        {
+            this->_has_error = true;
+            return value;
+        }
+        std::memcpy(&value, this->_message.data() + this->_offset, sizeof(T));
+        this->_offset += sizeof(T);
+        return value;
+    }
+
+    std::string read_string()
+    {
+        const auto size = this->read<std::uint32_t>();
+        if (this->_message.size() - this->_offset < size)
+        {
+            this->_has_error = true;
+            return {};
+        }
+        std::string value{this->_message.substr(this->_offset, size)};
+        this->_offset += size;
+        return value;
+    }
+
+    /**
+     * Validates the message header and reads the request type or response status.
+     */
+    bool read_header(std::uint16_t &kind) noexcept
+    {
+        const auto magic = this->read<std::uint32_t>();
+        const auto version = this->read<std::uint16_t>();
+        kind = this->read<std::uint16_t>();
+        const auto payload_size = this->read<std::uint32_t>();
+        return !this->_has_error && magic == protocol::magic && version == protocol::version &&
+            payload_size == this->_message.size() - protocol::header_size;
+    }
+
+    inline bool has_error() const noexcept {
+        return this->_has_error;
+    }
+
+    /**
+     * The whole message was read without errors.
+     */
+    inline bool is_complete() const noexcept {
+        return !this->_has_error && this->_offset == this->_message.size();
+    }
+
+private:
+    std::string_view _message;
+    std::size_t _offset{0};
+    bool _has_error{false};
+};
+
+/**
+ * Validates the header of a response and translates unsuccessful statuses into error codes.
+ */
+std::error_code read_response_header(message_reader_t &reader) noexcept
+{
+    std::uint16_t status;
+    if (!reader.read_header(status))
+    {
+        return std::make_error_code(std::errc::protocol_error);
+    }
+
+    switch (static_cast<response_status_t>(status))
+    {
+        case response_status_t::ok:
+            return {};
+        case response_status_t::unknown_mapping:
+            return std::make_error_code(std::errc::no_such_file_or_directory);
+        case response_status_t::not_ready:
+            return std::make_error_code(std::errc::resource_unavailable_try_again);
+        case response_status_t::bad_request:
+        default:
+            return std::make_error_code(std::errc::bad_message);
+    }
+}
+
+/**
+ * Waits until the socket is ready or the deadline expired.
+ */
+std::error_code wait_for(int fd, short events, std::chrono::steady_clock::time_point deadline) noexcept
+{
+    for (;;)
+    {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining < 0)
+        {
+            return std::make_error_code(std::errc::timed_out);
+        }
+
+        struct pollfd pfd{.fd = fd, .events = events, .revents = 0};
+        const int ready = ::poll(&pfd, 1, static_cast<int>(remaining));
+        if (ready > 0)
+        {
+            return {};
+        }
+        else if (ready == 0)
+        {
+            return std::make_error_code(std::errc::timed_out);
+        }
+        else if (errno != EINTR)
+        {
+            return std::error_code{errno, std::system_category()};
+        }
+    }
+}
+
+/**
+ * Reads exactly @p size bytes from the socket.
+ */
+std::error_code read_exactly(int fd, char *buffer, std::size_t size,
+    std::chrono::steady_clock::time_point deadline) noexcept
+{
+    while (size > 0)
+    {
+        if (const auto ec = wait_for(fd, POLLIN, deadline); ec)
+        {
+            return ec;
+        }
+
+        const auto length = ::read(fd, buffer, size);
+        if (length == 0)
+        {
+            return std::make_error_code(std::errc::connection_reset);
+        }
+        else if (length < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return std::error_code{errno, std::system_category()};
+        }
+        buffer += length;
+        size -= static_cast<std::size_t>(length);
+    }
+    return {};
+}
+
+} // anonymous namespace
+
+namespace libcachemgr {
+namespace daemon {
+
+mapping_sizes_t make_mapping_sizes(const libcachemgr::mapped_cache_directory_t &dir)
+{
+    return mapping_sizes_t{
+        .id = dir.id,
+        .directory_type = dir.directory_type,
+        .original_path = dir.original_path,
+        .target_path = dir.target_path,
+        .wildcard_pattern = dir.wildcard_pattern,
+        .resolved_source_file_count = dir.resolved_source_files.size(),
+        .disk_size = dir.disk_size,
+        .allocated_disk_size = dir.allocated_disk_size,
+        .unique_disk_size = dir.unique_disk_size,
+        .unique_allocated_disk_size = dir.unique_allocated_disk_size,
+    };
+}
+
+libcachemgr::mapped_cache_directory_t make_mapped_cache_directory(const mapping_sizes_t &sizes)
+{
+    return libcachemgr::mapped_cache_directory_t{
+        .id = sizes.id,
+        .directory_type = sizes.directory_type,
+        .original_path = sizes.original_path,
+        .target_path = sizes.target_path,
+        .package_manager = libcachemgr::package_manager_t{nullptr},
+        .resolved_source_files = std::vector<fs_utils::wildcard_match_t>(sizes.resolved_source_file_count),
+        .wildcard_pattern = sizes.wildcard_pattern,
+        .disk_size = sizes.disk_size,
+        .allocated_disk_size = sizes.allocated_disk_size,
+        .unique_disk_size = sizes.unique_disk_size,
+        .unique_allocated_disk_size = sizes.unique_allocated_disk_size,
+    };
+}
+
+std::string encode_request(const request_t &request)
+{
+    message_writer_t writer(static_cast<std::uint16_t>(request.type));
+    if (request.type == request_type_t::trend)
+    {
+        writer.write_string(request.mapping_id);
+    }
+    return writer.finish();
+}
+
+std::string encode_response(const sizes_response_t &response)
+{
+    message_writer_t writer(static_cast<std::uint16_t>(response_status_t::ok));
+    writer.write<std::int64_t>(response.timestamp);
+    writer.write<std::uint64_t>(response.available_disk_space);
+    writer.write<std::uint8_t>(response.is_live ? 1 : 0);
+    writer.write<std::uint32_t>(static_cast<std::uint32_t>(response.mappings.size()));
+    for (const auto &mapping : response.mappings)
+    {
+        writer.write_string(mapping.id);
+        writer.write<std::uint8_t>(static_cast<std::uint8_t>(mapping.directory_type));
+        writer.write_string(mapping.original_path);
+        writer.write_string(mapping.target_path);
+        writer.write_string(mapping.wildcard_pattern);
+        writer.write<std::uint64_t>(mapping.resolved_source_file_count);
+        writer.write<std::uint64_t>(mapping.disk_size);
+        writer.write<std::uint64_t>(mapping.allocated_disk_size);
+        writer.write<std::uint64_t>(mapping.unique_disk_size);
+        writer.write<std::uint64_t>(mapping.unique_allocated_disk_size);
+    }
+    return writer.finish();
+}
+
+std::string encode_response(const trend_response_t &response)
+{
+    message_writer_t writer(static_cast<std::uint16_t>(response_status_t::ok));
+    writer.write<std::uint32_t>(static_cast<std::uint32_t>(response.samples.size()));
+    for (const auto &sample : response.samples)
+    {
+        writer.write<std::int64_t>(sample.timestamp);
+        writer.write<std::uint64_t>(sample.disk_size);
+        writer.write<std::uint64_t>(sample.allocated_disk_size);
+    }
+    return writer.finish();
+}
+
+std::string encode_response(response_status_t status)
+{
+    return message_writer_t(static_cast<std::uint16_t>(status)).finish();
+}
+
+std::error_code decode_request(std::string_view message, request_t &request) noexcept
+{
+    message_reader_t reader(message);
+    std::uint16_t type;
+    if (!reader.read_header(type))
+    {
+        return std::make_error_code(std::errc::protocol_error);
+    }
+
+    request.type = static_cast<request_type_t>(type);
+    switch (request.type)
+    {
+        case request_type_t::sizes:
+            break;
+        case request_type_t::trend:
+            request.mapping_id = reader.read_string();
+            break;
+        default:
+            return std::make_error_code(std::errc::bad_message);
+    }
+
+    return reader.is_complete() ? std::error_code{} : std::make_error_code(std::errc::bad_message);
+}
+
+std::error_code decode_response(std::string_view message, sizes_response_t &response) noexcept
+{
+    message_reader_t reader(message);
+    if (const auto ec = read_response_header(reader); ec)
+    {
+        return ec;
+    }
+
+    response.timestamp = reader.read<std::int64_t>();
+    response.available_disk_space = reader.read<std::uint64_t>();
+    response.is_live = reader.read<std::uint8_t>() != 0;
+    const auto count = reader.read<std::uint32_t>();
+    response.mappings.clear();
+    for (std::uint32_t i = 0; i < count && !reader.has_error(); ++i)
+    {
+        auto &mapping = response.mappings.emplace_back();
+        mapping.id = reader.read_string();
+        mapping.directory_type = static_cast<libcachemgr::directory_type_t>(reader.read<std::uint8_t>());
+        mapping.original_path = reader.read_string();
+        mapping.target_path = reader.read_string();
+        mapping.wildcard_pattern = reader.read_string();
+        mapping.resolved_source_file_count = reader.read<std::uint64_t>();
+        mapping.disk_size = reader.read<std::uint64_t>();
+        mapping.allocated_disk_size = reader.read<std::uint64_t>();
+        mapping.unique_disk_size = reader.read<std::uint64_t>();
+        mapping.unique_allocated_disk_size = reader.read<std::uint64_t>();
+    }
+
+    if (!reader.is_complete() || response.mappings.size() != count)
+    {
+        return std::make_error_code(std::errc::bad_message);
+    }
+    return {};
+}
+
+std::error_code decode_response(std::string_view message, trend_response_t &response) noexcept
+{
+    message_reader_t reader(message);
+    if (const auto ec = read_response_header(reader); ec)
+    {
+        return ec;
+    }
+
+    const auto count = reader.read<std::uint32_t>();
+    if (count > (message.size() - protocol::header_size) / (3 * sizeof(std::uint64_t)))
+    {
+        return std::make_error_code(std::errc::bad_message);
+    }
+
+    response.samples.resize(count);
+    for (auto &sample : response.samples)
+    {
+        sample.timestamp = reader.read<std::int64_t>();
+        sample.disk_size = reader.read<std::uint64_t>();
+        sample.allocated_disk_size = reader.read<std::uint64_t>();
+    }
+
+    return reader.is_complete() ? std::error_code{} : std::make_error_code(std::errc::bad_message);
+}
+
+std::error_code read_message(int fd, std::string &message, std::chrono::milliseconds timeout) noexcept
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    message.resize(protocol::header_size);
+    if (const auto ec = read_exactly(fd, message.data(), protocol::header_size, deadline); ec)
+    {
+        return ec;
+    }
+
+    std::uint32_t payload_size;
+    std::memcpy(&payload_size, message.data() + 8, sizeof(payload_size));
+    if (payload_size > protocol::max_payload_size)
+    {
+        return std::make_error_code(std::errc::message_size);
+    }
+
+    message.resize(protocol::header_size + payload_size);
+    return read_exactly(fd, message.data() + protocol::header_size, payload_size, deadline);
+}
+
+std::error_code write_message(int fd, std::string_view message, std::chrono::milliseconds timeout) noexcept
+{
+#ifdef MSG_NOSIGNAL
+    constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = 0;
+#endif
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!message.empty())
+    {
+        if (const auto ec = wait_for(fd, POLLOUT, deadline); ec)
+        {
+            return ec;
+        }
+
+        const auto length = ::send(fd, message.data(), message.size(), send_flags);
+        if (length < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return std::error_code{errno, std::system_category()};
+        }
+        message.remove_prefix(static_cast<std::size_t>(length));
+    }
+    return {};
+}
+
+} // namespace daemon
+} // namespace libcachemgr
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "../types.hpp"
+
+namespace libcachemgr {
+namespace daemon {
+
+/**
+ * Binary protocol between `cachemgrd` and its clients over a local Unix domain socket.
+ *
+ * Every connection carries exactly one request and one response. Every message starts with
+ * a fixed header (magic, protocol version, request type or response status, payload size),
+ * followed by the payload. Integers are stored in the native byte order, strings are prefixed
+ * with their 32-bit length. Both sides run on the same machine, so there is no need for a
+ * portable encoding.
+ */
+namespace protocol {
+
+/// "CMGD"
+static constexpr std::uint32_t magic = 0x44474d43;
+
+/// bump this when the layout of any message changes
+static constexpr std::uint16_t version = 1;
+
+/// size of the fixed message header
+static constexpr std::size_t header_size = 12;
+
+/// upper limit for the payload size of a single message
+static constexpr std::uint32_t max_payload_size = 64 * 1024 * 1024;
+
+} // namespace protocol
+
+/**
+ * Types of requests which are understood by the daemon.
+ */
+enum class request_type_t : std::uint16_t
+{
+    /// current sizes of all cache mappings
+    sizes = 1,
+    /// recorded size history of a single cache mapping
+    trend = 2,
+};
+
+/**
+ * Status of a response, the payload is empty unless the status is {ok}.
+ */
+enum class response_status_t : std::uint16_t
+{
+    ok = 0,
+    /// the request was malformed or the request type is unknown
+    bad_request = 1,
+    /// the requested cache mapping doesn't exist
+    unknown_mapping = 2,
+    /// the daemon is still calculating the initial sizes
+    not_ready = 3,
+};
+
+/**
+ * A request from a client.
+ */
+struct request_t final
+{
+    request_type_t type{request_type_t::sizes};
+
+    /// id of the cache mapping for trend requests
+    std::string mapping_id;
+};
+
+/**
+ * Everything a client needs to display a cache mapping without accessing the filesystem.
+ */
+struct mapping_sizes_t final
+{
+    std::string id;
+    libcachemgr::directory_type_t directory_type{libcachemgr::directory_type_t::standalone};
+    std::string original_path;
+    std::string target_path;
+    std::string wildcard_pattern;
+    std::uint64_t resolved_source_file_count{0};
+
+    std::uint64_t disk_size{0};
+    std::uint64_t allocated_disk_size{0};
+    std::uint64_t unique_disk_size{0};
+    std::uint64_t unique_allocated_disk_size{0};
+};
+
+/**
+ * Response to a {request_type_t::sizes} request.
+ */
+struct sizes_response_t final
+{
+    /// unix timestamp of the last update of the sizes
+    std::int64_t timestamp{0};
+
+    /// available space on the filesystem of the cache root
+    std::uint64_t available_disk_space{0};
+
+    /// the sizes are kept up to date by the filesystem watcher between rescans
+    bool is_live{false};
+
+    std::vector<mapping_sizes_t> mappings;
+};
+
+/**
+ * A single recorded size of a cache mapping.
+ */
+struct trend_sample_t final
+{
+    std::int64_t timestamp{0};
+    std::uint64_t disk_size{0};
+    std::uint64_t allocated_disk_size{0};
+};
+
+/**
+ * Response to a {request_type_t::trend} request, samples are ordered from oldest to newest.
+ */
+struct trend_response_t final
+{
+    std::vector<trend_sample_t> samples;
+};
+
+/**
+ * Creates the description of a mapped cache directory and its current sizes.
+ */
+mapping_sizes_t make_mapping_sizes(const libcachemgr::mapped_cache_directory_t &dir);
+
+/**
+ * Creates a mapped cache directory from its description, without package manager and resolved source files.
+ *
+ * Only the number of resolved source files is restored (as empty strings) for displaying purposes.
+ */
+libcachemgr::mapped_cache_directory_t make_mapped_cache_directory(const mapping_sizes_t &sizes);
+
+// encoding and decoding of complete messages (header and payload)
+
+std::string encode_request(const request_t &request);
+std::string encode_response(const sizes_response_t &response);
+std::string encode_response(const trend_response_t &response);
+std::string encode_response(response_status_t status);
+
+/**
+ * Decodes a request.
+ *
+ * @return error code if the message is malformed or from an incompatible protocol version
+ */
+std::error_code decode_request(std::string_view message, request_t &request) noexcept;
+
+/**
+ * Decodes a response.
+ *
+ * Unsuccessful response statuses are translated into error codes:
+ *  - {response_status_t::bad_request}: `std::errc::bad_message`
+ *  - {response_status_t::unknown_mapping}: `std::errc::no_such_file_or_directory`
+ *  - {response_status_t::not_ready}: `std::errc::resource_unavailable_try_again`
+ *
+ * @return error code if the message is malformed or the request was not successful
+ */
+std::error_code decode_response(std::string_view message, sizes_response_t &response) noexcept;
+std::error_code decode_response(std::string_view message, trend_response_t &response) noexcept;
+
+/**
+ * Reads a complete message from the socket.
+ *
+ * @param fd connected socket
+ * @param message receives the message
+ * @param timeout maximum time to wait for the complete message
+ * @return error code if the message couldn't be read in time
+ */
+std::error_code read_message(int fd, std::string &message, std::chrono::milliseconds timeout) noexcept;
+
+/**
+ * Writes a complete message to the socket.
+ */
+std::error_code write_message(int fd, std::string_view message, std::chrono::milliseconds timeout) noexcept;
+
+} // namespace daemon
+} // namespace libcachemgr
@@ -0,0 +1,211 @@
+#include "server.hpp"
+#include "../logging.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace libcachemgr {
+namespace daemon {
+
+daemon_server_t::daemon_server_t(std::chrono::seconds trend_interval)
+    : _trend_interval(trend_interval)
+{
+    if (::pipe(this->_stop_pipe) == 0)
+    {
+        for (const int fd : this->_stop_pipe)
+        {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            ::fcntl(fd, F_SETFL, O_NONBLOCK);
+        }
+    }
+}
+
+daemon_server_t::~daemon_server_t()
+{
+    for (const int fd : {this->_listen_fd, this->_stop_pipe[0], this->_stop_pipe[1]})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    if (!this->_socket_path.empty())
+    {
+        ::unlink(this->_socket_path.c_str());
+    }
+}
+
+std::error_code daemon_server_t::listen(const std::string &socket_path) noexcept
+{
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        return std::make_error_code(std::errc::filename_too_long);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return std::error_code{errno, std::system_category()};
+    }
+
+    // a leftover socket file of a crashed daemon refuses connections
+    const auto *sockaddr = reinterpret_cast<const struct sockaddr*>(&address);
+    if (::connect(fd, sockaddr, sizeof(address)) == 0)
+    {
+        ::close(fd);
+        return std::make_error_code(std::errc::address_in_use);
+    }
+    ::unlink(socket_path.c_str());
+
+    // the socket is only accessible by the current user
+    const auto previous_umask = ::umask(0077);
+    const int bind_result = ::bind(fd, sockaddr, sizeof(address));
+    ::umask(previous_umask);
+
+    if (bind_result != 0 || ::listen(fd, 64) != 0)
+    {
+        const std::error_code ec{errno, std::system_category()};
+        ::close(fd);
+        return ec;
+    }
+
+    this->_listen_fd = fd;
+    this->_socket_path = socket_path;
+    return {};
+}
+
+void daemon_server_t::run() noexcept
+{
+    struct pollfd fds[2] = {
+        {.fd = this->_listen_fd, .events = POLLIN, .revents = 0},
+        {.fd = this->_stop_pipe[0], .events = POLLIN, .revents = 0},
+    };
+
+    for (;;)
+    {
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR(libcachemgr::log_main, "failed to wait for connections: {}", std::strerror(errno));
+            return;
+        }
+
+        if (fds[1].revents != 0)
+        {
+            return;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            const int fd = ::accept(this->_listen_fd, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                this->handle_connection(fd);
+                ::close(fd);
+            }
+        }
+    }
+}
+
+void daemon_server_t::stop() noexcept
+{
+    const char value = 1;
+    [[maybe_unused]] const auto written = ::write(this->_stop_pipe[1], &value, sizeof(value));
+}
+
+void daemon_server_t::publish(const sizes_response_t &sizes)
+{
+    auto message = encode_response(sizes);
+
+    std::lock_guard lock(this->_mutex);
+    this->_sizes_message = std::move(message);
+
+    for (const auto &mapping : sizes.mappings)
+    {
+        // the newest sample is replaced until it is at least one interval apart from the previous one
+        auto &samples = this->_trends[mapping.id];
+        if (samples.size() >= 2 &&
+            samples.back().timestamp - samples[samples.size() - 2].timestamp < this->_trend_interval.count())
+        {
+            samples.pop_back();
+        }
+        samples.emplace_back(trend_sample_t{
+            .timestamp = sizes.timestamp,
+            .disk_size = mapping.disk_size,
+            .allocated_disk_size = mapping.allocated_disk_size,
+        });
+        if (samples.size() > trend_capacity)
+        {
+            samples.pop_front();
+        }
+    }
+}
+
+void daemon_server_t::handle_connection(int fd) noexcept
+{
+    std::string message;
+    if (const auto ec = read_message(fd, message, io_timeout); ec)
+    {
+        LOG_DEBUG(libcachemgr::log_main, "failed to read request: {}", ec);
+        return;
+    }
+
+    request_t request;
+    if (const auto ec = decode_request(message, request); ec)
+    {
+        LOG_DEBUG(libcachemgr::log_main, "received malformed request: {}", ec);
+        message = encode_response(response_status_t::bad_request);
+    }
+    else
+    {
+        message = this->respond(request);
+    }
+
+    if (const auto ec = write_message(fd, message, io_timeout); ec)
+    {
+        LOG_DEBUG(libcachemgr::log_main, "failed to send response: {}", ec);
+    }
+}
+
+std::string daemon_server_t::respond(const request_t &request)
+{
+    std::lock_guard lock(this->_mutex);
+    switch (request.type)
+    {
+        case request_type_t::sizes:
+            if (this->_sizes_message.empty())
+            {
+                return encode_response(response_status_t::not_ready);
+            }
+            return this->_sizes_message;
+
+        case request_type_t::trend:
+            if (const auto it = this->_trends.find(request.mapping_id); it != this->_trends.end())
+            {
+                return encode_response(trend_response_t{
+                    .samples = {it->second.begin(), it->second.end()},
+                });
+            }
+            return encode_response(this->_sizes_message.empty() ?
+                response_status_t::not_ready : response_status_t::unknown_mapping);
+    }
+
+    return encode_response(response_status_t::bad_request);
+}
+
+} // namespace daemon
+} // namespace libcachemgr
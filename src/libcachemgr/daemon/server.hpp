@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include "protocol.hpp"
+
+namespace libcachemgr {
+namespace daemon {
+
+/**
+ * Server side of the `cachemgrd` query API.
+ *
+ * The owner publishes the sizes whenever they change, the server encodes them once and answers
+ * every size query with a copy of the encoded message. No filesystem access and no locking of
+ * the cache manager happens while answering a query.
+ *
+ * Every publication is also recorded in an in-memory size history per cache mapping, at most
+ * one sample per {trend_interval}, with a bounded number of samples. The persistent history
+ * is stored in the database by the owner.
+ */
+class daemon_server_t final
+{
+public:
+    /// maximum number of trend samples per cache mapping (one day with the default interval)
+    static constexpr std::size_t trend_capacity = 1440;
+
+    /// maximum time to wait for a request or for sending a response
+    static constexpr std::chrono::milliseconds io_timeout{100};
+
+    /**
+     * @param trend_interval minimum time between two trend samples of a cache mapping
+     */
+    explicit daemon_server_t(std::chrono::seconds trend_interval = std::chrono::seconds(60));
+    ~daemon_server_t();
+
+    daemon_server_t(const daemon_server_t&) = delete;
+    daemon_server_t &operator=(const daemon_server_t&) = delete;
+
+    /**
+     * Creates the Unix domain socket and starts listening.
+     *
+     * A stale socket file of a crashed daemon is replaced, a socket of a running daemon is not.
+     *
+     * @param socket_path path to the Unix domain socket
+     * @return error code if the socket couldn't be created, `std::errc::address_in_use` if
+     *         another daemon is listening on the socket already
+     */
+    std::error_code listen(const std::string &socket_path) noexcept;
+
+    /**
+     * Answers requests until {stop} is called.
+     */
+    void run() noexcept;
+
+    /**
+     * Stops {run}, can be called from any thread and from signal handlers.
+     */
+    void stop() noexcept;
+
+    /**
+     * Publishes new sizes, subsequent queries receive these sizes.
+     */
+    void publish(const sizes_response_t &sizes);
+
+private:
+    /**
+     * Reads a single request from the client and sends the response.
+     */
+    void handle_connection(int fd) noexcept;
+
+    /**
+     * Creates the response to the given request.
+     */
+    std::string respond(const request_t &request);
+
+    const std::chrono::seconds _trend_interval;
+
+    std::string _socket_path;
+    int _listen_fd{-1};
+    int _stop_pipe[2]{-1, -1};
+
+    std::mutex _mutex;
+
+    /// the encoded response of the last publication, empty until the first publication
+    std::string _sizes_message;
+
+    /// size history per cache mapping
+    std::unordered_map<std::string, std::deque<trend_sample_t>> _trends;
+};
+
+} // namespace daemon
+} // namespace libcachemgr
@@ -26,6 +26,7 @@ using libcachemgr::database::cache_db;
 namespace {
     constexpr const char *tbl_schema_migration = "schema_migration";
     constexpr const char *tbl_cache_trends = "cache_trends";
+    constexpr const char *tbl_cache_histograms = "cache_histograms";
 } // anonymous namespace
 
 cache_db::cache_db()
@@ -163,6 +164,12 @@ bool cache_db::run_migrations()
         case 3:
             if (!this->run_migration_v2_to_v3()) return false;
             migration_executed = true;
+        case 4:
+            if (!this->run_migration_v3_to_v4()) return false;
+            migration_executed = true;
+        case 5:
+            if (!this->run_migration_v4_to_v5()) return false;
+            migration_executed = true;
     }
 
     // if a migration was executed, perform a VACUUM on the database
@@ -296,6 +303,41 @@ bool cache_db::run_migration_v2_to_v3()
     }, 2, 3);
 }
 
+bool cache_db::run_migration_v3_to_v4()
+{
+    return this->execute_migration([=]{
+        // add the allocated size on disk, existing records don't have this information
+        if (!this->__private->execute_statement(fmt::format(
+            "ALTER TABLE {} ADD COLUMN "
+            "allocated_size INTEGER CHECK("
+            "(typeof(allocated_size) = 'integer' AND allocated_size >= 0) OR allocated_size IS NULL)",
+            tbl_cache_trends)
+        )) return false;
+
+        return true;
+    }, 3, 4);
+}
+
+bool cache_db::run_migration_v4_to_v5()
+{
+    return this->execute_migration([=]{
+        // age and size histograms, the rows belong to the cache_trends record with the same key
+        if (!this->__private->execute_statement(fmt::format(
+            "CREATE TABLE {} ("
+            "timestamp INTEGER NOT NULL CHECK(typeof(timestamp) = 'integer' AND timestamp >= 0), "
+            "cache_mapping_id TEXT NOT NULL CHECK(typeof(cache_mapping_id) = 'text'), "
+            "histogram TEXT NOT NULL CHECK(typeof(histogram) = 'text' AND histogram IN ('accessed', 'modified', 'size')), "
+            "bucket INTEGER NOT NULL CHECK(typeof(bucket) = 'integer' AND bucket >= 0), "
+            "file_count INTEGER CHECK((typeof(file_count) = 'integer' AND file_count >= 0) OR file_count IS NULL), "
+            "byte_count INTEGER NOT NULL CHECK(typeof(byte_count) = 'integer' AND byte_count >= 0), "
+            "PRIMARY KEY (timestamp, cache_mapping_id, histogram, bucket)"
+            ")", tbl_cache_histograms)
+        )) return false;
+
+        return true;
+    }, 4, 5);
+}
+
 std::optional<std::uint32_t> cache_db::get_database_version() const
 {
     std::uint32_t version = 0;
@@ -335,9 +377,34 @@ bool cache_db::insert_cache_trend(const cache_trend &cache_trend)
         cache_trend.timestamp,
         cache_trend.cache_mapping_id,
         cache_trend.package_manager,
-        cache_trend.cache_size);
+        cache_trend.cache_size,
+        cache_trend.allocated_size);
     if (!status) {
         LOG_WARNING(libcachemgr::log_db, "failed to insert {}", fmt::format("{}", cache_trend));
     }
     return status;
 }
+
+bool cache_db::insert_cache_histogram(const std::vector<cache_histogram_bucket> &buckets)
+{
+    LOG_INFO(libcachemgr::log_db, "inserting {} histogram buckets", buckets.size());
+    const auto status = this->__private->execute_transactional([&]{
+        for (const auto &bucket : buckets)
+        {
+            if (!this->__private->execute_insert_statement(
+                tbl_cache_histograms,
+                bucket.timestamp,
+                bucket.cache_mapping_id,
+                bucket.histogram,
+                bucket.bucket,
+                bucket.file_count,
+                bucket.byte_count))
+            {
+                LOG_WARNING(libcachemgr::log_db, "failed to insert {}", fmt::format("{}", bucket));
+                return false;
+            }
+        }
+        return true;
+    });
+    return status;
+}
@@ -5,6 +5,7 @@
 #include <functional>
 #include <optional>
 #include <memory>
+#include <vector>
 
 #include "models.hpp"
 
@@ -21,7 +22,7 @@ class cache_db final
      * If an older version of the application tries to load a newer database,
      * the compatibility check will fail.
      */
-    static constexpr std::uint32_t required_schema_version = 3;
+    static constexpr std::uint32_t required_schema_version = 5;
 
 public:
     /**
@@ -119,6 +120,17 @@ public:
      */
     bool insert_cache_trend(const cache_trend &cache_trend);
 
+    /**
+     * Inserts the buckets of the histograms of a cache trend record into the database.
+     *
+     * All buckets are inserted in a single transaction.
+     *
+     * @param buckets the histogram buckets to insert
+     * @return true successfully inserted all buckets
+     * @return false failed to insert the buckets, nothing was inserted
+     */
+    bool insert_cache_histogram(const std::vector<cache_histogram_bucket> &buckets);
+
 private:
     // TODO: migrate into __private class and remove 'typedef struct sqlite3 sqlite3'
     sqlite3 *_db_ptr{nullptr};
@@ -143,6 +155,8 @@ private:
     bool run_migration_v0_to_v1();
     bool run_migration_v1_to_v2();
     bool run_migration_v2_to_v3();
+    bool run_migration_v3_to_v4();
+    bool run_migration_v4_to_v5();
 
     /// private implementation class
     class __cache_db_private;
@@ -6,11 +6,25 @@
 
 template<> struct fmt::formatter<libcachemgr::database::cache_trend> : formatter<string_view> {
     auto format(const libcachemgr::database::cache_trend &cache_trend, format_context &ctx) const {
-        const auto fmt = fmt::format("cache_trend({}={}, {}={}, {}={}, {}={})",
+        const auto fmt = fmt::format("cache_trend({}={}, {}={}, {}={}, {}={}, {}={})",
             cache_trend.timestamp.name, cache_trend.timestamp.value,
             cache_trend.cache_mapping_id.name, cache_trend.cache_mapping_id.value,
             cache_trend.package_manager.name, cache_trend.package_manager.value,
-            cache_trend.cache_size.name, cache_trend.cache_size.value);
+            cache_trend.cache_size.name, cache_trend.cache_size.value,
+            cache_trend.allocated_size.name, cache_trend.allocated_size.value);
+        return formatter<string_view>::format(fmt, ctx);
+    }
+};
+
+template<> struct fmt::formatter<libcachemgr::database::cache_histogram_bucket> : formatter<string_view> {
+    auto format(const libcachemgr::database::cache_histogram_bucket &bucket, format_context &ctx) const {
+        const auto fmt = fmt::format("cache_histogram_bucket({}={}, {}={}, {}={}, {}={}, {}={}, {}={})",
+            bucket.timestamp.name, bucket.timestamp.value,
+            bucket.cache_mapping_id.name, bucket.cache_mapping_id.value,
+            bucket.histogram.name, bucket.histogram.value,
+            bucket.bucket.name, bucket.bucket.value,
+            bucket.file_count.name, bucket.file_count.value,
+            bucket.byte_count.name, bucket.byte_count.value);
         return formatter<string_view>::format(fmt, ctx);
     }
 };
@@ -93,8 +93,35 @@ struct cache_trend final
     /// name of the package manager
     field_pair<"package_manager", std::optional<std::string>> package_manager;
 
-    /// cache size in bytes
+    /// cache size in bytes (apparent size, sum of the file sizes)
     field_pair<"cache_size", std::uintmax_t> cache_size;
+
+    /// allocated cache size on disk in bytes (NULL for records created before schema version 4)
+    field_pair<"allocated_size", std::optional<std::uintmax_t>> allocated_size;
+};
+
+/**
+ * single bucket of an age or size histogram of a cache trend record
+ */
+struct cache_histogram_bucket final
+{
+    /// UTC unix timestamp of the cache trend record
+    field_pair<"timestamp", std::uint64_t> timestamp;
+
+    /// user-defined cache_mappings[].id
+    field_pair<"cache_mapping_id", std::string> cache_mapping_id;
+
+    /// name of the histogram: 'accessed', 'modified' or 'size'
+    field_pair<"histogram", std::string> histogram;
+
+    /// bucket index, see {disk_usage::file_histograms}
+    field_pair<"bucket", std::uint32_t> bucket;
+
+    /// number of files in the bucket (NULL for the age histograms)
+    field_pair<"file_count", std::optional<std::uintmax_t>> file_count;
+
+    /// apparent size of the files in the bucket in bytes
+    field_pair<"byte_count", std::uintmax_t> byte_count;
 };
 
 } // namespace database
@@ -1 +1,596 @@
 #include "inotify.hpp"
+#include "../../logging.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <utils/threading/work_stealing_pool.hpp>
+
+namespace {
+
+/// events which change the size of the files directly inside of a watched directory
+constexpr std::uint32_t file_events =
+    IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO;
+
+/**
+ * Mask of every watch.
+ *
+ * `IN_MASK_CREATE` refuses to modify an existing watch, a directory which is
+ * reachable twice (e.g. through nested cache mappings) is only accounted once.
+ */
+constexpr std::uint32_t watch_mask =
+    file_events | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK
+#ifdef IN_MASK_CREATE
+    | IN_MASK_CREATE
+#endif
+    ;
+
+/// size of the buffer for reading inotify events
+constexpr std::size_t event_buffer_size = 64 * 1024;
+
+/**
+ * Sum of the sizes of the files directly inside of a directory.
+ */
+struct directory_subtotal_t final
+{
+    std::uint64_t apparent_size{0};
+    std::uint64_t allocated_size{0};
+};
+
+/**
+ * Reads the given directory and sums up the sizes of its files, same rules as the scanner:
+ * symbolic links to regular files are counted with the size of the file they point to.
+ *
+ * @param subdirectories receives the names of the subdirectories, nullptr to ignore them
+ * @return false if the directory couldn't be opened
+ */
+bool read_directory(const std::string &path, directory_subtotal_t &subtotal,
+    std::vector<std::string> *subdirectories)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    DIR *dir = ::fdopendir(fd);
+    if (dir == nullptr)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    while (const struct dirent *entry = ::readdir(dir))
+    {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN)
+        {
+            if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR)
+        {
+            if (subdirectories)
+            {
+                subdirectories->emplace_back(name);
+            }
+        }
+        else if (type == DT_REG || type == DT_LNK)
+        {
+            if (::fstatat(fd, name, &st, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode))
+            {
+                subtotal.apparent_size += static_cast<std::uint64_t>(st.st_size);
+                subtotal.allocated_size += static_cast<std::uint64_t>(st.st_blocks) * 512;
+            }
+        }
+    }
+
+    ::closedir(dir);
+    return true;
+}
+
+} // anonymous namespace
+
+namespace libcachemgr {
+namespace fs_watcher {
+namespace backend {
+
+inotify_watcher_t::inotify_watcher_t(unsigned setup_threads, std::chrono::milliseconds coalesce_delay)
+    : _setup_threads(threading::work_stealing_pool_t::resolve_thread_count(setup_threads)),
+      _coalesce_delay(coalesce_delay)
+{
+    this->_inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    this->_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    this->_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!this->is_valid())
+    {
+        LOG_ERROR(libcachemgr::log_fs_watcher, "failed to initialize inotify: {}", std::strerror(errno));
+        return;
+    }
+
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = this->_inotify_fd;
+    ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, this->_inotify_fd, &event);
+    event.data.fd = this->_stop_fd;
+    ::epoll_ctl(this->_epoll_fd, EPOLL_CTL_ADD, this->_stop_fd, &event);
+}
+
+inotify_watcher_t::~inotify_watcher_t()
+{
+    this->stop();
+
+    for (const int fd : {this->_inotify_fd, this->_epoll_fd, this->_stop_fd})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+}
+
+bool inotify_watcher_t::is_valid() const noexcept
+{
+    return this->_inotify_fd >= 0 && this->_epoll_fd >= 0 && this->_stop_fd >= 0;
+}
+
+bool inotify_watcher_t::watch(const libcachemgr::mapped_cache_directory_t &dir)
+{
+    if (!this->is_valid() || this->_event_loop.joinable() || !dir.has_target_directory())
+    {
+        return false;
+    }
+
+    const std::size_t mapping = this->_mappings.size();
+    this->_mappings.emplace_back(mapping_state_t{.dir = &dir});
+
+    const auto watches_before = this->watch_count();
+    this->add_tree(dir.target_path, -1, mapping, this->_setup_threads, false);
+    LOG_DEBUG(libcachemgr::log_fs_watcher, "watching {} directories of '{}'",
+        this->watch_count() - watches_before, dir.target_path);
+
+    return this->watch_count() > watches_before;
+}
+
+bool inotify_watcher_t::start()
+{
+    if (!this->is_valid() || this->_event_loop.joinable())
+    {
+        return false;
+    }
+
+    this->_event_loop = std::thread(&inotify_watcher_t::run_event_loop, this);
+    return true;
+}
+
+void inotify_watcher_t::stop()
+{
+    if (!this->_event_loop.joinable())
+    {
+        return;
+    }
+
+    const std::uint64_t value = 1;
+    [[maybe_unused]] const auto written = ::write(this->_stop_fd, &value, sizeof(value));
+    this->_event_loop.join();
+}
+
+bool inotify_watcher_t::apply_deltas()
+{
+    // subtracting more than the current size can happen when the deltas contain
+    // changes in files which were not present during the last scan (e.g. hardlinks)
+    const auto apply = [](std::uintmax_t &size, std::int64_t delta) {
+        if (delta < 0 && static_cast<std::uintmax_t>(-delta) > size)
+        {
+            size = 0;
+        }
+        else
+        {
+            size += static_cast<std::uintmax_t>(delta);
+        }
+    };
+
+    std::lock_guard lock(this->_mappings_mutex);
+    bool changed = false;
+    for (auto &mapping : this->_mappings)
+    {
+        if (mapping.apparent_delta == 0 && mapping.allocated_delta == 0)
+        {
+            continue;
+        }
+
+        apply(mapping.dir->disk_size, mapping.apparent_delta);
+        apply(mapping.dir->unique_disk_size, mapping.apparent_delta);
+        apply(mapping.dir->allocated_disk_size, mapping.allocated_delta);
+        apply(mapping.dir->unique_allocated_disk_size, mapping.allocated_delta);
+        mapping.apparent_delta = 0;
+        mapping.allocated_delta = 0;
+        changed = true;
+    }
+    return changed;
+}
+
+void inotify_watcher_t::add_tree(const std::string &path, int parent_wd, std::size_t mapping,
+    unsigned thread_count, bool count_as_delta)
+{
+    if (thread_count <= 1)
+    {
+        std::vector<std::pair<std::string, int>> stack{{path, parent_wd}};
+        std::vector<std::string> subdirectories;
+        while (!stack.empty() && !this->is_degraded())
+        {
+            auto [directory, parent] = std::move(stack.back());
+            stack.pop_back();
+
+            subdirectories.clear();
+            const int wd = this->add_directory(directory, parent, mapping, count_as_delta, subdirectories);
+            if (wd < 0)
+            {
+                continue;
+            }
+            for (const auto &name : subdirectories)
+            {
+                stack.emplace_back(directory + '/' + name, wd);
+            }
+        }
+        return;
+    }
+
+    // every directory is a task, the pool balances wide and deep trees across all threads
+    threading::work_stealing_pool_t pool(thread_count);
+    std::function<void(const std::string&, int)> visit = [&](const std::string &directory, int parent) {
+        if (this->is_degraded())
+        {
+            return;
+        }
+
+        std::vector<std::string> subdirectories;
+        const int wd = this->add_directory(directory, parent, mapping, count_as_delta, subdirectories);
+        if (wd < 0)
+        {
+            return;
+        }
+        for (auto &name : subdirectories)
+        {
+            pool.submit([&visit, subdirectory = directory + '/' + name, wd](unsigned) {
+                visit(subdirectory, wd);
+            });
+        }
+    };
+    pool.submit([&visit, &path, parent_wd](unsigned) {
+        visit(path, parent_wd);
+    });
+    pool.wait();
+}
+
+int inotify_watcher_t::add_directory(const std::string &path, int parent_wd, std::size_t mapping,
+    bool count_as_delta, std::vector<std::string> &subdirectories)
+{
+    // the watch is added before reading the directory, changes while reading are not lost
+    const int wd = ::inotify_add_watch(this->_inotify_fd, path.c_str(), watch_mask);
+    if (wd < 0)
+    {
+        if (errno == ENOSPC)
+        {
+            if (!this->_degraded.exchange(true))
+            {
+                LOG_WARNING(libcachemgr::log_fs_watcher,
+                    "inotify watch limit reached after {} watches, directories without a watch are not tracked "
+                    "(increase fs.inotify.max_user_watches)", this->watch_count());
+            }
+        }
+        else if (errno != ENOENT && errno != EACCES && errno != ENOTDIR && errno != EEXIST)
+        {
+            LOG_WARNING(libcachemgr::log_fs_watcher, "failed to watch '{}': {}", path, std::strerror(errno));
+        }
+        return -1;
+    }
+
+    directory_subtotal_t subtotal;
+    read_directory(path, subtotal, &subdirectories);
+
+    {
+        std::lock_guard lock(this->_directories_mutex);
+        auto &entry = this->_directories[wd];
+        entry.parent_wd = parent_wd;
+        entry.mapping = mapping;
+        entry.name = parent_wd < 0 ? path : path.substr(path.rfind('/') + 1);
+        entry.apparent_size = subtotal.apparent_size;
+        entry.allocated_size = subtotal.allocated_size;
+        if (parent_wd >= 0)
+        {
+            if (const auto parent = this->_directories.find(parent_wd); parent != this->_directories.end())
+            {
+                parent->second.children.emplace_back(wd);
+            }
+        }
+    }
+    this->_watch_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (count_as_delta)
+    {
+        this->add_delta(mapping,
+            static_cast<std::int64_t>(subtotal.apparent_size),
+            static_cast<std::int64_t>(subtotal.allocated_size));
+    }
+
+    return wd;
+}
+
+void inotify_watcher_t::remove_tree(int wd, bool remove_watches)
+{
+    const auto root = this->_directories.find(wd);
+    if (root == this->_directories.end())
+    {
+        return;
+    }
+
+    if (const auto parent = this->_directories.find(root->second.parent_wd); parent != this->_directories.end())
+    {
+        std::erase(parent->second.children, wd);
+    }
+
+    std::vector<int> stack{wd};
+    while (!stack.empty())
+    {
+        const int current = stack.back();
+        stack.pop_back();
+
+        const auto it = this->_directories.find(current);
+        if (it == this->_directories.end())
+        {
+            continue;
+        }
+
+        const auto &entry = it->second;
+        this->add_delta(entry.mapping,
+            -static_cast<std::int64_t>(entry.apparent_size),
+            -static_cast<std::int64_t>(entry.allocated_size));
+        stack.insert(stack.end(), entry.children.begin(), entry.children.end());
+
+        if (remove_watches || current != wd)
+        {
+            ::inotify_rm_watch(this->_inotify_fd, current);
+        }
+        this->_directories.erase(it);
+        this->_dirty_directories.erase(current);
+        this->_watch_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+std::string inotify_watcher_t::path_of(int wd) const
+{
+    std::vector<const std::string*> names;
+    for (auto it = this->_directories.find(wd); it != this->_directories.end();
+        it = this->_directories.find(it->second.parent_wd))
+    {
+        names.emplace_back(&it->second.name);
+        if (it->second.parent_wd < 0)
+        {
+            break;
+        }
+    }
+
+    std::string path;
+    for (auto it = names.rbegin(); it != names.rend(); ++it)
+    {
+        if (!path.empty())
+        {
+            path += '/';
+        }
+        path += **it;
+    }
+    return path;
+}
+
+int inotify_watcher_t::find_child(int parent_wd, std::string_view name) const
+{
+    const auto parent = this->_directories.find(parent_wd);
+    if (parent == this->_directories.end())
+    {
+        return -1;
+    }
+
+    for (const int child : parent->second.children)
+    {
+        if (const auto it = this->_directories.find(child); it != this->_directories.end() && it->second.name == name)
+        {
+            return child;
+        }
+    }
+    return -1;
+}
+
+void inotify_watcher_t::run_event_loop()
+{
+    alignas(struct inotify_event) std::array<char, event_buffer_size> buffer;
+    std::array<struct epoll_event, 2> events;
+
+    for (;;)
+    {
+        int timeout = -1;
+        if (!this->_dirty_directories.empty())
+        {
+            const auto deadline = this->_first_dirty_event + this->_coalesce_delay;
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<std::int64_t>(remaining.count(), 0));
+        }
+
+        const int ready = ::epoll_wait(this->_epoll_fd, events.data(), static_cast<int>(events.size()), timeout);
+        if (ready < 0 && errno != EINTR)
+        {
+            LOG_ERROR(libcachemgr::log_fs_watcher, "epoll_wait failed: {}", std::strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            if (events[i].data.fd == this->_stop_fd)
+            {
+                return;
+            }
+
+            // drain the inotify queue, the fd is non-blocking
+            ssize_t length;
+            while ((length = ::read(this->_inotify_fd, buffer.data(), buffer.size())) > 0)
+            {
+                for (ssize_t offset = 0; offset < length; )
+                {
+                    const auto *event = reinterpret_cast<const struct inotify_event*>(buffer.data() + offset);
+                    this->handle_event(*event);
+                    offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+                }
+            }
+        }
+
+        if (!this->_dirty_directories.empty() &&
+            std::chrono::steady_clock::now() >= this->_first_dirty_event + this->_coalesce_delay)
+        {
+            this->flush_dirty_directories();
+        }
+    }
+}
+
+void inotify_watcher_t::handle_event(const struct inotify_event &event)
+{
+    if (event.mask & IN_Q_OVERFLOW)
+    {
+        LOG_WARNING(libcachemgr::log_fs_watcher, "inotify event queue overflowed, resynchronizing all cache directories");
+        this->resynchronize();
+        return;
+    }
+
+    if (event.mask & IN_IGNORED)
+    {
+        // the directory was deleted or its watch was removed
+        this->remove_tree(event.wd, false);
+        return;
+    }
+
+    if (!this->_directories.contains(event.wd))
+    {
+        return;
+    }
+
+    const std::string_view name = event.len > 0 ? std::string_view(event.name) : std::string_view();
+    if (event.mask & IN_ISDIR)
+    {
+        if (event.mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            if (this->find_child(event.wd, name) < 0)
+            {
+                const auto mapping = this->_directories[event.wd].mapping;
+                this->add_tree(this->path_of(event.wd) + '/' + std::string(name), event.wd, mapping, 1, true);
+            }
+        }
+        else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            if (const int child = this->find_child(event.wd, name); child >= 0)
+            {
+                this->remove_tree(child, true);
+            }
+        }
+        return;
+    }
+
+    if (event.mask & file_events)
+    {
+        if (this->_dirty_directories.empty())
+        {
+            this->_first_dirty_event = std::chrono::steady_clock::now();
+        }
+        this->_dirty_directories.insert(event.wd);
+    }
+}
+
+void inotify_watcher_t::flush_dirty_directories()
+{
+    for (const int wd : this->_dirty_directories)
+    {
+        const auto it = this->_directories.find(wd);
+        if (it == this->_directories.end())
+        {
+            continue;
+        }
+
+        directory_subtotal_t subtotal;
+        if (!read_directory(this->path_of(wd), subtotal, nullptr))
+        {
+            // removed in the meantime, IN_IGNORED follows
+            continue;
+        }
+
+        auto &entry = it->second;
+        this->add_delta(entry.mapping,
+            static_cast<std::int64_t>(subtotal.apparent_size) - static_cast<std::int64_t>(entry.apparent_size),
+            static_cast<std::int64_t>(subtotal.allocated_size) - static_cast<std::int64_t>(entry.allocated_size));
+        entry.apparent_size = subtotal.apparent_size;
+        entry.allocated_size = subtotal.allocated_size;
+    }
+    this->_dirty_directories.clear();
+}
+
+void inotify_watcher_t::resynchronize()
+{
+    std::vector<std::pair<std::string, std::size_t>> roots;
+    std::vector<int> root_wds;
+    for (const auto &[wd, entry] : this->_directories)
+    {
+        if (entry.parent_wd < 0)
+        {
+            roots.emplace_back(entry.name, entry.mapping);
+            root_wds.emplace_back(wd);
+        }
+    }
+
+    // events are lost, rebuild all watches, the difference of the sizes is the delta
+    for (const int wd : root_wds)
+    {
+        this->remove_tree(wd, true);
+    }
+    this->_dirty_directories.clear();
+    this->_degraded.store(false, std::memory_order_relaxed);
+    for (const auto &[path, mapping] : roots)
+    {
+        this->add_tree(path, -1, mapping, 1, true);
+    }
+}
+
+void inotify_watcher_t::add_delta(std::size_t mapping, std::int64_t apparent_delta, std::int64_t allocated_delta)
+{
+    if (apparent_delta == 0 && allocated_delta == 0)
+    {
+        return;
+    }
+
+    std::lock_guard lock(this->_mappings_mutex);
+    this->_mappings[mapping].apparent_delta += apparent_delta;
+    this->_mappings[mapping].allocated_delta += allocated_delta;
+}
+
+} // namespace backend
+} // namespace fs_watcher
+} // namespace libcachemgr
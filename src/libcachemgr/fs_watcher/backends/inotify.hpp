@@ -1 +1,188 @@
 #pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../../types.hpp"
+
+struct inotify_event;
+
+namespace libcachemgr {
+namespace fs_watcher {
+namespace backend {
+
+/**
+ * Recursive filesystem watcher built on top of inotify and epoll.
+ *
+ * inotify only watches single directories, every directory of a watched tree gets its own watch.
+ * For every watched directory, the sum of the sizes of its files is kept in memory. Events mark
+ * directories as dirty, dirty directories are re-read once the coalescing delay after the first
+ * event of a burst expired, and the difference to the previous sum is the size delta of the directory.
+ * A single `npm install` which creates thousands of files results in one re-read per directory.
+ *
+ * New directories (created or moved into a watched tree) are watched automatically,
+ * removed directories (deleted or moved out of the tree) are subtracted with their last known sum.
+ *
+ * When `fs.inotify.max_user_watches` is reached, no more watches are added and the watcher
+ * is degraded: directories without a watch are not tracked anymore, their sizes remain
+ * as they were during the last scan.
+ */
+class inotify_watcher_t
+{
+public:
+    /**
+     * Creates the inotify instance, the epoll instance and the event used to stop the event loop.
+     *
+     * @param setup_threads number of threads to set up the watches of a mapped cache directory
+     * @param coalesce_delay delay between the first event of a burst and applying the changes
+     */
+    inotify_watcher_t(unsigned setup_threads, std::chrono::milliseconds coalesce_delay);
+    ~inotify_watcher_t();
+
+    inotify_watcher_t(const inotify_watcher_t&) = delete;
+    inotify_watcher_t &operator=(const inotify_watcher_t&) = delete;
+
+    /**
+     * Checks if all file descriptors were created successfully.
+     */
+    bool is_valid() const noexcept;
+
+    /**
+     * Watches all directories of the given mapped cache directory, see {fs_watcher_t::watch}.
+     */
+    bool watch(const libcachemgr::mapped_cache_directory_t &dir);
+
+    /**
+     * Starts the event loop in a background thread.
+     */
+    bool start();
+
+    /**
+     * Stops the event loop and waits for the background thread.
+     */
+    void stop();
+
+    /**
+     * Adds the size deltas collected so far to the mapped cache directories.
+     */
+    bool apply_deltas();
+
+    inline std::size_t watch_count() const noexcept {
+        return this->_watch_count.load(std::memory_order_relaxed);
+    }
+
+    inline bool is_degraded() const noexcept {
+        return this->_degraded.load(std::memory_order_relaxed);
+    }
+
+private:
+    /**
+     * A single watched directory.
+     */
+    struct watched_directory_t final
+    {
+        /// watch descriptor of the parent directory, -1 for the root of a mapped cache directory
+        int parent_wd{-1};
+
+        /// index of the mapped cache directory in {_mappings}
+        std::size_t mapping{0};
+
+        /// name of the directory in its parent, the full path for the root of a mapped cache directory
+        std::string name;
+
+        /// sum of the sizes of the files directly inside of this directory
+        std::uint64_t apparent_size{0};
+        std::uint64_t allocated_size{0};
+
+        /// watch descriptors of the watched subdirectories
+        std::vector<int> children;
+    };
+
+    /**
+     * Size changes of a mapped cache directory which are not applied yet.
+     */
+    struct mapping_state_t final
+    {
+        const libcachemgr::mapped_cache_directory_t *dir;
+        std::int64_t apparent_delta{0};
+        std::int64_t allocated_delta{0};
+    };
+
+    /**
+     * Watches the given directory and all its subdirectories.
+     *
+     * @param path path of the directory
+     * @param parent_wd watch descriptor of the parent directory, -1 for the root of a mapped cache directory
+     * @param mapping index of the mapped cache directory
+     * @param thread_count number of threads, 1 sets up the watches in the calling thread
+     * @param count_as_delta the sizes of the new directories are size changes (new directories in a watched tree)
+     */
+    void add_tree(const std::string &path, int parent_wd, std::size_t mapping,
+        unsigned thread_count, bool count_as_delta);
+
+    /**
+     * Watches a single directory and reads its files.
+     *
+     * @param subdirectories receives the names of the subdirectories
+     * @return the watch descriptor or -1 if the directory couldn't be watched
+     */
+    int add_directory(const std::string &path, int parent_wd, std::size_t mapping,
+        bool count_as_delta, std::vector<std::string> &subdirectories);
+
+    /**
+     * Removes the watches of the given directory and all its subdirectories
+     * and subtracts their sizes from the mapped cache directory.
+     */
+    void remove_tree(int wd, bool remove_watches);
+
+    /**
+     * Reconstructs the path of a watched directory.
+     */
+    std::string path_of(int wd) const;
+
+    /**
+     * Finds the watch descriptor of a subdirectory by its name, -1 if not watched.
+     */
+    int find_child(int parent_wd, std::string_view name) const;
+
+    void run_event_loop();
+    void handle_event(const struct inotify_event &event);
+    void flush_dirty_directories();
+    void resynchronize();
+    void add_delta(std::size_t mapping, std::int64_t apparent_delta, std::int64_t allocated_delta);
+
+    const unsigned _setup_threads;
+    const std::chrono::milliseconds _coalesce_delay;
+
+    int _inotify_fd{-1};
+    int _epoll_fd{-1};
+    int _stop_fd{-1};
+
+    std::thread _event_loop;
+
+    /// all watched directories by their watch descriptor
+    std::unordered_map<int, watched_directory_t> _directories;
+    std::mutex _directories_mutex;
+
+    /// directories with pending events and the time of the first event of the burst
+    std::unordered_set<int> _dirty_directories;
+    std::chrono::steady_clock::time_point _first_dirty_event;
+
+    std::vector<mapping_state_t> _mappings;
+    std::mutex _mappings_mutex;
+
+    std::atomic<std::size_t> _watch_count{0};
+    std::atomic<bool> _degraded{false};
+};
+
+} // namespace backend
+} // namespace fs_watcher
+} // namespace libcachemgr
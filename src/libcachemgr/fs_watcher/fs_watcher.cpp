@@ -1 +1,102 @@
 #include "fs_watcher.hpp"
+
+#ifdef FILESYSTEM_WATCHER_BACKEND
+#include "backends/inotify.hpp"
+#endif
+
+namespace libcachemgr {
+namespace fs_watcher {
+
+#ifdef FILESYSTEM_WATCHER_BACKEND
+class fs_watcher_t::backend_t final : public backend::inotify_watcher_t
+{
+public:
+    using backend::inotify_watcher_t::inotify_watcher_t;
+};
+#else
+class fs_watcher_t::backend_t final {};
+#endif
+
+fs_watcher_t::fs_watcher_t(
+    [[maybe_unused]] unsigned setup_threads,
+    [[maybe_unused]] std::chrono::milliseconds coalesce_delay)
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    this->_backend = std::make_unique<backend_t>(setup_threads, coalesce_delay);
+#endif
+}
+
+fs_watcher_t::~fs_watcher_t() = default;
+
+std::string_view fs_watcher_t::backend_name() noexcept
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return FILESYSTEM_WATCHER_BACKEND;
+#else
+    return "none";
+#endif
+}
+
+bool fs_watcher_t::is_available() const noexcept
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->is_valid();
+#else
+    return false;
+#endif
+}
+
+bool fs_watcher_t::watch([[maybe_unused]] const libcachemgr::mapped_cache_directory_t &dir)
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->watch(dir);
+#else
+    return false;
+#endif
+}
+
+bool fs_watcher_t::start()
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->start();
+#else
+    return false;
+#endif
+}
+
+void fs_watcher_t::stop()
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    this->_backend->stop();
+#endif
+}
+
+bool fs_watcher_t::apply_deltas()
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->apply_deltas();
+#else
+    return false;
+#endif
+}
+
+std::size_t fs_watcher_t::watch_count() const noexcept
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->watch_count();
+#else
+    return 0;
+#endif
+}
+
+bool fs_watcher_t::is_degraded() const noexcept
+{
+#ifdef FILESYSTEM_WATCHER_BACKEND
+    return this->_backend->is_degraded();
+#else
+    return false;
+#endif
+}
+
+} // namespace fs_watcher
+} // namespace libcachemgr
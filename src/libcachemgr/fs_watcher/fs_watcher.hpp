@@ -1 +1,93 @@
 #pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+#include "../types.hpp"
+
+namespace libcachemgr {
+namespace fs_watcher {
+
+/**
+ * Keeps the sizes of mapped cache directories up to date without rescanning them.
+ *
+ * The watcher observes the target directories recursively with the filesystem watcher backend
+ * selected at build time. Size changes are collected in the background and added to the
+ * {mapped_cache_directory_t} objects with {apply_deltas}, the owner decides when to apply them
+ * (e.g. right before answering a query) so that readers never see sizes change concurrently.
+ *
+ * The unique sizes receive the same deltas as the total sizes, hardlinks which are created or removed
+ * while watching are not deduplicated until the next full scan.
+ *
+ * On platforms without a filesystem watcher backend, nothing is watched and {is_available} is false.
+ */
+class fs_watcher_t final
+{
+public:
+    /**
+     * @param setup_threads number of threads to set up the watches, 0 means one thread per hardware thread
+     * @param coalesce_delay changes are applied this long after the first event of a burst
+     */
+    explicit fs_watcher_t(unsigned setup_threads = 0,
+        std::chrono::milliseconds coalesce_delay = std::chrono::milliseconds(200));
+    ~fs_watcher_t();
+
+    fs_watcher_t(const fs_watcher_t&) = delete;
+    fs_watcher_t &operator=(const fs_watcher_t&) = delete;
+
+    /**
+     * Name of the filesystem watcher backend, "none" if there is no backend for this platform.
+     */
+    static std::string_view backend_name() noexcept;
+
+    /**
+     * Checks if the backend is available and was initialized successfully.
+     */
+    bool is_available() const noexcept;
+
+    /**
+     * Watches the target directory of the given mapped cache directory recursively.
+     *
+     * Must be called before {start}, right after the sizes of the directory were calculated.
+     * The mapped cache directory must outlive the watcher. Wildcard mappings are not supported.
+     *
+     * @return true if the target directory is watched
+     */
+    bool watch(const libcachemgr::mapped_cache_directory_t &dir);
+
+    /**
+     * Starts processing filesystem events in a background thread.
+     */
+    bool start();
+
+    /**
+     * Stops processing filesystem events, pending deltas are kept.
+     */
+    void stop();
+
+    /**
+     * Adds the size changes since the last call to the watched mapped cache directories.
+     *
+     * @return true if any size changed
+     */
+    bool apply_deltas();
+
+    /**
+     * Number of watched directories.
+     */
+    std::size_t watch_count() const noexcept;
+
+    /**
+     * Checks if the watch limit of the system was reached and some directories are not tracked.
+     */
+    bool is_degraded() const noexcept;
+
+private:
+    class backend_t;
+    std::unique_ptr<backend_t> _backend;
+};
+
+} // namespace fs_watcher
+} // namespace libcachemgr
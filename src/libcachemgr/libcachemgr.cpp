@@ -90,6 +90,30 @@ const std::string &user_configuration_t::database_file() const noexcept
     return this->_database_file;
 }
 
+void user_configuration_t::set_scan_snapshot_file(const std::string &scan_snapshot_file) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_scan_snapshot_file = scan_snapshot_file;
+}
+
+const std::string &user_configuration_t::scan_snapshot_file() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_scan_snapshot_file;
+}
+
+void user_configuration_t::set_daemon_socket_file(const std::string &daemon_socket_file) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_daemon_socket_file = daemon_socket_file;
+}
+
+const std::string &user_configuration_t::daemon_socket_file() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_daemon_socket_file;
+}
+
 void user_configuration_t::set_verify_cache_mappings(bool verify_cache_mappings) noexcept
 {
     mutex_lock_t lock{user_configuration_mutex};
@@ -114,6 +138,224 @@ bool user_configuration_t::show_usage_stats() const noexcept
     return this->_show_usage_stats;
 }
 
+void user_configuration_t::set_scan_threads(unsigned scan_threads) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_scan_threads = scan_threads;
+}
+
+std::optional<unsigned> user_configuration_t::scan_threads() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_scan_threads;
+}
+
+void user_configuration_t::set_full_rescan(bool full_rescan) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_full_rescan = full_rescan;
+}
+
+bool user_configuration_t::full_rescan() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_full_rescan;
+}
+
+void user_configuration_t::set_stream_usage_stats(bool stream_usage_stats) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_stream_usage_stats = stream_usage_stats;
+}
+
+bool user_configuration_t::stream_usage_stats() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_stream_usage_stats;
+}
+
+void user_configuration_t::set_from_daemon(bool from_daemon) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_from_daemon = from_daemon;
+}
+
+bool user_configuration_t::from_daemon() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_from_daemon;
+}
+
+void user_configuration_t::set_estimate(bool estimate) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_estimate = estimate;
+}
+
+bool user_configuration_t::estimate() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_estimate;
+}
+
+void user_configuration_t::set_estimate_budget(std::chrono::milliseconds time_budget, std::uint64_t stat_budget) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_estimate_time_budget = time_budget;
+    this->_estimate_stat_budget = stat_budget;
+}
+
+std::chrono::milliseconds user_configuration_t::estimate_time_budget() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_estimate_time_budget;
+}
+
+std::uint64_t user_configuration_t::estimate_stat_budget() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_estimate_stat_budget;
+}
+
+void user_configuration_t::set_breakdown(unsigned count, unsigned depth) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_breakdown_count = count;
+    this->_breakdown_depth = depth;
+}
+
+unsigned user_configuration_t::breakdown_count() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_breakdown_count;
+}
+
+unsigned user_configuration_t::breakdown_depth() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_breakdown_depth;
+}
+
+void user_configuration_t::set_show_histograms(bool show_histograms) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_show_histograms = show_histograms;
+}
+
+bool user_configuration_t::show_histograms() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_show_histograms;
+}
+
+void user_configuration_t::set_show_allocated_size(bool show_allocated_size) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_show_allocated_size = show_allocated_size;
+}
+
+bool user_configuration_t::show_allocated_size() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_show_allocated_size;
+}
+
+void user_configuration_t::set_enforce_size_limits(bool enforce_size_limits) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_enforce_size_limits = enforce_size_limits;
+}
+
+bool user_configuration_t::enforce_size_limits() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_enforce_size_limits;
+}
+
+void user_configuration_t::set_dedupe(bool dedupe) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_dedupe = dedupe;
+}
+
+bool user_configuration_t::dedupe() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_dedupe;
+}
+
+void user_configuration_t::set_allow_hardlinks(bool allow_hardlinks) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_allow_hardlinks = allow_hardlinks;
+}
+
+bool user_configuration_t::allow_hardlinks() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_allow_hardlinks;
+}
+
+void user_configuration_t::set_show_compressibility(bool show_compressibility) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_show_compressibility = show_compressibility;
+}
+
+bool user_configuration_t::show_compressibility() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_show_compressibility;
+}
+
+void user_configuration_t::set_pack_after_days(unsigned pack_after_days) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_pack_after_days = pack_after_days;
+}
+
+unsigned user_configuration_t::pack_after_days() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_pack_after_days;
+}
+
+void user_configuration_t::set_dry_run(bool dry_run) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_dry_run = dry_run;
+}
+
+bool user_configuration_t::dry_run() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_dry_run;
+}
+
+void user_configuration_t::set_clean_cache_mapping(const std::string &cache_mapping_id) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_clean_cache_mapping = cache_mapping_id;
+}
+
+const std::string &user_configuration_t::clean_cache_mapping() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_clean_cache_mapping;
+}
+
+void user_configuration_t::set_restore_cache_mapping(const std::string &cache_mapping_id) noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    this->_restore_cache_mapping = cache_mapping_id;
+}
+
+const std::string &user_configuration_t::restore_cache_mapping() const noexcept
+{
+    mutex_lock_t lock{user_configuration_mutex};
+    return this->_restore_cache_mapping;
+}
+
 void user_configuration_t::set_print_pm_cache_locations(bool print_pm_cache_locations) noexcept
 {
     mutex_lock_t lock{user_configuration_mutex};
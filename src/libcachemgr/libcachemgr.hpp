@@ -1,7 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <string_view>
+#include <optional>
 
 namespace libcachemgr {
 
@@ -77,12 +80,90 @@ public:
     void set_database_file(const std::string &database_file) noexcept;
     const std::string &database_file() const noexcept;
 
+    /// memory-mapped snapshot of the previous scan for incremental rescans
+    void set_scan_snapshot_file(const std::string &scan_snapshot_file) noexcept;
+    const std::string &scan_snapshot_file() const noexcept;
+
+    /// Unix domain socket of the daemon
+    void set_daemon_socket_file(const std::string &daemon_socket_file) noexcept;
+    const std::string &daemon_socket_file() const noexcept;
+
     void set_verify_cache_mappings(bool verify_cache_mappings) noexcept;
     bool verify_cache_mappings() const noexcept;
 
     void set_show_usage_stats(bool show_usage_stats) noexcept;
     bool show_usage_stats() const noexcept;
 
+    /// number of threads for directory scanning, overrides the configuration file when set
+    void set_scan_threads(unsigned scan_threads) noexcept;
+    std::optional<unsigned> scan_threads() const noexcept;
+
+    /// ignore the directory index and scan all cache directories completely
+    void set_full_rescan(bool full_rescan) noexcept;
+    bool full_rescan() const noexcept;
+
+    /// print the usage statistics of every cache directory as soon as it is scanned
+    void set_stream_usage_stats(bool stream_usage_stats) noexcept;
+    bool stream_usage_stats() const noexcept;
+
+    /// query the usage statistics from the daemon, scan the cache directories if it is not running
+    void set_from_daemon(bool from_daemon) noexcept;
+    bool from_daemon() const noexcept;
+
+    /// estimate the usage statistics by sampling instead of scanning the cache directories completely
+    void set_estimate(bool estimate) noexcept;
+    bool estimate() const noexcept;
+
+    /// budget of the estimator for all cache directories together, a stat budget of 0 means no limit
+    void set_estimate_budget(std::chrono::milliseconds time_budget, std::uint64_t stat_budget) noexcept;
+    std::chrono::milliseconds estimate_time_budget() const noexcept;
+    std::uint64_t estimate_stat_budget() const noexcept;
+
+    /// show the given number of largest subdirectories per level up to the given depth, 0 disables the breakdown
+    void set_breakdown(unsigned count, unsigned depth) noexcept;
+    unsigned breakdown_count() const noexcept;
+    unsigned breakdown_depth() const noexcept;
+
+    /// collect and show the age and size histograms of every cache directory
+    void set_show_histograms(bool show_histograms) noexcept;
+    bool show_histograms() const noexcept;
+
+    /// show the allocated size instead of the apparent size in the usage statistics
+    void set_show_allocated_size(bool show_allocated_size) noexcept;
+    bool show_allocated_size() const noexcept;
+
+    /// delete the least recently used files of every cache directory which exceeds its size limit
+    void set_enforce_size_limits(bool enforce_size_limits) noexcept;
+    bool enforce_size_limits() const noexcept;
+
+    /// replace files with identical contents across all cache directories with reflinks
+    void set_dedupe(bool dedupe) noexcept;
+    bool dedupe() const noexcept;
+
+    /// replace duplicates with hardlinks when the filesystem doesn't support reflinks
+    void set_allow_hardlinks(bool allow_hardlinks) noexcept;
+    bool allow_hardlinks() const noexcept;
+
+    /// estimate how well every cache directory compresses by sampling its files
+    void set_show_compressibility(bool show_compressibility) noexcept;
+    bool show_compressibility() const noexcept;
+
+    /// pack subtrees which were not used for the given number of days into archives, 0 disables packing
+    void set_pack_after_days(unsigned pack_after_days) noexcept;
+    unsigned pack_after_days() const noexcept;
+
+    /// only show what would be deleted, replaced or packed, nothing is modified
+    void set_dry_run(bool dry_run) noexcept;
+    bool dry_run() const noexcept;
+
+    /// empty the cache directory of the cache mapping with the given id
+    void set_clean_cache_mapping(const std::string &cache_mapping_id) noexcept;
+    const std::string &clean_cache_mapping() const noexcept;
+
+    /// unpack all archives in the cache directory of the cache mapping with the given id
+    void set_restore_cache_mapping(const std::string &cache_mapping_id) noexcept;
+    const std::string &restore_cache_mapping() const noexcept;
+
     void set_print_pm_cache_locations(bool print_pm_cache_locations) noexcept;
     bool print_pm_cache_locations() const noexcept;
 
@@ -94,9 +175,30 @@ private:
 
     std::string _configuration_file{};
     std::string _database_file{};
+    std::string _scan_snapshot_file{};
+    std::string _daemon_socket_file{};
     std::string _print_pm_cache_location_of{};
+    std::string _clean_cache_mapping{};
+    std::string _restore_cache_mapping{};
+    std::optional<unsigned> _scan_threads{};
+    std::chrono::milliseconds _estimate_time_budget{2000};
+    std::uint64_t _estimate_stat_budget{0};
+    unsigned _breakdown_count{0};
+    unsigned _breakdown_depth{1};
+    unsigned _pack_after_days{0};
     bool _verify_cache_mappings{false};
     bool _show_usage_stats{false};
+    bool _full_rescan{false};
+    bool _stream_usage_stats{false};
+    bool _from_daemon{false};
+    bool _estimate{false};
+    bool _show_histograms{false};
+    bool _show_allocated_size{false};
+    bool _enforce_size_limits{false};
+    bool _dedupe{false};
+    bool _show_compressibility{false};
+    bool _allow_hardlinks{false};
+    bool _dry_run{false};
     bool _print_pm_cache_locations{false};
 };
 
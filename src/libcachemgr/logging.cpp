@@ -133,6 +133,7 @@ quill::Logger *libcachemgr::log_pm = nullptr;
   quill::Logger *libcachemgr::log_composer = nullptr;
   quill::Logger *libcachemgr::log_npm = nullptr;
 quill::Logger *libcachemgr::log_db = nullptr;
+quill::Logger *libcachemgr::log_fs_watcher = nullptr;
 quill::Logger *libcachemgr::log_test = nullptr;
 
 void libcachemgr::init_logging(const logging_config &config)
@@ -171,6 +172,7 @@ void libcachemgr::init_logging(const logging_config &config)
       log_composer = libcachemgr::create_logger("composer", config);
       log_npm =      libcachemgr::create_logger("npm", config);
     log_db =       libcachemgr::create_logger("database", config);
+    log_fs_watcher = libcachemgr::create_logger("watcher", config);
     log_test =     libcachemgr::create_logger("test", config);
 
     LOG_INFO(log_main, "starting {} {}", program_metadata::application_name, program_metadata::full_application_version());
@@ -11,6 +11,7 @@ extern quill::Logger *log_pm;
   extern quill::Logger *log_composer;
   extern quill::Logger *log_npm;
 extern quill::Logger *log_db;
+extern quill::Logger *log_fs_watcher;
 extern quill::Logger *log_test;
 
 /**
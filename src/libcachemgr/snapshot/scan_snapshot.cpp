@@ -0,0 +1,499 @@
+#include "scan_snapshot.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char snapshot_magic[8] = {'C', 'M', 'G', 'R', 'S', 'N', 'A', 'P'};
+
+/// bump this when the layout of any section changes
+constexpr std::uint32_t snapshot_version = 1;
+
+/// every n-th string of a front-coded string table is stored completely
+constexpr std::uint32_t front_coding_restart_interval = 16;
+
+/**
+ * Header at the start of the snapshot file, all offsets are relative to the start of the file.
+ */
+struct snapshot_header_t final
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t generation;
+    std::int64_t timestamp;
+    std::uint64_t file_size;
+
+    std::uint64_t mapping_count;
+    std::uint64_t mappings_offset;
+    std::uint64_t mapping_ids_offset;
+    std::uint64_t mapping_ids_size;
+    std::uint64_t mapping_paths_offset;
+    std::uint64_t mapping_paths_size;
+
+    std::uint64_t directory_count;
+    std::uint64_t directories_offset;
+};
+
+constexpr std::size_t align8(std::size_t value)
+{
+    return (value + 7) & ~std::size_t{7};
+}
+
+/**
+ * Offsets of the directory record columns relative to the start of the directories section.
+ *
+ * 64-bit columns come first, every column starts 8-byte aligned.
+ */
+struct directory_columns_layout_t final
+{
+    explicit directory_columns_layout_t(std::size_t count)
+    {
+        const std::size_t column64 = count * sizeof(std::uint64_t);
+        const std::size_t column32 = align8(count * sizeof(std::uint32_t));
+
+        path_hash = 0;
+        mtime_sec = path_hash + column64;
+        ctime_sec = mtime_sec + column64;
+        apparent_size = ctime_sec + column64;
+        allocated_size = apparent_size + column64;
+        mtime_nsec = allocated_size + column64;
+        ctime_nsec = mtime_nsec + column32;
+        entry_count = ctime_nsec + column32;
+        flags = entry_count + column32;
+        size = flags + column32;
+    }
+
+    std::size_t path_hash;
+    std::size_t mtime_sec;
+    std::size_t ctime_sec;
+    std::size_t apparent_size;
+    std::size_t allocated_size;
+    std::size_t mtime_nsec;
+    std::size_t ctime_nsec;
+    std::size_t entry_count;
+    std::size_t flags;
+    std::size_t size;
+};
+
+/// typed pointer to a column at the given offset of a section
+template<typename T, typename Byte>
+inline T *column_at(Byte *base, std::size_t offset)
+{
+    return reinterpret_cast<T*>(base + offset);
+}
+
+/// number of columns in the mapping totals section
+constexpr std::size_t mapping_totals_columns = 4;
+
+template<typename T>
+void append_pod(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void append_varint(std::string &out, std::uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool read_varint(std::string_view &in, std::uint32_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 32 && !in.empty(); shift += 7)
+    {
+        const auto byte = static_cast<unsigned char>(in.front());
+        in.remove_prefix(1);
+        value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Encodes the strings into a front-coded string table.
+ *
+ * Layout: `u32 count`, `u32 restart_offsets[ceil(count / restart interval)]`, entries.
+ * Every entry is `varint shared_prefix_length`, `varint suffix_length`, `suffix`.
+ * The restart offsets point to entries without a shared prefix, relative to the first entry.
+ */
+std::string encode_front_coded(const std::vector<std::string_view> &strings)
+{
+    const auto count = static_cast<std::uint32_t>(strings.size());
+    const auto restart_count = (count + front_coding_restart_interval - 1) / front_coding_restart_interval;
+
+    std::string entries;
+    std::vector<std::uint32_t> restart_offsets;
+    restart_offsets.reserve(restart_count);
+
+    std::string_view previous;
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        const auto current = strings[i];
+
+        std::size_t shared = 0;
+        if (i % front_coding_restart_interval == 0)
+        {
+            restart_offsets.emplace_back(static_cast<std::uint32_t>(entries.size()));
+        }
+        else
+        {
+            while (shared < previous.size() && shared < current.size() && previous[shared] == current[shared])
+            {
+                ++shared;
+            }
+        }
+
+        append_varint(entries, static_cast<std::uint32_t>(shared));
+        append_varint(entries, static_cast<std::uint32_t>(current.size() - shared));
+        entries.append(current.substr(shared));
+        previous = current;
+    }
+
+    std::string table;
+    append_pod(table, count);
+    for (const auto offset : restart_offsets)
+    {
+        append_pod(table, offset);
+    }
+    table.append(entries);
+    return table;
+}
+
+/**
+ * Decodes a single string of a front-coded string table, see {encode_front_coded}.
+ *
+ * @return the string or an empty string if the index is out of range or the table is corrupt
+ */
+std::string decode_front_coded(std::string_view table, std::size_t index)
+{
+    std::uint32_t count;
+    if (table.size() < sizeof(count))
+    {
+        return {};
+    }
+    std::memcpy(&count, table.data(), sizeof(count));
+
+    const auto restart_count = (count + front_coding_restart_interval - 1) / front_coding_restart_interval;
+    const auto entries_offset = sizeof(count) + std::size_t{restart_count} * sizeof(std::uint32_t);
+    if (index >= count || table.size() < entries_offset)
+    {
+        return {};
+    }
+
+    std::uint32_t restart_offset;
+    std::memcpy(&restart_offset, table.data() + sizeof(count) +
+        (index / front_coding_restart_interval) * sizeof(std::uint32_t), sizeof(restart_offset));
+
+    auto entries = table.substr(entries_offset);
+    if (restart_offset > entries.size())
+    {
+        return {};
+    }
+    entries.remove_prefix(restart_offset);
+
+    // decode from the restart point up to the requested string
+    std::string result;
+    for (auto i = index - index % front_coding_restart_interval; i <= index; ++i)
+    {
+        std::uint32_t shared, suffix_length;
+        if (!read_varint(entries, shared) || !read_varint(entries, suffix_length) ||
+            shared > result.size() || suffix_length > entries.size())
+        {
+            return {};
+        }
+        result.resize(shared);
+        result.append(entries.substr(0, suffix_length));
+        entries.remove_prefix(suffix_length);
+    }
+    return result;
+}
+
+/**
+ * Checks that the section is inside of the file and 8-byte aligned.
+ */
+inline bool is_valid_section(std::uint64_t offset, std::uint64_t size, std::size_t file_size)
+{
+    return offset % 8 == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+} // anonymous namespace
+
+namespace libcachemgr {
+namespace snapshot {
+
+scan_snapshot_t::~scan_snapshot_t()
+{
+    this->close();
+}
+
+std::error_code scan_snapshot_t::open(const std::string &path) noexcept
+{
+    this->close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        const std::error_code ec{errno, std::generic_category()};
+        ::close(fd);
+        return ec;
+    }
+
+    const auto file_size = static_cast<std::size_t>(st.st_size);
+    if (file_size < sizeof(snapshot_header_t))
+    {
+        ::close(fd);
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    void *data = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int mmap_errno = errno;
+
+    // the mapping keeps the file alive
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return std::error_code{mmap_errno, std::generic_category()};
+    }
+
+    // validate the header, all accessors rely on it
+    const auto *header = static_cast<const snapshot_header_t*>(data);
+    const bool is_valid =
+        std::memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) == 0 &&
+        header->version == snapshot_version &&
+        header->file_size == file_size &&
+        header->mapping_count <= file_size / sizeof(std::uint64_t) &&
+        header->directory_count <= file_size / sizeof(std::uint64_t) &&
+        is_valid_section(header->mappings_offset,
+            header->mapping_count * mapping_totals_columns * sizeof(std::uint64_t), file_size) &&
+        is_valid_section(header->mapping_ids_offset, header->mapping_ids_size, file_size) &&
+        is_valid_section(header->mapping_paths_offset, header->mapping_paths_size, file_size) &&
+        is_valid_section(header->directories_offset,
+            directory_columns_layout_t(header->directory_count).size, file_size);
+
+    if (!is_valid)
+    {
+        ::munmap(data, file_size);
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    this->_data = static_cast<const char*>(data);
+    this->_size = file_size;
+    return {};
+}
+
+void scan_snapshot_t::close() noexcept
+{
+    if (this->_data != nullptr)
+    {
+        ::munmap(const_cast<char*>(this->_data), this->_size);
+        this->_data = nullptr;
+        this->_size = 0;
+    }
+}
+
+std::error_code scan_snapshot_t::write(const std::string &path, std::int64_t timestamp,
+    const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+    const disk_usage::directory_index_t &index) noexcept
+{
+    const auto records = index.current_records();
+
+    std::vector<std::string_view> mapping_ids;
+    std::vector<std::string_view> mapping_paths;
+    for (const auto &dir : mapped_cache_directories)
+    {
+        mapping_ids.emplace_back(dir.id);
+        mapping_paths.emplace_back(dir.has_target_directory() ? dir.target_path : dir.wildcard_pattern);
+    }
+    const auto mapping_ids_table = encode_front_coded(mapping_ids);
+    const auto mapping_paths_table = encode_front_coded(mapping_paths);
+
+    snapshot_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = snapshot_version;
+    header.generation = index.generation() + 1;
+    header.timestamp = timestamp;
+    header.mapping_count = mapped_cache_directories.size();
+    header.directory_count = records.size();
+
+    // section layout
+    const directory_columns_layout_t layout(records.size());
+    header.mappings_offset = align8(sizeof(header));
+    header.directories_offset = align8(header.mappings_offset +
+        header.mapping_count * mapping_totals_columns * sizeof(std::uint64_t));
+    header.mapping_ids_offset = align8(header.directories_offset + layout.size);
+    header.mapping_ids_size = mapping_ids_table.size();
+    header.mapping_paths_offset = align8(header.mapping_ids_offset + header.mapping_ids_size);
+    header.mapping_paths_size = mapping_paths_table.size();
+    header.file_size = header.mapping_paths_offset + header.mapping_paths_size;
+
+    std::string out(header.file_size, '\0');
+    std::memcpy(out.data(), &header, sizeof(header));
+
+    // per-mapping totals, one column per size type
+    {
+        auto *totals = reinterpret_cast<std::uint64_t*>(out.data() + header.mappings_offset);
+        const auto count = header.mapping_count;
+        std::size_t i = 0;
+        for (const auto &dir : mapped_cache_directories)
+        {
+            totals[0 * count + i] = dir.disk_size;
+            totals[1 * count + i] = dir.allocated_disk_size;
+            totals[2 * count + i] = dir.unique_disk_size;
+            totals[3 * count + i] = dir.unique_allocated_disk_size;
+            ++i;
+        }
+    }
+
+    // per-directory records, one column per field
+    {
+        char *base = out.data() + header.directories_offset;
+        auto *path_hash = column_at<std::uint64_t>(base, layout.path_hash);
+        auto *mtime_sec = column_at<std::int64_t>(base, layout.mtime_sec);
+        auto *ctime_sec = column_at<std::int64_t>(base, layout.ctime_sec);
+        auto *apparent_size = column_at<std::uint64_t>(base, layout.apparent_size);
+        auto *allocated_size = column_at<std::uint64_t>(base, layout.allocated_size);
+        auto *mtime_nsec = column_at<std::uint32_t>(base, layout.mtime_nsec);
+        auto *ctime_nsec = column_at<std::uint32_t>(base, layout.ctime_nsec);
+        auto *entry_count = column_at<std::uint32_t>(base, layout.entry_count);
+        auto *flags = column_at<std::uint32_t>(base, layout.flags);
+
+        for (std::size_t i = 0; i < records.size(); ++i)
+        {
+            const auto &record = records[i];
+            path_hash[i] = record.path_hash;
+            mtime_sec[i] = record.mtime_sec;
+            ctime_sec[i] = record.ctime_sec;
+            apparent_size[i] = record.apparent_size;
+            allocated_size[i] = record.allocated_size;
+            mtime_nsec[i] = record.mtime_nsec;
+            ctime_nsec[i] = record.ctime_nsec;
+            entry_count[i] = record.entry_count;
+            flags[i] = record.flags;
+        }
+    }
+
+    std::memcpy(out.data() + header.mapping_ids_offset, mapping_ids_table.data(), mapping_ids_table.size());
+    std::memcpy(out.data() + header.mapping_paths_offset, mapping_paths_table.data(), mapping_paths_table.size());
+
+    // write into a temporary file and replace the snapshot atomically
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(out.data(), static_cast<std::streamsize>(out.size())) || !file.flush())
+        {
+            const std::error_code ec{errno != 0 ? errno : EIO, std::generic_category()};
+            std::error_code remove_ec;
+            std::filesystem::remove(temporary_path, remove_ec);
+            return ec;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary_path, path, ec);
+    return ec;
+}
+
+std::int64_t scan_snapshot_t::timestamp() const noexcept
+{
+    return this->is_open() ? reinterpret_cast<const snapshot_header_t*>(this->_data)->timestamp : 0;
+}
+
+std::uint32_t scan_snapshot_t::generation() const noexcept
+{
+    return this->is_open() ? reinterpret_cast<const snapshot_header_t*>(this->_data)->generation : 0;
+}
+
+std::size_t scan_snapshot_t::mapping_count() const noexcept
+{
+    return this->is_open() ? reinterpret_cast<const snapshot_header_t*>(this->_data)->mapping_count : 0;
+}
+
+std::string scan_snapshot_t::mapping_id(std::size_t index) const
+{
+    if (!this->is_open())
+    {
+        return {};
+    }
+    const auto *header = reinterpret_cast<const snapshot_header_t*>(this->_data);
+    return decode_front_coded(std::string_view(this->_data + header->mapping_ids_offset, header->mapping_ids_size), index);
+}
+
+std::string scan_snapshot_t::mapping_path(std::size_t index) const
+{
+    if (!this->is_open())
+    {
+        return {};
+    }
+    const auto *header = reinterpret_cast<const snapshot_header_t*>(this->_data);
+    return decode_front_coded(std::string_view(this->_data + header->mapping_paths_offset, header->mapping_paths_size), index);
+}
+
+scan_snapshot_t::mapping_totals_t scan_snapshot_t::mapping_totals(std::size_t index) const noexcept
+{
+    if (index >= this->mapping_count())
+    {
+        return {};
+    }
+
+    const auto *header = reinterpret_cast<const snapshot_header_t*>(this->_data);
+    const auto *totals = reinterpret_cast<const std::uint64_t*>(this->_data + header->mappings_offset);
+    const auto count = header->mapping_count;
+    return mapping_totals_t{
+        .apparent_size = totals[0 * count + index],
+        .allocated_size = totals[1 * count + index],
+        .unique_apparent_size = totals[2 * count + index],
+        .unique_allocated_size = totals[3 * count + index],
+    };
+}
+
+disk_usage::directory_columns_t scan_snapshot_t::directories() const noexcept
+{
+    if (!this->is_open())
+    {
+        return {};
+    }
+
+    const auto *header = reinterpret_cast<const snapshot_header_t*>(this->_data);
+    const char *base = this->_data + header->directories_offset;
+    const directory_columns_layout_t layout(header->directory_count);
+
+    return disk_usage::directory_columns_t{
+        .path_hash = column_at<const std::uint64_t>(base, layout.path_hash),
+        .mtime_sec = column_at<const std::int64_t>(base, layout.mtime_sec),
+        .ctime_sec = column_at<const std::int64_t>(base, layout.ctime_sec),
+        .mtime_nsec = column_at<const std::uint32_t>(base, layout.mtime_nsec),
+        .ctime_nsec = column_at<const std::uint32_t>(base, layout.ctime_nsec),
+        .apparent_size = column_at<const std::uint64_t>(base, layout.apparent_size),
+        .allocated_size = column_at<const std::uint64_t>(base, layout.allocated_size),
+        .entry_count = column_at<const std::uint32_t>(base, layout.entry_count),
+        .flags = column_at<const std::uint32_t>(base, layout.flags),
+        .size = header->directory_count,
+    };
+}
+
+} // namespace snapshot
+} // namespace libcachemgr
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <utils/disk_usage/directory_index.hpp>
+
+#include "../types.hpp"
+
+namespace libcachemgr {
+namespace snapshot {
+
+/**
+ * Read-only, memory-mapped snapshot of the results of a previous scan.
+ *
+ * The snapshot is a flat, versioned binary file which is used as-is after mapping it into memory,
+ * nothing is parsed or copied when opening it:
+ *
+ *  - header: magic, format version, index generation, timestamp, section offsets and counts
+ *  - per-mapping totals: one column of 64-bit integers per size type
+ *  - per-directory records: one column per field of {disk_usage::directory_record_t},
+ *    sorted by path hash, directly usable as the previous generation of the directory index
+ *  - mapping ids and scanned paths: front-coded string tables, strings share the prefix
+ *    with the previous string, every 16th string is stored completely for random access
+ *
+ * All sections are 8-byte aligned and stored in the native byte order, the snapshot is a
+ * local cache and is never shared between machines. Snapshots with a different version
+ * are rejected and rewritten after the next scan.
+ */
+class scan_snapshot_t final
+{
+public:
+    /**
+     * Totals of a single cache mapping.
+     */
+    struct mapping_totals_t final
+    {
+        std::uint64_t apparent_size{0};
+        std::uint64_t allocated_size{0};
+        std::uint64_t unique_apparent_size{0};
+        std::uint64_t unique_allocated_size{0};
+    };
+
+    scan_snapshot_t() = default;
+    ~scan_snapshot_t();
+
+    scan_snapshot_t(const scan_snapshot_t&) = delete;
+    scan_snapshot_t &operator=(const scan_snapshot_t&) = delete;
+
+    /**
+     * Maps the given snapshot file read-only into memory.
+     *
+     * A previously opened snapshot is closed first.
+     *
+     * @param path the snapshot file
+     * @return error code if the file doesn't exist, can't be mapped or has an unsupported format
+     */
+    std::error_code open(const std::string &path) noexcept;
+
+    /**
+     * Unmaps the snapshot, all views into the snapshot become dangling.
+     */
+    void close() noexcept;
+
+    /**
+     * Writes a new snapshot file.
+     *
+     * The file is replaced atomically, opened snapshots keep seeing the previous file.
+     *
+     * @param path the snapshot file
+     * @param timestamp unix timestamp of the scan
+     * @param mapped_cache_directories mapped cache directories with their calculated sizes
+     * @param index the directory index of the scan, its current generation is written
+     * @return error code if the file couldn't be written
+     */
+    static std::error_code write(const std::string &path, std::int64_t timestamp,
+        const std::list<libcachemgr::mapped_cache_directory_t> &mapped_cache_directories,
+        const disk_usage::directory_index_t &index) noexcept;
+
+    inline bool is_open() const noexcept {
+        return this->_data != nullptr;
+    }
+
+    /**
+     * Unix timestamp of the scan which created the snapshot.
+     */
+    std::int64_t timestamp() const noexcept;
+
+    /**
+     * Generation of the directory records in the snapshot.
+     */
+    std::uint32_t generation() const noexcept;
+
+    /**
+     * Number of cache mappings in the snapshot.
+     */
+    std::size_t mapping_count() const noexcept;
+
+    /**
+     * Id of the cache mapping at the given index.
+     */
+    std::string mapping_id(std::size_t index) const;
+
+    /**
+     * The scanned path (target directory or wildcard pattern) of the cache mapping at the given index.
+     */
+    std::string mapping_path(std::size_t index) const;
+
+    /**
+     * Totals of the cache mapping at the given index.
+     */
+    mapping_totals_t mapping_totals(std::size_t index) const noexcept;
+
+    /**
+     * Zero-copy view of the directory records, valid until the snapshot is closed.
+     */
+    disk_usage::directory_columns_t directories() const noexcept;
+
+private:
+    /// start of the read-only memory mapping, nullptr if not open
+    const char *_data{nullptr};
+    std::size_t _size{0};
+};
+
+} // namespace snapshot
+} // namespace libcachemgr
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <list>
+#include <vector>
 
 #include <fmt/format.h>
 
+#include <utils/fs_utils.hpp>
+
 #include "package_manager_support/pm_base.hpp"
 
 namespace libcachemgr {
@@ -48,6 +52,17 @@ enum class directory_type_t : unsigned
     wildcard = 3,
 };
 
+/**
+ * Which size of a cache directory is displayed and used for sorting.
+ */
+enum class disk_size_type_t : unsigned
+{
+    /// sum of the file sizes
+    apparent_size = 0,
+    /// space allocated on disk (`st_blocks * 512`), accounts for sparse files and compression
+    allocated_size = 1,
+};
+
 /**
  * Structure containing information about a cache directory mapping.
  */
@@ -79,9 +94,12 @@ struct mapped_cache_directory_t
     const libcachemgr::package_manager_t package_manager;
 
     /**
-     * List of resolved source files when wildcard matching is used.
+     * List of resolved source files and directories when wildcard matching is used.
+     *
+     * The sizes of regular files are captured while resolving the pattern,
+     * only directories must be scanned to calculate the disk usage.
      */
-    const std::list<std::string> resolved_source_files;
+    const std::vector<fs_utils::wildcard_match_t> resolved_source_files;
 
     /**
      * The original wildcard pattern which was used to build the list of resolved source files.
@@ -89,11 +107,58 @@ struct mapped_cache_directory_t
     const std::string wildcard_pattern;
 
     /**
-     * The size on disk of the target directory {target_path}.
+     * The bind mounted directory of a bind mount, taken from the mount table.
+     * Empty for all other directory types.
+     */
+    const std::string bind_source{};
+
+    /**
+     * The size limit of the cache directory and the size to which it is shrunk when the limit is exceeded.
+     * 0 means unlimited, see {configuration_t::cache_mapping_t::max_size}.
+     */
+    const std::uint64_t max_size{0};
+    const std::uint64_t target_size{0};
+
+    /**
+     * The apparent size of the target directory {target_path}.
      * This property can be mutated in const contexts.
      */
     mutable std::uintmax_t disk_size{0};
 
+    /**
+     * The allocated size on disk of the target directory {target_path}.
+     * This property can be mutated in const contexts.
+     */
+    mutable std::uintmax_t allocated_disk_size{0};
+
+    /**
+     * The apparent size of the target directory {target_path} without hardlinks
+     * which were already accounted in another cache mapping.
+     * This property can be mutated in const contexts.
+     */
+    mutable std::uintmax_t unique_disk_size{0};
+
+    /**
+     * The allocated size on disk of the target directory {target_path} without hardlinks
+     * which were already accounted in another cache mapping.
+     * This property can be mutated in const contexts.
+     */
+    mutable std::uintmax_t unique_allocated_disk_size{0};
+
+    /**
+     * Returns the requested size of the target directory.
+     */
+    inline constexpr std::uintmax_t disk_size_of(disk_size_type_t size_type) const {
+        return size_type == disk_size_type_t::allocated_size ? this->allocated_disk_size : this->disk_size;
+    }
+
+    /**
+     * Returns the requested unique size of the target directory.
+     */
+    inline constexpr std::uintmax_t unique_disk_size_of(disk_size_type_t size_type) const {
+        return size_type == disk_size_type_t::allocated_size ? this->unique_allocated_disk_size : this->unique_disk_size;
+    }
+
     // Implementation details:
     //  - use inclusive matching only for directory types
 
@@ -116,6 +181,14 @@ struct mapped_cache_directory_t
             this->resolved_source_files.size() > 0;
     }
 
+    /**
+     * Checks if the wildcard matches contain directories which must be scanned.
+     */
+    inline bool has_directory_matches() const {
+        return std::any_of(this->resolved_source_files.cbegin(), this->resolved_source_files.cend(),
+            [](const fs_utils::wildcard_match_t &match){ return match.is_directory; });
+    }
+
     /**
      * Returns a string optimized for printing to a terminal.
      *
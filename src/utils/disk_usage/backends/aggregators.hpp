@@ -0,0 +1,233 @@
+#pragma once
+
+#include "../disk_usage.hpp"
+#include "../inode_set.hpp"
+
+#include <concepts>
+#include <cstdint>
+#include <ctime>
+
+/**
+ * Statistics which are collected by the directory walkers of the backends.
+ *
+ * Every statistic is an aggregator type with hooks for the entries of the walk. The walkers are
+ * templates over a compile-time pack of aggregators and feed all of them during a single traversal.
+ * The hooks are resolved statically, aggregators which are not selected are not instantiated and
+ * don't cost anything during the walk.
+ */
+namespace disk_usage {
+namespace backend {
+
+/**
+ * A stat'ed regular file as seen by the aggregators.
+ */
+struct file_entry_t final
+{
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+
+    /// unix timestamps of the last access and the last modification, 0 if not available
+    std::int64_t atime{0};
+    std::int64_t mtime{0};
+
+    /// this is the first link of the inode which was seen, see {scan_options::hardlinks}
+    bool is_unique{true};
+};
+
+/**
+ * Creates the file entry of a regular file.
+ *
+ * The file is unique unless another link of the inode is already in @p hardlinks.
+ */
+inline file_entry_t make_file_entry(inode_set_t *hardlinks,
+    std::uintmax_t apparent_size, std::uintmax_t allocated_size,
+    std::uint64_t nlink, std::uint64_t dev, std::uint64_t ino,
+    std::int64_t atime = 0, std::int64_t mtime = 0)
+{
+    return file_entry_t{
+        .apparent_size = apparent_size,
+        .allocated_size = allocated_size,
+        .atime = atime,
+        .mtime = mtime,
+        .is_unique = hardlinks == nullptr || nlink <= 1 || hardlinks->insert(dev, ino),
+    };
+}
+
+/**
+ * Requirements of an aggregator.
+ *
+ * Every worker owns a copy of the aggregator, the copies are merged when the walk is finished.
+ * Aggregators are constructed from the options of the scan and publish their merged result into them.
+ */
+template<typename T>
+concept aggregator = std::copyable<T> && std::constructible_from<T, const scan_options&> &&
+    requires(T &aggregator, const T &other, const file_entry_t &file, const scan_options &options)
+{
+    /// called for every stat'ed regular file
+    aggregator.on_file(file);
+
+    /// called for every directory which was read
+    aggregator.on_dir();
+
+    /// adds the statistics of another worker
+    aggregator.merge(other);
+
+    /// stores the merged statistics in the outputs of the scan options
+    other.publish(options);
+};
+
+/**
+ * Per-thread accumulator of the sizes, aligned to avoid false sharing between workers.
+ *
+ * The sizes are the result of every scan, this aggregator is always part of the pack.
+ */
+struct alignas(64) thread_totals_t
+{
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+    std::uintmax_t unique_apparent_size{0};
+    std::uintmax_t unique_allocated_size{0};
+    std::uintmax_t reused_directories{0};
+
+    /// progress counters, see {scan_progress}
+    std::uint64_t file_count{0};
+    std::uint64_t directory_count{0};
+
+    inline void on_file(const file_entry_t &file) noexcept
+    {
+        this->apparent_size += file.apparent_size;
+        this->allocated_size += file.allocated_size;
+        ++this->file_count;
+
+        if (file.is_unique)
+        {
+            this->unique_apparent_size += file.apparent_size;
+            this->unique_allocated_size += file.allocated_size;
+        }
+    }
+
+    inline void on_dir() noexcept
+    {
+        ++this->directory_count;
+    }
+
+    inline void merge(const thread_totals_t &other) noexcept
+    {
+        this->apparent_size += other.apparent_size;
+        this->allocated_size += other.allocated_size;
+        this->unique_apparent_size += other.unique_apparent_size;
+        this->unique_allocated_size += other.unique_allocated_size;
+        this->reused_directories += other.reused_directories;
+        this->file_count += other.file_count;
+        this->directory_count += other.directory_count;
+    }
+
+    /// copies the sizes into the result of the scan
+    inline void store(scan_result &result) const noexcept
+    {
+        result.apparent_size = this->apparent_size;
+        result.allocated_size = this->allocated_size;
+        result.unique_apparent_size = this->unique_apparent_size;
+        result.unique_allocated_size = this->unique_allocated_size;
+        result.reused_directories = this->reused_directories;
+    }
+};
+
+/**
+ * Age and size histograms, see {scan_options::histograms}.
+ */
+struct histogram_aggregator_t
+{
+    explicit histogram_aggregator_t(const scan_options &options) noexcept
+    {
+        // all workers must use the same reference time
+        if (options.histograms->reference_time == 0)
+        {
+            options.histograms->reference_time = static_cast<std::int64_t>(std::time(nullptr));
+        }
+        this->histograms.reference_time = options.histograms->reference_time;
+    }
+
+    inline void on_file(const file_entry_t &file) noexcept
+    {
+        this->histograms.add(file.apparent_size, file.atime, file.mtime);
+    }
+
+    inline void on_dir() noexcept {}
+
+    inline void merge(const histogram_aggregator_t &other) noexcept
+    {
+        this->histograms.merge(other.histograms);
+    }
+
+    inline void publish(const scan_options &options) const noexcept
+    {
+        options.histograms->merge(this->histograms);
+    }
+
+    file_histograms histograms;
+};
+
+/**
+ * Compile-time pack of the aggregators of a walk, one instance per worker.
+ *
+ * The sizes are always collected, the optional aggregators are added as further bases.
+ * A pack without optional aggregators has the layout of a {thread_totals_t}, the size-only walk
+ * doesn't pay for the aggregators of other statistics.
+ */
+template<aggregator... Aggregators>
+struct aggregator_pack_t final : thread_totals_t, Aggregators...
+{
+    explicit aggregator_pack_t(const scan_options &options)
+        : thread_totals_t{}, Aggregators(options)...
+    {
+    }
+
+    /// true if the walk needs the timestamps of the files
+    static constexpr bool needs_timestamps = sizeof...(Aggregators) > 0;
+
+    inline void on_file(const file_entry_t &file) noexcept
+    {
+        thread_totals_t::on_file(file);
+        (Aggregators::on_file(file), ...);
+    }
+
+    inline void on_dir() noexcept
+    {
+        thread_totals_t::on_dir();
+        (Aggregators::on_dir(), ...);
+    }
+
+    inline void merge(const aggregator_pack_t &other) noexcept
+    {
+        thread_totals_t::merge(other);
+        (Aggregators::merge(other), ...);
+    }
+
+    inline void publish(const scan_options &options) const noexcept
+    {
+        (Aggregators::publish(options), ...);
+    }
+};
+
+static_assert(sizeof(aggregator_pack_t<>) == sizeof(thread_totals_t));
+
+/**
+ * Selects the aggregator pack for the given options and invokes @p walk with it.
+ *
+ * Only the combinations listed here are instantiated, every walker is compiled once per pack.
+ *
+ * @param walk generic callable with a template parameter for the pack, `walk.template operator()<Pack>()`
+ */
+template<typename Walk>
+inline scan_result with_aggregators(const scan_options &options, Walk &&walk)
+{
+    if (options.histograms != nullptr)
+    {
+        return walk.template operator()<aggregator_pack_t<histogram_aggregator_t>>();
+    }
+    return walk.template operator()<aggregator_pack_t<>>();
+}
+
+} // namespace backend
+} // namespace disk_usage
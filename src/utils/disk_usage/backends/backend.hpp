@@ -0,0 +1,194 @@
+#pragma once
+
+#include "../disk_usage.hpp"
+#include "../inode_set.hpp"
+#include "../subtree_breakdown.hpp"
+#include "aggregators.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../../threading/work_stealing_pool.hpp"
+
+/**
+ * Interface between the public disk usage API and the platform specific scanner backends.
+ *
+ * Exactly one backend is compiled into the library, see `src/utils/CMakeLists.txt`.
+ */
+namespace disk_usage {
+namespace backend {
+
+/**
+ * Shared state of a single scan.
+ *
+ * @tparam Pack the {aggregator_pack_t} which is fed by the walker
+ */
+template<typename Pack>
+struct scan_state_t final
+{
+    scan_state_t(threading::work_stealing_pool_t &pool, const scan_options &options)
+        : pool(pool), hardlinks(options.hardlinks), progress(options.progress),
+          totals(pool.thread_count(), Pack(options)),
+          published(options.progress != nullptr ? pool.thread_count() : 0), _options(options)
+    {}
+
+    threading::work_stealing_pool_t &pool;
+
+    /// optional set of already accounted hardlinked inodes (shared between scans)
+    inode_set_t *const hardlinks;
+
+    /// optional progress counters (shared between scans)
+    scan_progress *const progress;
+
+    /// one aggregator pack per worker thread, indexed by the worker index
+    std::vector<Pack> totals;
+
+    /// the part of {totals} which was already published to {progress}
+    std::vector<thread_totals_t> published;
+
+    /// adds the sizes which the worker accounted since @p before to the breakdown node of the directory
+    static void add_to_breakdown(subtree_breakdown_t::node_t *node, const thread_totals_t &before,
+        const thread_totals_t &after)
+    {
+        if (node != nullptr)
+        {
+            subtree_breakdown_t::add_sizes(node,
+                after.apparent_size - before.apparent_size, after.allocated_size - before.allocated_size);
+        }
+    }
+
+    /// counts a finished directory and publishes the progress of the worker since the last call
+    void finish_directory(unsigned worker_index)
+    {
+        auto &totals = this->totals[worker_index];
+        totals.on_dir();
+
+        if (this->progress == nullptr)
+        {
+            return;
+        }
+
+        auto &published = this->published[worker_index];
+        this->progress->files.fetch_add(totals.file_count - published.file_count, std::memory_order_relaxed);
+        this->progress->directories.fetch_add(totals.directory_count - published.directory_count,
+            std::memory_order_relaxed);
+        this->progress->apparent_size.fetch_add(totals.apparent_size - published.apparent_size,
+            std::memory_order_relaxed);
+        published = totals;
+    }
+
+    /// records the first error, all following errors are dropped
+    void report_error(const std::error_code &ec)
+    {
+        std::lock_guard<std::mutex> lock(this->_error_mutex);
+        if (!this->_first_error)
+        {
+            this->_first_error = ec;
+        }
+    }
+
+    /// merges the per-thread aggregators into the final scan result and the outputs of the options
+    scan_result merge() const
+    {
+        Pack merged(this->_options);
+        for (const auto &totals : this->totals)
+        {
+            merged.merge(totals);
+        }
+        merged.publish(this->_options);
+
+        scan_result result;
+        merged.store(result);
+        result.ec = this->_first_error;
+        return result;
+    }
+
+private:
+    const scan_options &_options;
+
+    std::mutex _error_mutex;
+    std::error_code _first_error;
+};
+
+/**
+ * Contents of a single directory, without descending into its subdirectories.
+ */
+struct directory_listing_t final
+{
+    /// sizes of the files directly inside of the directory (hardlinks are not deduplicated)
+    thread_totals_t totals;
+
+    /// null-terminated names of all subdirectories
+    std::string subdirectory_names;
+
+    /// number of names in {subdirectory_names}
+    std::size_t subdirectory_count{0};
+
+    /// number of entries which were stat'ed
+    std::uint64_t stat_calls{0};
+};
+
+/**
+ * Reads single directories with the primitives of the directory walker of the backend.
+ *
+ * Used by the sampling estimator, which visits directories in random order instead of walking the tree.
+ * Not thread-safe, every thread needs its own lister.
+ */
+class directory_lister_t final
+{
+public:
+    explicit directory_lister_t(bool use_io_uring);
+    ~directory_lister_t();
+
+    directory_lister_t(const directory_lister_t&) = delete;
+    directory_lister_t &operator=(const directory_lister_t&) = delete;
+
+    /**
+     * Reads the given directory.
+     *
+     * @param path the directory to read
+     * @param listing receives the contents of the directory
+     * @return error code if the directory couldn't be read, the listing is incomplete in this case
+     */
+    std::error_code list(const std::string &path, directory_listing_t &listing) noexcept;
+
+private:
+    struct impl_t;
+    std::unique_ptr<impl_t> _impl;
+};
+
+/**
+ * Backend implementation of {disk_usage::scan_directory}.
+ */
+scan_result scan_directory(const std::string &path, const scan_options &options) noexcept;
+
+/**
+ * Backend implementation of {disk_usage::stat_file}.
+ */
+scan_result stat_file(const std::string &path, inode_set_t *hardlinks) noexcept;
+
+/**
+ * Backend implementation of {disk_usage::walk_directory}.
+ */
+std::error_code walk_directory(const std::string &path, const walk_options &options,
+    const walk_visitor &visitor) noexcept;
+
+/**
+ * Backend implementation of {disk_usage::stat_entry}.
+ */
+std::error_code stat_entry(const walk_entry &entry, entry_stat &stat) noexcept;
+
+/**
+ * Backend implementation of {disk_usage::io_uring_available}.
+ */
+bool io_uring_available() noexcept;
+
+/**
+ * The name of the compiled-in backend.
+ */
+extern const char *const backend_name;
+
+} // namespace backend
+} // namespace disk_usage
@@ -0,0 +1,1072 @@
+#include "backend.hpp"
+#include "io_uring.hpp"
+#include "../directory_index.hpp"
+#include "../../os_utils.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+
+/**
+ * Linux scanner backend built on top of `openat(O_DIRECTORY)`, `getdents64` and `statx`.
+ *
+ *  - Directories are read with large `getdents64` buffers.
+ *  - The `d_type` of the directory entry decides what to do with an entry,
+ *    directories are never stat'ed.
+ *  - Regular files are stat'ed with `statx` and a minimal mask relative to the parent fd,
+ *    the apparent size and the allocated blocks are obtained with the same call.
+ *  - Optionally, the `statx` calls of a directory are submitted in batches to io_uring
+ *    and reaped from the completion queue without a system call per entry.
+ *    If io_uring is not available, `statx` is called synchronously.
+ *  - With a directory index, the files of directories with unchanged mtime and ctime are not stat'ed,
+ *    the subtotal of the previous scan is reused instead.
+ *  - No full path strings are ever built. Every worker keeps an explicit stack of open directory
+ *    fds and the subdirectory names of each level, memory usage is bounded by the depth of the
+ *    tree and the width of the directories on the current path, not by the number of entries.
+ */
+
+namespace {
+
+using disk_usage::backend::scan_state_t;
+using disk_usage::subtree_breakdown_t;
+using disk_usage::backend::thread_totals_t;
+using disk_usage::backend::aggregator_pack_t;
+using disk_usage::inode_set_t;
+using disk_usage::directory_index_t;
+using disk_usage::directory_record_t;
+using disk_usage::backend::io_uring_t;
+
+/// size of the getdents64 buffer of each worker
+constexpr std::size_t getdents_buffer_size = 128 * 1024;
+
+/// number of statx operations which are submitted to io_uring at once
+constexpr unsigned statx_batch_size = 256;
+
+/// don't spawn new tasks when the worker has this many tasks queued already
+constexpr std::size_t split_threshold = 2;
+
+/// layout of the records returned by the getdents64 system call
+struct linux_dirent64
+{
+    std::uint64_t  d_ino;
+    std::int64_t   d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+/// the minimal statx mask required to account a file
+constexpr unsigned statx_mask = STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO;
+
+/// the statx mask of a walk, the timestamps are only requested when an aggregator needs them
+template<typename Pack>
+constexpr unsigned statx_mask_of = statx_mask | (Pack::needs_timestamps ? STATX_ATIME | STATX_MTIME : 0);
+
+/// file descriptor flags for opening directories
+constexpr int open_directory_flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+/**
+ * A single level of the explicit traversal stack.
+ */
+struct directory_frame_t final
+{
+    directory_frame_t(int fd, std::uint64_t path_hash, subtree_breakdown_t::node_t *node = nullptr) noexcept
+        : fd(fd), path_hash(path_hash), node(node)
+    {
+    }
+
+    /// open file descriptor of this directory
+    int fd{-1};
+
+    /// path hash of this directory, only calculated when a directory index is used
+    std::uint64_t path_hash{0};
+
+    /// node of this directory in the subtree breakdown, only set when a breakdown is built
+    subtree_breakdown_t::node_t *node{nullptr};
+
+    /// the directory contains files with more than one link
+    bool has_hardlinks{false};
+
+    /// the directory contains entries without a `d_type`
+    bool has_unknown_types{false};
+
+    /// number of `statx` calls which were issued for the entries of this directory
+    std::uint32_t stat_calls{0};
+
+    /// null-terminated names of all subdirectories which are still to be visited
+    std::string subdirectory_names;
+
+    /// offset of the next subdirectory name in {subdirectory_names}
+    std::size_t next_subdirectory{0};
+};
+
+/**
+ * `statx` was added in Linux 4.11, fallback to `fstatat` on older kernels.
+ */
+bool stat_entry(int dirfd, const char *name, int flags, unsigned mask, struct statx &stx)
+{
+    static std::atomic<bool> has_statx{true};
+
+    if (has_statx.load(std::memory_order_relaxed))
+    {
+        if (::statx(dirfd, name, flags | AT_NO_AUTOMOUNT, mask, &stx) == 0)
+        {
+            return true;
+        }
+        else if (errno != ENOSYS)
+        {
+            return false;
+        }
+        has_statx.store(false, std::memory_order_relaxed);
+    }
+
+    struct stat st;
+    if (::fstatat(dirfd, name, &st, flags) != 0)
+    {
+        return false;
+    }
+
+    stx.stx_mask = STATX_BASIC_STATS;
+    stx.stx_mode = st.st_mode;
+    stx.stx_size = static_cast<std::uint64_t>(st.st_size);
+    stx.stx_blocks = static_cast<std::uint64_t>(st.st_blocks);
+    stx.stx_nlink = static_cast<std::uint32_t>(st.st_nlink);
+    stx.stx_ino = static_cast<std::uint64_t>(st.st_ino);
+    stx.stx_dev_major = major(st.st_dev);
+    stx.stx_dev_minor = minor(st.st_dev);
+    stx.stx_atime.tv_sec = st.st_atim.tv_sec;
+    stx.stx_atime.tv_nsec = static_cast<std::uint32_t>(st.st_atim.tv_nsec);
+    stx.stx_mtime.tv_sec = st.st_mtim.tv_sec;
+    stx.stx_mtime.tv_nsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+    stx.stx_ctime.tv_sec = st.st_ctim.tv_sec;
+    stx.stx_ctime.tv_nsec = static_cast<std::uint32_t>(st.st_ctim.tv_nsec);
+    return true;
+}
+
+/**
+ * Feeds a stat'ed regular file to the aggregators.
+ *
+ * `stx_blocks` is always in units of 512 bytes, regardless of the filesystem block size.
+ */
+template<typename Pack>
+inline void add_file(Pack &totals, inode_set_t *hardlinks, const struct statx &stx)
+{
+    totals.on_file(disk_usage::backend::make_file_entry(hardlinks,
+        stx.stx_size, stx.stx_blocks * 512, stx.stx_nlink,
+        makedev(stx.stx_dev_major, stx.stx_dev_minor), stx.stx_ino,
+        stx.stx_atime.tv_sec, stx.stx_mtime.tv_sec));
+}
+
+/**
+ * Determines how a directory entry is stat'ed and how the result is interpreted.
+ */
+enum class entry_kind_t : unsigned char
+{
+    /// `DT_REG`, stat'ed without following symbolic links
+    regular_file,
+    /// `DT_LNK`, symbolic links to regular files are counted with the size of the file they point to
+    symbolic_link,
+    /// `DT_UNKNOWN`, the filesystem doesn't support d_type, the type is determined with the stat call
+    unknown,
+};
+
+/// stat flags for the given entry kind
+inline constexpr int stat_flags_of(entry_kind_t kind) noexcept
+{
+    return kind == entry_kind_t::symbolic_link ? 0 : AT_SYMLINK_NOFOLLOW;
+}
+
+/**
+ * A batch of `statx` operations which are submitted to io_uring at once.
+ *
+ * The names point into the getdents64 buffer of the worker, the batch must be flushed
+ * before the buffer is overwritten by the next getdents64 call.
+ */
+struct statx_batch_t final
+{
+    struct entry_t final
+    {
+        const char *name;
+        entry_kind_t kind;
+        bool completed;
+    };
+
+    /// io_uring instance of the worker, nullptr when io_uring is not used
+    std::unique_ptr<disk_usage::backend::io_uring_t> ring;
+
+    std::unique_ptr<entry_t[]> entries;
+    std::unique_ptr<struct statx[]> results;
+    unsigned size{0};
+};
+
+/**
+ * Backend specific state of a single scan.
+ */
+template<typename Pack>
+struct getdents_state_t final
+{
+    scan_state_t<Pack> &state;
+
+    /// one getdents64 buffer per worker thread
+    std::vector<std::unique_ptr<char[]>> buffers;
+
+    /// one statx batch per worker thread
+    std::vector<statx_batch_t> batches;
+
+    /// optional directory index for incremental rescans
+    directory_index_t *index;
+
+    /// records of all visited directories, one list per worker thread
+    std::vector<std::vector<directory_record_t>> records;
+
+    /// optional tree of subdirectory sizes
+    subtree_breakdown_t *breakdown{nullptr};
+};
+
+/**
+ * Interprets the stat result of a directory entry.
+ *
+ * @param stx the stat result or nullptr when the stat call failed
+ * @param error the errno of the failed stat call
+ */
+template<typename Pack>
+void handle_entry(scan_state_t<Pack> &state, Pack &totals, directory_frame_t &frame,
+    const char *name, entry_kind_t kind, const struct statx *stx, int error);
+
+/**
+ * Stats the given directory entry synchronously and interprets the result.
+ */
+template<typename Pack>
+void stat_and_handle_entry(scan_state_t<Pack> &state, Pack &totals, directory_frame_t &frame,
+    const char *name, entry_kind_t kind)
+{
+    struct statx stx;
+    ++frame.stat_calls;
+    if (stat_entry(frame.fd, name, stat_flags_of(kind), statx_mask_of<Pack>, stx))
+    {
+        handle_entry(state, totals, frame, name, kind, &stx, 0);
+    }
+    else
+    {
+        handle_entry(state, totals, frame, name, kind, nullptr, errno);
+    }
+}
+
+template<typename Pack>
+void handle_entry(scan_state_t<Pack> &state, Pack &totals, directory_frame_t &frame,
+    const char *name, entry_kind_t kind, const struct statx *stx, int error)
+{
+    if (stx == nullptr)
+    {
+        // dangling symbolic links and entries removed during the scan are not an error
+        if (error != ENOENT && error != EACCES)
+        {
+            state.report_error(std::error_code{error, std::generic_category()});
+        }
+        return;
+    }
+
+    if (S_ISREG(stx->stx_mode))
+    {
+        add_file(totals, state.hardlinks, *stx);
+        frame.has_hardlinks |= stx->stx_nlink > 1;
+    }
+    else if (kind == entry_kind_t::unknown && S_ISDIR(stx->stx_mode))
+    {
+        frame.subdirectory_names.append(name, std::strlen(name) + 1);
+    }
+    else if (kind == entry_kind_t::unknown && S_ISLNK(stx->stx_mode))
+    {
+        stat_and_handle_entry(state, totals, frame, name, entry_kind_t::symbolic_link);
+    }
+}
+
+/**
+ * Submits all queued `statx` operations of the batch and interprets the results.
+ *
+ * If io_uring fails, the remaining entries are stat'ed synchronously
+ * and io_uring is not used by this worker anymore.
+ */
+template<typename Pack>
+void flush_batch(scan_state_t<Pack> &state, Pack &totals, directory_frame_t &frame, statx_batch_t &batch)
+{
+    if (batch.size == 0)
+    {
+        return;
+    }
+
+    const int ret = batch.ring->submit_and_wait();
+    batch.ring->reap_completions([&](std::uint64_t index, int res){
+        auto &entry = batch.entries[index];
+        entry.completed = true;
+        handle_entry(state, totals, frame, entry.name, entry.kind, res < 0 ? nullptr : &batch.results[index], -res);
+    });
+
+    if (ret < 0)
+    {
+        for (unsigned i = 0; i < batch.size; ++i)
+        {
+            if (!batch.entries[i].completed)
+            {
+                stat_and_handle_entry(state, totals, frame, batch.entries[i].name, batch.entries[i].kind);
+            }
+        }
+        batch.ring.reset();
+    }
+
+    batch.size = 0;
+}
+
+/**
+ * Stats the given directory entry, either queued in the io_uring batch or synchronously.
+ */
+template<typename Pack>
+void queue_entry(scan_state_t<Pack> &state, Pack &totals, directory_frame_t &frame,
+    statx_batch_t &batch, const char *name, entry_kind_t kind)
+{
+    if (!batch.ring)
+    {
+        stat_and_handle_entry(state, totals, frame, name, kind);
+        return;
+    }
+
+    if (batch.size == batch.ring->capacity())
+    {
+        flush_batch(state, totals, frame, batch);
+    }
+
+    const auto prepare = [&]{
+        return batch.ring && batch.ring->prepare_statx(frame.fd, name, stat_flags_of(kind) | AT_NO_AUTOMOUNT,
+            statx_mask_of<Pack>, &batch.results[batch.size], batch.size);
+    };
+    bool is_queued = prepare();
+    if (!is_queued && batch.ring)
+    {
+        // the submission queue is full before the batch is, submit the batch and retry with an empty queue
+        flush_batch(state, totals, frame, batch);
+        is_queued = prepare();
+    }
+
+    // io_uring failed during the flush or the queue is still full
+    if (!is_queued)
+    {
+        stat_and_handle_entry(state, totals, frame, name, kind);
+        return;
+    }
+
+    ++frame.stat_calls;
+    batch.entries[batch.size++] = statx_batch_t::entry_t{
+        .name = name,
+        .kind = kind,
+        .completed = false,
+    };
+}
+
+/**
+ * Reads all entries of the directory in the given frame.
+ *
+ * Files are accounted immediately, subdirectory names are collected in the frame.
+ *
+ * @param account_files stat and account the files, otherwise only the subdirectories are collected
+ * @param entry_count receives the number of entries (without "." and "..")
+ * @return false if the directory couldn't be read completely
+ */
+template<typename Pack>
+bool read_directory(getdents_state_t<Pack> &gd_state, directory_frame_t &frame, unsigned worker_index,
+    bool account_files, std::uint32_t &entry_count)
+{
+    auto &state = gd_state.state;
+    auto &totals = state.totals[worker_index];
+    auto &batch = gd_state.batches[worker_index];
+    char *buffer = gd_state.buffers[worker_index].get();
+
+    while (true)
+    {
+        const auto bytes_read = ::syscall(SYS_getdents64, frame.fd, buffer, getdents_buffer_size);
+        if (bytes_read == 0)
+        {
+            return true;
+        }
+        else if (bytes_read < 0)
+        {
+            state.report_error(std::error_code{errno, std::generic_category()});
+            return false;
+        }
+
+        for (long offset = 0; offset < bytes_read;)
+        {
+            const auto *entry = reinterpret_cast<const linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+
+            // skip "." and ".."
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            ++entry_count;
+
+            switch (entry->d_type)
+            {
+                case DT_DIR:
+                    frame.subdirectory_names.append(name, std::strlen(name) + 1);
+                    break;
+
+                case DT_REG:
+                    if (account_files)
+                    {
+                        queue_entry(state, totals, frame, batch, name, entry_kind_t::regular_file);
+                    }
+                    break;
+
+                case DT_LNK:
+                    if (account_files)
+                    {
+                        queue_entry(state, totals, frame, batch, name, entry_kind_t::symbolic_link);
+                    }
+                    break;
+
+                case DT_UNKNOWN:
+                    frame.has_unknown_types = true;
+                    if (account_files)
+                    {
+                        queue_entry(state, totals, frame, batch, name, entry_kind_t::unknown);
+                    }
+                    break;
+
+                // sockets, fifos and devices don't occupy disk space
+                default:
+                    break;
+            }
+        }
+
+        // the names in the batch point into the buffer which is reused by the next getdents64 call
+        flush_batch(state, totals, frame, batch);
+    }
+}
+
+/**
+ * Checks if the metadata of the directory is the same as in the record.
+ */
+inline bool is_unchanged(const directory_record_t &record, const struct statx &stx)
+{
+    return record.mtime_sec == stx.stx_mtime.tv_sec && record.mtime_nsec == stx.stx_mtime.tv_nsec &&
+        record.ctime_sec == stx.stx_ctime.tv_sec && record.ctime_nsec == stx.stx_ctime.tv_nsec;
+}
+
+/**
+ * Reads the directory in the given frame and records it in the directory index.
+ *
+ * If the directory is unchanged since the previous scan, only the subdirectories are collected
+ * and the subtotal of the files is taken from the index.
+ */
+template<typename Pack>
+void visit_directory(getdents_state_t<Pack> &gd_state, directory_frame_t &frame, unsigned worker_index)
+{
+    std::uint32_t entry_count = 0;
+
+    auto *index = gd_state.index;
+    if (index == nullptr)
+    {
+        read_directory(gd_state, frame, worker_index, true, entry_count);
+        return;
+    }
+
+    auto &state = gd_state.state;
+    auto &totals = state.totals[worker_index];
+
+    // the metadata must be obtained before reading the directory,
+    // changes during the scan are detected in the next scan
+    struct statx dir_stx;
+    if (!stat_entry(frame.fd, "", AT_EMPTY_PATH, STATX_MTIME | STATX_CTIME, dir_stx))
+    {
+        state.report_error(std::error_code{errno, std::generic_category()});
+        read_directory(gd_state, frame, worker_index, true, entry_count);
+        return;
+    }
+
+    // aggregators which need the timestamps of every file can't reuse unchanged directories
+    const auto previous = index->find(frame.path_hash);
+    if (previous && !Pack::needs_timestamps && (previous->flags & directory_record_t::flag_not_reusable) == 0 &&
+        is_unchanged(*previous, dir_stx) && !index->must_verify(frame.path_hash))
+    {
+        if (read_directory(gd_state, frame, worker_index, false, entry_count) &&
+            entry_count == previous->entry_count && !frame.has_unknown_types)
+        {
+            // hardlinked files are never reused, all sizes are unique
+            totals.apparent_size += previous->apparent_size;
+            totals.allocated_size += previous->allocated_size;
+            totals.unique_apparent_size += previous->apparent_size;
+            totals.unique_allocated_size += previous->allocated_size;
+            ++totals.reused_directories;
+            gd_state.records[worker_index].emplace_back(*previous);
+            return;
+        }
+
+        // the directory changed without updating its metadata, read it again
+        ::lseek(frame.fd, 0, SEEK_SET);
+        frame.subdirectory_names.clear();
+        frame.has_unknown_types = false;
+        entry_count = 0;
+    }
+
+    const auto apparent_size_before = totals.apparent_size;
+    const auto allocated_size_before = totals.allocated_size;
+
+    if (read_directory(gd_state, frame, worker_index, true, entry_count))
+    {
+        gd_state.records[worker_index].emplace_back(directory_record_t{
+            .path_hash = frame.path_hash,
+            .mtime_sec = dir_stx.stx_mtime.tv_sec,
+            .ctime_sec = dir_stx.stx_ctime.tv_sec,
+            .mtime_nsec = dir_stx.stx_mtime.tv_nsec,
+            .ctime_nsec = dir_stx.stx_ctime.tv_nsec,
+            .apparent_size = totals.apparent_size - apparent_size_before,
+            .allocated_size = totals.allocated_size - allocated_size_before,
+            .entry_count = entry_count,
+            .flags = frame.has_hardlinks || frame.has_unknown_types ? directory_record_t::flag_not_reusable : 0,
+        });
+    }
+}
+
+/**
+ * Traverses the directory tree below the given directory fd (takes ownership of the fd).
+ *
+ * Subdirectories are either visited by this worker using the explicit stack, or are handed
+ * over to the thread pool as a new task when the worker doesn't have enough queued work.
+ */
+template<typename Pack>
+void scan_directory_task(getdents_state_t<Pack> &gd_state, int root_fd, std::uint64_t root_hash,
+    subtree_breakdown_t::node_t *root_node, unsigned worker_index)
+{
+    auto &state = gd_state.state;
+    const bool can_split = state.pool.thread_count() > 1;
+
+    const auto visit = [&gd_state, &state, worker_index](directory_frame_t &frame) {
+        const thread_totals_t before = state.totals[worker_index];
+        visit_directory(gd_state, frame, worker_index);
+        scan_state_t<Pack>::add_to_breakdown(frame.node, before, state.totals[worker_index]);
+        state.finish_directory(worker_index);
+    };
+
+    std::vector<directory_frame_t> stack;
+    stack.emplace_back(root_fd, root_hash, root_node);
+    visit(stack.back());
+
+    while (!stack.empty())
+    {
+        auto &frame = stack.back();
+
+        // all subdirectories of this level are visited, go up one level
+        if (frame.next_subdirectory >= frame.subdirectory_names.size())
+        {
+            ::close(frame.fd);
+            stack.pop_back();
+            continue;
+        }
+
+        const char *name = frame.subdirectory_names.data() + frame.next_subdirectory;
+        frame.next_subdirectory += std::strlen(name) + 1;
+
+        const int child_fd = ::openat(frame.fd, name, open_directory_flags);
+        if (child_fd < 0)
+        {
+            // permission errors are skipped, entries can also disappear or be replaced during the scan
+            if (errno != EACCES && errno != ENOENT && errno != ENOTDIR && errno != ELOOP)
+            {
+                state.report_error(std::error_code{errno, std::generic_category()});
+            }
+            continue;
+        }
+
+        const auto child_hash = gd_state.index != nullptr ?
+            directory_index_t::hash_child(frame.path_hash, name) : 0;
+        auto *child_node = frame.node != nullptr ?
+            gd_state.breakdown->add_child(worker_index, frame.node, name) : nullptr;
+
+        // hand the subdirectory over to another worker
+        if (can_split && state.pool.queued_tasks(worker_index) < split_threshold)
+        {
+            state.pool.submit([&gd_state, child_fd, child_hash, child_node](unsigned worker_index){
+                scan_directory_task(gd_state, child_fd, child_hash, child_node, worker_index);
+            });
+            continue;
+        }
+
+        // descend into the subdirectory (invalidates {frame})
+        stack.emplace_back(child_fd, child_hash, child_node);
+        visit(stack.back());
+    }
+}
+
+/**
+ * Shared state of a single walk, see {disk_usage::walk_directory}.
+ */
+struct walk_state_t final
+{
+    threading::work_stealing_pool_t &pool;
+    const disk_usage::walk_visitor &visitor;
+
+    /// one getdents64 buffer per worker thread
+    std::vector<std::unique_ptr<char[]>> buffers;
+
+    std::mutex error_mutex;
+    std::error_code first_error;
+
+    /// records the first error, all following errors are dropped
+    void report_error(int error)
+    {
+        std::lock_guard<std::mutex> lock(this->error_mutex);
+        if (!this->first_error)
+        {
+            this->first_error = std::error_code{error, std::generic_category()};
+        }
+    }
+};
+
+/**
+ * A single level of the explicit traversal stack of a walk.
+ *
+ * Unlike the scanner, the walk keeps the path of every level, the visitor needs it to report entries.
+ */
+struct walk_frame_t final
+{
+    walk_frame_t(int fd, std::string path, std::uint64_t state) noexcept
+        : fd(fd), path(std::move(path)), state(state)
+    {
+    }
+
+    /// open file descriptor of this directory
+    int fd{-1};
+
+    /// path of this directory
+    std::string path;
+
+    /// state of this directory which was returned by the visitor
+    std::uint64_t state{0};
+
+    /// null-terminated names of all subdirectories which are still to be visited
+    std::string subdirectory_names;
+
+    /// the visitor states of the subdirectories, in the order of {subdirectory_names}
+    std::vector<std::uint64_t> subdirectory_states;
+
+    /// offset of the next subdirectory name in {subdirectory_names} and index of its state
+    std::size_t next_subdirectory{0};
+    std::size_t next_state{0};
+};
+
+/**
+ * Joins a directory path and a file name, without doubling the separator of the root directory.
+ */
+inline std::string join_path(const std::string &directory, std::string_view name)
+{
+    std::string path;
+    path.reserve(directory.size() + name.size() + 1);
+    path.append(directory);
+    if (!path.empty() && path.back() != '/')
+    {
+        path.push_back('/');
+    }
+    path.append(name);
+    return path;
+}
+
+/**
+ * Determines the entry type from the `d_type` of a directory entry, stats the entry if it is unknown.
+ *
+ * @return false if the entry disappeared or couldn't be stat'ed
+ */
+bool entry_type_of(walk_state_t &state, int dirfd, const char *name, unsigned char d_type,
+    disk_usage::entry_type &type)
+{
+    using disk_usage::entry_type;
+
+    mode_t mode = 0;
+    switch (d_type)
+    {
+        case DT_DIR: type = entry_type::directory; return true;
+        case DT_REG: type = entry_type::regular_file; return true;
+        case DT_LNK: type = entry_type::symbolic_link; return true;
+        case DT_UNKNOWN:
+        {
+            struct statx stx;
+            if (!stat_entry(dirfd, name, AT_SYMLINK_NOFOLLOW, STATX_TYPE, stx))
+            {
+                if (errno != ENOENT && errno != EACCES)
+                {
+                    state.report_error(errno);
+                }
+                return false;
+            }
+            mode = stx.stx_mode;
+            break;
+        }
+        default: type = entry_type::other; return true;
+    }
+
+    type = S_ISDIR(mode) ? entry_type::directory :
+        S_ISREG(mode) ? entry_type::regular_file :
+        S_ISLNK(mode) ? entry_type::symbolic_link : entry_type::other;
+    return true;
+}
+
+/**
+ * Reads all entries of the directory in the given frame and passes them to the visitor.
+ *
+ * The subdirectories which the visitor selected are collected in the frame.
+ */
+void walk_read_directory(walk_state_t &state, walk_frame_t &frame, unsigned worker_index)
+{
+    char *buffer = state.buffers[worker_index].get();
+
+    while (true)
+    {
+        const auto bytes_read = ::syscall(SYS_getdents64, frame.fd, buffer, getdents_buffer_size);
+        if (bytes_read == 0)
+        {
+            return;
+        }
+        else if (bytes_read < 0)
+        {
+            state.report_error(errno);
+            return;
+        }
+
+        for (long offset = 0; offset < bytes_read;)
+        {
+            const auto *entry = reinterpret_cast<const linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+
+            // skip "." and ".."
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            disk_usage::entry_type type;
+            if (!entry_type_of(state, frame.fd, name, entry->d_type, type))
+            {
+                continue;
+            }
+
+            const std::string_view name_view{name};
+            const auto child_state = state.visitor(disk_usage::walk_entry{
+                .directory = frame.path,
+                .name = name_view,
+                .type = type,
+                .parent_state = frame.state,
+                .directory_handle = frame.fd,
+            });
+
+            if (type == disk_usage::entry_type::directory && child_state != 0)
+            {
+                frame.subdirectory_names.append(name_view.data(), name_view.size() + 1);
+                frame.subdirectory_states.emplace_back(child_state);
+            }
+        }
+    }
+}
+
+/**
+ * Walks the directory tree below the given directory fd (takes ownership of the fd),
+ * same traversal and work splitting as {scan_directory_task}.
+ */
+void walk_directory_task(walk_state_t &state, int root_fd, std::string root_path, std::uint64_t root_state,
+    unsigned worker_index)
+{
+    const bool can_split = state.pool.thread_count() > 1;
+
+    std::vector<walk_frame_t> stack;
+    stack.emplace_back(root_fd, std::move(root_path), root_state);
+    walk_read_directory(state, stack.back(), worker_index);
+
+    while (!stack.empty())
+    {
+        auto &frame = stack.back();
+
+        // all subdirectories of this level are visited, go up one level
+        if (frame.next_subdirectory >= frame.subdirectory_names.size())
+        {
+            ::close(frame.fd);
+            stack.pop_back();
+            continue;
+        }
+
+        const char *name = frame.subdirectory_names.data() + frame.next_subdirectory;
+        frame.next_subdirectory += std::strlen(name) + 1;
+        const auto child_state = frame.subdirectory_states[frame.next_state++];
+
+        const int child_fd = ::openat(frame.fd, name, open_directory_flags);
+        if (child_fd < 0)
+        {
+            // permission errors are skipped, entries can also disappear or be replaced during the walk
+            if (errno != EACCES && errno != ENOENT && errno != ENOTDIR && errno != ELOOP)
+            {
+                state.report_error(errno);
+            }
+            continue;
+        }
+
+        auto child_path = join_path(frame.path, name);
+
+        // hand the subdirectory over to another worker
+        if (can_split && state.pool.queued_tasks(worker_index) < split_threshold)
+        {
+            state.pool.submit([&state, child_fd, child_path = std::move(child_path), child_state](unsigned worker_index){
+                walk_directory_task(state, child_fd, std::move(child_path), child_state, worker_index);
+            });
+            continue;
+        }
+
+        // descend into the subdirectory (invalidates {frame})
+        stack.emplace_back(child_fd, std::move(child_path), child_state);
+        walk_read_directory(state, stack.back(), worker_index);
+    }
+}
+
+} // anonymous namespace
+
+namespace disk_usage {
+namespace backend {
+
+const char *const backend_name = "getdents";
+
+scan_result scan_directory(const std::string &path, const scan_options &options) noexcept
+{
+    const int root_fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+    {
+        scan_result result;
+
+        // not a directory is not an error, there is just nothing to calculate
+        if (errno != ENOTDIR)
+        {
+            result.ec = std::error_code{errno, std::generic_category()};
+        }
+        return result;
+    }
+
+    os_utils::raise_open_file_limit();
+
+    return with_aggregators(options, [&]<typename Pack>() {
+        threading::work_stealing_pool_t pool(options.thread_count);
+        scan_state_t<Pack> state(pool, options);
+        getdents_state_t<Pack> gd_state{
+            .state = state,
+            .buffers = {},
+            .batches = {},
+            .index = options.index,
+            .records = {},
+            .breakdown = options.breakdown,
+        };
+
+        gd_state.buffers.reserve(pool.thread_count());
+        gd_state.batches.resize(pool.thread_count());
+        gd_state.records.resize(options.index != nullptr ? pool.thread_count() : 0);
+        for (unsigned i = 0; i < pool.thread_count(); ++i)
+        {
+            gd_state.buffers.emplace_back(std::make_unique<char[]>(getdents_buffer_size));
+
+            // every worker gets its own ring, workers without a ring fallback to synchronous statx calls
+            if (auto &batch = gd_state.batches[i]; options.use_io_uring)
+            {
+                batch.ring = io_uring_t::create(statx_batch_size);
+                if (batch.ring)
+                {
+                    batch.entries = std::make_unique<statx_batch_t::entry_t[]>(batch.ring->capacity());
+                    batch.results = std::make_unique<struct statx[]>(batch.ring->capacity());
+                }
+            }
+        }
+
+        const auto root_hash = options.index != nullptr ? directory_index_t::hash_path(path) : 0;
+        auto *root_node = options.breakdown != nullptr ? options.breakdown->reset(path, pool.thread_count()) : nullptr;
+        pool.submit([&gd_state, root_fd, root_hash, root_node](unsigned worker_index){
+            scan_directory_task(gd_state, root_fd, root_hash, root_node, worker_index);
+        });
+        pool.wait();
+
+        for (const auto &records : gd_state.records)
+        {
+            options.index->add_records(records);
+        }
+
+        return state.merge();
+    });
+}
+
+std::error_code walk_directory(const std::string &path, const walk_options &options,
+    const walk_visitor &visitor) noexcept
+{
+    const int root_fd = ::open(path.c_str(), open_directory_flags & ~O_NOFOLLOW);
+    if (root_fd < 0)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    os_utils::raise_open_file_limit();
+
+    threading::work_stealing_pool_t pool(options.thread_count);
+    walk_state_t state{
+        .pool = pool,
+        .visitor = visitor,
+        .buffers = {},
+        .error_mutex = {},
+        .first_error = {},
+    };
+    state.buffers.reserve(pool.thread_count());
+    for (unsigned i = 0; i < pool.thread_count(); ++i)
+    {
+        state.buffers.emplace_back(std::make_unique<char[]>(getdents_buffer_size));
+    }
+
+    pool.submit([&state, root_fd, &path, root_state = options.root_state](unsigned worker_index){
+        walk_directory_task(state, root_fd, path, root_state, worker_index);
+    });
+    pool.wait();
+
+    return state.first_error;
+}
+
+std::error_code stat_entry(const walk_entry &entry, entry_stat &stat) noexcept
+{
+    constexpr unsigned mask =
+        STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_MTIME | STATX_ATIME | STATX_NLINK | STATX_INO;
+
+    // during a walk, the name points into the getdents64 buffer and is null-terminated
+    struct statx stx;
+    const bool is_ok = entry.directory_handle >= 0 ?
+        ::stat_entry(static_cast<int>(entry.directory_handle), entry.name.data(), 0, mask, stx) :
+        ::stat_entry(AT_FDCWD, join_path(std::string{entry.directory}, entry.name).c_str(), 0, mask, stx);
+    if (!is_ok)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    const bool is_regular_file = S_ISREG(stx.stx_mode);
+    stat = entry_stat{
+        .type = is_regular_file ? entry_type::regular_file :
+            S_ISDIR(stx.stx_mode) ? entry_type::directory : entry_type::other,
+        .apparent_size = is_regular_file ? stx.stx_size : 0,
+        .allocated_size = is_regular_file ? stx.stx_blocks * 512 : 0,
+        .mtime = stx.stx_mtime.tv_sec,
+        .atime = stx.stx_atime.tv_sec,
+        .device = makedev(stx.stx_dev_major, stx.stx_dev_minor),
+        .inode = stx.stx_ino,
+        .link_count = stx.stx_nlink,
+    };
+    return {};
+}
+
+bool io_uring_available() noexcept
+{
+    return io_uring_t::is_available();
+}
+
+/**
+ * A single-worker scan state, the directory is read by the same function as during a scan.
+ */
+struct directory_lister_t::impl_t final
+{
+    using pack_t = aggregator_pack_t<>;
+
+    explicit impl_t(bool use_io_uring)
+        : pool(1), state(pool, options), gd_state{
+            .state = state,
+            .buffers = {},
+            .batches = std::vector<statx_batch_t>(1),
+            .index = nullptr,
+            .records = {},
+            .breakdown = nullptr,
+        }
+    {
+        gd_state.buffers.emplace_back(std::make_unique<char[]>(getdents_buffer_size));
+        if (auto &batch = gd_state.batches[0]; use_io_uring)
+        {
+            batch.ring = io_uring_t::create(statx_batch_size);
+            if (batch.ring)
+            {
+                batch.entries = std::make_unique<statx_batch_t::entry_t[]>(batch.ring->capacity());
+                batch.results = std::make_unique<struct statx[]>(batch.ring->capacity());
+            }
+        }
+    }
+
+    const disk_usage::scan_options options{};
+    threading::work_stealing_pool_t pool;
+    scan_state_t<pack_t> state;
+    getdents_state_t<pack_t> gd_state;
+};
+
+directory_lister_t::directory_lister_t(bool use_io_uring)
+    : _impl(std::make_unique<impl_t>(use_io_uring))
+{
+}
+
+directory_lister_t::~directory_lister_t() = default;
+
+std::error_code directory_lister_t::list(const std::string &path, directory_listing_t &listing) noexcept
+{
+    const int fd = ::open(path.c_str(), open_directory_flags);
+    if (fd < 0)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    auto &totals = this->_impl->state.totals[0];
+    static_cast<thread_totals_t&>(totals) = thread_totals_t{};
+
+    directory_frame_t frame(fd, 0);
+    std::uint32_t entry_count = 0;
+    const bool is_complete = read_directory(this->_impl->gd_state, frame, 0, true, entry_count);
+    const int error = errno;
+    ::close(fd);
+
+    listing.totals = totals;
+    listing.subdirectory_count = 0;
+    for (const char c : frame.subdirectory_names)
+    {
+        listing.subdirectory_count += c == '\0';
+    }
+    listing.stat_calls = frame.stat_calls;
+    listing.subdirectory_names = std::move(frame.subdirectory_names);
+
+    return is_complete ? std::error_code{} : std::error_code{error, std::generic_category()};
+}
+
+scan_result stat_file(const std::string &path, inode_set_t *hardlinks) noexcept
+{
+    scan_result result;
+
+    struct statx stx;
+    if (!::stat_entry(AT_FDCWD, path.c_str(), 0, statx_mask, stx))
+    {
+        result.ec = std::error_code{errno, std::generic_category()};
+    }
+    else if (S_ISREG(stx.stx_mode))
+    {
+        thread_totals_t totals;
+        add_file(totals, hardlinks, stx);
+        totals.store(result);
+    }
+
+    return result;
+}
+
+} // namespace backend
+} // namespace disk_usage
@@ -0,0 +1,242 @@
+#include "io_uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int sys_io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+/**
+ * Checks if the kernel supports `IORING_OP_STATX` on the given ring.
+ */
+bool supports_statx(int ring_fd)
+{
+    constexpr unsigned probe_ops = 256;
+    std::vector<unsigned char> buffer(sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op), 0);
+    auto *probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, probe_ops) < 0)
+    {
+        return false;
+    }
+
+    return probe->last_op >= IORING_OP_STATX &&
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+} // anonymous namespace
+
+namespace disk_usage {
+namespace backend {
+
+std::unique_ptr<io_uring_t> io_uring_t::create(unsigned entries) noexcept
+{
+    if (!is_available())
+    {
+        return nullptr;
+    }
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    const int ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring_fd < 0)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<io_uring_t> ring(new io_uring_t());
+    ring->_ring_fd = ring_fd;
+
+    // map the submission and completion queue rings (a single mapping on Linux 5.4 and later)
+    ring->_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        ring->_sq_ring_size = ring->_cq_ring_size = std::max(ring->_sq_ring_size, ring->_cq_ring_size);
+    }
+
+    ring->_sq_ring_ptr = ::mmap(nullptr, ring->_sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring->_sq_ring_ptr == MAP_FAILED)
+    {
+        ring->_sq_ring_ptr = nullptr;
+        return nullptr;
+    }
+
+    if (single_mmap)
+    {
+        ring->_cq_ring_ptr = ring->_sq_ring_ptr;
+    }
+    else
+    {
+        ring->_cq_ring_ptr = ::mmap(nullptr, ring->_cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (ring->_cq_ring_ptr == MAP_FAILED)
+        {
+            ring->_cq_ring_ptr = nullptr;
+            return nullptr;
+        }
+    }
+
+    ring->_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes_ptr = ::mmap(nullptr, ring->_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    ring->_sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+    auto *sq_ptr = static_cast<char*>(ring->_sq_ring_ptr);
+    ring->_sq_tail = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.tail);
+    ring->_sq_array = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.array);
+    ring->_sq_mask = *reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.ring_mask);
+    ring->_sq_entries = params.sq_entries;
+
+    auto *cq_ptr = static_cast<char*>(ring->_cq_ring_ptr);
+    ring->_cq_head = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.head);
+    ring->_cq_tail = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.tail);
+    ring->_cq_mask = *reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.ring_mask);
+    ring->_cqes = reinterpret_cast<io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+
+    return ring;
+}
+
+bool io_uring_t::is_available() noexcept
+{
+    static const bool available = []{
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        const int ring_fd = sys_io_uring_setup(1, &params);
+        if (ring_fd < 0)
+        {
+            return false;
+        }
+
+        const bool has_statx = supports_statx(ring_fd);
+        ::close(ring_fd);
+        return has_statx;
+    }();
+
+    return available;
+}
+
+io_uring_t::~io_uring_t()
+{
+    if (this->_sqes != nullptr)
+    {
+        ::munmap(this->_sqes, this->_sqes_size);
+    }
+    if (this->_cq_ring_ptr != nullptr && this->_cq_ring_ptr != this->_sq_ring_ptr)
+    {
+        ::munmap(this->_cq_ring_ptr, this->_cq_ring_size);
+    }
+    if (this->_sq_ring_ptr != nullptr)
+    {
+        ::munmap(this->_sq_ring_ptr, this->_sq_ring_size);
+    }
+    if (this->_ring_fd >= 0)
+    {
+        ::close(this->_ring_fd);
+    }
+}
+
+bool io_uring_t::prepare_statx(int dirfd, const char *path, int flags, unsigned mask,
+    struct statx *buffer, std::uint64_t user_data) noexcept
+{
+    if (this->_sq_pending + this->_in_flight >= this->_sq_entries)
+    {
+        return false;
+    }
+
+    // the submission queue tail is only written by this thread
+    const auto tail = *this->_sq_tail;
+    const auto index = tail & this->_sq_mask;
+
+    auto &sqe = this->_sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_STATX;
+    sqe.fd = dirfd;
+    sqe.addr = reinterpret_cast<std::uint64_t>(path);
+    sqe.len = mask;
+    sqe.off = reinterpret_cast<std::uint64_t>(buffer);
+    sqe.statx_flags = static_cast<std::uint32_t>(flags);
+    sqe.user_data = user_data;
+
+    this->_sq_array[index] = index;
+    store_release(this->_sq_tail, tail + 1);
+    ++this->_sq_pending;
+
+    return true;
+}
+
+int io_uring_t::submit_and_wait() noexcept
+{
+    // submit everything and wait for all completions in the same system call,
+    // the kernel doesn't wait when not all entries could be submitted
+    while (this->_sq_pending > 0)
+    {
+        const int submitted = sys_io_uring_enter(this->_ring_fd,
+            this->_sq_pending, this->_in_flight + this->_sq_pending, IORING_ENTER_GETEVENTS);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        this->_sq_pending -= static_cast<unsigned>(submitted);
+        this->_in_flight += static_cast<unsigned>(submitted);
+    }
+
+    // wait for the remaining completions (interrupted waits)
+    while (load_acquire(this->_cq_tail) - *this->_cq_head < this->_in_flight)
+    {
+        if (sys_io_uring_enter(this->_ring_fd, 0, this->_in_flight, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            return -errno;
+        }
+    }
+
+    return 0;
+}
+
+unsigned io_uring_t::load_acquire(const unsigned *ptr) noexcept
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void io_uring_t::store_release(unsigned *ptr, unsigned value) noexcept
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+} // namespace backend
+} // namespace disk_usage
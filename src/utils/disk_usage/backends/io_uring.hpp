@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+struct statx;
+
+namespace disk_usage {
+namespace backend {
+
+/**
+ * Minimal io_uring instance built directly on top of the raw system calls.
+ *
+ * Only supports what the directory scanner needs: batched `IORING_OP_STATX` submissions
+ * which are reaped from the completion queue without a system call per entry.
+ *
+ * An instance must only be used by a single thread.
+ */
+class io_uring_t final
+{
+public:
+    /**
+     * Creates a new io_uring instance with the given number of submission queue entries.
+     *
+     * Returns nullptr when io_uring is not available: kernels without io_uring or without
+     * `IORING_OP_STATX` support (before Linux 5.6), or io_uring disabled by the system
+     * administrator (`kernel.io_uring_disabled`, seccomp filters in containers).
+     *
+     * @param entries number of submission queue entries (rounded up to a power of two by the kernel)
+     * @return io_uring instance or nullptr if not available
+     */
+    static std::unique_ptr<io_uring_t> create(unsigned entries) noexcept;
+
+    /**
+     * Checks once per process if io_uring with `IORING_OP_STATX` support is available.
+     */
+    static bool is_available() noexcept;
+
+    ~io_uring_t();
+
+    io_uring_t(const io_uring_t&) = delete;
+    io_uring_t &operator=(const io_uring_t&) = delete;
+
+    /**
+     * Maximum number of entries which can be queued before {submit_and_wait} must be called.
+     */
+    inline unsigned capacity() const noexcept {
+        return this->_sq_entries;
+    }
+
+    /**
+     * Queues a `statx` operation, the equivalent of `statx(dirfd, path, flags, mask, buffer)`.
+     *
+     * The @p path and @p buffer must stay valid until the completion was reaped.
+     *
+     * @return false the submission queue is full, nothing was queued
+     */
+    [[nodiscard]] bool prepare_statx(int dirfd, const char *path, int flags, unsigned mask,
+        struct statx *buffer, std::uint64_t user_data) noexcept;
+
+    /**
+     * Submits all queued operations and waits until all of them are completed.
+     *
+     * @return 0 on success, a negative errno on failure
+     */
+    int submit_and_wait() noexcept;
+
+    /**
+     * Reaps all available completions.
+     *
+     * The callback receives the `user_data` of the operation and the result
+     * (0 on success, a negative errno on failure).
+     */
+    template<typename Callback>
+    void reap_completions(Callback &&callback) noexcept
+    {
+        auto head = *this->_cq_head;
+        const auto tail = load_acquire(this->_cq_tail);
+        for (; head != tail; ++head)
+        {
+            const auto &cqe = this->_cqes[head & this->_cq_mask];
+            callback(cqe.user_data, cqe.res);
+            --this->_in_flight;
+        }
+        store_release(this->_cq_head, head);
+    }
+
+private:
+    io_uring_t() = default;
+
+    static unsigned load_acquire(const unsigned *ptr) noexcept;
+    static void store_release(unsigned *ptr, unsigned value) noexcept;
+
+    int _ring_fd{-1};
+
+    // memory mappings of the kernel ring buffers
+    void *_sq_ring_ptr{nullptr};
+    std::size_t _sq_ring_size{0};
+    void *_cq_ring_ptr{nullptr};
+    std::size_t _cq_ring_size{0};
+    io_uring_sqe *_sqes{nullptr};
+    std::size_t _sqes_size{0};
+
+    // submission queue
+    unsigned *_sq_tail{nullptr};
+    unsigned *_sq_array{nullptr};
+    unsigned _sq_mask{0};
+    unsigned _sq_entries{0};
+
+    /// number of queued operations which are not submitted yet
+    unsigned _sq_pending{0};
+
+    // completion queue
+    unsigned *_cq_head{nullptr};
+    unsigned *_cq_tail{nullptr};
+    unsigned _cq_mask{0};
+    io_uring_cqe *_cqes{nullptr};
+
+    /// number of submitted operations which are not completed yet
+    unsigned _in_flight{0};
+};
+
+} // namespace backend
+} // namespace disk_usage
@@ -0,0 +1,358 @@
+#include "backend.hpp"
+
+#include <filesystem>
+#include <mutex>
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using disk_usage::backend::scan_state_t;
+using disk_usage::backend::thread_totals_t;
+using disk_usage::backend::make_file_entry;
+using disk_usage::inode_set_t;
+
+/**
+ * Feeds a regular file to the aggregators.
+ *
+ * std::filesystem has no API for the allocated size, the inode and the access time, use `stat` where available.
+ * Otherwise the allocated size falls back to the apparent size, hardlinks are not deduplicated
+ * and the timestamps are not available.
+ */
+template<typename Pack>
+void add_file(Pack &totals, inode_set_t *hardlinks, const fs::path &path, std::uintmax_t file_size)
+{
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+    {
+        totals.on_file(make_file_entry(hardlinks,
+            file_size, static_cast<std::uintmax_t>(st.st_blocks) * 512,
+            st.st_nlink, st.st_dev, st.st_ino, st.st_atim.tv_sec, st.st_mtim.tv_sec));
+        return;
+    }
+#endif
+    totals.on_file(make_file_entry(hardlinks, file_size, file_size, 1, 0, 0));
+}
+
+/**
+ * Scans the direct children of the given directory.
+ *
+ * Regular files are summed up, subdirectories are submitted as new tasks.
+ */
+template<typename Pack>
+void scan_directory_task(scan_state_t<Pack> &state, const fs::path &directory,
+    disk_usage::subtree_breakdown_t *breakdown, disk_usage::subtree_breakdown_t::node_t *node, unsigned worker_index)
+{
+    auto &totals = state.totals[worker_index];
+    const thread_totals_t before = totals;
+
+    std::error_code ec;
+    fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+    if (ec)
+    {
+        state.report_error(ec);
+        return;
+    }
+
+    for (const fs::directory_iterator end; it != end; it.increment(ec))
+    {
+        if (ec)
+        {
+            // reported below, the files accounted so far are still added to the breakdown
+            break;
+        }
+
+        const auto &entry = *it;
+        std::error_code ec_entry;
+
+        // note: don't follow directory symlinks, same behavior as {recursive_directory_iterator}
+        if (entry.is_directory(ec_entry) && !entry.is_symlink(ec_entry))
+        {
+            auto *child_node = node != nullptr ?
+                breakdown->add_child(worker_index, node, entry.path().filename().string()) : nullptr;
+            state.pool.submit([&state, path = entry.path(), breakdown, child_node](unsigned worker_index){
+                scan_directory_task(state, path, breakdown, child_node, worker_index);
+            });
+        }
+        else if (entry.is_regular_file(ec_entry))
+        {
+            const auto file_size = entry.file_size(ec_entry);
+            if (!ec_entry)
+            {
+                add_file(totals, state.hardlinks, entry.path(), file_size);
+            }
+        }
+
+        // dangling symbolic links and entries removed during the scan are not an error
+        if (ec_entry && ec_entry != std::errc::no_such_file_or_directory)
+        {
+            state.report_error(ec_entry);
+        }
+    }
+
+    // the iterator reports errors of the last increment here
+    if (ec)
+    {
+        state.report_error(ec);
+    }
+
+    scan_state_t<Pack>::add_to_breakdown(node, before, totals);
+    state.finish_directory(worker_index);
+}
+
+/**
+ * Shared state of a single walk, see {disk_usage::walk_directory}.
+ */
+struct walk_state_t final
+{
+    threading::work_stealing_pool_t &pool;
+    const disk_usage::walk_visitor &visitor;
+
+    std::mutex error_mutex;
+    std::error_code first_error;
+
+    /// records the first error, all following errors are dropped
+    void report_error(const std::error_code &ec)
+    {
+        std::lock_guard<std::mutex> lock(this->error_mutex);
+        if (!this->first_error)
+        {
+            this->first_error = ec;
+        }
+    }
+};
+
+/**
+ * Passes the direct children of the given directory to the visitor,
+ * the selected subdirectories are submitted as new tasks.
+ */
+void walk_directory_task(walk_state_t &state, const fs::path &directory, std::uint64_t directory_state)
+{
+    using disk_usage::entry_type;
+
+    std::error_code ec;
+    fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, ec);
+    if (ec)
+    {
+        state.report_error(ec);
+        return;
+    }
+
+    const auto directory_path = directory.string();
+    for (const fs::directory_iterator end; !ec && it != end; it.increment(ec))
+    {
+        const auto &entry = *it;
+        std::error_code ec_entry;
+
+        // note: same rules as {scan_directory_task}, symbolic links are not resolved
+        const auto type = entry.is_symlink(ec_entry) ? entry_type::symbolic_link :
+            entry.is_directory(ec_entry) ? entry_type::directory :
+            entry.is_regular_file(ec_entry) ? entry_type::regular_file : entry_type::other;
+
+        // entries removed during the walk are not an error
+        if (ec_entry)
+        {
+            if (ec_entry != std::errc::no_such_file_or_directory)
+            {
+                state.report_error(ec_entry);
+            }
+            continue;
+        }
+
+        const auto name = entry.path().filename().string();
+        const auto child_state = state.visitor(disk_usage::walk_entry{
+            .directory = directory_path,
+            .name = name,
+            .type = type,
+            .parent_state = directory_state,
+        });
+
+        if (type == entry_type::directory && child_state != 0)
+        {
+            state.pool.submit([&state, path = entry.path(), child_state](unsigned){
+                walk_directory_task(state, path, child_state);
+            });
+        }
+    }
+
+    // the iterator reports errors of the last increment here
+    if (ec)
+    {
+        state.report_error(ec);
+    }
+}
+
+} // anonymous namespace
+
+namespace disk_usage {
+namespace backend {
+
+const char *const backend_name = "std_filesystem";
+
+scan_result scan_directory(const std::string &path, const scan_options &options) noexcept
+{
+    scan_result result;
+
+    if (!fs::is_directory(path, result.ec))
+    {
+        return result;
+    }
+
+    return with_aggregators(options, [&]<typename Pack>() {
+        threading::work_stealing_pool_t pool(options.thread_count);
+        scan_state_t<Pack> state(pool, options);
+
+        auto *breakdown = options.breakdown;
+        auto *root_node = breakdown != nullptr ? breakdown->reset(path, pool.thread_count()) : nullptr;
+        pool.submit([&state, root = fs::path(path), breakdown, root_node](unsigned worker_index){
+            scan_directory_task(state, root, breakdown, root_node, worker_index);
+        });
+        pool.wait();
+
+        return state.merge();
+    });
+}
+
+std::error_code walk_directory(const std::string &path, const walk_options &options,
+    const walk_visitor &visitor) noexcept
+{
+    std::error_code ec;
+    if (!fs::is_directory(path, ec))
+    {
+        return ec ? ec : std::make_error_code(std::errc::not_a_directory);
+    }
+
+    threading::work_stealing_pool_t pool(options.thread_count);
+    walk_state_t state{
+        .pool = pool,
+        .visitor = visitor,
+        .error_mutex = {},
+        .first_error = {},
+    };
+
+    pool.submit([&state, root = fs::path(path), root_state = options.root_state](unsigned){
+        walk_directory_task(state, root, root_state);
+    });
+    pool.wait();
+
+    return state.first_error;
+}
+
+std::error_code stat_entry(const walk_entry &entry, entry_stat &stat) noexcept
+{
+    const auto path = fs::path(entry.directory) / entry.name;
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    const bool is_regular_file = S_ISREG(st.st_mode);
+    stat = entry_stat{
+        .type = is_regular_file ? entry_type::regular_file :
+            S_ISDIR(st.st_mode) ? entry_type::directory : entry_type::other,
+        .apparent_size = is_regular_file ? static_cast<std::uintmax_t>(st.st_size) : 0,
+        .allocated_size = is_regular_file ? static_cast<std::uintmax_t>(st.st_blocks) * 512 : 0,
+        .mtime = st.st_mtim.tv_sec,
+        .atime = st.st_atim.tv_sec,
+        .device = st.st_dev,
+        .inode = st.st_ino,
+        .link_count = st.st_nlink,
+    };
+    return {};
+#else
+    std::error_code ec;
+    const auto status = fs::status(path, ec);
+    if (ec)
+    {
+        return ec;
+    }
+
+    stat = entry_stat{};
+    if (fs::is_regular_file(status))
+    {
+        stat.type = entry_type::regular_file;
+        stat.apparent_size = fs::file_size(path, ec);
+        stat.allocated_size = stat.apparent_size;
+    }
+    else if (fs::is_directory(status))
+    {
+        stat.type = entry_type::directory;
+    }
+    return ec;
+#endif
+}
+
+bool io_uring_available() noexcept
+{
+    return false;
+}
+
+struct directory_lister_t::impl_t final {};
+
+directory_lister_t::directory_lister_t(bool)
+{
+}
+
+directory_lister_t::~directory_lister_t() = default;
+
+std::error_code directory_lister_t::list(const std::string &path, directory_listing_t &listing) noexcept
+{
+    listing = directory_listing_t{};
+
+    std::error_code ec;
+    fs::directory_iterator it(path, fs::directory_options::skip_permission_denied, ec);
+    for (const fs::directory_iterator end; !ec && it != end; it.increment(ec))
+    {
+        const auto &entry = *it;
+        std::error_code ec_entry;
+
+        // note: same rules as {scan_directory_task}
+        if (entry.is_directory(ec_entry) && !entry.is_symlink(ec_entry))
+        {
+            const auto name = entry.path().filename().string();
+            listing.subdirectory_names.append(name.c_str(), name.size() + 1);
+            ++listing.subdirectory_count;
+        }
+        else if (entry.is_regular_file(ec_entry))
+        {
+            ++listing.stat_calls;
+            if (const auto file_size = entry.file_size(ec_entry); !ec_entry)
+            {
+                add_file(listing.totals, nullptr, entry.path(), file_size);
+            }
+        }
+    }
+
+    return ec;
+}
+
+scan_result stat_file(const std::string &path, inode_set_t *hardlinks) noexcept
+{
+    scan_result result;
+
+    if (!fs::is_regular_file(path, result.ec))
+    {
+        return result;
+    }
+
+    const auto file_size = fs::file_size(path, result.ec);
+    if (!result.ec)
+    {
+        thread_totals_t totals;
+        add_file(totals, hardlinks, path, file_size);
+        totals.store(result);
+    }
+
+    return result;
+}
+
+} // namespace backend
+} // namespace disk_usage
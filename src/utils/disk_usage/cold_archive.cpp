@@ -0,0 +1,1243 @@
+#include "cold_archive.hpp"
+#include "disk_usage.hpp"
+#include "error_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "../threading/work_stealing_pool.hpp"
+#include "../trash.hpp"
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(PROJECT_PLATFORM_LINUX)
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#endif
+
+// added in Linux 3.15, the value is part of the kernel ABI
+#if defined(PROJECT_PLATFORM_LINUX) && !defined(RENAME_NOREPLACE)
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+namespace {
+
+using disk_usage::last_error;
+
+/// size of the blocks of a tar stream
+constexpr std::size_t tar_block_size = 512;
+
+/// magic of the footer at the end of an archive, followed by the offset and size of the index and the entry count
+constexpr char footer_magic[8] = {'C', 'M', 'G', 'R', 'I', 'D', 'X', '1'};
+constexpr std::size_t footer_size = sizeof(footer_magic) + 3 * sizeof(std::uint64_t);
+
+/// fixed size part of an index record, followed by the path and the target of symbolic links
+constexpr std::size_t index_record_size = 8 + 8 + 8 + 4 + 2 + 2 + 1;
+
+/// largest file size which fits into the 11 octal digits of a ustar header
+constexpr std::uintmax_t max_tar_file_size = (std::uintmax_t{1} << 33) - 1;
+
+/// a subtree is renamed to this suffix while it is packed, and restored to it before it is renamed into place
+constexpr std::string_view packing_suffix = ".cachemgr-packing";
+constexpr std::string_view restoring_suffix = ".cachemgr-restoring";
+
+/// the writes to the archive are buffered
+constexpr std::size_t write_buffer_size = 1024 * 1024;
+
+bool ends_with(std::string_view str, std::string_view suffix) noexcept
+{
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+
+/**
+ * Renames the path, fails with `EEXIST` instead of replacing an existing (empty) directory.
+ */
+std::error_code rename_noreplace(const std::string &from, const std::string &to) noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX) && defined(SYS_renameat2)
+    if (::syscall(SYS_renameat2, AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0)
+    {
+        return {};
+    }
+    else if (errno != ENOSYS && errno != EINVAL)
+    {
+        return last_error();
+    }
+#endif
+
+    // the check is racy without support for RENAME_NOREPLACE
+    struct stat st;
+    if (::lstat(to.c_str(), &st) == 0)
+    {
+        return std::make_error_code(std::errc::file_exists);
+    }
+    return ::rename(from.c_str(), to.c_str()) != 0 ? last_error() : std::error_code{};
+}
+
+#endif // !defined(PROJECT_PLATFORM_WINDOWS)
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+
+enum class archive_entry_type : std::uint8_t
+{
+    directory = 'd',
+    regular_file = 'f',
+    symbolic_link = 'l',
+};
+
+/**
+ * An entry of the index of an archive, paths are relative to the packed directory.
+ */
+struct archive_entry_t final
+{
+    archive_entry_type type;
+    std::uint32_t mode{0};
+    std::int64_t mtime{0};
+
+    /// offset of the contents of regular files in the archive
+    std::uint64_t data_offset{0};
+    std::uint64_t size{0};
+
+    std::string path{};
+    std::string link_target{};
+};
+
+/**
+ * A directory which was visited while searching for cold subtrees, see {pack_cold_subtrees}.
+ *
+ * The sums include all subtrees after the walk was completed.
+ */
+struct cold_node_t final
+{
+    /// index of the parent node, 0 for the root and its direct children
+    std::size_t parent{0};
+    std::string path;
+
+    /// the most recent use of any entry of the subtree
+    std::int64_t last_used{0};
+
+    std::uint64_t entries{1};
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+
+    /// false if the subtree contains entries which can't be archived
+    bool is_packable{true};
+};
+
+/**
+ * Writes a tar stream with buffering and keeps track of the offset.
+ */
+class archive_writer_t final
+{
+public:
+    explicit archive_writer_t(int fd) noexcept
+        : _fd(fd)
+    {
+        this->_buffer.reserve(write_buffer_size);
+    }
+
+    std::uint64_t offset() const noexcept
+    {
+        return this->_offset;
+    }
+
+    std::error_code write(const void *data, std::size_t size) noexcept
+    {
+        const auto *bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const auto count = std::min(size, write_buffer_size - this->_buffer.size());
+            this->_buffer.insert(this->_buffer.end(), bytes, bytes + count);
+            this->_offset += count;
+            bytes += count;
+            size -= count;
+            if (this->_buffer.size() == write_buffer_size)
+            {
+                if (const auto ec = this->flush())
+                {
+                    return ec;
+                }
+            }
+        }
+        return {};
+    }
+
+    /**
+     * Pads the stream with zeros to the next tar block.
+     */
+    std::error_code pad() noexcept
+    {
+        static constexpr char zeros[tar_block_size] = {};
+        const auto remainder = this->_offset % tar_block_size;
+        return remainder == 0 ? std::error_code{} : this->write(zeros, tar_block_size - remainder);
+    }
+
+    std::error_code flush() noexcept
+    {
+        std::size_t written = 0;
+        while (written < this->_buffer.size())
+        {
+            const auto count = ::write(this->_fd, this->_buffer.data() + written, this->_buffer.size() - written);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (count < 0)
+            {
+                return last_error();
+            }
+            written += static_cast<std::size_t>(count);
+        }
+        this->_buffer.clear();
+        return {};
+    }
+
+private:
+    int _fd;
+    std::vector<char> _buffer;
+    std::uint64_t _offset{0};
+};
+
+/**
+ * Writes an octal number into a NUL terminated ustar header field.
+ */
+void write_octal(char *field, std::size_t field_size, std::uint64_t value) noexcept
+{
+    std::snprintf(field, field_size, "%0*llo", static_cast<int>(field_size - 1),
+        static_cast<unsigned long long>(value));
+}
+
+/**
+ * Writes a ustar header block for the given entry, the path is prefixed with the name of the packed directory.
+ */
+std::error_code write_tar_header(archive_writer_t &writer, const std::string &path,
+    const archive_entry_t &entry) noexcept
+{
+    char header[tar_block_size] = {};
+
+    // paths which don't fit into the name field are split into a prefix at a directory separator
+    std::string_view name = path;
+    std::string_view prefix;
+    if (name.size() > 100)
+    {
+        const auto first = name.size() - 101;
+        const auto separator = name.find('/', first);
+        if (separator == std::string_view::npos || separator > 155 || separator == 0)
+        {
+            return std::make_error_code(std::errc::filename_too_long);
+        }
+        prefix = name.substr(0, separator);
+        name = name.substr(separator + 1);
+    }
+    if (entry.link_target.size() > 100)
+    {
+        return std::make_error_code(std::errc::filename_too_long);
+    }
+    if (entry.size > max_tar_file_size)
+    {
+        return std::make_error_code(std::errc::file_too_large);
+    }
+
+    std::memcpy(header, name.data(), name.size());
+    write_octal(header + 100, 8, entry.mode & 07777);
+    write_octal(header + 108, 8, 0);
+    write_octal(header + 116, 8, 0);
+    write_octal(header + 124, 12, entry.type == archive_entry_type::regular_file ? entry.size : 0);
+    write_octal(header + 136, 12, static_cast<std::uint64_t>(std::max<std::int64_t>(0, entry.mtime)));
+    header[156] = entry.type == archive_entry_type::directory ? '5' :
+        entry.type == archive_entry_type::symbolic_link ? '2' : '0';
+    std::memcpy(header + 157, entry.link_target.data(), entry.link_target.size());
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    std::memcpy(header + 345, prefix.data(), prefix.size());
+
+    // the checksum is calculated with the checksum field filled with spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (const auto byte : header)
+    {
+        checksum += static_cast<unsigned char>(byte);
+    }
+    std::snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    return writer.write(header, sizeof(header));
+}
+
+/**
+ * Appends the contents of a regular file to the archive.
+ */
+std::error_code write_file_contents(archive_writer_t &writer, int fd, std::uint64_t size) noexcept
+{
+    char buffer[64 * 1024];
+    std::uint64_t copied = 0;
+    while (copied < size)
+    {
+        const auto count = ::read(fd, buffer, static_cast<std::size_t>(std::min<std::uint64_t>(sizeof(buffer), size - copied)));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (count < 0)
+        {
+            return last_error();
+        }
+        else if (count == 0)
+        {
+            // the file was truncated while it was archived
+            return std::make_error_code(std::errc::device_or_resource_busy);
+        }
+        if (const auto ec = writer.write(buffer, static_cast<std::size_t>(count)))
+        {
+            return ec;
+        }
+        copied += static_cast<std::uint64_t>(count);
+    }
+    return writer.pad();
+}
+
+/**
+ * State of archiving a single subtree, see {archive_directory}.
+ */
+struct archive_state_t final
+{
+    archive_writer_t &writer;
+
+    /// name of the packed directory, prefixed to all paths in the tar stream
+    std::string root_name;
+
+    /// entries which were used after this timestamp abort packing
+    std::int64_t cold_before{0};
+
+    std::vector<archive_entry_t> entries{};
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+};
+
+/**
+ * Archives the entries of the given open directory recursively, in sorted order.
+ *
+ * Any entry which can't be archived exactly aborts packing, the subtree is restored by the caller.
+ */
+std::error_code archive_directory(archive_state_t &state, int dir_fd, const std::string &relative_path) noexcept
+{
+    const int list_fd = ::dup(dir_fd);
+    if (list_fd < 0)
+    {
+        return last_error();
+    }
+    DIR *dir = ::fdopendir(list_fd);
+    if (dir == nullptr)
+    {
+        const auto ec = last_error();
+        ::close(list_fd);
+        return ec;
+    }
+
+    std::vector<std::string> names;
+    errno = 0;
+    while (const auto *dirent = ::readdir(dir))
+    {
+        if (std::strcmp(dirent->d_name, ".") != 0 && std::strcmp(dirent->d_name, "..") != 0)
+        {
+            names.emplace_back(dirent->d_name);
+        }
+        errno = 0;
+    }
+    const auto ec_read = errno != 0 ? last_error() : std::error_code{};
+    ::closedir(dir);
+    if (ec_read)
+    {
+        return ec_read;
+    }
+    std::sort(names.begin(), names.end());
+
+    for (const auto &name : names)
+    {
+        struct stat st;
+        if (::fstatat(dir_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            return last_error();
+        }
+
+        archive_entry_t entry{
+            .type = archive_entry_type::regular_file,
+            .mode = static_cast<std::uint32_t>(st.st_mode & 07777),
+            .mtime = st.st_mtime,
+            .path = relative_path.empty() ? name : relative_path + "/" + name,
+        };
+        const auto tar_path = state.root_name + "/" + entry.path;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            if (st.st_mtime >= state.cold_before)
+            {
+                return std::make_error_code(std::errc::device_or_resource_busy);
+            }
+            entry.type = archive_entry_type::directory;
+            if (const auto ec = write_tar_header(state.writer, tar_path + "/", entry))
+            {
+                return ec;
+            }
+            const auto child_path = entry.path;
+            state.entries.emplace_back(std::move(entry));
+
+            const int child_fd = ::openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child_fd < 0)
+            {
+                return last_error();
+            }
+            const auto ec = archive_directory(state, child_fd, child_path);
+            ::close(child_fd);
+            if (ec)
+            {
+                return ec;
+            }
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            if (st.st_nlink > 1)
+            {
+                // other links of the inode would silently become separate copies
+                return std::make_error_code(std::errc::too_many_links);
+            }
+            if (std::max<std::int64_t>(st.st_atime, st.st_mtime) >= state.cold_before)
+            {
+                return std::make_error_code(std::errc::device_or_resource_busy);
+            }
+
+            // reading the file for the archive doesn't count as a use, O_NOATIME requires ownership
+#if defined(PROJECT_PLATFORM_LINUX)
+            const int fd = ::openat(dir_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_NOATIME | O_CLOEXEC);
+            const int file_fd = fd >= 0 || errno != EPERM ? fd :
+                ::openat(dir_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+#else
+            const int file_fd = ::openat(dir_fd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+#endif
+            if (file_fd < 0)
+            {
+                return last_error();
+            }
+
+            entry.size = static_cast<std::uint64_t>(st.st_size);
+            auto ec = write_tar_header(state.writer, tar_path, entry);
+            entry.data_offset = state.writer.offset();
+            ec = ec ? ec : write_file_contents(state.writer, file_fd, entry.size);
+            ::close(file_fd);
+            if (ec)
+            {
+                return ec;
+            }
+            state.apparent_size += entry.size;
+            state.allocated_size += static_cast<std::uintmax_t>(st.st_blocks) * 512;
+            state.entries.emplace_back(std::move(entry));
+        }
+        else if (S_ISLNK(st.st_mode))
+        {
+            char target[4096];
+            const auto size = ::readlinkat(dir_fd, name.c_str(), target, sizeof(target));
+            if (size < 0)
+            {
+                return last_error();
+            }
+            else if (static_cast<std::size_t>(size) >= sizeof(target))
+            {
+                return std::make_error_code(std::errc::filename_too_long);
+            }
+            entry.type = archive_entry_type::symbolic_link;
+            entry.link_target.assign(target, static_cast<std::size_t>(size));
+            if (const auto ec = write_tar_header(state.writer, tar_path, entry))
+            {
+                return ec;
+            }
+            state.entries.emplace_back(std::move(entry));
+        }
+        else
+        {
+            return std::make_error_code(std::errc::not_supported);
+        }
+    }
+    return {};
+}
+
+template<typename T>
+void append_integer(std::string &buffer, T value) noexcept
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+}
+
+template<typename T>
+T read_integer(const char *data) noexcept
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/**
+ * Appends the end of the tar stream, the index and the footer.
+ *
+ * The index and footer are in native byte order, archives are not meant to be moved between machines.
+ */
+std::error_code write_index(archive_writer_t &writer, const std::vector<archive_entry_t> &entries) noexcept
+{
+    static constexpr char end_of_archive[2 * tar_block_size] = {};
+    if (const auto ec = writer.write(end_of_archive, sizeof(end_of_archive)))
+    {
+        return ec;
+    }
+
+    std::string index;
+    for (const auto &entry : entries)
+    {
+        append_integer<std::uint64_t>(index, entry.data_offset);
+        append_integer<std::uint64_t>(index, entry.size);
+        append_integer<std::int64_t>(index, entry.mtime);
+        append_integer<std::uint32_t>(index, entry.mode);
+        append_integer<std::uint16_t>(index, static_cast<std::uint16_t>(entry.path.size()));
+        append_integer<std::uint16_t>(index, static_cast<std::uint16_t>(entry.link_target.size()));
+        append_integer<std::uint8_t>(index, static_cast<std::uint8_t>(entry.type));
+        index.append(entry.path).append(entry.link_target);
+    }
+
+    std::string footer(footer_magic, sizeof(footer_magic));
+    append_integer<std::uint64_t>(footer, writer.offset());
+    append_integer<std::uint64_t>(footer, index.size());
+    append_integer<std::uint64_t>(footer, entries.size());
+
+    if (const auto ec = writer.write(index.data(), index.size()))
+    {
+        return ec;
+    }
+    return writer.write(footer.data(), footer.size());
+}
+
+/**
+ * Reads exactly the given number of bytes at the given offset.
+ */
+std::error_code read_at(int fd, void *data, std::size_t size, std::uint64_t offset) noexcept
+{
+    auto *bytes = static_cast<char*>(data);
+    std::size_t done = 0;
+    while (done < size)
+    {
+        const auto count = ::pread(fd, bytes + done, size - done, static_cast<off_t>(offset + done));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (count < 0)
+        {
+            return last_error();
+        }
+        else if (count == 0)
+        {
+            return std::make_error_code(std::errc::illegal_byte_sequence);
+        }
+        done += static_cast<std::size_t>(count);
+    }
+    return {};
+}
+
+/**
+ * Reads and validates the index of an archive.
+ */
+std::error_code read_index(int fd, std::vector<archive_entry_t> &entries) noexcept
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        return last_error();
+    }
+    const auto archive_size = static_cast<std::uint64_t>(st.st_size);
+    const auto invalid = std::make_error_code(std::errc::illegal_byte_sequence);
+    if (archive_size < footer_size)
+    {
+        return invalid;
+    }
+
+    char footer[footer_size];
+    if (const auto ec = read_at(fd, footer, sizeof(footer), archive_size - footer_size))
+    {
+        return ec;
+    }
+    const auto index_offset = read_integer<std::uint64_t>(footer + sizeof(footer_magic));
+    const auto index_size = read_integer<std::uint64_t>(footer + sizeof(footer_magic) + 8);
+    const auto entry_count = read_integer<std::uint64_t>(footer + sizeof(footer_magic) + 16);
+    if (std::memcmp(footer, footer_magic, sizeof(footer_magic)) != 0 ||
+        index_offset > archive_size - footer_size || index_size != archive_size - footer_size - index_offset ||
+        entry_count > index_size / index_record_size)
+    {
+        return invalid;
+    }
+
+    std::string index(static_cast<std::size_t>(index_size), '\0');
+    if (const auto ec = read_at(fd, index.data(), index.size(), index_offset))
+    {
+        return ec;
+    }
+
+    // every entry must be unique and below a directory entry which comes before it,
+    // so no entry can be created through a symbolic link of the same archive
+    std::unordered_set<std::string_view> paths;
+    std::unordered_set<std::string_view> directories;
+
+    entries.reserve(static_cast<std::size_t>(entry_count));
+    std::size_t position = 0;
+    for (std::uint64_t i = 0; i < entry_count; ++i)
+    {
+        if (index.size() - position < index_record_size)
+        {
+            return invalid;
+        }
+        const char *record = index.data() + position;
+        archive_entry_t entry{
+            .type = static_cast<archive_entry_type>(read_integer<std::uint8_t>(record + 32)),
+            .mode = read_integer<std::uint32_t>(record + 24),
+            .mtime = read_integer<std::int64_t>(record + 16),
+            .data_offset = read_integer<std::uint64_t>(record),
+            .size = read_integer<std::uint64_t>(record + 8),
+        };
+        const auto path_size = read_integer<std::uint16_t>(record + 28);
+        const auto link_size = read_integer<std::uint16_t>(record + 30);
+        position += index_record_size;
+        if (index.size() - position < std::size_t{path_size} + link_size)
+        {
+            return invalid;
+        }
+        entry.path.assign(index.data() + position, path_size);
+        entry.link_target.assign(index.data() + position + path_size, link_size);
+        position += std::size_t{path_size} + link_size;
+
+        // entries must stay inside of the restored directory
+        const std::string_view path = entry.path;
+        const bool is_valid_path = !path.empty() && path.front() != '/' && path.back() != '/' &&
+            path.find('\0') == std::string_view::npos && path.find("//") == std::string_view::npos &&
+            path != ".." && path.substr(0, 3) != "../" && path.find("/../") == std::string_view::npos &&
+            !ends_with(path, "/..") && path != "." && path.substr(0, 2) != "./" &&
+            path.find("/./") == std::string_view::npos && !ends_with(path, "/.");
+        const bool is_valid_type = entry.type == archive_entry_type::directory ||
+            entry.type == archive_entry_type::symbolic_link ||
+            (entry.type == archive_entry_type::regular_file && entry.data_offset <= index_offset &&
+                entry.size <= index_offset - entry.data_offset);
+        if (!is_valid_path || !is_valid_type)
+        {
+            return invalid;
+        }
+
+        const auto separator = path.find_last_of('/');
+        if (separator != std::string_view::npos && !directories.contains(path.substr(0, separator)))
+        {
+            return invalid;
+        }
+
+        // the views point into the entries, their strings don't move once they are in place
+        const auto &added = entries.emplace_back(std::move(entry));
+        if (!paths.emplace(added.path).second)
+        {
+            return invalid;
+        }
+        if (added.type == archive_entry_type::directory)
+        {
+            directories.emplace(added.path);
+        }
+    }
+    return position == index.size() ? std::error_code{} : invalid;
+}
+
+/**
+ * Opens a directory below the given directory without following symbolic links in any component.
+ *
+ * Uses `openat2` with `RESOLVE_BENEATH` when available, otherwise every component is opened with `O_NOFOLLOW`.
+ *
+ * @param root_fd the directory which must contain the result
+ * @param relative_path path of the directory relative to @p root_fd, empty for @p root_fd itself
+ * @return a new file descriptor, -1 with `errno` set on failure
+ */
+int open_directory_beneath(int root_fd, std::string_view relative_path) noexcept
+{
+    if (relative_path.empty())
+    {
+        return ::fcntl(root_fd, F_DUPFD_CLOEXEC, 0);
+    }
+
+    const std::string path{relative_path};
+#if defined(PROJECT_PLATFORM_LINUX) && defined(SYS_openat2)
+    struct open_how how{};
+    how.flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS | RESOLVE_NO_MAGICLINKS;
+    const auto resolved_fd = static_cast<int>(::syscall(SYS_openat2, root_fd, path.c_str(), &how, sizeof(how)));
+    if (resolved_fd >= 0 || errno != ENOSYS)
+    {
+        return resolved_fd;
+    }
+#endif
+
+    int fd = ::fcntl(root_fd, F_DUPFD_CLOEXEC, 0);
+    std::size_t begin = 0;
+    while (fd >= 0 && begin < path.size())
+    {
+        const auto end = std::min(path.find('/', begin), path.size());
+        const auto component = path.substr(begin, end - begin);
+        const int next_fd = ::openat(fd, component.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        const int saved_errno = errno;
+        ::close(fd);
+        errno = saved_errno;
+        fd = next_fd;
+        begin = end + 1;
+    }
+    return fd;
+}
+
+/**
+ * Splits the path of an archive entry into its parent directory and its name.
+ */
+std::pair<std::string_view, std::string_view> split_entry_path(std::string_view path) noexcept
+{
+    const auto separator = path.find_last_of('/');
+    if (separator == std::string_view::npos)
+    {
+        return {{}, path};
+    }
+    return {path.substr(0, separator), path.substr(separator + 1)};
+}
+
+/**
+ * Copies a range of the archive into a new file, without passing the data through user space when possible.
+ */
+std::error_code extract_file_contents(int archive_fd, int fd, std::uint64_t offset, std::uint64_t size) noexcept
+{
+    auto input_offset = static_cast<off_t>(offset);
+    std::uint64_t copied = 0;
+    bool use_copy_file_range = true;
+    char buffer[64 * 1024];
+    while (copied < size)
+    {
+        const auto remaining = static_cast<std::size_t>(std::min<std::uint64_t>(size - copied, 1 << 30));
+#if defined(PROJECT_PLATFORM_LINUX)
+        if (use_copy_file_range)
+        {
+            const auto count = ::copy_file_range(archive_fd, &input_offset, fd, nullptr, remaining, 0);
+            if (count > 0)
+            {
+                copied += static_cast<std::uint64_t>(count);
+                continue;
+            }
+            else if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (count < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+            {
+                return last_error();
+            }
+            use_copy_file_range = false;
+        }
+#else
+        use_copy_file_range = false;
+#endif
+
+        const auto count = std::min(remaining, sizeof(buffer));
+        if (const auto ec = read_at(archive_fd, buffer, count, static_cast<std::uint64_t>(input_offset)))
+        {
+            return ec;
+        }
+        std::size_t written = 0;
+        while (written < count)
+        {
+            const auto result = ::write(fd, buffer + written, count - written);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (result < 0)
+            {
+                return last_error();
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        input_offset += static_cast<off_t>(count);
+        copied += count;
+    }
+    return {};
+}
+
+/**
+ * Packs a single subtree into an archive next to it and removes the subtree.
+ */
+std::error_code pack_subtree(disk_usage::packed_subtree &subtree, std::int64_t cold_before,
+    unsigned thread_count) noexcept
+{
+    const auto &path = subtree.path;
+    const auto separator = path.find_last_of('/');
+    const auto root_name = separator == std::string::npos ? path : path.substr(separator + 1);
+    const auto staging_path = path + std::string{packing_suffix};
+    const auto archive_path = path + disk_usage::cold_archive_suffix;
+    const auto temporary_path = archive_path + ".tmp";
+
+    struct stat st;
+    if (::lstat(archive_path.c_str(), &st) == 0)
+    {
+        return std::make_error_code(std::errc::file_exists);
+    }
+    if (::lstat(path.c_str(), &st) != 0)
+    {
+        return last_error();
+    }
+
+    // package managers only see the subtree before or after it was packed
+    if (const auto ec = rename_noreplace(path, staging_path); ec)
+    {
+        return ec;
+    }
+
+    std::error_code ec;
+    const int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    const int dir_fd = ::open(staging_path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0 || dir_fd < 0)
+    {
+        ec = last_error();
+    }
+    else
+    {
+        archive_writer_t writer(fd);
+        archive_state_t state{
+            .writer = writer,
+            .root_name = root_name,
+            .cold_before = cold_before,
+        };
+
+        archive_entry_t root{
+            .type = archive_entry_type::directory,
+            .mode = static_cast<std::uint32_t>(st.st_mode & 07777),
+            .mtime = st.st_mtime,
+        };
+        ec = write_tar_header(writer, root_name + "/", root);
+        ec = ec ? ec : archive_directory(state, dir_fd, {});
+        ec = ec ? ec : write_index(writer, state.entries);
+        ec = ec ? ec : writer.flush();
+        if (!ec && ::fsync(fd) != 0)
+        {
+            ec = last_error();
+        }
+        subtree.entries = state.entries.size() + 1;
+        subtree.apparent_size = state.apparent_size;
+        subtree.allocated_size = state.allocated_size;
+        subtree.archive_size = ec ? 0 : writer.offset();
+    }
+    if (dir_fd >= 0)
+    {
+        ::close(dir_fd);
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+
+    if (!ec && ::rename(temporary_path.c_str(), archive_path.c_str()) != 0)
+    {
+        ec = last_error();
+    }
+    if (ec)
+    {
+        ::unlink(temporary_path.c_str());
+        subtree.archive_size = 0;
+
+        // a directory which was recreated in the meantime is never replaced, the subtree stays staged then
+        if (rename_noreplace(staging_path, path))
+        {
+            subtree.staging_path = staging_path;
+        }
+        return ec;
+    }
+
+    // the archive is complete, a failed removal only leaves the renamed subtree behind
+    return fs_utils::remove_all_parallel(staging_path, thread_count);
+}
+
+#endif // !defined(PROJECT_PLATFORM_WINDOWS)
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+packing_result pack_cold_subtrees(const std::string &path, const packing_options &options) noexcept
+{
+    packing_result result;
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    const auto cold_before = static_cast<std::int64_t>(std::time(nullptr)) - options.min_idle_time.count();
+
+    // every directory is a node, its index + 1 is the state of the walk
+    std::mutex nodes_mutex;
+    std::vector<cold_node_t> nodes(1);
+    nodes.front().path = path;
+    std::error_code ec_stat;
+
+    const auto ec_walk = walk_directory(path, walk_options{.thread_count = options.thread_count, .root_state = 1},
+        [&](const walk_entry &entry) -> std::uint64_t {
+            const auto parent = static_cast<std::size_t>(entry.parent_state - 1);
+
+            entry_stat stat;
+            std::error_code ec;
+            if (entry.type == entry_type::directory || entry.type == entry_type::regular_file)
+            {
+                ec = stat_entry(entry, stat);
+            }
+
+            std::lock_guard<std::mutex> lock(nodes_mutex);
+            if (ec)
+            {
+                nodes[parent].is_packable = false;
+                if (ec != std::errc::permission_denied && ec != std::errc::no_such_file_or_directory)
+                {
+                    ec_stat = ec_stat ? ec_stat : ec;
+                }
+                return 0;
+            }
+
+            if (entry.type == entry_type::directory)
+            {
+                // leftovers of an interrupted run are neither packed nor descended into
+                if (ends_with(entry.name, packing_suffix) || ends_with(entry.name, restoring_suffix))
+                {
+                    nodes[parent].is_packable = false;
+                    return 0;
+                }
+
+                std::string directory_path;
+                directory_path.reserve(entry.directory.size() + entry.name.size() + 1);
+                directory_path.append(entry.directory).append("/").append(entry.name);
+                nodes.emplace_back(cold_node_t{
+                    .parent = parent,
+                    .path = std::move(directory_path),
+                    .last_used = stat.mtime,
+                });
+                return nodes.size();
+            }
+
+            auto &node = nodes[parent];
+            ++node.entries;
+            if (entry.type == entry_type::regular_file)
+            {
+                node.last_used = std::max({node.last_used, stat.atime, stat.mtime});
+                node.apparent_size += stat.apparent_size;
+                node.allocated_size += stat.allocated_size;
+                node.is_packable = node.is_packable && stat.link_count <= 1;
+            }
+            else if (entry.type != entry_type::symbolic_link)
+            {
+                node.is_packable = false;
+            }
+            return 0;
+        });
+    result.ec = ec_walk ? ec_walk : ec_stat;
+    if (ec_walk)
+    {
+        return result;
+    }
+
+    // children are always added after their parents, so a reverse pass sums up every subtree
+    for (auto i = nodes.size() - 1; i > 0; --i)
+    {
+        const auto &child = nodes[i];
+        auto &parent = nodes[child.parent];
+        parent.last_used = std::max(parent.last_used, child.last_used);
+        parent.entries += child.entries;
+        parent.apparent_size += child.apparent_size;
+        parent.allocated_size += child.allocated_size;
+        parent.is_packable = parent.is_packable && child.is_packable;
+    }
+
+    // only the largest cold subtrees are packed, the root directory itself never
+    const auto is_cold = [&](const cold_node_t &node) {
+        return node.is_packable && node.last_used < cold_before && node.entries >= options.min_entries;
+    };
+    for (std::size_t i = 1; i < nodes.size(); ++i)
+    {
+        const auto &node = nodes[i];
+        if (is_cold(node) && (node.parent == 0 || !is_cold(nodes[node.parent])))
+        {
+            auto &subtree = result.subtrees.emplace_back();
+            subtree.path = node.path;
+            subtree.entries = node.entries;
+            subtree.apparent_size = node.apparent_size;
+            subtree.allocated_size = node.allocated_size;
+        }
+    }
+    std::sort(result.subtrees.begin(), result.subtrees.end(),
+        [](const packed_subtree &a, const packed_subtree &b) { return a.path < b.path; });
+
+    if (options.dry_run)
+    {
+        return result;
+    }
+
+    // the subtrees are packed one after another, every subtree is removed in parallel
+    for (auto &subtree : result.subtrees)
+    {
+        subtree.ec = pack_subtree(subtree, cold_before, options.thread_count);
+    }
+#else
+    (void) path;
+    (void) options;
+    result.ec = std::make_error_code(std::errc::not_supported);
+#endif
+
+    return result;
+}
+
+restore_result restore_archive(const std::string &archive_path, unsigned thread_count) noexcept
+{
+    restore_result result;
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    if (!ends_with(archive_path, cold_archive_suffix) || archive_path.size() == std::strlen(cold_archive_suffix))
+    {
+        result.ec = std::make_error_code(std::errc::invalid_argument);
+        return result;
+    }
+    const auto path = archive_path.substr(0, archive_path.size() - std::strlen(cold_archive_suffix));
+    const auto staging_path = path + std::string{restoring_suffix};
+
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0)
+    {
+        result.ec = std::make_error_code(std::errc::file_exists);
+        return result;
+    }
+
+    const int archive_fd = ::open(archive_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (archive_fd < 0)
+    {
+        result.ec = last_error();
+        return result;
+    }
+
+    std::vector<archive_entry_t> entries;
+    if (const auto ec = read_index(archive_fd, entries))
+    {
+        ::close(archive_fd);
+        result.ec = ec;
+        return result;
+    }
+
+    // a previous restore was interrupted, its partial result is discarded
+    if (::lstat(staging_path.c_str(), &st) == 0)
+    {
+        if (const auto ec = fs_utils::remove_all_parallel(staging_path, thread_count))
+        {
+            ::close(archive_fd);
+            result.ec = ec;
+            return result;
+        }
+    }
+
+    // all entries are created relative to the restored directory, symbolic links are never followed
+    std::error_code ec;
+    int staging_fd = -1;
+    if (::mkdir(staging_path.c_str(), 0700) != 0)
+    {
+        ec = last_error();
+    }
+    else if (staging_fd = ::open(staging_path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        staging_fd < 0)
+    {
+        ec = last_error();
+    }
+
+    // directories are listed before their entries, they are created first with owner access
+    for (const auto &entry : entries)
+    {
+        if (ec || entry.type != archive_entry_type::directory)
+        {
+            continue;
+        }
+        const auto [parent, name] = split_entry_path(entry.path);
+        const int parent_fd = open_directory_beneath(staging_fd, parent);
+        if (parent_fd < 0 || ::mkdirat(parent_fd, std::string{name}.c_str(), 0700) != 0)
+        {
+            ec = last_error();
+        }
+        if (parent_fd >= 0)
+        {
+            ::close(parent_fd);
+        }
+    }
+
+    // files are extracted in parallel, the archive is read at the offsets from the index
+    if (!ec)
+    {
+        std::mutex ec_mutex;
+        std::atomic<std::uintmax_t> apparent_size{0};
+        threading::work_stealing_pool_t pool(thread_count);
+        for (const auto &entry : entries)
+        {
+            if (entry.type == archive_entry_type::directory)
+            {
+                continue;
+            }
+            pool.submit([&, &entry = entry](unsigned) {
+                const auto [parent, name_view] = split_entry_path(entry.path);
+                const std::string name{name_view};
+                std::error_code ec_entry;
+
+                const int parent_fd = open_directory_beneath(staging_fd, parent);
+                if (parent_fd < 0)
+                {
+                    ec_entry = last_error();
+                }
+                else if (entry.type == archive_entry_type::symbolic_link)
+                {
+                    if (::symlinkat(entry.link_target.c_str(), parent_fd, name.c_str()) != 0)
+                    {
+                        ec_entry = last_error();
+                    }
+                }
+                else
+                {
+                    const int fd = ::openat(parent_fd, name.c_str(),
+                        O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+                    if (fd < 0)
+                    {
+                        ec_entry = last_error();
+                    }
+                    else
+                    {
+                        ec_entry = extract_file_contents(archive_fd, fd, entry.data_offset, entry.size);
+
+                        // restored files count as used now, otherwise they would be packed again right away
+                        const struct timespec times[2] = {{0, UTIME_NOW}, {entry.mtime, 0}};
+                        if (!ec_entry && (::fchmod(fd, entry.mode) != 0 || ::futimens(fd, times) != 0))
+                        {
+                            ec_entry = last_error();
+                        }
+                        ::close(fd);
+                        apparent_size.fetch_add(entry.size, std::memory_order_relaxed);
+                    }
+                }
+                if (parent_fd >= 0)
+                {
+                    ::close(parent_fd);
+                }
+
+                if (ec_entry)
+                {
+                    std::lock_guard<std::mutex> lock(ec_mutex);
+                    ec = ec ? ec : ec_entry;
+                }
+            });
+        }
+        pool.wait();
+        result.apparent_size = apparent_size.load(std::memory_order_relaxed);
+    }
+
+    // the metadata of directories is restored last, the deepest directories first
+    for (auto it = entries.rbegin(); !ec && it != entries.rend(); ++it)
+    {
+        if (it->type != archive_entry_type::directory)
+        {
+            continue;
+        }
+        const int dir_fd = open_directory_beneath(staging_fd, it->path);
+        const struct timespec times[2] = {{0, UTIME_NOW}, {it->mtime, 0}};
+        if (dir_fd < 0 || ::fchmod(dir_fd, it->mode) != 0 || ::futimens(dir_fd, times) != 0)
+        {
+            ec = last_error();
+        }
+        if (dir_fd >= 0)
+        {
+            ::close(dir_fd);
+        }
+    }
+
+    // the directory itself isn't part of the index, its metadata is taken from the tar header
+    if (!ec)
+    {
+        char header[tar_block_size];
+        ec = read_at(archive_fd, header, sizeof(header), 0);
+        if (!ec)
+        {
+            const auto mode = std::strtoul(std::string(header + 100, 7).c_str(), nullptr, 8);
+            const auto mtime = std::strtoll(std::string(header + 136, 11).c_str(), nullptr, 8);
+            const struct timespec times[2] = {{0, UTIME_NOW}, {static_cast<time_t>(mtime), 0}};
+            if (::fchmod(staging_fd, static_cast<mode_t>(mode & 07777)) != 0 || ::futimens(staging_fd, times) != 0)
+            {
+                ec = last_error();
+            }
+        }
+    }
+    if (staging_fd >= 0)
+    {
+        ::close(staging_fd);
+    }
+    ::close(archive_fd);
+
+    if (!ec && ::rename(staging_path.c_str(), path.c_str()) != 0)
+    {
+        ec = last_error();
+    }
+    if (ec)
+    {
+        fs_utils::remove_all_parallel(staging_path, thread_count);
+        result.ec = ec;
+        result.apparent_size = 0;
+        return result;
+    }
+
+    result.entries = entries.size() + 1;
+    if (::unlink(archive_path.c_str()) != 0)
+    {
+        result.ec = last_error();
+    }
+#else
+    (void) archive_path;
+    (void) thread_count;
+    result.ec = std::make_error_code(std::errc::not_supported);
+#endif
+
+    return result;
+}
+
+std::error_code find_cold_archives(const std::string &path, std::vector<std::string> &archives,
+    unsigned thread_count) noexcept
+{
+    std::mutex archives_mutex;
+    const auto ec = walk_directory(path, walk_options{.thread_count = thread_count},
+        [&](const walk_entry &entry) -> std::uint64_t {
+            if (entry.type == entry_type::directory)
+            {
+                return 1;
+            }
+            else if (entry.type == entry_type::regular_file && ends_with(entry.name, cold_archive_suffix))
+            {
+                std::string archive_path;
+                archive_path.reserve(entry.directory.size() + entry.name.size() + 1);
+                archive_path.append(entry.directory).append("/").append(entry.name);
+
+                std::lock_guard<std::mutex> lock(archives_mutex);
+                archives.emplace_back(std::move(archive_path));
+            }
+            return 0;
+        });
+    std::sort(archives.begin(), archives.end());
+    return ec;
+}
+
+} // namespace disk_usage
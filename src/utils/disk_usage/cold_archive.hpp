@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace disk_usage {
+
+/**
+ * File name suffix of the archives of packed subtrees, see {pack_cold_subtrees}.
+ */
+inline constexpr const char *cold_archive_suffix = ".cachemgr.tar";
+
+/**
+ * Options to control the behavior of {pack_cold_subtrees}.
+ */
+struct packing_options final
+{
+    /**
+     * Subtrees are packed when none of their entries was used for this long.
+     *
+     * A file is used when it is read or modified (the later one of `atime` and `mtime`),
+     * a directory when entries are added or removed (`mtime`).
+     */
+    std::chrono::seconds min_idle_time{30 * 24 * 3600};
+
+    /**
+     * Subtrees with fewer entries are not packed, the archive wouldn't save enough inodes.
+     */
+    std::uint64_t min_entries{256};
+
+    /**
+     * Number of worker threads to use for the traversal and the removal of packed subtrees,
+     * see {scan_options::thread_count}.
+     */
+    unsigned thread_count{0};
+
+    /**
+     * Only find the cold subtrees, nothing is packed.
+     */
+    bool dry_run{false};
+};
+
+/**
+ * A cold subtree which was packed into an archive, see {pack_cold_subtrees}.
+ */
+struct packed_subtree final
+{
+    /// the directory which was packed, the archive is next to it, see {cold_archive_suffix}
+    std::string path;
+
+    /// number of entries (files, directories and symbolic links) of the subtree, including the directory itself
+    std::uint64_t entries{0};
+
+    /// sizes of the regular files of the subtree
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+
+    /// size of the archive, 0 if the subtree wasn't packed
+    std::uintmax_t archive_size{0};
+
+    /// error code if the subtree couldn't be packed, it is unchanged in this case
+    std::error_code ec;
+
+    /// where the subtree was left behind if it couldn't be packed and not be renamed back either,
+    /// because its path was recreated in the meantime, empty otherwise
+    std::string staging_path;
+};
+
+/**
+ * Outcome of {pack_cold_subtrees}.
+ */
+struct packing_result final
+{
+    /// the cold subtrees, in the order of their paths
+    std::vector<packed_subtree> subtrees;
+
+    /// the first error encountered while searching for cold subtrees
+    std::error_code ec;
+};
+
+/**
+ * Packs the subtrees of the given directory which were not used for a while into one archive file each.
+ *
+ * Caches with millions of tiny files exhaust the inodes of their filesystem and slow down every scan.
+ * Subtrees without recent use are packed into a single archive next to them (`<name>.cachemgr.tar`)
+ * and removed afterwards, see {restore_archive} for unpacking them again.
+ *
+ * The directory is walked in parallel once to find the largest cold subtrees below it (the directory
+ * itself is never packed). Subtrees with hardlinks, special files or entries which couldn't be read are
+ * not packed. A subtree is renamed before it is packed, so package managers don't see a partially packed
+ * subtree, it is renamed back when packing fails.
+ *
+ * The archive is a POSIX ustar stream which can be read with `tar` as well, followed by an index
+ * with the offsets of all entries and a fixed size footer, which allows extracting without reading
+ * the archive sequentially.
+ *
+ * @param path the directory to search for cold subtrees
+ * @param options packing options
+ * @return the cold subtrees and the outcome of packing each of them
+ */
+packing_result pack_cold_subtrees(const std::string &path, const packing_options &options) noexcept;
+
+/**
+ * Outcome of {restore_archive}.
+ */
+struct restore_result final
+{
+    /// number of restored entries
+    std::uint64_t entries{0};
+
+    /// sum of the sizes of the restored regular files
+    std::uintmax_t apparent_size{0};
+
+    /// error code if the archive couldn't be restored, the archive is kept in this case
+    std::error_code ec;
+};
+
+/**
+ * Unpacks an archive which was created by {pack_cold_subtrees} and removes it.
+ *
+ * The entries are read with the index of the archive, the files are extracted in parallel with
+ * `copy_file_range` directly from their offsets in the archive. Every entry must be below a directory
+ * entry of the same index, and all entries are created relative to their parent directory without
+ * following symbolic links, so an archive can't write outside of the restored directory. The subtree
+ * is restored next to a temporary name and renamed into place when all entries were extracted.
+ * Restored files are marked as accessed now, the modification times are preserved.
+ *
+ * @param archive_path the archive to restore, its name must end with {cold_archive_suffix}
+ * @param thread_count number of worker threads, 0 means one thread per hardware thread
+ * @return the number of restored entries, error code if the archive is invalid or the subtree already exists
+ */
+restore_result restore_archive(const std::string &archive_path, unsigned thread_count = 0) noexcept;
+
+/**
+ * Finds all archives of packed subtrees below the given directory.
+ *
+ * @param path the directory to search
+ * @param archives receives the paths of the archives, sorted
+ * @param thread_count number of worker threads, 0 means one thread per hardware thread
+ * @return the first error encountered while walking the directory
+ */
+std::error_code find_cold_archives(const std::string &path, std::vector<std::string> &archives,
+    unsigned thread_count = 0) noexcept;
+
+} // namespace disk_usage
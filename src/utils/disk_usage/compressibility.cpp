@@ -0,0 +1,300 @@
+#include "compressibility.hpp"
+#include "disk_usage.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#include "../threading/work_stealing_pool.hpp"
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/// blocks with a higher entropy (bits per byte) are considered incompressible
+constexpr double incompressible_entropy = 7.5;
+
+/// lower bound of the entropy of a block for the ratio estimate, limits the ratio of a single block to 64
+constexpr double min_entropy = 0.125;
+
+/// sampled blocks are aligned to the page size
+constexpr std::uintmax_t block_alignment = 4096;
+
+/**
+ * A regular file of the sampled directory.
+ */
+struct sampled_file_t final
+{
+    std::string path;
+    std::uintmax_t size{0};
+};
+
+/**
+ * A block of a file which is sampled.
+ */
+struct sample_t final
+{
+    std::string path;
+    std::uintmax_t offset{0};
+    std::size_t size{0};
+
+    /// the block is the first sample of its file
+    bool is_first_of_file{false};
+};
+
+/**
+ * Per-worker sums of the analyzed blocks, aligned to avoid false sharing between workers.
+ */
+struct alignas(64) sample_totals_t
+{
+    std::uint64_t blocks{0};
+    std::uint64_t files{0};
+    std::uintmax_t size{0};
+
+    /// sum of the entropies weighted with the block sizes, in bits
+    double entropy_bits{0};
+
+    /// sum of the estimated compressed sizes of the blocks
+    double compressed_size{0};
+
+    std::uintmax_t incompressible_size{0};
+};
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+void byte_histogram::add(const void *data, std::size_t size) noexcept
+{
+    const auto *bytes = static_cast<const unsigned char*>(data);
+    this->total += size;
+
+    // the 32-bit sub-histograms can't overflow within a chunk
+    constexpr std::size_t chunk_size = std::size_t{1} << 30;
+    while (size > 0)
+    {
+        const auto count = std::min(size, chunk_size);
+
+        std::uint32_t partial[4][256] = {};
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            ++partial[0][bytes[i]];
+            ++partial[1][bytes[i + 1]];
+            ++partial[2][bytes[i + 2]];
+            ++partial[3][bytes[i + 3]];
+        }
+        for (; i < count; ++i)
+        {
+            ++partial[0][bytes[i]];
+        }
+
+        for (std::size_t value = 0; value < 256; ++value)
+        {
+            this->counts[value] += std::uint64_t{partial[0][value]} + partial[1][value] +
+                partial[2][value] + partial[3][value];
+        }
+
+        bytes += count;
+        size -= count;
+    }
+}
+
+double byte_histogram::entropy() const noexcept
+{
+    if (this->total == 0)
+    {
+        return 0;
+    }
+
+    const double inverse_total = 1.0 / static_cast<double>(this->total);
+    double entropy = 0;
+    for (const auto count : this->counts)
+    {
+        const double probability = static_cast<double>(count) * inverse_total;
+        entropy -= count > 0 ? probability * std::log2(probability) : 0;
+    }
+    return std::clamp(entropy, 0.0, 8.0);
+}
+
+compressibility_result estimate_compressibility(const std::string &path,
+    const compressibility_options &options) noexcept
+{
+    compressibility_result result;
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    const auto block_size = std::max<std::size_t>(options.block_size, block_alignment);
+    const auto max_samples = std::max<std::uintmax_t>(1, options.max_read_size / block_size);
+
+    // the files are collected first, the sample positions depend on the total size of all of them
+    std::mutex files_mutex;
+    std::vector<sampled_file_t> files;
+    std::error_code ec_stat;
+
+    const auto ec_walk = walk_directory(path, walk_options{.thread_count = options.thread_count},
+        [&](const walk_entry &entry) -> std::uint64_t {
+            if (entry.type == entry_type::directory)
+            {
+                return 1;
+            }
+            else if (entry.type != entry_type::regular_file)
+            {
+                return 0;
+            }
+
+            entry_stat stat;
+            if (const auto ec = stat_entry(entry, stat); ec || stat.type != entry_type::regular_file)
+            {
+                if (ec && ec != std::errc::permission_denied && ec != std::errc::no_such_file_or_directory)
+                {
+                    std::lock_guard<std::mutex> lock(files_mutex);
+                    ec_stat = ec_stat ? ec_stat : ec;
+                }
+                return 0;
+            }
+            if (stat.apparent_size == 0)
+            {
+                return 0;
+            }
+
+            std::string file_path;
+            file_path.reserve(entry.directory.size() + entry.name.size() + 1);
+            file_path.append(entry.directory).append("/").append(entry.name);
+
+            std::lock_guard<std::mutex> lock(files_mutex);
+            files.emplace_back(sampled_file_t{.path = std::move(file_path), .size = stat.apparent_size});
+            return 0;
+        });
+    result.ec = ec_walk ? ec_walk : ec_stat;
+
+    // the walk order depends on the scheduling, the samples don't
+    std::sort(files.begin(), files.end(), [](const sampled_file_t &a, const sampled_file_t &b) {
+        return a.path < b.path;
+    });
+    std::uintmax_t total_size = 0;
+    for (const auto &file : files)
+    {
+        total_size += file.size;
+    }
+
+    // a sample every stride bytes of the concatenated files, blocks don't overlap
+    const auto stride = std::max<std::uintmax_t>(block_size, (total_size + max_samples - 1) / max_samples);
+
+    std::vector<sample_t> samples;
+    std::uintmax_t begin = 0;
+    for (const auto &file : files)
+    {
+        const auto size = file.size;
+        bool is_first_of_file = true;
+        for (auto sample = (begin + stride - 1) / stride; sample < max_samples && sample * stride < begin + size; ++sample)
+        {
+            const auto last_offset = size > block_size ? size - block_size : 0;
+            const auto offset = std::min(sample * stride - begin, last_offset) / block_alignment * block_alignment;
+            samples.emplace_back(sample_t{
+                .path = file.path,
+                .offset = offset,
+                .size = static_cast<std::size_t>(std::min<std::uintmax_t>(block_size, size - offset)),
+                .is_first_of_file = is_first_of_file,
+            });
+            is_first_of_file = false;
+        }
+        begin += size;
+    }
+
+    if (samples.empty())
+    {
+        return result;
+    }
+
+    // read and analyze the blocks in parallel, every worker owns a buffer
+    const auto threads = static_cast<unsigned>(std::min<std::size_t>(
+        threading::work_stealing_pool_t::resolve_thread_count(options.thread_count), samples.size()));
+    std::vector<sample_totals_t> totals(threads);
+    std::vector<std::vector<unsigned char>> buffers(threads);
+    {
+        threading::work_stealing_pool_t pool(threads);
+        for (const auto &sample : samples)
+        {
+            pool.submit([&sample, &totals, &buffers, block_size](unsigned worker) {
+                auto &buffer = buffers[worker];
+                buffer.resize(block_size);
+
+                const int fd = ::open(sample.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    return;
+                }
+
+                // files may shrink after the walk, the bytes which are still there are analyzed
+                std::size_t size = 0;
+                while (size < sample.size)
+                {
+                    const auto count = ::pread(fd, buffer.data() + size, sample.size - size,
+                        static_cast<off_t>(sample.offset + size));
+                    if (count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    else if (count <= 0)
+                    {
+                        break;
+                    }
+                    size += static_cast<std::size_t>(count);
+                }
+                ::close(fd);
+                if (size == 0)
+                {
+                    return;
+                }
+
+                byte_histogram histogram;
+                histogram.add(buffer.data(), size);
+                const auto entropy = histogram.entropy();
+
+                auto &worker_totals = totals[worker];
+                ++worker_totals.blocks;
+                worker_totals.files += sample.is_first_of_file ? 1 : 0;
+                worker_totals.size += size;
+                worker_totals.entropy_bits += entropy * static_cast<double>(size);
+                worker_totals.compressed_size += std::max(entropy, min_entropy) / 8 * static_cast<double>(size);
+                worker_totals.incompressible_size += entropy >= incompressible_entropy ? size : 0;
+            });
+        }
+        pool.wait();
+    }
+
+    sample_totals_t sum;
+    for (const auto &worker_totals : totals)
+    {
+        sum.blocks += worker_totals.blocks;
+        sum.files += worker_totals.files;
+        sum.size += worker_totals.size;
+        sum.entropy_bits += worker_totals.entropy_bits;
+        sum.compressed_size += worker_totals.compressed_size;
+        sum.incompressible_size += worker_totals.incompressible_size;
+    }
+
+    result.sampled_blocks = sum.blocks;
+    result.sampled_files = sum.files;
+    result.sampled_size = sum.size;
+    if (sum.size > 0)
+    {
+        const auto sampled_size = static_cast<double>(sum.size);
+        result.entropy = sum.entropy_bits / sampled_size;
+        result.compression_ratio = std::max(1.0, sampled_size / sum.compressed_size);
+        result.incompressible_share = static_cast<double>(sum.incompressible_size) / sampled_size;
+    }
+#else
+    (void) path;
+    (void) options;
+    result.ec = std::make_error_code(std::errc::not_supported);
+#endif
+
+    return result;
+}
+
+} // namespace disk_usage
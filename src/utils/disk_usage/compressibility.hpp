@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+namespace disk_usage {
+
+/**
+ * Number of occurrences of every byte value in a block of data.
+ */
+struct byte_histogram final
+{
+    std::array<std::uint64_t, 256> counts{};
+    std::uint64_t total{0};
+
+    /**
+     * Counts the bytes of the given data.
+     *
+     * Consecutive bytes are counted into 4 interleaved sub-histograms, so runs of the same byte
+     * don't serialize on a single counter. The sub-histograms are summed up with a vectorized loop.
+     */
+    void add(const void *data, std::size_t size) noexcept;
+
+    /**
+     * Order-0 Shannon entropy of the counted bytes in bits per byte, in the range of [0, 8].
+     */
+    double entropy() const noexcept;
+};
+
+/**
+ * Options to control the behavior of {estimate_compressibility}.
+ */
+struct compressibility_options final
+{
+    /**
+     * Maximum number of bytes which are read from the directory.
+     */
+    std::uintmax_t max_read_size{64 * 1024 * 1024};
+
+    /**
+     * Size of a single sampled block, smaller files are sampled completely.
+     */
+    std::size_t block_size{64 * 1024};
+
+    /**
+     * Number of worker threads to use, see {scan_options::thread_count}.
+     */
+    unsigned thread_count{0};
+};
+
+/**
+ * Outcome of {estimate_compressibility}.
+ */
+struct compressibility_result final
+{
+    /// number of sampled blocks, the number of files they belong to and the bytes which were read
+    std::uint64_t sampled_blocks{0};
+    std::uint64_t sampled_files{0};
+    std::uintmax_t sampled_size{0};
+
+    /// size weighted mean of the entropies of the sampled blocks in bits per byte
+    double entropy{0};
+
+    /// estimated ratio of the original size to the compressed size, 1 means incompressible
+    double compression_ratio{1};
+
+    /// share of the sampled bytes in blocks which are practically incompressible (already compressed data)
+    double incompressible_share{0};
+
+    /// the first error encountered, unreadable files are skipped
+    std::error_code ec;
+
+    /// inline helper which returns true when the estimate is based on at least one sample
+    inline bool has_samples() const noexcept {
+        return this->sampled_size > 0;
+    }
+};
+
+/**
+ * Estimates how well the files of the given directory compress by sampling blocks of their contents.
+ *
+ * The directory is walked once to collect the sizes of all regular files, the samples are then spread
+ * over their bytes, not over the files: every `total_size / (max_read_size / block_size)` bytes of the
+ * files concatenated in path order, a block of the file at this position is sampled. Large files are
+ * therefore sampled in multiple places, and at most {compressibility_options::max_read_size} bytes are
+ * read no matter how large the directory is. The blocks are read and analyzed in parallel.
+ *
+ * The estimate is based on the order-0 entropy of every block (see {byte_histogram}). It reliably identifies
+ * already compressed data (archives, images, compiled objects), which doesn't benefit from a compressed
+ * filesystem. For text, the estimate is a lower bound, dictionary based compressors achieve more.
+ *
+ * @param path the directory to sample
+ * @param options sampling options
+ * @return the estimated compressibility
+ */
+compressibility_result estimate_compressibility(const std::string &path,
+    const compressibility_options &options) noexcept;
+
+} // namespace disk_usage
@@ -0,0 +1,767 @@
+#include "dedupe.hpp"
+#include "disk_usage.hpp"
+#include "error_utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <tuple>
+
+#include "../threading/work_stealing_pool.hpp"
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(PROJECT_PLATFORM_LINUX)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+
+using disk_usage::first_error_t;
+using disk_usage::last_error;
+
+constexpr std::uint32_t prime32_1 = 0x9E3779B1U;
+constexpr std::uint32_t prime32_2 = 0x85EBCA77U;
+constexpr std::uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+
+/// number of bytes at the beginning and the end of a file which are hashed by the prefilter
+constexpr std::size_t edge_size = 4096;
+
+/// size of the read buffers, reduced to fit into the memory budget
+constexpr std::size_t max_buffer_size = 1024 * 1024;
+constexpr std::size_t min_buffer_size = 64 * 1024;
+
+/// number of files which are hashed by a single task
+constexpr std::size_t files_per_task = 16;
+
+/**
+ * A regular file which may have duplicates.
+ */
+struct candidate_t final
+{
+    std::string path;
+    std::size_t root_index{0};
+    std::uint64_t device{0};
+    std::uint64_t inode{0};
+    std::uintmax_t size{0};
+
+    /// hash of the current stage
+    std::uint64_t hash{0};
+
+    /// the file changed or couldn't be read, it is dropped after the current stage
+    bool failed{false};
+};
+
+inline auto group_key(const candidate_t &candidate) noexcept
+{
+    return std::tie(candidate.device, candidate.size, candidate.hash);
+}
+
+/**
+ * Sorts the candidates into groups and removes all candidates without another candidate in their group.
+ */
+void drop_unique_candidates(std::vector<candidate_t> &candidates)
+{
+    std::erase_if(candidates, [](const candidate_t &candidate) {
+        return candidate.failed;
+    });
+    std::sort(candidates.begin(), candidates.end(), [](const candidate_t &a, const candidate_t &b) {
+        return std::tie(a.device, a.size, a.hash, a.root_index, a.path) <
+            std::tie(b.device, b.size, b.hash, b.root_index, b.path);
+    });
+
+    std::size_t kept = 0;
+    for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end)
+    {
+        end = begin + 1;
+        while (end < candidates.size() && group_key(candidates[end]) == group_key(candidates[begin]))
+        {
+            ++end;
+        }
+        if (end - begin < 2)
+        {
+            continue;
+        }
+
+        // groups which are already in place are not moved, moving onto themselves would empty the paths
+        if (kept != begin)
+        {
+            std::move(candidates.begin() + begin, candidates.begin() + end, candidates.begin() + kept);
+        }
+        kept += end - begin;
+    }
+    candidates.erase(candidates.begin() + kept, candidates.end());
+}
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+
+/**
+ * Reads exactly @p size bytes at the given offset, fails on short files.
+ */
+bool read_fully(int fd, unsigned char *buffer, std::size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        const auto count = ::pread(fd, buffer, size, offset);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (count <= 0)
+        {
+            if (count == 0)
+            {
+                errno = ENODATA;
+            }
+            return false;
+        }
+        buffer += count;
+        size -= static_cast<std::size_t>(count);
+        offset += count;
+    }
+    return true;
+}
+
+/**
+ * Opens the candidate read-only and makes sure that it is still the same file with the same size.
+ *
+ * @return the file descriptor, or -1 if the file can't be opened or changed since the walk
+ */
+int open_candidate(const candidate_t &candidate, struct stat &st)
+{
+    const int fd = ::open(candidate.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_ino != candidate.inode ||
+        static_cast<std::uintmax_t>(st.st_size) != candidate.size)
+    {
+        ::close(fd);
+        errno = ESTALE;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Hashes the first and last {edge_size} bytes of the candidate (@p partial) or its whole contents.
+ *
+ * Files which are not larger than both edges are always hashed completely.
+ */
+void hash_candidate(candidate_t &candidate, bool partial, unsigned char *buffer, std::size_t buffer_size,
+    first_error_t &first_error)
+{
+    struct stat st;
+    const int fd = open_candidate(candidate, st);
+    if (fd < 0)
+    {
+        if (errno != ENOENT && errno != ESTALE && errno != EACCES && errno != ELOOP)
+        {
+            first_error.report(last_error());
+        }
+        candidate.failed = true;
+        return;
+    }
+
+    // the size is part of the seed, files of different sizes are never compared anyway
+    disk_usage::content_hash_t hash(candidate.size);
+    bool ok = true;
+    if (partial && candidate.size > 2 * edge_size)
+    {
+        ok = read_fully(fd, buffer, edge_size, 0) &&
+            read_fully(fd, buffer + edge_size, edge_size, static_cast<off_t>(candidate.size - edge_size));
+        hash.update(buffer, 2 * edge_size);
+    }
+    else
+    {
+#if defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        std::uintmax_t offset = 0;
+        while (ok && offset < candidate.size)
+        {
+            const auto count = static_cast<std::size_t>(std::min<std::uintmax_t>(buffer_size, candidate.size - offset));
+            ok = read_fully(fd, buffer, count, static_cast<off_t>(offset));
+            hash.update(buffer, count);
+            offset += count;
+        }
+    }
+
+    if (!ok && errno != ENODATA)
+    {
+        first_error.report(last_error());
+    }
+    ::close(fd);
+
+    candidate.hash = hash.digest();
+    candidate.failed = !ok;
+}
+
+/**
+ * Compares the contents of two files of the given size.
+ */
+bool have_same_contents(int fd_a, int fd_b, std::uintmax_t size, unsigned char *buffer, std::size_t buffer_size)
+{
+    const auto half = buffer_size / 2;
+    for (std::uintmax_t offset = 0; offset < size;)
+    {
+        const auto count = static_cast<std::size_t>(std::min<std::uintmax_t>(half, size - offset));
+        if (!read_fully(fd_a, buffer, count, static_cast<off_t>(offset)) ||
+            !read_fully(fd_b, buffer + half, count, static_cast<off_t>(offset)) ||
+            std::memcmp(buffer, buffer + half, count) != 0)
+        {
+            return false;
+        }
+        offset += count;
+    }
+    return true;
+}
+
+/**
+ * Checks if both files start with the same physical extent, which means they were already deduplicated.
+ */
+bool share_extents(int fd_a, int fd_b)
+{
+#if defined(PROJECT_PLATFORM_LINUX)
+    const auto first_extent = [](int fd, std::uint64_t &physical) {
+        // room for a single extent after the header
+        alignas(struct fiemap) unsigned char request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)]{};
+        auto *map = reinterpret_cast<struct fiemap*>(request);
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+        if (::ioctl(fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0 ||
+            (map->fm_extents[0].fe_flags & FIEMAP_EXTENT_SHARED) == 0)
+        {
+            return false;
+        }
+        physical = map->fm_extents[0].fe_physical;
+        return true;
+    };
+
+    std::uint64_t physical_a = 0, physical_b = 0;
+    return first_extent(fd_a, physical_a) && first_extent(fd_b, physical_b) && physical_a == physical_b;
+#else
+    (void) fd_a;
+    (void) fd_b;
+    return false;
+#endif
+}
+
+/**
+ * Errors of reflinks and hardlinks which mean that the filesystem or the file doesn't support it.
+ */
+inline bool is_unsupported(int error) noexcept
+{
+    return error == EOPNOTSUPP || error == ENOTSUP || error == EXDEV || error == EINVAL || error == ENOTTY ||
+        error == EPERM || error == EACCES || error == EROFS || error == ETXTBSY || error == EMLINK;
+}
+
+/**
+ * Outcome of replacing a duplicate with a reflink.
+ */
+enum class reflink_result_t
+{
+    reflinked,
+    /// the filesystem or the file doesn't support reflinks, another method can be tried
+    unsupported,
+    /// the duplicate was modified since it was found, or an error occurred
+    failed,
+};
+
+/**
+ * Shares the extents of the kept file with the duplicate, the inode and its metadata are kept.
+ *
+ * Uses `FIDEDUPERANGE`, the kernel locks both files, compares their contents and only shares
+ * the extents if they are identical, so a duplicate which is modified concurrently is never lost.
+ * The duplicate only needs to be open for reading when it is owned by the current user.
+ */
+reflink_result_t replace_with_reflink(int keep_fd, int duplicate_fd, std::uintmax_t size, first_error_t &first_error)
+{
+#if defined(PROJECT_PLATFORM_LINUX) && defined(FIDEDUPERANGE)
+    // room for a single destination after the header
+    alignas(struct file_dedupe_range) unsigned char request[
+        sizeof(struct file_dedupe_range) + sizeof(struct file_dedupe_range_info)]{};
+    auto *range = reinterpret_cast<struct file_dedupe_range*>(request);
+
+    // filesystems may share less than requested in a single call
+    for (std::uintmax_t offset = 0; offset < size;)
+    {
+        *range = {};
+        range->src_offset = offset;
+        range->src_length = size - offset;
+        range->dest_count = 1;
+        range->info[0] = {};
+        range->info[0].dest_fd = duplicate_fd;
+        range->info[0].dest_offset = offset;
+
+        if (::ioctl(keep_fd, FIDEDUPERANGE, range) != 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (is_unsupported(errno))
+            {
+                return offset == 0 ? reflink_result_t::unsupported : reflink_result_t::failed;
+            }
+            first_error.report(last_error());
+            return reflink_result_t::failed;
+        }
+
+        const auto &info = range->info[0];
+        if (info.status == FILE_DEDUPE_RANGE_DIFFERS)
+        {
+            return reflink_result_t::failed;
+        }
+        else if (info.status < 0)
+        {
+            if (is_unsupported(-info.status))
+            {
+                return offset == 0 ? reflink_result_t::unsupported : reflink_result_t::failed;
+            }
+            first_error.report(std::error_code{-info.status, std::generic_category()});
+            return reflink_result_t::failed;
+        }
+        else if (info.bytes_deduped == 0)
+        {
+            return reflink_result_t::failed;
+        }
+        offset += info.bytes_deduped;
+    }
+    return reflink_result_t::reflinked;
+#else
+    (void) keep_fd;
+    (void) duplicate_fd;
+    (void) size;
+    (void) first_error;
+    return reflink_result_t::unsupported;
+#endif
+}
+
+/**
+ * Checks that a file still has the identity, size and modification time it had when it was compared.
+ */
+inline bool is_unchanged(const struct stat &st, const struct stat &compared_st) noexcept
+{
+    return st.st_dev == compared_st.st_dev && st.st_ino == compared_st.st_ino &&
+        st.st_size == compared_st.st_size && st.st_mtim.tv_sec == compared_st.st_mtim.tv_sec &&
+        st.st_mtim.tv_nsec == compared_st.st_mtim.tv_nsec;
+}
+
+/**
+ * Atomically replaces the duplicate with a hardlink to the kept file.
+ *
+ * The kept file and the path of the duplicate are checked against the state in which they were
+ * compared right before the duplicate is replaced, the duplicate is skipped if anything changed.
+ */
+bool replace_with_hardlink(int keep_fd, const struct stat &keep_st, const candidate_t &keep,
+    const candidate_t &duplicate, const struct stat &duplicate_st, first_error_t &first_error)
+{
+    const auto separator = duplicate.path.find_last_of('/');
+    const auto parent_path = separator == std::string::npos ? std::string{"."} :
+        separator == 0 ? std::string{"/"} : duplicate.path.substr(0, separator);
+    const auto name = separator == std::string::npos ? duplicate.path : duplicate.path.substr(separator + 1);
+    const auto temporary_name = name + ".cachemgr-dedupe." + std::to_string(::getpid());
+
+    const int parent_fd = ::open(parent_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parent_fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            first_error.report(last_error());
+        }
+        return false;
+    }
+
+    // link the opened file, the kept path may have been replaced since it was compared
+    int result = -1;
+#if defined(PROJECT_PLATFORM_LINUX)
+    const auto fd_path = "/proc/self/fd/" + std::to_string(keep_fd);
+    result = ::linkat(AT_FDCWD, fd_path.c_str(), parent_fd, temporary_name.c_str(), AT_SYMLINK_FOLLOW);
+#else
+    errno = ENOENT;
+#endif
+    if (result != 0 && errno == ENOENT)
+    {
+        result = ::linkat(AT_FDCWD, keep.path.c_str(), parent_fd, temporary_name.c_str(), 0);
+    }
+    if (result != 0)
+    {
+        if (!is_unsupported(errno))
+        {
+            first_error.report(last_error());
+        }
+        ::close(parent_fd);
+        return false;
+    }
+
+    // neither file may have changed since they were compared
+    struct stat current_keep_st, current_duplicate_st, linked_st;
+    const bool is_same = ::fstat(keep_fd, &current_keep_st) == 0 && is_unchanged(current_keep_st, keep_st) &&
+        ::fstatat(parent_fd, temporary_name.c_str(), &linked_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        linked_st.st_ino == keep_st.st_ino && linked_st.st_dev == keep_st.st_dev &&
+        ::fstatat(parent_fd, name.c_str(), &current_duplicate_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        is_unchanged(current_duplicate_st, duplicate_st);
+    if (!is_same)
+    {
+        ::unlinkat(parent_fd, temporary_name.c_str(), 0);
+        ::close(parent_fd);
+        return false;
+    }
+
+    if (::renameat(parent_fd, temporary_name.c_str(), parent_fd, name.c_str()) != 0)
+    {
+        first_error.report(last_error());
+        ::unlinkat(parent_fd, temporary_name.c_str(), 0);
+        ::close(parent_fd);
+        return false;
+    }
+    ::close(parent_fd);
+    return true;
+}
+
+/**
+ * Replaces all duplicates of a group, the first candidate is kept.
+ */
+void replace_group(const candidate_t *group, std::size_t group_size, const disk_usage::dedupe_options &options,
+    unsigned char *buffer, std::size_t buffer_size, std::mutex &result_mutex, disk_usage::dedupe_result &result,
+    first_error_t &first_error)
+{
+    const auto &keep = group[0];
+    struct stat keep_st;
+    const int keep_fd = open_candidate(keep, keep_st);
+    if (keep_fd < 0)
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        result.skipped_files += group_size - 1;
+        return;
+    }
+
+    for (std::size_t i = 1; i < group_size; ++i)
+    {
+        const auto &duplicate = group[i];
+
+        struct stat duplicate_st;
+        const int duplicate_fd = open_candidate(duplicate, duplicate_st);
+        if (duplicate_fd < 0 || share_extents(keep_fd, duplicate_fd))
+        {
+            if (duplicate_fd >= 0)
+            {
+                ::close(duplicate_fd);
+            }
+            std::lock_guard<std::mutex> lock(result_mutex);
+            ++result.skipped_files;
+            continue;
+        }
+
+        // a reflink frees the blocks of the duplicate, a hardlink only when the duplicate has no other links
+        const auto reflink_freed_size = static_cast<std::uintmax_t>(duplicate_st.st_blocks) * 512;
+        const auto hardlink_freed_size = duplicate_st.st_nlink == 1 ? reflink_freed_size : 0;
+
+        // the kernel compares the contents for reflinks, they are only compared here for a dry run and hardlinks
+        bool is_duplicate = false, reflinked = false, hardlinked = false;
+        if (options.dry_run)
+        {
+            is_duplicate = have_same_contents(keep_fd, duplicate_fd, keep.size, buffer, buffer_size);
+        }
+        else
+        {
+            const auto reflink_result = replace_with_reflink(keep_fd, duplicate_fd, keep.size, first_error);
+            reflinked = reflink_result == reflink_result_t::reflinked;
+            is_duplicate = reflinked || (reflink_result == reflink_result_t::unsupported &&
+                have_same_contents(keep_fd, duplicate_fd, keep.size, buffer, buffer_size));
+            hardlinked = !reflinked && is_duplicate && options.allow_hardlinks &&
+                replace_with_hardlink(keep_fd, keep_st, keep, duplicate, duplicate_st, first_error);
+        }
+        ::close(duplicate_fd);
+
+        std::lock_guard<std::mutex> lock(result_mutex);
+        if (!is_duplicate)
+        {
+            ++result.skipped_files;
+            continue;
+        }
+
+        auto &root = result.roots[duplicate.root_index];
+        ++root.duplicate_files;
+        if (options.dry_run)
+        {
+            root.reclaimed_size += reflink_freed_size;
+        }
+        else if (reflinked || hardlinked)
+        {
+            root.reflinked_files += reflinked ? 1 : 0;
+            root.hardlinked_files += hardlinked ? 1 : 0;
+            root.reclaimed_size += reflinked ? reflink_freed_size : hardlink_freed_size;
+        }
+        else
+        {
+            ++result.skipped_files;
+        }
+    }
+    ::close(keep_fd);
+}
+
+#endif
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+content_hash_t::content_hash_t(std::uint64_t seed) noexcept
+    : _seed(seed)
+{
+    for (std::size_t i = 0; i < lane_count; ++i)
+    {
+        this->_lanes[i] = static_cast<std::uint32_t>(seed) + prime32_1 * static_cast<std::uint32_t>(i + 1);
+    }
+}
+
+void content_hash_t::consume_stripes(const unsigned char *data, std::size_t stripe_count) noexcept
+{
+    // the lanes are independent, this loop is vectorized by the compiler
+    auto lanes = this->_lanes;
+    for (std::size_t stripe = 0; stripe < stripe_count; ++stripe, data += stripe_size)
+    {
+        std::uint32_t input[lane_count];
+        std::memcpy(input, data, stripe_size);
+        for (std::size_t i = 0; i < lane_count; ++i)
+        {
+            lanes[i] = std::rotl(lanes[i] + input[i] * prime32_2, 13) * prime32_1;
+        }
+    }
+    this->_lanes = lanes;
+}
+
+void content_hash_t::update(const void *data, std::size_t size) noexcept
+{
+    auto *bytes = static_cast<const unsigned char*>(data);
+    this->_total_size += size;
+
+    if (this->_tail_size > 0)
+    {
+        const auto count = std::min(size, stripe_size - this->_tail_size);
+        std::memcpy(this->_tail.data() + this->_tail_size, bytes, count);
+        this->_tail_size += count;
+        bytes += count;
+        size -= count;
+        if (this->_tail_size < stripe_size)
+        {
+            return;
+        }
+        this->consume_stripes(this->_tail.data(), 1);
+        this->_tail_size = 0;
+    }
+
+    const auto stripe_count = size / stripe_size;
+    this->consume_stripes(bytes, stripe_count);
+    bytes += stripe_count * stripe_size;
+    size -= stripe_count * stripe_size;
+
+    std::memcpy(this->_tail.data(), bytes, size);
+    this->_tail_size = size;
+}
+
+std::uint64_t content_hash_t::digest() const noexcept
+{
+    std::uint64_t hash = this->_seed + prime64_3 + this->_total_size;
+    for (const auto lane : this->_lanes)
+    {
+        hash ^= lane * prime64_2;
+        hash = std::rotl(hash, 27) * prime64_1 + prime64_3;
+    }
+    for (std::size_t i = 0; i < this->_tail_size; ++i)
+    {
+        hash ^= this->_tail[i] * prime64_3;
+        hash = std::rotl(hash, 11) * prime64_1;
+    }
+
+    // final avalanche
+    hash ^= hash >> 33;
+    hash *= prime64_2;
+    hash ^= hash >> 29;
+    hash *= prime64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::uint64_t content_hash_t::hash(const void *data, std::size_t size, std::uint64_t seed) noexcept
+{
+    content_hash_t hash(seed);
+    hash.update(data, size);
+    return hash.digest();
+}
+
+dedupe_result deduplicate(const std::vector<std::string> &roots, const dedupe_options &options) noexcept
+{
+    dedupe_result result;
+    result.roots.resize(roots.size());
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    first_error_t first_error;
+
+    // stage 1: collect all regular files, grouped by filesystem and size
+    std::vector<candidate_t> candidates;
+    {
+        std::mutex candidates_mutex;
+        for (std::size_t root_index = 0; root_index < roots.size(); ++root_index)
+        {
+            const auto ec_walk = walk_directory(roots[root_index], walk_options{.thread_count = options.thread_count},
+                [&](const walk_entry &entry) -> std::uint64_t {
+                    if (entry.type == entry_type::directory)
+                    {
+                        return 1;
+                    }
+                    else if (entry.type != entry_type::regular_file)
+                    {
+                        return 0;
+                    }
+
+                    entry_stat stat;
+                    if (const auto ec = stat_entry(entry, stat); ec)
+                    {
+                        if (ec != std::errc::permission_denied && ec != std::errc::no_such_file_or_directory)
+                        {
+                            first_error.report(ec);
+                        }
+                        return 0;
+                    }
+                    if (stat.type != entry_type::regular_file || stat.apparent_size < options.min_size ||
+                        stat.apparent_size == 0)
+                    {
+                        return 0;
+                    }
+
+                    std::string path;
+                    path.reserve(entry.directory.size() + entry.name.size() + 1);
+                    path.append(entry.directory).append("/").append(entry.name);
+
+                    std::lock_guard<std::mutex> lock(candidates_mutex);
+                    candidates.emplace_back(candidate_t{
+                        .path = std::move(path),
+                        .root_index = root_index,
+                        .device = stat.device,
+                        .inode = stat.inode,
+                        .size = stat.apparent_size,
+                    });
+                    return 0;
+                });
+            if (ec_walk)
+            {
+                first_error.report(ec_walk);
+            }
+        }
+    }
+
+    // paths of the same inode are already deduplicated, the first one (by root, then path) represents the inode
+    std::sort(candidates.begin(), candidates.end(), [](const candidate_t &a, const candidate_t &b) {
+        return std::tie(a.device, a.inode, a.root_index, a.path) < std::tie(b.device, b.inode, b.root_index, b.path);
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const candidate_t &a, const candidate_t &b) {
+        return a.device == b.device && a.inode == b.inode;
+    }), candidates.end());
+    drop_unique_candidates(candidates);
+
+    // every reading thread owns a buffer, the threads are limited by the memory budget
+    const auto requested_threads = threading::work_stealing_pool_t::resolve_thread_count(options.thread_count);
+    const auto buffer_size = std::clamp<std::size_t>(options.memory_budget / requested_threads,
+        min_buffer_size, max_buffer_size);
+    const auto threads = static_cast<unsigned>(std::clamp<std::size_t>(
+        options.memory_budget / buffer_size, 1, requested_threads));
+    std::vector<std::vector<unsigned char>> buffers(threads);
+
+    // hashes the candidates in [first, last)
+    const auto hash_candidates = [&](bool partial, std::size_t first, std::size_t last) {
+        threading::work_stealing_pool_t pool(threads);
+        for (std::size_t begin = first; begin < last; begin += files_per_task)
+        {
+            const auto end = std::min(begin + files_per_task, last);
+            pool.submit([&, begin, end](unsigned worker) {
+                auto &buffer = buffers[worker];
+                buffer.resize(buffer_size);
+                for (auto i = begin; i < end; ++i)
+                {
+                    hash_candidate(candidates[i], partial, buffer.data(), buffer.size(), first_error);
+                }
+            });
+        }
+        pool.wait();
+    };
+
+    // stage 2: hash the first and last bytes, small files are hashed completely
+    result.partially_hashed_files = candidates.size();
+    hash_candidates(true, 0, candidates.size());
+    drop_unique_candidates(candidates);
+
+    // stage 3: hash the remaining large files completely, they are moved behind the small files
+    // (small and large files never share a size, so they never end up in the same group)
+    const auto large_files_begin = static_cast<std::size_t>(std::distance(candidates.begin(),
+        std::stable_partition(candidates.begin(), candidates.end(), [](const candidate_t &candidate) {
+            return candidate.size <= 2 * edge_size;
+        })));
+
+    result.fully_hashed_files = candidates.size() - large_files_begin;
+    hash_candidates(false, large_files_begin, candidates.size());
+    drop_unique_candidates(candidates);
+
+    // collect the groups, candidates are sorted by group and by root and path inside of a group
+    std::vector<std::pair<std::size_t, std::size_t>> group_ranges;
+    for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end)
+    {
+        end = begin + 1;
+        while (end < candidates.size() && group_key(candidates[end]) == group_key(candidates[begin]))
+        {
+            ++end;
+        }
+        group_ranges.emplace_back(begin, end);
+
+        auto &group = result.groups.emplace_back(duplicate_group{.size = candidates[begin].size, .files = {}});
+        group.files.reserve(end - begin);
+        for (auto i = begin; i < end; ++i)
+        {
+            group.files.emplace_back(duplicate_file{
+                .path = candidates[i].path,
+                .root_index = candidates[i].root_index,
+                .device = candidates[i].device,
+                .inode = candidates[i].inode,
+            });
+        }
+    }
+
+    // stage 4: compare and replace the duplicates of every group
+    {
+        std::mutex result_mutex;
+        threading::work_stealing_pool_t pool(threads);
+        for (const auto &[begin, end] : group_ranges)
+        {
+            pool.submit([&, begin, end](unsigned worker) {
+                auto &buffer = buffers[worker];
+                buffer.resize(buffer_size);
+                replace_group(&candidates[begin], end - begin, options, buffer.data(), buffer.size(),
+                    result_mutex, result, first_error);
+            });
+        }
+        pool.wait();
+    }
+
+    result.ec = first_error.ec;
+#else
+    result.ec = std::make_error_code(std::errc::not_supported);
+#endif
+
+    return result;
+}
+
+} // namespace disk_usage
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace disk_usage {
+
+/**
+ * Fast non-cryptographic 64-bit hash of file contents, see {deduplicate}.
+ *
+ * The data is consumed in stripes of 32 bytes by 8 independent 32-bit lanes. The lanes don't
+ * depend on each other, so the compiler vectorizes the kernel into a few SIMD multiply/rotate
+ * instructions per stripe (SSE4.1/AVX2/NEON), without platform specific code.
+ * The digest doesn't depend on how the data is split into {update} calls.
+ *
+ * Not suitable against adversarial inputs, duplicates are always compared byte by byte before they are replaced.
+ */
+class content_hash_t final
+{
+public:
+    explicit content_hash_t(std::uint64_t seed = 0) noexcept;
+
+    /**
+     * Appends the given data to the hashed contents.
+     */
+    void update(const void *data, std::size_t size) noexcept;
+
+    /**
+     * Returns the hash of all contents which were appended so far.
+     */
+    std::uint64_t digest() const noexcept;
+
+    /**
+     * Hashes the given data in one go.
+     */
+    static std::uint64_t hash(const void *data, std::size_t size, std::uint64_t seed = 0) noexcept;
+
+private:
+    static constexpr std::size_t stripe_size = 32;
+    static constexpr std::size_t lane_count = stripe_size / sizeof(std::uint32_t);
+
+    void consume_stripes(const unsigned char *data, std::size_t stripe_count) noexcept;
+
+    std::array<std::uint32_t, lane_count> _lanes;
+    std::array<unsigned char, stripe_size> _tail{};
+    std::size_t _tail_size{0};
+    std::uint64_t _total_size{0};
+    std::uint64_t _seed;
+};
+
+/**
+ * Options to control the behavior of {deduplicate}.
+ */
+struct dedupe_options final
+{
+    /**
+     * Files smaller than this size are ignored, they rarely free a whole filesystem block.
+     */
+    std::uintmax_t min_size{4096};
+
+    /**
+     * Replace duplicates with hardlinks when the filesystem doesn't support reflinks.
+     *
+     * Hardlinked files share their permissions and timestamps, and a write through one path
+     * changes all of them. This is only safe for caches whose files are never modified in place.
+     */
+    bool allow_hardlinks{false};
+
+    /**
+     * Upper bound of the memory used for read buffers, shared by all threads.
+     *
+     * The number of threads which read file contents at the same time is reduced to fit into the budget.
+     */
+    std::size_t memory_budget{64 * 1024 * 1024};
+
+    /**
+     * Number of worker threads to use, see {scan_options::thread_count}.
+     */
+    unsigned thread_count{0};
+
+    /**
+     * Only find the duplicates, nothing is modified.
+     */
+    bool dry_run{false};
+};
+
+/**
+ * A file which has the same contents as other files, see {duplicate_group}.
+ */
+struct duplicate_file final
+{
+    std::string path;
+
+    /// index of the root directory which contains the file
+    std::size_t root_index{0};
+
+    /// identity of the inode
+    std::uint64_t device{0};
+    std::uint64_t inode{0};
+};
+
+/**
+ * Files with identical contents on the same filesystem.
+ */
+struct duplicate_group final
+{
+    /// size of every file of the group
+    std::uintmax_t size{0};
+
+    /// the first file is kept, all other files are replaced by it (ordered by root, then path)
+    std::vector<duplicate_file> files;
+};
+
+/**
+ * Outcome of {deduplicate} for a single root directory.
+ */
+struct dedupe_root_result final
+{
+    /// number of files of this root which duplicate a kept file
+    std::uint64_t duplicate_files{0};
+
+    /// number of duplicates of this root which were replaced, always 0 in a dry run
+    std::uint64_t reflinked_files{0};
+    std::uint64_t hardlinked_files{0};
+
+    /// space which was freed by replacing the duplicates of this root, the reclaimable space in a dry run
+    std::uintmax_t reclaimed_size{0};
+};
+
+/**
+ * Outcome of {deduplicate}.
+ */
+struct dedupe_result final
+{
+    /// one result per root directory, in the given order
+    std::vector<dedupe_root_result> roots;
+
+    /// files with identical sizes and hashes, files which turn out to differ when compared are skipped
+    std::vector<duplicate_group> groups;
+
+    /// number of files which were hashed partially and completely, shows how effective the prefilters were
+    std::uint64_t partially_hashed_files{0};
+    std::uint64_t fully_hashed_files{0};
+
+    /// number of files which were not replaced, because they changed or the filesystem doesn't support it
+    std::uint64_t skipped_files{0};
+
+    /// the first error encountered, processing continues after errors
+    std::error_code ec;
+};
+
+/**
+ * Finds files with identical contents in the given directories and replaces them with reflinks or hardlinks.
+ *
+ * Duplicates are found in stages, every stage only looks at the candidates which survived the previous one:
+ *  1. the directories are walked in parallel, regular files are grouped by filesystem and size
+ *  2. files of the same size are grouped by a hash of their first and last 4 KiB
+ *  3. the remaining files are hashed completely, see {content_hash_t}
+ *
+ * Files are read in parallel with buffers which fit into {dedupe_options::memory_budget}.
+ * Paths of the same inode are only considered once, symbolic links are neither followed nor replaced.
+ *
+ * Duplicates are replaced with reflinks (`FIDEDUPERANGE`, btrfs, XFS, bcachefs) which keep their inodes
+ * and metadata. The kernel compares the contents and shares the extents atomically, so duplicates which
+ * are modified concurrently are skipped, and read-only files of the current user are supported.
+ * When the filesystem doesn't support reflinks and hardlinks are allowed, the duplicate is compared
+ * byte by byte and atomically replaced with a hardlink to the kept file, unless either file changed
+ * since the comparison. Files which already share their extents with the kept file are skipped.
+ *
+ * @param roots the directories to deduplicate
+ * @param options deduplication options
+ * @return the duplicates and the freed space per root directory
+ */
+dedupe_result deduplicate(const std::vector<std::string> &roots, const dedupe_options &options) noexcept;
+
+} // namespace disk_usage
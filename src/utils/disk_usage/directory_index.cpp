@@ -0,0 +1,94 @@
+#include "directory_index.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr std::uint64_t fnv_offset_basis = 0xcbf29ce484222325ull;
+constexpr std::uint64_t fnv_prime = 0x100000001b3ull;
+
+inline std::uint64_t fnv1a(std::uint64_t hash, std::string_view data) noexcept
+{
+    for (const char c : data)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+std::uint64_t directory_index_t::hash_path(std::string_view path) noexcept
+{
+    return fnv1a(fnv_offset_basis, path);
+}
+
+std::uint64_t directory_index_t::hash_child(std::uint64_t parent_hash, std::string_view name) noexcept
+{
+    return fnv1a(fnv1a(parent_hash, "/"), name);
+}
+
+void directory_index_t::attach(const directory_columns_t &columns, std::uint32_t generation) noexcept
+{
+    this->_previous = columns;
+    this->_generation = generation;
+}
+
+std::optional<directory_record_t> directory_index_t::find(std::uint64_t path_hash) const noexcept
+{
+    const auto &columns = this->_previous;
+    const auto *end = columns.path_hash + columns.size;
+    const auto *it = std::lower_bound(columns.path_hash, end, path_hash);
+    if (it == end || *it != path_hash)
+    {
+        return std::nullopt;
+    }
+
+    const auto i = static_cast<std::size_t>(it - columns.path_hash);
+    return directory_record_t{
+        .path_hash = path_hash,
+        .mtime_sec = columns.mtime_sec[i],
+        .ctime_sec = columns.ctime_sec[i],
+        .mtime_nsec = columns.mtime_nsec[i],
+        .ctime_nsec = columns.ctime_nsec[i],
+        .apparent_size = columns.apparent_size[i],
+        .allocated_size = columns.allocated_size[i],
+        .entry_count = columns.entry_count[i],
+        .flags = columns.flags[i],
+    };
+}
+
+bool directory_index_t::must_verify(std::uint64_t path_hash) const noexcept
+{
+    return path_hash % verification_interval == (this->_generation + 1) % verification_interval;
+}
+
+void directory_index_t::add_records(const std::vector<directory_record_t> &records)
+{
+    std::lock_guard<std::mutex> lock(this->_current_mutex);
+    this->_current.insert(this->_current.end(), records.begin(), records.end());
+}
+
+std::vector<directory_record_t> directory_index_t::current_records() const
+{
+    std::vector<directory_record_t> records;
+    {
+        std::lock_guard<std::mutex> lock(this->_current_mutex);
+        records = this->_current;
+    }
+
+    std::sort(records.begin(), records.end(), [](const directory_record_t &lhs, const directory_record_t &rhs) {
+        return lhs.path_hash < rhs.path_hash;
+    });
+    records.erase(std::unique(records.begin(), records.end(),
+        [](const directory_record_t &lhs, const directory_record_t &rhs) {
+            return lhs.path_hash == rhs.path_hash;
+        }), records.end());
+
+    return records;
+}
+
+} // namespace disk_usage
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace disk_usage {
+
+/**
+ * Persisted metadata of a single directory from a previous scan.
+ */
+struct directory_record_t final
+{
+    /// the directory contains hardlinks or entries without `d_type`, the subtotal can't be reused
+    static constexpr std::uint32_t flag_not_reusable = 1u << 0;
+
+    /// hash of the absolute path, see {directory_index_t::hash_path}
+    std::uint64_t path_hash{0};
+
+    /// modification and status change time of the directory itself
+    std::int64_t mtime_sec{0};
+    std::int64_t ctime_sec{0};
+    std::uint32_t mtime_nsec{0};
+    std::uint32_t ctime_nsec{0};
+
+    /// sizes of the files directly inside of the directory, subdirectories are not included
+    std::uint64_t apparent_size{0};
+    std::uint64_t allocated_size{0};
+
+    /// number of directory entries (without "." and "..")
+    std::uint32_t entry_count{0};
+
+    std::uint32_t flags{0};
+};
+
+/**
+ * Read-only structure-of-arrays view of directory records, sorted by path hash.
+ *
+ * Every column has {size} elements, the memory is owned by someone else
+ * (e.g. a memory-mapped snapshot file).
+ */
+struct directory_columns_t final
+{
+    const std::uint64_t *path_hash{nullptr};
+    const std::int64_t *mtime_sec{nullptr};
+    const std::int64_t *ctime_sec{nullptr};
+    const std::uint32_t *mtime_nsec{nullptr};
+    const std::uint32_t *ctime_nsec{nullptr};
+    const std::uint64_t *apparent_size{nullptr};
+    const std::uint64_t *allocated_size{nullptr};
+    const std::uint32_t *entry_count{nullptr};
+    const std::uint32_t *flags{nullptr};
+    std::size_t size{0};
+};
+
+/**
+ * Index of directory records which allows incremental rescans.
+ *
+ * The mtime and ctime of a directory change whenever an entry is created, removed or renamed
+ * in it, but not when the contents of a file change. If the metadata of a directory is unchanged,
+ * the scanner reuses the recorded subtotal of the files in this directory instead of stat'ing them.
+ * Subdirectories are still listed, they are checked individually.
+ *
+ * To eventually catch files which grew in place, every directory is verified with a full stat
+ * once every {verification_interval} generations, spread evenly across all generations.
+ *
+ * The index consists of two generations:
+ *  - the previous generation, a read-only view into memory owned by someone else
+ *  - the current generation, filled by the scanner and persisted by the owner after the scan
+ *
+ * Lookups and adding records are thread-safe, attaching must not run concurrently with scans.
+ */
+class directory_index_t final
+{
+public:
+    /// every directory is verified at least once in this many generations
+    static constexpr std::uint32_t verification_interval = 24;
+
+    directory_index_t() = default;
+    ~directory_index_t() = default;
+
+    directory_index_t(const directory_index_t&) = delete;
+    directory_index_t &operator=(const directory_index_t&) = delete;
+
+    /**
+     * Hashes the given path (64-bit FNV-1a).
+     *
+     * `hash_child(hash_path("/a"), "b") == hash_path("/a/b")`
+     */
+    static std::uint64_t hash_path(std::string_view path) noexcept;
+
+    /**
+     * Hashes the path of an entry in the directory with the given path hash.
+     */
+    static std::uint64_t hash_child(std::uint64_t parent_hash, std::string_view name) noexcept;
+
+    /**
+     * Uses the given records as the previous generation.
+     *
+     * The memory of the columns must outlive all scans which use this index.
+     *
+     * @param columns records of the previous generation, sorted by path hash
+     * @param generation the generation of the records
+     */
+    void attach(const directory_columns_t &columns, std::uint32_t generation) noexcept;
+
+    /**
+     * Looks up the record of the given directory in the previous generation.
+     *
+     * @return the record or nothing if the directory is not in the index
+     */
+    std::optional<directory_record_t> find(std::uint64_t path_hash) const noexcept;
+
+    /**
+     * Checks if the given directory must be verified in the current generation.
+     */
+    bool must_verify(std::uint64_t path_hash) const noexcept;
+
+    /**
+     * Adds records to the current generation.
+     */
+    void add_records(const std::vector<directory_record_t> &records);
+
+    /**
+     * Returns the records of the current generation, sorted by path hash without duplicates.
+     *
+     * The same directory can be recorded multiple times, e.g. when cache mappings are nested.
+     */
+    std::vector<directory_record_t> current_records() const;
+
+    /**
+     * Returns the generation of the attached records, 0 if nothing was attached.
+     *
+     * The records of the current generation belong to `generation() + 1`.
+     */
+    inline std::uint32_t generation() const noexcept {
+        return this->_generation;
+    }
+
+    /**
+     * Returns the number of records in the previous generation.
+     */
+    inline std::size_t size() const noexcept {
+        return this->_previous.size;
+    }
+
+private:
+    /// records of the previous generation, sorted by path hash
+    directory_columns_t _previous;
+
+    /// records of the current generation in arbitrary order
+    std::vector<directory_record_t> _current;
+    mutable std::mutex _current_mutex;
+
+    std::uint32_t _generation{0};
+};
+
+} // namespace disk_usage
@@ -0,0 +1,37 @@
+#include "disk_usage.hpp"
+#include "backends/backend.hpp"
+
+namespace disk_usage {
+
+scan_result scan_directory(const std::string &path, const scan_options &options) noexcept
+{
+    return backend::scan_directory(path, options);
+}
+
+scan_result stat_file(const std::string &path, inode_set_t *hardlinks) noexcept
+{
+    return backend::stat_file(path, hardlinks);
+}
+
+std::error_code walk_directory(const std::string &path, const walk_options &options,
+    const walk_visitor &visitor) noexcept
+{
+    return backend::walk_directory(path, options, visitor);
+}
+
+std::error_code stat_entry(const walk_entry &entry, entry_stat &stat) noexcept
+{
+    return backend::stat_entry(entry, stat);
+}
+
+bool io_uring_available() noexcept
+{
+    return backend::io_uring_available();
+}
+
+const char *backend_name() noexcept
+{
+    return backend::backend_name;
+}
+
+} // namespace disk_usage
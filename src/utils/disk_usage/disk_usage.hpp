@@ -0,0 +1,472 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace disk_usage {
+
+class inode_set_t;
+class directory_index_t;
+class subtree_breakdown_t;
+
+/**
+ * Live progress of running scans, can be shared by multiple concurrent scans.
+ *
+ * Workers accumulate into their own counters and publish them once per directory with relaxed
+ * atomic additions, the values lag behind the actual progress by at most one directory per worker.
+ */
+struct scan_progress final
+{
+    /// number of regular files which were stat'ed, files of reused directories are not counted
+    std::atomic<std::uint64_t> files{0};
+
+    /// number of directories which were read or reused from the index
+    std::atomic<std::uint64_t> directories{0};
+
+    /// sum of the apparent sizes of the accounted files
+    std::atomic<std::uint64_t> apparent_size{0};
+};
+
+/**
+ * Age and size distribution of the regular files of a scan.
+ *
+ * The age histograms sum up the apparent sizes of the files by the time since their last access
+ * and last modification. The size histogram counts the files by the binary logarithm of their size.
+ */
+struct file_histograms final
+{
+    /// upper limits of the age buckets in seconds: <1d, <7d, <30d, <90d, the last bucket has no limit
+    static constexpr std::array<std::int64_t, 4> age_limits = {
+        24 * 3600, 7 * 24 * 3600, 30 * 24 * 3600, 90 * 24 * 3600,
+    };
+    static constexpr std::size_t age_bucket_count = age_limits.size() + 1;
+
+    /// bucket 0 holds empty files, bucket i holds sizes in [2^(i-1), 2^i), the last bucket has no limit
+    static constexpr std::size_t size_bucket_count = 41;
+
+    /**
+     * Unix timestamp the ages are calculated against, 0 means the start of the scan.
+     */
+    std::int64_t reference_time{0};
+
+    /// bytes by time since the last access (atime)
+    std::array<std::uint64_t, age_bucket_count> accessed_bytes{};
+
+    /// bytes by time since the last modification (mtime)
+    std::array<std::uint64_t, age_bucket_count> modified_bytes{};
+
+    /// number of files and their bytes by size
+    std::array<std::uint64_t, size_bucket_count> size_files{};
+    std::array<std::uint64_t, size_bucket_count> size_bytes{};
+
+    static inline constexpr std::size_t age_bucket_of(std::int64_t age) noexcept
+    {
+        std::size_t bucket = 0;
+        while (bucket < age_limits.size() && age >= age_limits[bucket])
+        {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    static inline constexpr std::size_t size_bucket_of(std::uint64_t size) noexcept
+    {
+        const auto bucket = static_cast<std::size_t>(std::bit_width(size));
+        return bucket < size_bucket_count ? bucket : size_bucket_count - 1;
+    }
+
+    /// adds a single file
+    inline void add(std::uint64_t size, std::int64_t atime, std::int64_t mtime) noexcept
+    {
+        this->accessed_bytes[age_bucket_of(this->reference_time - atime)] += size;
+        this->modified_bytes[age_bucket_of(this->reference_time - mtime)] += size;
+        const auto bucket = size_bucket_of(size);
+        ++this->size_files[bucket];
+        this->size_bytes[bucket] += size;
+    }
+
+    /// adds all buckets of the other histograms, the reference time is not changed
+    inline void merge(const file_histograms &other) noexcept
+    {
+        for (std::size_t i = 0; i < age_bucket_count; ++i)
+        {
+            this->accessed_bytes[i] += other.accessed_bytes[i];
+            this->modified_bytes[i] += other.modified_bytes[i];
+        }
+        for (std::size_t i = 0; i < size_bucket_count; ++i)
+        {
+            this->size_files[i] += other.size_files[i];
+            this->size_bytes[i] += other.size_bytes[i];
+        }
+    }
+};
+
+/**
+ * Options to control the behavior of the directory scanner.
+ */
+struct scan_options final
+{
+    /**
+     * Number of worker threads to use for the traversal.
+     *
+     * 0 means one thread per hardware thread.
+     */
+    unsigned thread_count{0};
+
+    /**
+     * Optional set of already accounted hardlinked inodes.
+     *
+     * Files with more than one link are only counted in the unique sizes when their inode
+     * is not in the set yet. Share the same set across multiple scans to deduplicate hardlinks
+     * between directory trees. If not set, the unique sizes equal the apparent and allocated sizes.
+     */
+    inode_set_t *hardlinks{nullptr};
+
+    /**
+     * Submit the `stat` calls in batches to io_uring instead of one system call per file.
+     *
+     * Ignored when the backend or the running kernel doesn't support io_uring,
+     * see {io_uring_available}. The scanner falls back to synchronous `stat` calls.
+     */
+    bool use_io_uring{false};
+
+    /**
+     * Optional index of directory records from previous scans for incremental rescans.
+     *
+     * Directories with unchanged metadata reuse the recorded subtotal of their files,
+     * the records of all scanned directories are added to the current generation of the index.
+     * Backends without support for incremental rescans ignore the index and scan everything.
+     */
+    directory_index_t *index{nullptr};
+
+    /**
+     * Optional progress counters which are updated during the scan.
+     */
+    scan_progress *progress{nullptr};
+
+    /**
+     * Optional tree of subdirectory sizes which is built during the scan.
+     *
+     * The tree is reset at the start of the scan, every scan needs its own tree.
+     */
+    subtree_breakdown_t *breakdown{nullptr};
+
+    /**
+     * Optional age and size histograms which are collected during the scan.
+     *
+     * The histograms of the scan are added to the given ones, every concurrent scan needs its own.
+     * Unchanged directories are not reused from the {index} when histograms are collected,
+     * their files must be stat'ed for the timestamps. The index is still updated.
+     */
+    file_histograms *histograms{nullptr};
+};
+
+/**
+ * Result of a directory scan.
+ */
+struct scan_result final
+{
+    /**
+     * Sum of the file sizes of all regular files.
+     */
+    std::uintmax_t apparent_size{0};
+
+    /**
+     * Sum of the allocated sizes (`st_blocks * 512`) of all regular files.
+     *
+     * Differs from the apparent size for sparse files and on filesystems with compression.
+     * Backends without access to the allocated size report the apparent size instead.
+     */
+    std::uintmax_t allocated_size{0};
+
+    /**
+     * Apparent size without hardlinks which were already accounted in {scan_options::hardlinks}.
+     */
+    std::uintmax_t unique_apparent_size{0};
+
+    /**
+     * Allocated size without hardlinks which were already accounted in {scan_options::hardlinks}.
+     */
+    std::uintmax_t unique_allocated_size{0};
+
+    /**
+     * Number of directories whose file subtotals were reused from {scan_options::index}.
+     */
+    std::uintmax_t reused_directories{0};
+
+    /**
+     * The first error encountered during the scan.
+     *
+     * Permission errors are skipped and not reported.
+     * Scanning continues after errors, the sizes are the sum of everything that could be scanned.
+     */
+    std::error_code ec;
+};
+
+/**
+ * Type of an entry which is visited by {walk_directory}.
+ *
+ * The type is taken from the directory entry, entries are only stat'ed
+ * when the filesystem doesn't report the type. Symbolic links are not resolved.
+ */
+enum class entry_type : std::uint8_t
+{
+    directory,
+    regular_file,
+    symbolic_link,
+    other,
+};
+
+/**
+ * A directory entry which is visited by {walk_directory}.
+ */
+struct walk_entry final
+{
+    /// path of the directory which contains the entry
+    std::string_view directory;
+
+    /// file name of the entry
+    std::string_view name;
+
+    entry_type type;
+
+    /// the state which the visitor returned for the directory which contains the entry
+    std::uint64_t parent_state;
+
+    /// backend specific handle of the open directory, see {stat_entry}, -1 if not available
+    std::intptr_t directory_handle{-1};
+};
+
+/**
+ * Metadata of an entry which was stat'ed during a walk, see {stat_entry}.
+ */
+struct entry_stat final
+{
+    /// the type of the entry, symbolic links are resolved
+    entry_type type{entry_type::other};
+
+    /// the sizes of regular files, 0 for all other types
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+
+    /// unix timestamp of the last modification
+    std::int64_t mtime{0};
+
+    /// unix timestamp of the last access, depends on the `atime` mount options
+    std::int64_t atime{0};
+
+    /// identity of the inode, see {scan_options::hardlinks}
+    std::uint64_t device{0};
+    std::uint64_t inode{0};
+    std::uint64_t link_count{1};
+};
+
+/**
+ * Visitor of {walk_directory}, called concurrently from all worker threads.
+ *
+ * For directories, the returned state is passed on to the visits of their entries,
+ * the walk only descends into directories with a non-zero state. The return value is ignored for other entries.
+ */
+using walk_visitor = std::function<std::uint64_t(const walk_entry &entry)>;
+
+/**
+ * Options to control the behavior of {walk_directory}.
+ */
+struct walk_options final
+{
+    /**
+     * Number of worker threads to use for the traversal, see {scan_options::thread_count}.
+     */
+    unsigned thread_count{0};
+
+    /**
+     * The state of the root directory, see {walk_visitor}.
+     */
+    std::uint64_t root_state{1};
+};
+
+/**
+ * Options to control the sampling estimator.
+ */
+struct estimate_options final
+{
+    /**
+     * Stop sampling after this amount of time.
+     *
+     * 0 means no time limit, in this case {stat_budget} must be set.
+     */
+    std::chrono::milliseconds time_budget{2000};
+
+    /**
+     * Stop sampling after this number of `stat` calls, every directory which is read counts as one call.
+     *
+     * 0 means no limit on the number of `stat` calls.
+     */
+    std::uint64_t stat_budget{0};
+
+    /**
+     * Confidence level of the reported margins, between 0 and 1 (exclusive).
+     */
+    double confidence{0.95};
+
+    /**
+     * Seed of the random number generator, equal seeds visit the same directories.
+     */
+    std::uint64_t seed{0};
+
+    /**
+     * See {scan_options::use_io_uring}.
+     */
+    bool use_io_uring{false};
+};
+
+/**
+ * Result of a size estimation.
+ */
+struct estimate_result final
+{
+    /**
+     * Estimated sum of the file sizes of all regular files.
+     */
+    std::uintmax_t apparent_size{0};
+
+    /**
+     * Estimated sum of the allocated sizes of all regular files.
+     */
+    std::uintmax_t allocated_size{0};
+
+    /**
+     * Half-width of the confidence interval of the apparent size, see {estimate_options::confidence}.
+     */
+    std::uintmax_t apparent_size_margin{0};
+
+    /**
+     * Half-width of the confidence interval of the allocated size.
+     */
+    std::uintmax_t allocated_size_margin{0};
+
+    /**
+     * Number of random root-to-leaf probes the estimate is based on.
+     */
+    std::uint64_t probes{0};
+
+    /**
+     * Number of directories which were read.
+     */
+    std::uint64_t directories_listed{0};
+
+    /**
+     * Number of `stat` calls which were issued.
+     */
+    std::uint64_t stat_calls{0};
+
+    /**
+     * The budget was sufficient to read the whole tree, the sizes are exact and the margins are 0.
+     */
+    bool is_exact{false};
+
+    /**
+     * The first error encountered while reading directories, see {scan_result::ec}.
+     */
+    std::error_code ec;
+};
+
+/**
+ * Calculates the used disk space of the given directory using a parallel directory walker.
+ *
+ * Subdirectories are distributed across a work-stealing thread pool.
+ * Every worker sums up the sizes into its own counter, the counters are merged at the end.
+ *
+ * The traversal is implemented by a platform specific backend:
+ *  - Linux: `getdents64` and `statx` relative to the parent directory fd
+ *  - everything else: `std::filesystem::directory_iterator`
+ *
+ * If the given path is not a directory, the result is empty without an error.
+ *
+ * Symbolic links to directories are not followed. Symbolic links to regular files are counted
+ * with the size of the file they point to.
+ *
+ * @param path the directory to scan
+ * @param options scanner options
+ * @return scan result
+ */
+scan_result scan_directory(const std::string &path, const scan_options &options = {}) noexcept;
+
+/**
+ * Obtains the apparent and allocated size of a single file.
+ *
+ * Symbolic links are followed. If the given path is not a regular file, the result is empty without an error.
+ *
+ * @param path the file to stat
+ * @param hardlinks optional set of already accounted hardlinked inodes, see {scan_options::hardlinks}
+ * @return scan result of the single file
+ */
+scan_result stat_file(const std::string &path, inode_set_t *hardlinks = nullptr) noexcept;
+
+/**
+ * Walks the given directory with the parallel directory walker and passes every entry to the visitor.
+ *
+ * Unlike {scan_directory}, nothing is stat'ed and nothing is accumulated. The visitor decides which
+ * directories are descended into, which allows pruning the walk, for example when resolving glob patterns.
+ * Symbolic links to directories are not followed.
+ *
+ * Permission errors are skipped and not reported, the walk continues after all other errors.
+ *
+ * @param path the directory to walk
+ * @param options walker options
+ * @param visitor called for every entry below @p path
+ * @return the first error encountered during the walk, or the error of opening @p path
+ */
+std::error_code walk_directory(const std::string &path, const walk_options &options,
+    const walk_visitor &visitor) noexcept;
+
+/**
+ * Stats an entry from inside of a {walk_visitor} with a single system call relative to its directory.
+ *
+ * Symbolic links are followed. Without a directory handle, the joined path is stat'ed instead.
+ *
+ * @param entry the entry which is currently visited
+ * @param stat receives the metadata of the entry
+ * @return error code if the entry couldn't be stat'ed
+ */
+std::error_code stat_entry(const walk_entry &entry, entry_stat &stat) noexcept;
+
+/**
+ * Estimates the used disk space of the given directory by sampling, without reading the whole tree.
+ *
+ * Every probe walks from the root to a leaf directory and picks a random subdirectory at every level.
+ * The sizes of the visited directories are weighted by the product of the subdirectory counts along
+ * the path (Knuth's tree size estimator), the mean over all probes is an unbiased estimate of the total.
+ * Directories are read only once and cached, later probes through the same directories are free.
+ * When the cache covers the whole tree before the budget is exhausted, the exact sizes are returned.
+ *
+ * The estimate is accurate for trees with evenly distributed content (like package caches with many
+ * similar entries) and converges slowly for trees where a few directories contain most of the data,
+ * which shows up as a wide confidence interval. Hardlinks are not deduplicated.
+ *
+ * At least one probe is always completed, even when this exceeds the budget.
+ *
+ * @param path the directory to estimate
+ * @param options estimator options
+ * @return estimated sizes with their margins of error
+ */
+estimate_result estimate_directory(const std::string &path, const estimate_options &options = {}) noexcept;
+
+/**
+ * Checks if the scanner backend can submit `stat` calls to io_uring on the running kernel.
+ */
+bool io_uring_available() noexcept;
+
+/**
+ * Returns the name of the scanner backend which was compiled into the library.
+ */
+const char *backend_name() noexcept;
+
+} // namespace disk_usage
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cerrno>
+#include <mutex>
+#include <system_error>
+
+/**
+ * Error helpers shared by the file operations of the disk usage utilities, not part of the public API.
+ */
+namespace disk_usage {
+
+/**
+ * Returns the error of the last failed system call.
+ */
+inline std::error_code last_error() noexcept
+{
+    return std::error_code{errno, std::generic_category()};
+}
+
+/**
+ * Records the first error of a concurrent operation, all following errors are dropped.
+ */
+struct first_error_t final
+{
+    std::mutex mutex;
+    std::error_code ec;
+
+    void report(const std::error_code &error)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->ec)
+        {
+            this->ec = error;
+        }
+    }
+};
+
+} // namespace disk_usage
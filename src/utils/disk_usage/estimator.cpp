@@ -0,0 +1,300 @@
+#include "disk_usage.hpp"
+#include "backends/backend.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+/// probes which revisit directories that were already read cost nothing, their number is limited as well
+constexpr std::uint64_t max_probes = std::uint64_t{1} << 20;
+
+/**
+ * A directory in the sampled part of the tree.
+ *
+ * Children are created when their parent is read, they are read themselves when a probe visits them.
+ */
+struct node_t final
+{
+    /// index of the parent node, the root is its own parent
+    std::uint32_t parent{0};
+
+    /// index of the first child node, all children of a node are stored consecutively
+    std::uint32_t first_child{0};
+    std::uint32_t child_count{0};
+
+    /// number of children which are not complete yet
+    std::uint32_t incomplete_children{0};
+
+    /// name of the directory in its parent, the full path for the root
+    std::string name;
+
+    /// sizes of the files directly inside of this directory
+    std::uint64_t apparent_size{0};
+    std::uint64_t allocated_size{0};
+
+    bool is_listed{false};
+};
+
+/**
+ * Running mean and variance of the probe results (Welford's algorithm).
+ */
+struct running_stats_t final
+{
+    void add(double value) noexcept
+    {
+        ++this->count;
+        const double delta = value - this->mean;
+        this->mean += delta / static_cast<double>(this->count);
+        this->m2 += delta * (value - this->mean);
+    }
+
+    /// half-width of the confidence interval of the mean
+    double margin(double z) const noexcept
+    {
+        if (this->count < 2)
+        {
+            return 0.0;
+        }
+        const double n = static_cast<double>(this->count);
+        return z * std::sqrt(this->m2 / (n - 1.0) / n);
+    }
+
+    std::uint64_t count{0};
+    double mean{0.0};
+    double m2{0.0};
+};
+
+/**
+ * Two-sided z-score of the given confidence level, the inverse of `erf(z / sqrt(2))` by bisection.
+ */
+double z_score(double confidence) noexcept
+{
+    if (!(confidence > 0.0 && confidence < 1.0))
+    {
+        confidence = 0.95;
+    }
+
+    double low = 0.0, high = 10.0;
+    for (int i = 0; i < 64; ++i)
+    {
+        const double mid = (low + high) / 2.0;
+        (std::erf(mid / std::sqrt(2.0)) < confidence ? low : high) = mid;
+    }
+    return (low + high) / 2.0;
+}
+
+inline std::uintmax_t to_size(double value) noexcept
+{
+    return value <= 0.0 ? 0 : static_cast<std::uintmax_t>(std::llround(value));
+}
+
+/**
+ * Sampling state of a single estimation.
+ */
+class estimator_t final
+{
+public:
+    estimator_t(const std::string &path, const disk_usage::estimate_options &options)
+        : _options(options), _lister(options.use_io_uring), _random(options.seed),
+          _deadline(std::chrono::steady_clock::now() + options.time_budget)
+    {
+        this->_nodes.emplace_back(node_t{.name = path});
+    }
+
+    disk_usage::estimate_result run()
+    {
+        disk_usage::estimate_result result;
+
+        // the root must be readable, otherwise there is nothing to estimate
+        if (const auto ec = this->list(0); ec)
+        {
+            // note: same behavior as {scan_directory}
+            if (ec != std::errc::not_a_directory)
+            {
+                result.ec = ec;
+            }
+            result.directories_listed = this->_directories_listed;
+            result.is_exact = true;
+            return result;
+        }
+
+        running_stats_t apparent, allocated;
+        do
+        {
+            std::uint32_t index = 0;
+            double weight = 1.0;
+            double apparent_sample = 0.0, allocated_sample = 0.0;
+            while (true)
+            {
+                auto *node = &this->_nodes[index];
+                if (!node->is_listed)
+                {
+                    this->list(index);
+                    node = &this->_nodes[index];
+                }
+
+                apparent_sample += weight * static_cast<double>(node->apparent_size);
+                allocated_sample += weight * static_cast<double>(node->allocated_size);
+
+                if (node->child_count == 0)
+                {
+                    break;
+                }
+
+                std::uniform_int_distribution<std::uint32_t> pick(0, node->child_count - 1);
+                weight *= static_cast<double>(node->child_count);
+                index = node->first_child + pick(this->_random);
+            }
+
+            apparent.add(apparent_sample);
+            allocated.add(allocated_sample);
+        }
+        while (this->_nodes[0].incomplete_children > 0 && apparent.count < max_probes && !this->is_budget_exhausted());
+
+        result.probes = apparent.count;
+        result.directories_listed = this->_directories_listed;
+        result.stat_calls = this->_stat_calls;
+        result.ec = this->_ec;
+
+        if (this->_nodes[0].incomplete_children == 0)
+        {
+            // every directory was read, sum up the exact sizes
+            for (const auto &node : this->_nodes)
+            {
+                result.apparent_size += node.apparent_size;
+                result.allocated_size += node.allocated_size;
+            }
+            result.is_exact = true;
+        }
+        else
+        {
+            const double z = z_score(this->_options.confidence);
+            result.apparent_size = to_size(apparent.mean);
+            result.allocated_size = to_size(allocated.mean);
+            result.apparent_size_margin = to_size(apparent.margin(z));
+            result.allocated_size_margin = to_size(allocated.margin(z));
+        }
+
+        return result;
+    }
+
+private:
+    /**
+     * Reads the directory of the given node and creates its children.
+     *
+     * Unreadable directories are treated as empty leaves.
+     */
+    std::error_code list(std::uint32_t index)
+    {
+        std::string path = this->path_of(index);
+        const auto ec = this->_lister.list(path, this->_listing);
+        ++this->_directories_listed;
+        this->_stat_calls += this->_listing.stat_calls;
+
+        if (ec && ec != std::errc::permission_denied && !this->_ec)
+        {
+            this->_ec = ec;
+        }
+
+        const auto first_child = static_cast<std::uint32_t>(this->_nodes.size());
+        const auto child_count = ec ? 0 : static_cast<std::uint32_t>(std::min<std::size_t>(
+            this->_listing.subdirectory_count, std::numeric_limits<std::uint32_t>::max() - first_child));
+
+        const char *name = this->_listing.subdirectory_names.data();
+        for (std::uint32_t i = 0; i < child_count; ++i)
+        {
+            std::string child_name(name);
+            name += child_name.size() + 1;
+            this->_nodes.emplace_back(node_t{.parent = index, .name = std::move(child_name)});
+        }
+
+        auto &node = this->_nodes[index];
+        node.first_child = first_child;
+        node.child_count = child_count;
+        node.incomplete_children = child_count;
+        node.apparent_size = ec ? 0 : this->_listing.totals.apparent_size;
+        node.allocated_size = ec ? 0 : this->_listing.totals.allocated_size;
+        node.is_listed = true;
+
+        if (child_count == 0)
+        {
+            this->mark_complete(index);
+        }
+        return ec;
+    }
+
+    /**
+     * Propagates the completion of a node to its ancestors.
+     */
+    void mark_complete(std::uint32_t index)
+    {
+        while (index != 0)
+        {
+            auto &parent = this->_nodes[this->_nodes[index].parent];
+            if (--parent.incomplete_children > 0)
+            {
+                return;
+            }
+            index = this->_nodes[index].parent;
+        }
+    }
+
+    std::string path_of(std::uint32_t index) const
+    {
+        std::vector<std::uint32_t> chain;
+        for (; index != 0; index = this->_nodes[index].parent)
+        {
+            chain.emplace_back(index);
+        }
+
+        std::string path = this->_nodes[0].name;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            path += '/';
+            path += this->_nodes[*it].name;
+        }
+        return path;
+    }
+
+    bool is_budget_exhausted() const noexcept
+    {
+        // every directory read costs a system call as well, trees of directories don't need any stat calls
+        if (this->_options.stat_budget > 0 &&
+            this->_stat_calls + this->_directories_listed >= this->_options.stat_budget)
+        {
+            return true;
+        }
+        if (this->_options.time_budget.count() > 0 && std::chrono::steady_clock::now() >= this->_deadline)
+        {
+            return true;
+        }
+        return this->_options.time_budget.count() <= 0 && this->_options.stat_budget == 0;
+    }
+
+    const disk_usage::estimate_options &_options;
+    disk_usage::backend::directory_lister_t _lister;
+    disk_usage::backend::directory_listing_t _listing;
+    std::mt19937_64 _random;
+    const std::chrono::steady_clock::time_point _deadline;
+
+    std::vector<node_t> _nodes;
+    std::uint64_t _directories_listed{0};
+    std::uint64_t _stat_calls{0};
+    std::error_code _ec;
+};
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+estimate_result estimate_directory(const std::string &path, const estimate_options &options) noexcept
+{
+    estimator_t estimator(path, options);
+    return estimator.run();
+}
+
+} // namespace disk_usage
@@ -0,0 +1,337 @@
+#include "eviction.hpp"
+#include "disk_usage.hpp"
+#include "error_utils.hpp"
+#include "inode_set.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+
+#include "../threading/work_stealing_pool.hpp"
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using disk_usage::eviction_candidate;
+using disk_usage::first_error_t;
+using disk_usage::last_error;
+
+/// number of files which are deleted by a single task
+constexpr std::size_t files_per_task = 256;
+
+/**
+ * Orders a max-heap so that the least recently used file is on top, ties are broken by path
+ * to keep the plan deterministic.
+ */
+bool is_used_later(const eviction_candidate &a, const eviction_candidate &b) noexcept
+{
+    return a.last_used != b.last_used ? a.last_used > b.last_used : a.relative_path > b.relative_path;
+}
+
+/**
+ * Returns the path of the walked directory relative to the root, empty for the root itself.
+ */
+std::string_view relative_directory_of(std::string_view directory, std::string_view root) noexcept
+{
+    if (directory.size() <= root.size())
+    {
+        return {};
+    }
+    directory.remove_prefix(root.size());
+    return directory.front() == '/' ? directory.substr(1) : directory;
+}
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+
+/**
+ * Opens the given directory below the root one component at a time without following symbolic links.
+ *
+ * @return the file descriptor of the directory, or -1 with `errno` set
+ */
+int open_beneath(int root_fd, std::string_view relative_directory)
+{
+    int fd = root_fd;
+    while (!relative_directory.empty())
+    {
+        const auto separator = relative_directory.find('/');
+        const std::string component{relative_directory.substr(0, separator)};
+        relative_directory = separator == std::string_view::npos ?
+            std::string_view{} : relative_directory.substr(separator + 1);
+
+        // the walker never produces these, but the plan must not be able to leave the root
+        if (component.empty() || component == "." || component == "..")
+        {
+            if (fd != root_fd)
+            {
+                ::close(fd);
+            }
+            errno = EINVAL;
+            return -1;
+        }
+
+        const int next_fd = ::openat(fd, component.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd != root_fd)
+        {
+            const int error = errno;
+            ::close(fd);
+            errno = error;
+        }
+        if (next_fd < 0)
+        {
+            return -1;
+        }
+        fd = next_fd;
+    }
+    return fd;
+}
+
+/**
+ * Deletes a range of planned files, files in the same directory share a single directory handle.
+ */
+void evict_files(int root_fd, std::vector<const eviction_candidate*> files,
+    std::atomic<std::uint64_t> &deleted_files, std::atomic<std::uintmax_t> &freed_size,
+    std::atomic<std::uint64_t> &skipped_files, first_error_t &first_error)
+{
+    std::sort(files.begin(), files.end(), [](const auto *a, const auto *b) {
+        return a->relative_path < b->relative_path;
+    });
+
+    std::string_view open_directory;
+    int directory_fd = -1;
+    int directory_error = 0;
+
+    for (const auto *file : files)
+    {
+        const std::string_view path = file->relative_path;
+        const auto separator = path.rfind('/');
+        const auto directory = separator == std::string_view::npos ? std::string_view{} : path.substr(0, separator);
+        const std::string name{separator == std::string_view::npos ? path : path.substr(separator + 1)};
+
+        if (directory_fd < 0 || directory != open_directory)
+        {
+            if (directory_fd >= 0 && directory_fd != root_fd)
+            {
+                ::close(directory_fd);
+            }
+            open_directory = directory;
+            directory_fd = open_beneath(root_fd, directory);
+            directory_error = directory_fd < 0 ? errno : 0;
+        }
+
+        // the directory was removed or replaced with a symbolic link since planning
+        if (directory_fd < 0)
+        {
+            if (directory_error != ENOENT && directory_error != ENOTDIR && directory_error != ELOOP)
+            {
+                first_error.report(std::error_code{directory_error, std::generic_category()});
+            }
+            skipped_files.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // only delete the planned file, and only if it wasn't used since planning
+        struct stat st;
+        if (::fstatat(directory_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode) || st.st_ino != file->inode || st.st_nlink > 1 ||
+            std::max<std::int64_t>(st.st_atime, st.st_mtime) > file->last_used)
+        {
+            skipped_files.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (::unlinkat(directory_fd, name.c_str(), 0) != 0)
+        {
+            if (errno != ENOENT)
+            {
+                first_error.report(last_error());
+            }
+            skipped_files.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        deleted_files.fetch_add(1, std::memory_order_relaxed);
+        freed_size.fetch_add(file->size, std::memory_order_relaxed);
+    }
+
+    if (directory_fd >= 0 && directory_fd != root_fd)
+    {
+        ::close(directory_fd);
+    }
+}
+
+#endif
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+eviction_plan plan_eviction(const std::string &path, const eviction_options &options) noexcept
+{
+    eviction_plan plan;
+    plan.root = path;
+    while (plan.root.size() > 1 && plan.root.back() == '/')
+    {
+        plan.root.pop_back();
+    }
+    plan.max_size = options.max_size;
+    plan.target_size = options.target_size == 0 || options.target_size > options.max_size ?
+        options.max_size : options.target_size;
+
+    if (plan.max_size == 0)
+    {
+        return plan;
+    }
+
+    std::mutex candidates_mutex;
+    std::vector<eviction_candidate> candidates;
+    inode_set_t hardlinks;
+    std::atomic<std::uintmax_t> current_size{0};
+    first_error_t first_error;
+
+    const auto ec_walk = walk_directory(plan.root, walk_options{.thread_count = options.thread_count},
+        [&](const walk_entry &entry) -> std::uint64_t {
+            if (entry.type == entry_type::directory)
+            {
+                return 1;
+            }
+            else if (entry.type != entry_type::regular_file)
+            {
+                return 0;
+            }
+
+            entry_stat stat;
+            if (const auto ec = stat_entry(entry, stat); ec)
+            {
+                // permission errors are skipped, files can also disappear during the walk
+                if (ec != std::errc::permission_denied && ec != std::errc::no_such_file_or_directory)
+                {
+                    first_error.report(ec);
+                }
+                return 0;
+            }
+            if (stat.type != entry_type::regular_file)
+            {
+                return 0;
+            }
+
+            const auto size = options.allocated_size ? stat.allocated_size : stat.apparent_size;
+
+            // deleting a single link doesn't free any space
+            if (stat.link_count > 1)
+            {
+                if (hardlinks.insert(stat.device, stat.inode))
+                {
+                    current_size.fetch_add(size, std::memory_order_relaxed);
+                }
+                return 0;
+            }
+            current_size.fetch_add(size, std::memory_order_relaxed);
+
+            const auto directory = relative_directory_of(entry.directory, plan.root);
+            std::string relative_path;
+            relative_path.reserve(directory.size() + entry.name.size() + 1);
+            relative_path.append(directory);
+            if (!directory.empty())
+            {
+                relative_path += '/';
+            }
+            relative_path.append(entry.name);
+
+            std::lock_guard<std::mutex> lock(candidates_mutex);
+            candidates.emplace_back(eviction_candidate{
+                .relative_path = std::move(relative_path),
+                .size = size,
+                .last_used = std::max(stat.atime, stat.mtime),
+                .inode = stat.inode,
+            });
+            return 0;
+        });
+
+    plan.ec = ec_walk ? ec_walk : first_error.ec;
+    plan.current_size = current_size.load(std::memory_order_relaxed);
+    if (!plan.is_over_limit())
+    {
+        return plan;
+    }
+
+    // only the files which are needed to reach the target are popped from the heap
+    const auto required_size = plan.current_size - plan.target_size;
+    std::make_heap(candidates.begin(), candidates.end(), is_used_later);
+    auto heap_end = candidates.end();
+    while (heap_end != candidates.begin() && plan.planned_size < required_size)
+    {
+        std::pop_heap(candidates.begin(), heap_end, is_used_later);
+        --heap_end;
+        plan.planned_size += heap_end->size;
+    }
+
+    // the popped files are at the end in reverse order
+    std::reverse(heap_end, candidates.end());
+    candidates.erase(candidates.begin(), heap_end);
+    plan.files = std::move(candidates);
+
+    return plan;
+}
+
+eviction_result execute_eviction(const eviction_plan &plan, unsigned thread_count) noexcept
+{
+    eviction_result result;
+    if (plan.files.empty())
+    {
+        return result;
+    }
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    const int root_fd = ::open(plan.root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+    {
+        result.ec = last_error();
+        return result;
+    }
+
+    std::atomic<std::uint64_t> deleted_files{0}, skipped_files{0};
+    std::atomic<std::uintmax_t> freed_size{0};
+    first_error_t first_error;
+
+    const auto task_count = (plan.files.size() + files_per_task - 1) / files_per_task;
+    {
+        const auto threads = std::min<std::size_t>(
+            threading::work_stealing_pool_t::resolve_thread_count(thread_count), task_count);
+        threading::work_stealing_pool_t pool(static_cast<unsigned>(threads));
+        for (std::size_t task = 0; task < task_count; ++task)
+        {
+            pool.submit([&, task](unsigned) {
+                const auto begin = task * files_per_task;
+                const auto end = std::min(begin + files_per_task, plan.files.size());
+
+                std::vector<const eviction_candidate*> files;
+                files.reserve(end - begin);
+                for (auto i = begin; i < end; ++i)
+                {
+                    files.emplace_back(&plan.files[i]);
+                }
+                evict_files(root_fd, std::move(files), deleted_files, freed_size, skipped_files, first_error);
+            });
+        }
+        pool.wait();
+    }
+    ::close(root_fd);
+
+    result.deleted_files = deleted_files.load();
+    result.freed_size = freed_size.load();
+    result.skipped_files = skipped_files.load();
+    result.ec = first_error.ec;
+#else
+    result.ec = std::make_error_code(std::errc::not_supported);
+#endif
+
+    return result;
+}
+
+} // namespace disk_usage
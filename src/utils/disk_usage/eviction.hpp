@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace disk_usage {
+
+/**
+ * A regular file which is planned to be deleted, see {plan_eviction}.
+ */
+struct eviction_candidate final
+{
+    /// path relative to the root of the plan, never contains `.` or `..` components
+    std::string relative_path;
+
+    /// space which is freed by deleting the file
+    std::uintmax_t size{0};
+
+    /// unix timestamp of the last use, the later one of `atime` and `mtime`
+    std::int64_t last_used{0};
+
+    /// identity of the inode, the file is only deleted if it wasn't replaced in the meantime
+    std::uint64_t inode{0};
+};
+
+/**
+ * Options to control the behavior of {plan_eviction}.
+ */
+struct eviction_options final
+{
+    /**
+     * Files are evicted when the directory is larger than this size, 0 disables the eviction.
+     */
+    std::uintmax_t max_size{0};
+
+    /**
+     * Files are evicted until the directory is not larger than this size.
+     *
+     * 0 or a size above {max_size} means {max_size}.
+     */
+    std::uintmax_t target_size{0};
+
+    /**
+     * Account the allocated size on disk instead of the apparent size.
+     */
+    bool allocated_size{false};
+
+    /**
+     * Number of worker threads to use for the traversal, see {scan_options::thread_count}.
+     */
+    unsigned thread_count{0};
+};
+
+/**
+ * The files which must be deleted to bring a directory under its size limit, see {plan_eviction}.
+ */
+struct eviction_plan final
+{
+    /// the directory, all files are relative to it
+    std::string root;
+
+    /// size of the directory when the plan was created
+    std::uintmax_t current_size{0};
+
+    /// the size limits of the plan
+    std::uintmax_t max_size{0};
+    std::uintmax_t target_size{0};
+
+    /// sum of the sizes of all planned files
+    std::uintmax_t planned_size{0};
+
+    /// the files to delete, least recently used first
+    std::vector<eviction_candidate> files;
+
+    /**
+     * The first error encountered while walking the directory.
+     *
+     * Permission errors are skipped and not reported. Files which couldn't be accounted
+     * are not deleted, the plan is still usable.
+     */
+    std::error_code ec;
+
+    /// inline helper which returns true when the directory exceeds its limit
+    inline bool is_over_limit() const noexcept {
+        return this->max_size > 0 && this->current_size > this->max_size;
+    }
+
+    /// inline helper which returns true when the planned files free enough space to reach the target size
+    inline bool reaches_target() const noexcept {
+        return this->current_size - this->planned_size <= this->target_size || !this->is_over_limit();
+    }
+};
+
+/**
+ * Outcome of {execute_eviction}.
+ */
+struct eviction_result final
+{
+    /// number of deleted files and the space which was freed by them
+    std::uint64_t deleted_files{0};
+    std::uintmax_t freed_size{0};
+
+    /// number of files which were not deleted, because they were used, replaced or removed since planning
+    std::uint64_t skipped_files{0};
+
+    /// the first error encountered while deleting, deletion continues after errors
+    std::error_code ec;
+};
+
+/**
+ * Plans the eviction of the least recently used files of the given directory.
+ *
+ * The directory is walked in parallel and every regular file is stat'ed once. If the directory exceeds
+ * {eviction_options::max_size}, a binary heap is built over all candidates in linear time and only the
+ * files which are actually needed to reach {eviction_options::target_size} are popped from it.
+ *
+ * Files are ordered by their last use, which is the later one of `atime` and `mtime`
+ * (`atime` is not updated on `noatime` mounts and only once a day on `relatime` mounts).
+ * Hardlinked files are accounted once, but never planned, deleting a single link doesn't free space.
+ * Symbolic links are neither followed nor planned.
+ *
+ * Nothing is deleted, the plan can be printed for a dry run and executed with {execute_eviction}.
+ *
+ * @param path the directory to plan
+ * @param options eviction options
+ * @return the plan, its list of files is empty when the directory doesn't exceed its limit
+ */
+eviction_plan plan_eviction(const std::string &path, const eviction_options &options) noexcept;
+
+/**
+ * Deletes the files of the given plan in parallel.
+ *
+ * Deletion never leaves the root of the plan: every parent directory is opened relative to the root
+ * without following symbolic links, so a directory which is replaced by a symbolic link after
+ * planning can't redirect the deletion. Files which were used, replaced or removed since the plan
+ * was created are skipped. Directories are not removed.
+ *
+ * @param plan the plan to execute
+ * @param thread_count number of threads, 0 means one thread per hardware thread
+ * @return number of deleted files and the freed space
+ */
+eviction_result execute_eviction(const eviction_plan &plan, unsigned thread_count = 0) noexcept;
+
+} // namespace disk_usage
@@ -0,0 +1,110 @@
+#include "inode_set.hpp"
+
+namespace {
+
+/**
+ * Mixes both key components into a well distributed 64-bit hash (splitmix64 finalizer).
+ *
+ * Inode numbers are often sequential, the high bits select the shard and the low bits select the slot.
+ */
+inline std::uint64_t hash_key(std::uint64_t dev, std::uint64_t ino) noexcept
+{
+    std::uint64_t h = ino ^ (dev * 0x9e3779b97f4a7c15ull);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+} // anonymous namespace
+
+namespace disk_usage {
+
+bool inode_set_t::insert(std::uint64_t dev, std::uint64_t ino)
+{
+    const auto hash = hash_key(dev, ino);
+    auto &shard = this->_shards[(hash >> 58) & (shard_count - 1)];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (dev == 0 && ino == 0) [[unlikely]]
+    {
+        const bool inserted = !shard.has_zero_key;
+        shard.has_zero_key = true;
+        shard.size += inserted ? 1 : 0;
+        return inserted;
+    }
+
+    // keep the load factor below 0.75
+    if ((shard.size + 1) * 4 > shard.capacity * 3)
+    {
+        grow(shard);
+    }
+
+    const auto mask = shard.capacity - 1;
+    for (auto index = hash & mask; ; index = (index + 1) & mask)
+    {
+        auto &slot = shard.slots[index];
+        if (slot.dev == dev && slot.ino == ino)
+        {
+            return false;
+        }
+        else if (slot.dev == 0 && slot.ino == 0)
+        {
+            slot.dev = dev;
+            slot.ino = ino;
+            ++shard.size;
+            return true;
+        }
+    }
+}
+
+std::size_t inode_set_t::size() const
+{
+    std::size_t size = 0;
+    for (const auto &shard : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.size;
+    }
+    return size;
+}
+
+void inode_set_t::clear()
+{
+    for (auto &shard : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.slots.reset();
+        shard.capacity = 0;
+        shard.size = 0;
+        shard.has_zero_key = false;
+    }
+}
+
+void inode_set_t::grow(shard_t &shard)
+{
+    const auto old_capacity = shard.capacity;
+    const auto old_slots = std::move(shard.slots);
+
+    shard.capacity = old_capacity == 0 ? initial_capacity : old_capacity * 2;
+    shard.slots = std::make_unique<slot_t[]>(shard.capacity);
+
+    const auto mask = shard.capacity - 1;
+    for (std::size_t i = 0; i < old_capacity; ++i)
+    {
+        const auto &old_slot = old_slots[i];
+        if (old_slot.dev == 0 && old_slot.ino == 0)
+        {
+            continue;
+        }
+
+        auto index = hash_key(old_slot.dev, old_slot.ino) & mask;
+        while (shard.slots[index].dev != 0 || shard.slots[index].ino != 0)
+        {
+            index = (index + 1) & mask;
+        }
+        shard.slots[index] = old_slot;
+    }
+}
+
+} // namespace disk_usage
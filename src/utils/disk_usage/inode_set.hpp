@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace disk_usage {
+
+/**
+ * Thread-safe set of `(st_dev, st_ino)` pairs to detect hardlinks which were already accounted.
+ *
+ * The set is designed for millions of entries:
+ *  - open addressing with linear probing in flat arrays of 16 byte slots, no per-entry allocations
+ *  - the key space is split into independent shards, each guarded by its own mutex,
+ *    so concurrent scanner threads rarely contend on the same lock
+ *
+ * Only files with `st_nlink > 1` should be inserted, files with a single link can't be duplicates.
+ */
+class inode_set_t final
+{
+public:
+    inode_set_t() = default;
+    ~inode_set_t() = default;
+
+    inode_set_t(const inode_set_t&) = delete;
+    inode_set_t &operator=(const inode_set_t&) = delete;
+
+    /**
+     * Inserts the given inode into the set.
+     *
+     * @param dev device id of the filesystem
+     * @param ino inode number
+     * @return true the inode was not in the set before (first link)
+     * @return false the inode is already in the set (additional link)
+     */
+    bool insert(std::uint64_t dev, std::uint64_t ino);
+
+    /**
+     * Returns the number of distinct inodes in the set.
+     */
+    std::size_t size() const;
+
+    /**
+     * Removes all inodes from the set and releases the memory.
+     */
+    void clear();
+
+private:
+    /// a single slot of the hash table, {ino} = 0 with {dev} = 0 marks an empty slot
+    struct slot_t final
+    {
+        std::uint64_t dev{0};
+        std::uint64_t ino{0};
+    };
+
+    /// an independent open addressing hash table
+    struct alignas(64) shard_t final
+    {
+        mutable std::mutex mutex;
+        std::unique_ptr<slot_t[]> slots;
+        std::size_t capacity{0};
+        std::size_t size{0};
+
+        /// the key (0, 0) can't be stored in a slot because it marks empty slots
+        bool has_zero_key{false};
+    };
+
+    /// number of shards, must be a power of two
+    static constexpr std::size_t shard_count = 64;
+
+    /// initial number of slots of a shard, must be a power of two
+    static constexpr std::size_t initial_capacity = 1024;
+
+    /// doubles the capacity of the shard and rehashes all slots
+    static void grow(shard_t &shard);
+
+    std::array<shard_t, shard_count> _shards;
+};
+
+} // namespace disk_usage
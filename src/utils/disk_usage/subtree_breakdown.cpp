@@ -0,0 +1,195 @@
+#include "subtree_breakdown.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace disk_usage {
+
+subtree_breakdown_t::node_t *subtree_breakdown_t::arena_t::allocate_node()
+{
+    if (this->nodes_in_last_block == nodes_per_block)
+    {
+        this->node_blocks.emplace_back(std::make_unique<node_t[]>(nodes_per_block));
+        this->nodes_in_last_block = 0;
+    }
+    return &this->node_blocks.back()[this->nodes_in_last_block++];
+}
+
+std::string_view subtree_breakdown_t::arena_t::copy_name(std::string_view name)
+{
+    // file names are at most 255 bytes, only a very long root path needs a block of its own
+    if (name.size() > chars_per_block)
+    {
+        auto block = std::make_unique<char[]>(name.size());
+        std::memcpy(block.get(), name.data(), name.size());
+        const std::string_view copy{block.get(), name.size()};
+        this->char_blocks.insert(this->char_blocks.begin(), std::move(block));
+        return copy;
+    }
+
+    if (name.size() > chars_per_block - this->chars_in_last_block)
+    {
+        this->char_blocks.emplace_back(std::make_unique<char[]>(chars_per_block));
+        this->chars_in_last_block = 0;
+    }
+
+    char *copy = this->char_blocks.back().get() + this->chars_in_last_block;
+    std::memcpy(copy, name.data(), name.size());
+    this->chars_in_last_block += name.size();
+    return std::string_view{copy, name.size()};
+}
+
+subtree_breakdown_t::subtree_breakdown_t(unsigned max_depth)
+    : _max_depth(max_depth)
+{
+}
+
+subtree_breakdown_t::~subtree_breakdown_t() = default;
+
+subtree_breakdown_t::node_t *subtree_breakdown_t::reset(std::string_view path, unsigned thread_count)
+{
+    this->_arenas = std::vector<arena_t>(std::max(1u, thread_count));
+
+    auto &arena = this->_arenas.front();
+    this->_root = arena.allocate_node();
+    this->_root->name = arena.copy_name(path);
+    return this->_root;
+}
+
+subtree_breakdown_t::node_t *subtree_breakdown_t::add_child(unsigned worker_index, node_t *parent,
+    std::string_view name)
+{
+    if (parent->depth >= this->_max_depth)
+    {
+        return parent;
+    }
+
+    auto &arena = this->_arenas[worker_index];
+    auto *node = arena.allocate_node();
+    node->parent = parent;
+    node->name = arena.copy_name(name);
+    node->depth = parent->depth + 1;
+    return node;
+}
+
+std::size_t subtree_breakdown_t::size() const noexcept
+{
+    std::size_t size = 0;
+    for (const auto &arena : this->_arenas)
+    {
+        if (!arena.node_blocks.empty())
+        {
+            size += (arena.node_blocks.size() - 1) * arena_t::nodes_per_block + arena.nodes_in_last_block;
+        }
+    }
+    return size;
+}
+
+subtree_breakdown_t::entry_t subtree_breakdown_t::top(std::size_t count, bool by_allocated_size) const
+{
+    if (this->_root == nullptr)
+    {
+        return {};
+    }
+
+    struct totals_t final
+    {
+        std::uint64_t apparent_size{0};
+        std::uint64_t allocated_size{0};
+        std::vector<const node_t*> children;
+    };
+
+    // collect all nodes from the arenas
+    std::vector<const node_t*> nodes;
+    nodes.reserve(this->size());
+    for (const auto &arena : this->_arenas)
+    {
+        for (std::size_t block = 0; block < arena.node_blocks.size(); ++block)
+        {
+            const auto used = block + 1 == arena.node_blocks.size() ? arena.nodes_in_last_block : arena_t::nodes_per_block;
+            for (std::size_t i = 0; i < used; ++i)
+            {
+                nodes.emplace_back(&arena.node_blocks[block][i]);
+            }
+        }
+    }
+
+    // sum up the subtree totals bottom-up, deeper nodes first
+    std::sort(nodes.begin(), nodes.end(), [](const node_t *lhs, const node_t *rhs){
+        return lhs->depth > rhs->depth;
+    });
+
+    std::unordered_map<const node_t*, totals_t> totals;
+    totals.reserve(nodes.size());
+    for (const auto *node : nodes)
+    {
+        auto &node_totals = totals[node];
+        node_totals.apparent_size += node->apparent_size.load(std::memory_order_relaxed);
+        node_totals.allocated_size += node->allocated_size.load(std::memory_order_relaxed);
+
+        if (node->parent != nullptr)
+        {
+            auto &parent_totals = totals[node->parent];
+            parent_totals.apparent_size += node_totals.apparent_size;
+            parent_totals.allocated_size += node_totals.allocated_size;
+            parent_totals.children.emplace_back(node);
+        }
+    }
+
+    const auto size_of = [&totals, by_allocated_size](const node_t *node){
+        const auto &node_totals = totals.at(node);
+        return by_allocated_size ? node_totals.allocated_size : node_totals.apparent_size;
+    };
+
+    // keeps the smallest of the selected children on top, it is replaced by any larger child
+    const auto is_larger = [&size_of](const node_t *lhs, const node_t *rhs){
+        return size_of(lhs) > size_of(rhs);
+    };
+
+    const std::function<void(const node_t*, entry_t&)> build = [&](const node_t *node, entry_t &entry) {
+        const auto &node_totals = totals.at(node);
+        entry.apparent_size = node_totals.apparent_size;
+        entry.allocated_size = node_totals.allocated_size;
+
+        if (count == 0)
+        {
+            return;
+        }
+
+        std::priority_queue<const node_t*, std::vector<const node_t*>, decltype(is_larger)> largest(is_larger);
+        for (const auto *child : node_totals.children)
+        {
+            if (largest.size() < count)
+            {
+                largest.push(child);
+            }
+            else if (size_of(child) > size_of(largest.top()))
+            {
+                largest.pop();
+                largest.push(child);
+            }
+        }
+
+        // the heap yields the smallest first
+        entry.children.resize(largest.size());
+        for (auto it = entry.children.rbegin(); it != entry.children.rend(); ++it)
+        {
+            const auto *child = largest.top();
+            largest.pop();
+
+            it->path = node == this->_root ? std::string{child->name} :
+                std::string{entry.path}.append("/").append(child->name);
+            build(child, *it);
+        }
+    };
+
+    entry_t root;
+    root.path = this->_root->name;
+    build(this->_root, root);
+    return root;
+}
+
+} // namespace disk_usage
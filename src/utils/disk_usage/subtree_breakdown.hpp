@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace disk_usage {
+
+/**
+ * Sizes of the subdirectories of a scanned directory, aggregated up to a maximum depth.
+ *
+ * The tree is built by the directory scanner during the regular walk, see {scan_options::breakdown}.
+ * Every directory up to the maximum depth gets its own node, deeper directories are accounted
+ * in their ancestor at the maximum depth. Nodes and names are allocated from per-worker arenas
+ * in large blocks, the scanner threads never contend on the allocation and a single directory
+ * costs one relaxed atomic addition per size.
+ *
+ * Nodes only store the sizes of their own files (and those of the aggregated deeper directories),
+ * the subtree totals are summed up when the report is created with {top}.
+ */
+class subtree_breakdown_t final
+{
+public:
+    /**
+     * A directory of the tree, owned by the arena of the worker which created it.
+     */
+    struct node_t final
+    {
+        /// the parent node, nullptr for the root
+        node_t *parent{nullptr};
+
+        /// name of the directory in its parent, the scanned path for the root
+        std::string_view name;
+
+        /// depth below the root, the root has depth 0
+        unsigned depth{0};
+
+        /// sizes of the files directly inside of this directory and its aggregated subdirectories
+        std::atomic<std::uint64_t> apparent_size{0};
+        std::atomic<std::uint64_t> allocated_size{0};
+    };
+
+    /**
+     * An entry of the report created by {top}.
+     */
+    struct entry_t final
+    {
+        /// path relative to the scanned directory, the scanned path for the root
+        std::string path;
+
+        /// sizes of the whole subtree
+        std::uint64_t apparent_size{0};
+        std::uint64_t allocated_size{0};
+
+        /// the largest subdirectories, largest first
+        std::vector<entry_t> children;
+    };
+
+    /**
+     * @param max_depth the deepest level which gets its own nodes, 1 only splits the direct subdirectories
+     */
+    explicit subtree_breakdown_t(unsigned max_depth);
+    ~subtree_breakdown_t();
+
+    subtree_breakdown_t(const subtree_breakdown_t&) = delete;
+    subtree_breakdown_t &operator=(const subtree_breakdown_t&) = delete;
+
+    inline unsigned max_depth() const noexcept {
+        return this->_max_depth;
+    }
+
+    // scanner interface
+
+    /**
+     * Discards all nodes and creates the root node for a new scan with the given number of workers.
+     */
+    node_t *reset(std::string_view path, unsigned thread_count);
+
+    /**
+     * Returns the node of a subdirectory, called by the worker which found the subdirectory.
+     *
+     * Below the maximum depth, the parent is returned and the subdirectory is aggregated into it.
+     */
+    node_t *add_child(unsigned worker_index, node_t *parent, std::string_view name);
+
+    /**
+     * Adds the sizes of the files of a directory to its node.
+     */
+    static inline void add_sizes(node_t *node, std::uint64_t apparent_size, std::uint64_t allocated_size) noexcept
+    {
+        node->apparent_size.fetch_add(apparent_size, std::memory_order_relaxed);
+        node->allocated_size.fetch_add(allocated_size, std::memory_order_relaxed);
+    }
+
+    // report interface
+
+    /**
+     * Creates a report of the largest subdirectories.
+     *
+     * On every level, only the @p count largest subdirectories are kept. They are selected with
+     * a heap bounded to @p count entries, so the cost is `O(k log count)` for a directory with k children.
+     *
+     * @param count number of subdirectories per level
+     * @param by_allocated_size rank the subdirectories by the allocated size instead of the apparent size
+     * @return the root entry, empty when nothing was scanned
+     */
+    entry_t top(std::size_t count, bool by_allocated_size = false) const;
+
+    /**
+     * Returns the number of nodes in the tree.
+     */
+    std::size_t size() const noexcept;
+
+private:
+    /**
+     * Block allocator for the nodes and names of a single worker.
+     */
+    struct alignas(64) arena_t final
+    {
+        static constexpr std::size_t nodes_per_block = 1024;
+        static constexpr std::size_t chars_per_block = 64 * 1024;
+
+        std::vector<std::unique_ptr<node_t[]>> node_blocks;
+        std::size_t nodes_in_last_block{nodes_per_block};
+
+        std::vector<std::unique_ptr<char[]>> char_blocks;
+        std::size_t chars_in_last_block{chars_per_block};
+
+        node_t *allocate_node();
+        std::string_view copy_name(std::string_view name);
+    };
+
+    const unsigned _max_depth;
+
+    /// one arena per worker thread, the root is stored in the arena of the first worker
+    std::vector<arena_t> _arenas;
+
+    node_t *_root{nullptr};
+};
+
+} // namespace disk_usage
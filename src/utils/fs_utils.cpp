@@ -1,11 +1,15 @@
 #include "fs_utils.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <filesystem>
 #include <fstream>
 #include <cstring>
-#include <regex>
+#include <iterator>
+#include <mutex>
 
 #include "logging_helper.hpp"
+#include "disk_usage/disk_usage.hpp"
 
 namespace fs_utils {
 
@@ -73,75 +77,464 @@ std::error_code find_in_text_file(const std::string &path, std::string &out,
     return std::error_code{};
 }
 
-std::list<std::string> resolve_wildcard_pattern(const std::string &pattern, std::error_code *user_ec) noexcept
+namespace {
+
+/// splits a path into its components, empty components and `.` are skipped
+std::vector<std::string_view> split_path(std::string_view path)
 {
-    // note: there is this glob library https://github.com/p-ranav/glob
-    // but it does much more than just simple wildcard matching and
-    // it uses exceptions for error handling, which is not desirable for this application
+    std::vector<std::string_view> components;
+    while (!path.empty())
+    {
+        const auto separator = path.find('/');
+        const auto component = path.substr(0, separator);
+        if (!component.empty() && component != ".")
+        {
+            components.emplace_back(component);
+        }
+        if (separator == std::string_view::npos)
+        {
+            break;
+        }
+        path.remove_prefix(separator + 1);
+    }
+    return components;
+}
 
-    namespace fs = std::filesystem;
+inline bool has_wildcard_characters(std::string_view component) noexcept
+{
+    return component.find_first_of("*?[\\") != std::string_view::npos;
+}
 
-    if (pattern.empty())
+} // anonymous namespace
+
+glob_pattern_t::glob_pattern_t(const std::string &pattern)
+    : _pattern(pattern)
+{
+    const auto components = split_path(pattern);
+
+    // the leading literal components are the base directory
+    std::size_t first_wildcard = 0;
+    while (first_wildcard < components.size() && !has_wildcard_characters(components[first_wildcard]))
     {
-        return {};
+        ++first_wildcard;
     }
 
-    std::list<std::string> file_paths;
-    std::error_code ec;
-
-    const fs::path input_path(pattern);
-    const fs::path directory = input_path.parent_path();
-    const std::string file_wildcard_pattern = input_path.filename();
-    const std::regex regex_pattern(std::regex_replace(file_wildcard_pattern, std::regex("\\*"), ".*"));
+    if (!pattern.empty() && pattern.front() == '/')
+    {
+        this->_base_directory = "/";
+    }
+    for (std::size_t i = 0; i < first_wildcard; ++i)
+    {
+        if (!this->_base_directory.empty() && this->_base_directory.back() != '/')
+        {
+            this->_base_directory += '/';
+        }
+        this->_base_directory.append(components[i]);
+    }
+    if (this->_base_directory.empty())
+    {
+        this->_base_directory = ".";
+    }
 
-    if (fs::exists(directory, ec) && fs::is_directory(directory, ec))
+    for (std::size_t i = first_wildcard; i < components.size(); ++i)
     {
-        for (const auto &entry : fs::directory_iterator(directory, fs::directory_options::skip_permission_denied, ec))
+        const auto component = components[i];
+
+        // consecutive `**` components are redundant
+        if (component == "**")
+        {
+            if (this->_components.empty() || !this->_components.back().is_globstar)
+            {
+                this->_components.emplace_back(component_t{.is_globstar = true});
+            }
+            continue;
+        }
+
+        component_t compiled{
+            .is_globstar = false,
+            .first_token = static_cast<std::uint32_t>(this->_tokens.size()),
+            .last_token = 0,
+        };
+
+        for (std::size_t pos = 0; pos < component.size(); ++pos)
         {
-            // check if the entry is a regular file and matches the wildcard pattern
-            if (fs::is_regular_file(entry, ec))
+            const auto c = static_cast<unsigned char>(component[pos]);
+            if (c == '*')
+            {
+                // consecutive stars are redundant
+                if (this->_tokens.size() == compiled.first_token || this->_tokens.back().kind != token_t::kind_t::star)
+                {
+                    this->_tokens.emplace_back(token_t{token_t::kind_t::star, 0});
+                }
+            }
+            else if (c == '?')
             {
-                const auto has_match = std::regex_match(entry.path().filename().string(), regex_pattern);
+                this->_tokens.emplace_back(token_t{token_t::kind_t::any, 0});
+            }
+            else if (c == '\\' && pos + 1 < component.size())
+            {
+                this->_tokens.emplace_back(token_t{token_t::kind_t::literal, static_cast<unsigned char>(component[++pos])});
+            }
+            else if (c == '[')
+            {
+                // a `]` directly after the opening bracket (or the negation) is part of the class
+                auto end = pos + 1;
+                const bool is_negated = end < component.size() && (component[end] == '!' || component[end] == '^');
+                end += is_negated ? 1 : 0;
+                const auto first_member = end;
+                end += end < component.size() && component[end] == ']' ? 1 : 0;
+                end = component.find(']', end);
 
-                logging_helper::get_logger()->log_debug(
-                    "matching file: '" + entry.path().string() + "' against pattern: " + file_wildcard_pattern +
-                    " (" + (has_match ? "match" : "no match") + ")");
+                if (end == std::string_view::npos)
+                {
+                    this->_tokens.emplace_back(token_t{token_t::kind_t::literal, c});
+                    continue;
+                }
 
-                if (has_match)
+                character_class_t members{};
+                const auto add = [&members](unsigned char member){
+                    members[member >> 6] |= std::uint64_t{1} << (member & 63);
+                };
+                for (auto member = first_member; member < end; ++member)
+                {
+                    const auto first = static_cast<unsigned char>(component[member]);
+                    if (member + 2 < end && component[member + 1] == '-')
+                    {
+                        const auto last = static_cast<unsigned char>(component[member + 2]);
+                        for (unsigned range = first; range <= last; ++range)
+                        {
+                            add(static_cast<unsigned char>(range));
+                        }
+                        member += 2;
+                    }
+                    else
+                    {
+                        add(first);
+                    }
+                }
+                if (is_negated)
                 {
-                    file_paths.emplace_back(entry.path().string());
+                    for (auto &bits : members)
+                    {
+                        bits = ~bits;
+                    }
                 }
+
+                this->_tokens.emplace_back(token_t{token_t::kind_t::character_class,
+                    static_cast<std::uint32_t>(this->_classes.size())});
+                this->_classes.emplace_back(members);
+                pos = end;
             }
-            else if (ec)
+            else
             {
-                logging_helper::get_logger()->log_warning("skipping inaccessible entry: " + entry.path().string() +
-                    " (" + strerror(errno) + ")");
+                this->_tokens.emplace_back(token_t{token_t::kind_t::literal, c});
+            }
+        }
+
+        compiled.last_token = static_cast<std::uint32_t>(this->_tokens.size());
+        this->_components.emplace_back(compiled);
+    }
+
+    // a trailing `**` matches every entry of the directories before it, like `*`
+    if (!this->_components.empty() && this->_components.back().is_globstar)
+    {
+        this->_components.back() = component_t{
+            .is_globstar = false,
+            .first_token = static_cast<std::uint32_t>(this->_tokens.size()),
+            .last_token = static_cast<std::uint32_t>(this->_tokens.size() + 1),
+        };
+        this->_tokens.emplace_back(token_t{token_t::kind_t::star, 0});
+    }
+
+    if (this->_components.size() > max_components)
+    {
+        this->_is_valid = false;
+        this->_components.clear();
+        return;
+    }
+
+    for (std::size_t i = 0; i < this->_components.size(); ++i)
+    {
+        if (this->_components[i].is_globstar)
+        {
+            this->_globstar_mask |= state_t{1} << i;
+        }
+    }
+}
+
+bool glob_pattern_t::match_component(const component_t &component, std::string_view name) const noexcept
+{
+    // on a mismatch, the last `*` consumes one more character and matching restarts after it
+    std::uint32_t token = component.first_token;
+    std::size_t pos = 0;
+    std::uint32_t restart_token = 0;
+    std::size_t restart_pos = 0;
+
+    while (token < component.last_token || pos < name.size())
+    {
+        if (token < component.last_token)
+        {
+            const auto &current = this->_tokens[token];
+            if (current.kind == token_t::kind_t::star)
+            {
+                restart_token = token;
+                restart_pos = pos + 1;
+                ++token;
                 continue;
             }
+            else if (pos < name.size())
+            {
+                const auto c = static_cast<unsigned char>(name[pos]);
+                const bool is_match =
+                    current.kind == token_t::kind_t::any ||
+                    (current.kind == token_t::kind_t::literal && current.value == c) ||
+                    (current.kind == token_t::kind_t::character_class &&
+                        (this->_classes[current.value][c >> 6] >> (c & 63)) & 1);
+                if (is_match)
+                {
+                    ++token;
+                    ++pos;
+                    continue;
+                }
+            }
+        }
+
+        if (restart_pos > 0 && restart_pos <= name.size())
+        {
+            token = restart_token;
+            pos = restart_pos;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+glob_pattern_t::state_t glob_pattern_t::close_state(state_t state) const noexcept
+{
+    // a `**` can match zero directories, the component after it applies to the same directory
+    for (auto globstars = state & this->_globstar_mask; globstars != 0;)
+    {
+        const auto bit = globstars & (~globstars + 1);
+        globstars ^= bit;
+        if ((state & (bit << 1)) == 0)
+        {
+            state |= bit << 1;
+            globstars |= (bit << 1) & this->_globstar_mask;
+        }
+    }
+    return state;
+}
+
+glob_pattern_t::state_t glob_pattern_t::initial_state() const noexcept
+{
+    return this->_components.empty() ? 0 : this->close_state(1);
+}
+
+glob_pattern_t::state_t glob_pattern_t::step(state_t state, std::string_view name, bool is_directory,
+    bool &is_match) const noexcept
+{
+    const auto last = this->_components.size() - 1;
+
+    state_t next = 0;
+    is_match = false;
+    for (auto remaining = state; remaining != 0; remaining &= remaining - 1)
+    {
+        const auto index = static_cast<std::size_t>(std::countr_zero(remaining));
+        const auto &component = this->_components[index];
+
+        if (component.is_globstar)
+        {
+            // the `**` consumes this directory
+            next |= state_t{1} << index;
         }
-        if (ec)
+        else if (this->match_component(component, name))
         {
-            logging_helper::get_logger()->log_error("failed to read directory: " + directory.string() +
-                " (" + strerror(errno) + ")");
-            if (user_ec != nullptr)
+            if (index == last)
             {
-                (*user_ec) = std::make_error_code(std::errc{errno});
+                is_match = true;
+            }
+            else
+            {
+                next |= state_t{1} << (index + 1);
             }
-            return {};
         }
     }
-    else if (ec)
+
+    return is_directory ? this->close_state(next) : 0;
+}
+
+glob_pattern_t::state_t glob_pattern_t::next_state(state_t state, std::string_view name, bool is_directory,
+    bool &is_match) const noexcept
+{
+    const auto next = this->step(state, name, is_directory, is_match);
+
+    // matched directories are resolved as a whole
+    return is_match ? 0 : next;
+}
+
+bool glob_pattern_t::match(std::string_view path) const noexcept
+{
+    if (!this->_is_valid)
     {
-        logging_helper::get_logger()->log_error("failed to stat directory: " + directory.string() +
-            " (" + strerror(errno) + ")");
+        return false;
+    }
+
+    const auto base = split_path(this->_base_directory);
+    const auto components = split_path(path);
+    const bool is_absolute = this->_base_directory.front() == '/';
+    if ((!path.empty() && path.front() == '/') != is_absolute || components.size() < base.size() ||
+        !std::equal(base.begin(), base.end(), components.begin()))
+    {
+        return false;
+    }
+
+    if (!this->has_wildcards())
+    {
+        return components.size() == base.size();
+    }
+
+    bool is_match = false;
+    auto state = this->initial_state();
+    for (auto it = components.begin() + static_cast<std::ptrdiff_t>(base.size()); it != components.end() && state != 0; ++it)
+    {
+        const bool is_last = it + 1 == components.end();
+        state = this->step(state, *it, !is_last, is_match);
+        if (is_last)
+        {
+            return is_match;
+        }
+    }
+    return false;
+}
+
+std::vector<wildcard_match_t> resolve_wildcard_matches(const glob_pattern_t &pattern,
+    std::error_code *user_ec) noexcept
+{
+    namespace fs = std::filesystem;
+
+    const auto report_error = [user_ec](const std::error_code &ec){
         if (user_ec != nullptr)
         {
-            (*user_ec) = std::make_error_code(std::errc{errno});
+            (*user_ec) = ec;
+        }
+    };
+
+    if (pattern.pattern().empty())
+    {
+        return {};
+    }
+    else if (!pattern.is_valid())
+    {
+        logging_helper::get_logger()->log_error("wildcard pattern has too many components: " + pattern.pattern());
+        report_error(std::make_error_code(std::errc::invalid_argument));
+        return {};
+    }
+
+    // converts the stat result, symbolic links are followed, but only links to regular files are matches
+    const auto make_match = [](std::string path, const disk_usage::entry_stat &stat) {
+        return wildcard_match_t{
+            .path = std::move(path),
+            .is_directory = stat.type == disk_usage::entry_type::directory,
+            .apparent_size = stat.apparent_size,
+            .allocated_size = stat.allocated_size,
+            .mtime = stat.mtime,
+            .device = stat.device,
+            .inode = stat.inode,
+            .link_count = stat.link_count,
+        };
+    };
+
+    // the pattern is a plain path
+    if (!pattern.has_wildcards())
+    {
+        const auto &path = pattern.base_directory();
+        const auto directory = fs::path(path).parent_path().string();
+        const auto name = fs::path(path).filename().string();
+
+        disk_usage::entry_stat stat;
+        if (!disk_usage::stat_entry(disk_usage::walk_entry{
+                .directory = directory,
+                .name = name,
+                .type = disk_usage::entry_type::other,
+                .parent_state = 0,
+            }, stat) && stat.type != disk_usage::entry_type::other)
+        {
+            return {make_match(path, stat)};
         }
         return {};
     }
 
+    std::mutex matches_mutex;
+    std::vector<wildcard_match_t> matches;
+
+    // single-level patterns don't profit from multiple threads
+    const auto ec = disk_usage::walk_directory(pattern.base_directory(), disk_usage::walk_options{
+        .thread_count = pattern.is_recursive() ? 0u : 1u,
+        .root_state = pattern.initial_state(),
+    }, [&](const disk_usage::walk_entry &entry) -> std::uint64_t {
+        using disk_usage::entry_type;
+
+        const bool is_directory = entry.type == entry_type::directory;
+        bool is_match = false;
+        const auto state = pattern.next_state(entry.parent_state, entry.name, is_directory, is_match);
+        if (!is_match || entry.type == entry_type::other)
+        {
+            return state;
+        }
+
+        // directories are scanned later, everything else is stat'ed once here
+        disk_usage::entry_stat stat;
+        if (is_directory)
+        {
+            stat.type = entry_type::directory;
+        }
+        else if (disk_usage::stat_entry(entry, stat) || stat.type != entry_type::regular_file)
+        {
+            // dangling symbolic links and symbolic links to directories are not matches
+            return 0;
+        }
+
+        auto match = make_match((fs::path(entry.directory) / entry.name).string(), stat);
+
+        std::lock_guard<std::mutex> lock(matches_mutex);
+        matches.emplace_back(std::move(match));
+        return 0;
+    });
+
+    if (ec)
+    {
+        // nothing to resolve
+        if (ec == std::errc::no_such_file_or_directory || ec == std::errc::not_a_directory)
+        {
+            return {};
+        }
+
+        logging_helper::get_logger()->log_error("failed to resolve wildcard pattern: " + pattern.pattern() +
+            " (" + ec.message() + ")");
+        report_error(ec);
+        return {};
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const wildcard_match_t &lhs, const wildcard_match_t &rhs){
+        return lhs.path < rhs.path;
+    });
+    return matches;
+}
+
+std::list<std::string> resolve_wildcard_pattern(const glob_pattern_t &pattern, std::error_code *ec) noexcept
+{
+    std::list<std::string> file_paths;
+    for (auto &match : resolve_wildcard_matches(pattern, ec))
+    {
+        file_paths.emplace_back(std::move(match.path));
+    }
     return file_paths;
 }
 
+std::list<std::string> resolve_wildcard_pattern(const std::string &pattern, std::error_code *ec) noexcept
+{
+    return resolve_wildcard_pattern(glob_pattern_t(pattern), ec);
+}
+
 } // namespace fs_utils
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <list>
+#include <vector>
 #include <system_error>
 #include <functional>
 
@@ -43,23 +46,208 @@ std::string read_text_file(const std::string &path, std::error_code *ec = nullpt
 std::error_code find_in_text_file(const std::string &path, std::string &out,
     std::function<bool(std::string_view line, std::string &cb_out)> line_callback) noexcept;
 
-/// Resolves the given wildcard pattern into a list of file paths.
+/**
+ * A compiled glob pattern for paths.
+ *
+ * Supported syntax in every path component:
+ *  - `*` matches any sequence of characters, including none
+ *  - `?` matches any single character (byte)
+ *  - `[abc]`, `[a-z]`, `[!a-z]` or `[^a-z]` match a single character of (or not of) the class
+ *  - `\` escapes the following character
+ *  - a component which is exactly `**` matches zero or more directories
+ *
+ * Unlike in a shell, wildcards also match names with a leading dot.
+ *
+ * Matching doesn't use regular expressions. A component is matched in a single pass over the name,
+ * the pass only restarts after the last `*` (no exponential backtracking). The pattern is parsed once,
+ * the same compiled pattern can be matched against any number of paths.
+ */
+class glob_pattern_t final
+{
+public:
+    /**
+     * Compiles the given pattern.
+     *
+     * An unterminated character class matches the `[` literally.
+     *
+     * @param pattern the glob pattern
+     */
+    explicit glob_pattern_t(const std::string &pattern);
+
+    /**
+     * The source pattern.
+     */
+    inline const std::string &pattern() const noexcept {
+        return this->_pattern;
+    }
+
+    /**
+     * The leading components of the pattern without wildcards, resolution starts in this directory.
+     */
+    inline const std::string &base_directory() const noexcept {
+        return this->_base_directory;
+    }
+
+    /**
+     * The pattern can be resolved, at most {max_components} components may follow the base directory.
+     */
+    inline bool is_valid() const noexcept {
+        return this->_is_valid;
+    }
+
+    /**
+     * The pattern contains wildcards, otherwise it matches only the path itself.
+     */
+    inline bool has_wildcards() const noexcept {
+        return !this->_components.empty();
+    }
+
+    /**
+     * The pattern contains a `**` component and matches paths in any depth.
+     */
+    inline bool is_recursive() const noexcept {
+        return this->_globstar_mask != 0;
+    }
+
+    /**
+     * Checks if the given path matches the whole pattern.
+     *
+     * The path is compared component by component, redundant separators are ignored.
+     */
+    bool match(std::string_view path) const noexcept;
+
+    /**
+     * Resolution state of a directory, bit `i` is set if the entries of the directory are matched
+     * against the i-th wildcard component. The base directory has the state {initial_state}.
+     */
+    using state_t = std::uint64_t;
+
+    /// the number of bits of a state limits the number of components after the base directory
+    static constexpr std::size_t max_components = 64;
+
+    /// the state of the base directory
+    state_t initial_state() const noexcept;
+
+    /**
+     * Matches a single entry of a directory with the given state.
+     *
+     * @param state the state of the directory which contains the entry
+     * @param name the file name of the entry
+     * @param is_directory the entry is a directory
+     * @param is_match set to true if the entry matches the whole pattern
+     * @return the state of the entry if it is a directory which must be descended into, 0 otherwise
+     */
+    state_t next_state(state_t state, std::string_view name, bool is_directory, bool &is_match) const noexcept;
+
+private:
+    /// single character matcher of a component
+    struct token_t final
+    {
+        enum class kind_t : std::uint8_t { literal, any, star, character_class };
+
+        kind_t kind;
+
+        /// the character of a literal or the index of the class in {_classes}
+        std::uint32_t value;
+    };
+
+    struct component_t final
+    {
+        /// the component is `**`
+        bool is_globstar{false};
+
+        /// first and one past the last token of the component in {_tokens}
+        std::uint32_t first_token{0};
+        std::uint32_t last_token{0};
+    };
+
+    /// 256 bit set of the bytes of a character class
+    using character_class_t = std::array<std::uint64_t, 4>;
+
+    bool match_component(const component_t &component, std::string_view name) const noexcept;
+
+    /// matches a single entry without pruning matched directories, see {next_state}
+    state_t step(state_t state, std::string_view name, bool is_directory, bool &is_match) const noexcept;
+
+    /// adds the states which are reachable by `**` matching zero directories
+    state_t close_state(state_t state) const noexcept;
+
+    std::string _pattern;
+    std::string _base_directory;
+
+    std::vector<component_t> _components;
+    std::vector<token_t> _tokens;
+    std::vector<character_class_t> _classes;
+
+    /// bits of the `**` components
+    state_t _globstar_mask{0};
+
+    bool _is_valid{true};
+};
+
+/**
+ * A path which matched a wildcard pattern, with the metadata from the resolution pass.
+ */
+struct wildcard_match_t final
+{
+    std::string path;
+
+    /// the match is a directory, its size must be calculated with a directory scan
+    bool is_directory{false};
+
+    /// the sizes of a regular file, 0 for directories
+    std::uintmax_t apparent_size{0};
+    std::uintmax_t allocated_size{0};
+
+    /// unix timestamp of the last modification of a regular file
+    std::int64_t mtime{0};
+
+    /// identity of the inode of a regular file, to deduplicate hardlinks
+    std::uint64_t device{0};
+    std::uint64_t inode{0};
+    std::uint64_t link_count{1};
+};
+
+/// Resolves the given wildcard pattern into a list of matches, see {resolve_wildcard_pattern}.
+///
+/// Regular files are stat'ed exactly once while the pattern is resolved, relative to their directory.
+/// The sizes of file matches are known without touching the filesystem again.
+///
+/// @param pattern the compiled wildcard pattern
+/// @param ec optional error_code for error handling
+/// @return the matches in lexicographical order of their paths
+std::vector<wildcard_match_t> resolve_wildcard_matches(const glob_pattern_t &pattern,
+    std::error_code *ec = nullptr) noexcept;
+
+/// Resolves the given wildcard pattern into a list of matching paths.
 ///
-/// Only simple singular `*` wildcards are supported.
-/// Globbing is not supported.
+/// See {glob_pattern_t} for the supported syntax. Matching regular files (also through symbolic links)
+/// and directories are returned in lexicographical order. Matching directories are not descended into,
+/// the matches never overlap.
 ///
 /// Example directory:
 ///  - /path/file1.txt
 ///  - /path/file2.log
 ///  - /path/file3.yaml
-///  - /path/sub/unreachable
+///  - /path/sub/file4.txt
 ///
-/// The wildcard pattern `/path/*` would return all 3 files in `/path`.
-/// The wildcard pattern `/path/file*` would return all 3 files `/path`.
+/// The wildcard pattern `/path/*` would return all 3 files and `/path/sub`.
+/// The wildcard pattern `/path/file*` would return all 3 files in `/path`.
 /// The wildcard pattern `/path/*.txt` would only return `/path/file1.txt`.
+/// The wildcard pattern `/path/**/*.txt` would return `/path/file1.txt` and `/path/sub/file4.txt`.
+///
+/// Patterns with `**` are resolved with the parallel directory walker, see {disk_usage::walk_directory}.
+/// A base directory which doesn't exist resolves into an empty list without an error.
 ///
 /// Implementation notice:
-///  Going up one directory with `..` is not supported.
+///  Going up one directory with `..` is only supported before the first wildcard.
+///
+/// @param pattern the compiled wildcard pattern
+/// @param ec optional error_code for error handling
+/// @return list of file paths
+std::list<std::string> resolve_wildcard_pattern(const glob_pattern_t &pattern, std::error_code *ec = nullptr) noexcept;
+
+/// Compiles and resolves the given wildcard pattern, see {resolve_wildcard_pattern(const glob_pattern_t&)}.
 ///
 /// @param pattern the wildcard pattern
 /// @param ec optional error_code for error handling
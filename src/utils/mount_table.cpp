@@ -0,0 +1,280 @@
+#include "mount_table.hpp"
+
+#include <filesystem>
+
+#if defined(PROJECT_PLATFORM_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+// added in Linux 5.8, the value is part of the kernel ABI
+#if defined(PROJECT_PLATFORM_LINUX) && !defined(STATX_ATTR_MOUNT_ROOT)
+#define STATX_ATTR_MOUNT_ROOT 0x00002000
+#endif
+
+namespace {
+
+/// splits off the next space separated field of the line
+std::string_view next_field(std::string_view &line) noexcept
+{
+    const auto end = line.find(' ');
+    const auto field = line.substr(0, end);
+    line.remove_prefix(end == std::string_view::npos ? line.size() : end + 1);
+    return field;
+}
+
+/// decodes the octal escapes of spaces, tabs, newlines and backslashes in paths (`\040`)
+std::string unescape(std::string_view field)
+{
+    std::string result;
+    result.reserve(field.size());
+    for (std::size_t i = 0; i < field.size(); ++i)
+    {
+        if (field[i] == '\\' && i + 3 < field.size() &&
+            field[i + 1] >= '0' && field[i + 1] <= '3' &&
+            field[i + 2] >= '0' && field[i + 2] <= '7' &&
+            field[i + 3] >= '0' && field[i + 3] <= '7')
+        {
+            result += static_cast<char>(((field[i + 1] - '0') << 6) | ((field[i + 2] - '0') << 3) | (field[i + 3] - '0'));
+            i += 3;
+        }
+        else
+        {
+            result += field[i];
+        }
+    }
+    return result;
+}
+
+/// parses a decimal number, returns false on invalid characters
+template<typename T>
+bool parse_number(std::string_view field, T &value) noexcept
+{
+    value = 0;
+    if (field.empty())
+    {
+        return false;
+    }
+    for (const char c : field)
+    {
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+        value = static_cast<T>(value * 10 + static_cast<T>(c - '0'));
+    }
+    return true;
+}
+
+/// lexically normalized absolute path without trailing separator
+std::string normalize(std::string_view path)
+{
+    auto normalized = std::filesystem::path(path).lexically_normal().string();
+    while (normalized.size() > 1 && normalized.back() == '/')
+    {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+/// checks if @p path is @p prefix or inside of it
+bool is_path_prefix(std::string_view prefix, std::string_view path) noexcept
+{
+    if (prefix == "/")
+    {
+        return !path.empty() && path.front() == '/';
+    }
+    return path.starts_with(prefix) && (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+} // anonymous namespace
+
+namespace os_utils {
+
+std::error_code mount_table_t::load(const std::string &path) noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX)
+    std::error_code ec;
+
+    // procfs files report a size of 0, read_text_file can't be used
+    std::string contents;
+    if (const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); fd >= 0)
+    {
+        char buffer[16 * 1024];
+        ssize_t bytes_read;
+        while ((bytes_read = ::read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            contents.append(buffer, static_cast<std::size_t>(bytes_read));
+        }
+        if (bytes_read < 0)
+        {
+            ec = std::error_code{errno, std::generic_category()};
+        }
+        ::close(fd);
+    }
+    else
+    {
+        ec = std::error_code{errno, std::generic_category()};
+    }
+
+    if (!ec)
+    {
+        this->parse(contents);
+    }
+    return ec;
+#else
+    static_cast<void>(path);
+    return std::make_error_code(std::errc::not_supported);
+#endif
+}
+
+void mount_table_t::parse(std::string_view contents)
+{
+    this->_mount_points.clear();
+    this->_mounts.clear();
+
+    while (!contents.empty())
+    {
+        const auto line_end = contents.find('\n');
+        auto line = contents.substr(0, line_end);
+        contents.remove_prefix(line_end == std::string_view::npos ? contents.size() : line_end + 1);
+
+        // 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+        mount_entry_t mount;
+        const auto mount_id = next_field(line);
+        const auto parent_id = next_field(line);
+        const auto device = next_field(line);
+        const auto root = next_field(line);
+        const auto mount_point = next_field(line);
+        next_field(line); // mount options
+
+        // optional fields until the separator
+        std::string_view field;
+        do
+        {
+            field = next_field(line);
+        } while (!field.empty() && field != "-");
+
+        const auto filesystem_type = next_field(line);
+        const auto mount_source = next_field(line);
+
+        const auto colon = device.find(':');
+        std::uint32_t major = 0, minor = 0;
+        if (field != "-" || colon == std::string_view::npos || root.empty() || mount_point.empty() ||
+            !parse_number(mount_id, mount.mount_id) || !parse_number(parent_id, mount.parent_id) ||
+            !parse_number(device.substr(0, colon), major) || !parse_number(device.substr(colon + 1), minor))
+        {
+            continue;
+        }
+
+#if defined(PROJECT_PLATFORM_LINUX)
+        mount.device = makedev(major, minor);
+#else
+        mount.device = (static_cast<std::uint64_t>(major) << 32) | minor;
+#endif
+        mount.root = unescape(root);
+        mount.mount_point = unescape(mount_point);
+        mount.filesystem_type = unescape(filesystem_type);
+        mount.mount_source = unescape(mount_source);
+        this->_mounts.emplace_back(std::move(mount));
+    }
+
+    // later mounts on the same mount point hide the earlier ones
+    this->_mount_points.reserve(this->_mounts.size());
+    for (std::size_t i = 0; i < this->_mounts.size(); ++i)
+    {
+        this->_mount_points[this->_mounts[i].mount_point] = i;
+    }
+}
+
+const mount_entry_t *mount_table_t::find_mount_point(std::string_view path) const noexcept
+{
+    const auto it = this->_mount_points.find(normalize(path));
+    return it != this->_mount_points.end() ? &this->_mounts[it->second] : nullptr;
+}
+
+const mount_entry_t *mount_table_t::find_containing_mount(std::string_view path) const noexcept
+{
+    const auto normalized = normalize(path);
+    if (normalized.empty() || normalized.front() != '/')
+    {
+        return nullptr;
+    }
+
+    // strip one component after another until a mount point is found
+    std::string_view prefix = normalized;
+    while (true)
+    {
+        if (const auto it = this->_mount_points.find(prefix); it != this->_mount_points.end())
+        {
+            return &this->_mounts[it->second];
+        }
+        if (prefix == "/")
+        {
+            return nullptr;
+        }
+
+        const auto separator = prefix.rfind('/');
+        prefix = separator == 0 ? std::string_view{"/"} : prefix.substr(0, separator);
+    }
+}
+
+std::string mount_table_t::bind_source_of(const mount_entry_t &mount) const
+{
+    if (mount.root == "/")
+    {
+        return mount.mount_source;
+    }
+
+    // the visible mount of the same filesystem with the longest root containing the bind mounted directory
+    const mount_entry_t *best = nullptr;
+    for (const auto &[mount_point, index] : this->_mount_points)
+    {
+        const auto &candidate = this->_mounts[index];
+        if (&candidate == &mount || candidate.device != mount.device || !is_path_prefix(candidate.root, mount.root) ||
+            (best != nullptr && best->root.size() >= candidate.root.size()))
+        {
+            continue;
+        }
+        best = &candidate;
+    }
+
+    if (best == nullptr)
+    {
+        return mount.root;
+    }
+
+    const auto relative = std::string_view{mount.root}.substr(best->root == "/" ? 0 : best->root.size());
+    if (best->mount_point == "/")
+    {
+        return std::string{relative};
+    }
+    return best->mount_point + std::string{relative};
+}
+
+std::error_code is_mount_root(const std::string &path, bool &is_mount_root) noexcept
+{
+    is_mount_root = false;
+
+#if defined(PROJECT_PLATFORM_LINUX)
+    struct statx stx;
+    if (::statx(AT_FDCWD, path.c_str(), AT_NO_AUTOMOUNT, STATX_TYPE, &stx) != 0)
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+    else if ((stx.stx_attributes_mask & STATX_ATTR_MOUNT_ROOT) == 0)
+    {
+        return std::make_error_code(std::errc::not_supported);
+    }
+
+    is_mount_root = (stx.stx_attributes & STATX_ATTR_MOUNT_ROOT) != 0;
+    return {};
+#else
+    static_cast<void>(path);
+    return std::make_error_code(std::errc::not_supported);
+#endif
+}
+
+} // namespace os_utils
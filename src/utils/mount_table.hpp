@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace os_utils {
+
+/**
+ * A single mount of the mount table, see `proc_pid_mountinfo(5)`.
+ */
+struct mount_entry_t final
+{
+    /// unique id of the mount and the id of its parent mount
+    std::uint32_t mount_id{0};
+    std::uint32_t parent_id{0};
+
+    /// device id (`st_dev`) of the mounted filesystem
+    std::uint64_t device{0};
+
+    /// the directory of the filesystem which is mounted, `/` unless this is a bind mount of a subdirectory
+    std::string root;
+
+    /// the directory where the filesystem is mounted
+    std::string mount_point;
+
+    /// filesystem type, for example `ext4` or `tmpfs`
+    std::string filesystem_type;
+
+    /// filesystem specific mount source, usually the block device
+    std::string mount_source;
+};
+
+/**
+ * Snapshot of the mount table of the process, parsed from `/proc/self/mountinfo`.
+ *
+ * The mount points are indexed in a hash table. Exact lookups are a single hash lookup,
+ * the mount which contains a path is found with one lookup per path component (longest prefix).
+ * No system calls are made after the table was loaded.
+ *
+ * Paths are compared lexically, they should be absolute and free of symbolic links.
+ * When the same directory is mounted multiple times, the last mount hides the previous ones.
+ */
+class mount_table_t final
+{
+public:
+    mount_table_t() = default;
+
+    // the index points into the mounts, copies would point into the original
+    mount_table_t(const mount_table_t&) = delete;
+    mount_table_t &operator=(const mount_table_t&) = delete;
+    mount_table_t(mount_table_t&&) = default;
+    mount_table_t &operator=(mount_table_t&&) = default;
+
+    /**
+     * Loads the mount table of the current process.
+     *
+     * Only supported on Linux, other platforms return `std::errc::not_supported`.
+     *
+     * @param path the mountinfo file to read
+     * @return error code if the file couldn't be read
+     */
+    std::error_code load(const std::string &path = "/proc/self/mountinfo") noexcept;
+
+    /**
+     * Parses the contents of a mountinfo file and replaces the current table.
+     *
+     * Malformed lines are skipped.
+     *
+     * @param contents the contents of a mountinfo file
+     */
+    void parse(std::string_view contents);
+
+    /**
+     * Returns the visible mount which is mounted exactly at the given path.
+     *
+     * @return nullptr if the path is not a mount point
+     */
+    const mount_entry_t *find_mount_point(std::string_view path) const noexcept;
+
+    /**
+     * Returns the visible mount which contains the given path (longest prefix match).
+     *
+     * @return nullptr if the table is empty or the path is relative
+     */
+    const mount_entry_t *find_containing_mount(std::string_view path) const noexcept;
+
+    /**
+     * Determines the source of a mount.
+     *
+     * For bind mounts, this is the path of the bind mounted directory, found through another mount
+     * of the same filesystem whose root contains the mounted directory. For all other mounts,
+     * this is the {mount_entry_t::mount_source}. If no other mount of the filesystem is visible,
+     * the root of the bind mount inside of its filesystem is returned.
+     *
+     * @param mount a mount of this table
+     * @return the source of the mount
+     */
+    std::string bind_source_of(const mount_entry_t &mount) const;
+
+    /**
+     * Returns the number of mounts in the table, including hidden mounts.
+     */
+    inline std::size_t size() const noexcept {
+        return this->_mounts.size();
+    }
+
+    /**
+     * Returns all mounts in the order of the mountinfo file.
+     */
+    inline const std::vector<mount_entry_t> &mounts() const noexcept {
+        return this->_mounts;
+    }
+
+private:
+    std::vector<mount_entry_t> _mounts;
+
+    /// index of the visible mount of every mount point, the keys point into {_mounts}
+    std::unordered_map<std::string_view, std::size_t> _mount_points;
+};
+
+/**
+ * Checks if the given path is the root of a mount with `statx` and `STATX_ATTR_MOUNT_ROOT` (Linux 5.8).
+ *
+ * Unlike comparing the device ids of the path and its parent, this detects bind mounts
+ * on the same filesystem.
+ *
+ * @param path the path to check, symbolic links are followed
+ * @param is_mount_root receives the result
+ * @return error code if the check failed, `std::errc::not_supported` if the kernel doesn't report the attribute
+ */
+std::error_code is_mount_root(const std::string &path, bool &is_mount_root) noexcept;
+
+} // namespace os_utils
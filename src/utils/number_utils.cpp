@@ -1 +1,72 @@
 #include "number_utils.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <string_view>
+
+namespace number_utils {
+
+std::uint64_t parse_file_size(const std::string &str, bool *ok) noexcept
+{
+    const auto fail = [ok]() -> std::uint64_t {
+        if (ok) {
+            *ok = false;
+        }
+        return 0;
+    };
+
+    // the number must not be empty or signed, strtoull accepts both
+    std::size_t digits = 0;
+    while (digits < str.size() && str[digits] >= '0' && str[digits] <= '9')
+    {
+        ++digits;
+    }
+    if (digits == 0)
+    {
+        return fail();
+    }
+
+    errno = 0;
+    const std::uint64_t value = std::strtoull(str.substr(0, digits).c_str(), nullptr, 10);
+    if (errno == ERANGE)
+    {
+        return fail();
+    }
+
+    std::string_view suffix = std::string_view{str}.substr(digits);
+    std::uint64_t multiplier = 1;
+    if (!suffix.empty() && suffix != "B")
+    {
+        constexpr std::string_view prefixes = "KMGT";
+        const auto exponent = prefixes.find(suffix.front());
+        if (exponent == std::string_view::npos)
+        {
+            return fail();
+        }
+
+        suffix.remove_prefix(1);
+        const std::uint64_t base = suffix == "iB" ? 1024 : 1000;
+        if (!suffix.empty() && suffix != "B" && suffix != "iB")
+        {
+            return fail();
+        }
+
+        for (std::size_t i = 0; i <= exponent; ++i)
+        {
+            multiplier *= base;
+        }
+    }
+
+    if (value > std::numeric_limits<std::uint64_t>::max() / multiplier)
+    {
+        return fail();
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return value * multiplier;
+}
+
+} // namespace number_utils
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <type_traits>
+#include <cerrno>
 #include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <string>
 
 namespace number_utils {
@@ -14,7 +17,8 @@ concept is_integral_type = requires {
 /**
  * Parses the given string into a number without throwing an exception.
  *
- * To check for parsing errors, pass a bool pointer to the @p ok parameter.
+ * Only plain decimal digits are accepted, signs, whitespace and values which don't fit into
+ * the type are parsing errors. To check for parsing errors, pass a bool pointer to the @p ok parameter.
  *
  * @tparam IntegralType any integral type
  * @param str the string to parse
@@ -31,9 +35,15 @@ IntegralType parse_integer(const std::string &str, bool *ok = nullptr) noexcept
 
     if constexpr (std::is_same_v<IntegralType, std::uint32_t>)
     {
-        char *end_ptr{};
-        result = std::strtoul(str.c_str(), &end_ptr, 10);
-        is_ok = *end_ptr == 0;
+        // strtoul skips whitespace and accepts a sign, "-1" would wrap around to the maximum
+        if (!str.empty() && str.front() >= '0' && str.front() <= '9')
+        {
+            char *end_ptr{};
+            errno = 0;
+            const auto value = std::strtoul(str.c_str(), &end_ptr, 10);
+            is_ok = *end_ptr == 0 && errno != ERANGE && value <= std::numeric_limits<std::uint32_t>::max();
+            result = static_cast<std::uint32_t>(value);
+        }
     }
     else
     {
@@ -50,4 +60,19 @@ IntegralType parse_integer(const std::string &str, bool *ok = nullptr) noexcept
     return result;
 }
 
+/**
+ * Parses a file size with an optional unit suffix without throwing an exception.
+ *
+ * Supported suffixes are `B`, decimal units (`K`, `M`, `G`, `T` with an optional `B`)
+ * and binary units (`KiB`, `MiB`, `GiB`, `TiB`), for example `32G` or `512MiB`.
+ * Decimal units match the units of the usage statistics.
+ *
+ * To check for parsing errors, pass a bool pointer to the @p ok parameter.
+ *
+ * @param str the string to parse
+ * @param ok optional parsing error indicator
+ * @return the size in bytes, or 0 if parsing failed
+ */
+std::uint64_t parse_file_size(const std::string &str, bool *ok = nullptr) noexcept;
+
 } // namespace number_utils
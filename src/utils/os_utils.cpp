@@ -4,15 +4,21 @@
 #include <cerrno>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
 
 #include "logging_helper.hpp"
+#include "mount_table.hpp"
+#include "disk_usage/disk_usage.hpp"
 
 #if defined(PROJECT_PLATFORM_WINDOWS)
 // Windows
 #else
 // everything else
 #include <unistd.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <spawn.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #endif
@@ -20,6 +26,8 @@
 #if defined(PROJECT_PLATFORM_LINUX)
 // Linux
 #include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #elif defined(PROJECT_PLATFORM_BSD)
 // BSD systems
 #include <sys/mount.h> // TODO: is this needed?
@@ -135,14 +143,45 @@ bool is_mount_point(const std::string &path, std::string *mount_target)
 #if defined(PROJECT_PLATFORM_WINDOWS)
 #error os_utils::is_mount_point not implemented for this platform
 #else
-    errno = 0;
+    if (mount_target != nullptr)
+    {
+        mount_target->clear();
+    }
+
+    // a single statx call is enough if the mount target is not requested
+    bool is_root = false;
+    const auto ec_mount_root = is_mount_root(path, is_root);
+    if (!ec_mount_root && (!is_root || mount_target == nullptr))
+    {
+        return is_root;
+    }
+    else if (ec_mount_root && ec_mount_root != std::errc::not_supported)
+    {
+        logging_helper::get_logger()->log_error(path + ": " + ec_mount_root.message());
+        return false;
+    }
 
-    // TODO: is receiving the mount destination for bind mounts even possible?
-    // /proc/mounts only shows the block device, not the mount destination of the bind mount
+    // the mount table also knows about bind mounts on the same filesystem and their source
+    mount_table_t mount_table;
+    if (!mount_table.load())
+    {
+        std::error_code ec;
+        const auto canonical_path = std::filesystem::canonical(path, ec);
+        if (const auto *mount = ec ? nullptr : mount_table.find_mount_point(canonical_path.string()))
+        {
+            if (mount_target != nullptr)
+            {
+                (*mount_target) = mount_table.bind_source_of(*mount);
+            }
+            return true;
+        }
+        return is_root;
+    }
 
-    // struct statfs fs_info;
-    // if (::statfs(path.c_str(), &fs_info) == 0) {}
+    errno = 0;
 
+    // without mount table, assume that the given path is a mount point to another filesystem
+    // bind mounts on the same filesystem can't be detected this way
     struct stat st1, st2;
     if (
         // stat the given path
@@ -150,9 +189,6 @@ bool is_mount_point(const std::string &path, std::string *mount_target)
         // stat the parent directory of the given path
         ::stat((path + "/..").c_str(), &st2) == 0)
     {
-        // assume that the given path is a mount point to another filesystem
-        // for bind mounted directories residing on different filesystems, this returns true
-        // TODO: check how this behaves for bind mounts residing on the same filesystem
         return st1.st_dev != st2.st_dev;
     }
 
@@ -191,37 +227,62 @@ bool can_access_file(const std::string &path, std::filesystem::perms mode)
 #endif
 }
 
-std::tuple<std::uintmax_t, std::error_code> get_used_disk_space_of(const std::string &path) noexcept
+std::tuple<std::uintmax_t, std::uintmax_t, std::error_code> get_used_disk_space_of(
+    const std::string &path, unsigned thread_count) noexcept
+{
+    const auto result = disk_usage::scan_directory(path, disk_usage::scan_options{
+        .thread_count = thread_count,
+    });
+
+    return std::make_tuple(result.apparent_size, result.allocated_size, result.ec);
+}
+
+std::tuple<std::uintmax_t, std::error_code> get_available_disk_space_of(const std::string &path) noexcept
 {
     namespace fs = std::filesystem;
 
     std::error_code ec;
-    if (!fs::is_directory(path, ec))
+    fs::space_info info = fs::space(path, ec);
+    return std::make_tuple(info.available, ec);
+}
+
+std::tuple<std::uint64_t, std::error_code> get_device_id_of(const std::string &path) noexcept
+{
+#if defined(PROJECT_PLATFORM_WINDOWS)
+#error os_utils::get_device_id_of not implemented for this platform
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
     {
-        return std::make_tuple(0, ec);
+        return std::make_tuple(std::uint64_t{0}, std::error_code{errno, std::generic_category()});
     }
 
-    std::uintmax_t total_size = 0;
+    return std::make_tuple(static_cast<std::uint64_t>(st.st_dev), std::error_code{});
+#endif
+}
+
+std::optional<bool> is_rotational_device(std::uint64_t device_id) noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX)
+    const std::string device_path = "/sys/dev/block/" +
+        std::to_string(major(device_id)) + ":" + std::to_string(minor(device_id));
 
-    // note: don't enable {follow_directory_symlink} here
-    for (const auto &entry : fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec))
+    // whole disks have a queue directory, partitions use the queue of the parent disk
+    for (const auto &queue_path : {device_path + "/queue/rotational", device_path + "/../queue/rotational"})
     {
-        if (entry.is_regular_file())
+        std::ifstream file(queue_path);
+        char rotational = '\0';
+        if (file.get(rotational))
         {
-            total_size += entry.file_size();
+            return rotational == '1';
         }
     }
 
-    return std::make_tuple(total_size, ec);
-}
-
-std::tuple<std::uintmax_t, std::error_code> get_available_disk_space_of(const std::string &path) noexcept
-{
-    namespace fs = std::filesystem;
-
-    std::error_code ec;
-    fs::space_info info = fs::space(path, ec);
-    return std::make_tuple(info.available, ec);
+    return std::nullopt;
+#else
+    (void)device_id;
+    return std::nullopt;
+#endif
 }
 
 std::uint64_t get_user_id()
@@ -242,4 +303,115 @@ std::uint64_t get_group_id()
 #endif
 }
 
+std::error_code spawn_detached(const std::vector<std::string> &arguments) noexcept
+{
+#if defined(PROJECT_PLATFORM_WINDOWS)
+#error os_utils::spawn_detached not implemented for this platform
+#else
+    if (arguments.empty())
+    {
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    std::vector<char *> argv;
+    argv.reserve(arguments.size() + 1);
+    for (const auto &argument : arguments)
+    {
+        argv.emplace_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.emplace_back(nullptr);
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attributes;
+    if (int error = ::posix_spawn_file_actions_init(&file_actions); error != 0)
+    {
+        return std::error_code{error, std::generic_category()};
+    }
+    if (int error = ::posix_spawnattr_init(&attributes); error != 0)
+    {
+        ::posix_spawn_file_actions_destroy(&file_actions);
+        return std::error_code{error, std::generic_category()};
+    }
+
+    // the process neither reads from nor writes to the terminal of the caller
+    int error = ::posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    for (const int fd : {STDOUT_FILENO, STDERR_FILENO})
+    {
+        if (error == 0)
+        {
+            error = ::posix_spawn_file_actions_addopen(&file_actions, fd, "/dev/null", O_WRONLY, 0);
+        }
+    }
+
+    // a new session isn't affected by signals for the terminal or the process group of the caller
+#if defined(POSIX_SPAWN_SETSID)
+    if (error == 0)
+    {
+        error = ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID);
+    }
+#else
+    if (error == 0)
+    {
+        error = ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    }
+#endif
+
+    pid_t pid;
+    if (error == 0)
+    {
+        error = ::posix_spawn(&pid, argv.front(), &file_actions, &attributes, argv.data(), environ);
+    }
+
+    ::posix_spawnattr_destroy(&attributes);
+    ::posix_spawn_file_actions_destroy(&file_actions);
+    return error != 0 ? std::error_code{error, std::generic_category()} : std::error_code{};
+#endif
+}
+
+std::string get_executable_path() noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX)
+    // the link resolves to the running executable even if its file was replaced in the meantime
+    return "/proc/self/exe";
+#else
+    return {};
+#endif
+}
+
+bool set_idle_priority() noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX)
+    // see ioprio_set(2), glibc doesn't provide a wrapper or the constants
+    constexpr int ioprio_who_process = 1;
+    constexpr int ioprio_class_idle = 3;
+    constexpr int ioprio_class_shift = 13;
+
+    [[maybe_unused]] const int nice_result = ::setpriority(PRIO_PROCESS, 0, 19);
+    return ::syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << ioprio_class_shift) == 0;
+#elif defined(PROJECT_PLATFORM_WINDOWS)
+    return false;
+#else
+    [[maybe_unused]] const int nice_result = ::setpriority(PRIO_PROCESS, 0, 19);
+    return false;
+#endif
+}
+
+bool raise_open_file_limit() noexcept
+{
+#if defined(PROJECT_PLATFORM_WINDOWS)
+    return false;
+#else
+    static const bool raised = []{
+        struct rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            return ::setrlimit(RLIMIT_NOFILE, &limit) == 0;
+        }
+        return false;
+    }();
+    return raised;
+#endif
+}
+
 } // namespace os_utils
@@ -6,6 +6,8 @@
 #include <system_error>
 #include <filesystem>
 #include <functional>
+#include <optional>
+#include <vector>
 
 namespace os_utils {
 
@@ -70,9 +72,11 @@ std::string get_home_directory();
 /**
  * Checks whether the given path is a mount point or a regular directory.
  *
+ * Bind mounts on the same filesystem are detected as mount points, see {is_mount_point(path, mount_target)}.
+ *
  * @param path the path to check
- * @return true the given path is a mount point residing on another filesystem
- * @return false the given path is a regular directory on the same filesystem
+ * @return true the given path is a mount point
+ * @return false the given path is a regular directory
  */
 bool is_mount_point(const std::string &path);
 
@@ -81,12 +85,18 @@ bool is_mount_point(const std::string &path);
  *
  * If the given path is a mount point, the mount target will be written to
  * the {mount_target} parameter, otherwise the {mount_target} will be set to
- * an empty string. [feature currently not implemented]
+ * an empty string. For bind mounts, the mount target is the bind mounted directory,
+ * for all other mounts it is the mount source (usually the block device).
+ *
+ * Uses `statx` with `STATX_ATTR_MOUNT_ROOT` where the kernel supports it (Linux 5.8),
+ * the mount target is looked up in the mount table, see {mount_table_t}.
+ * Without both, the device ids of the path and its parent directory are compared,
+ * which doesn't detect bind mounts on the same filesystem.
  *
  * @param path the path to check
  * @param mount_target the mount target if the given path is a mount point
- * @return true the given path is a mount point residing on another filesystem
- * @return false the given path is a regular directory on the same filesystem
+ * @return true the given path is a mount point
+ * @return false the given path is a regular directory
  */
 bool is_mount_point(const std::string &path, std::string *mount_target);
 
@@ -103,12 +113,22 @@ bool can_access_file(const std::string &path, std::filesystem::perms mode);
 /**
  * Calculate the used disk space of the given directory.
  *
- * On errors the disk space will be set to 0 and the std::error_code will contain the error.
+ * The directory tree is traversed in parallel, see {disk_usage::scan_directory} for details.
+ *
+ * Both the apparent size (sum of the file sizes) and the allocated size (`st_blocks * 512`)
+ * are collected in the same pass. The allocated size is smaller than the apparent size
+ * for sparse files and on filesystems with transparent compression.
+ *
+ * If the given path is not a directory, the disk space will be set to 0 and the std::error_code
+ * will contain the error. Errors during the traversal are reported in the std::error_code,
+ * the disk space contains the sum of everything that could be scanned.
  *
  * @param path the directory to calculate
- * @return used disk space in bytes and an optional error code on failure
+ * @param thread_count number of worker threads (0 = one thread per hardware thread)
+ * @return apparent size in bytes, allocated size in bytes and an optional error code on failure
  */
-std::tuple<std::uintmax_t, std::error_code> get_used_disk_space_of(const std::string &path) noexcept;
+std::tuple<std::uintmax_t, std::uintmax_t, std::error_code> get_used_disk_space_of(
+    const std::string &path, unsigned thread_count = 0) noexcept;
 
 /**
  * Calculate the available disk space on the filesystem where the given directory is located.
@@ -120,6 +140,33 @@ std::tuple<std::uintmax_t, std::error_code> get_used_disk_space_of(const std::st
  */
 std::tuple<std::uintmax_t, std::error_code> get_available_disk_space_of(const std::string &path) noexcept;
 
+/**
+ * Get the device id (`st_dev`) of the filesystem where the given path is located.
+ *
+ * Symbolic links are followed. On errors the device id will be set to 0
+ * and the std::error_code will contain the error.
+ *
+ * @param path the path to check
+ * @return device id and an optional error code on failure
+ */
+std::tuple<std::uint64_t, std::error_code> get_device_id_of(const std::string &path) noexcept;
+
+/**
+ * Checks whether the block device with the given device id is a rotational disk.
+ *
+ * The information is obtained from `/sys/dev/block/MAJ:MIN/queue/rotational`,
+ * partitions are resolved to their parent disk.
+ *
+ * Virtual filesystems (tmpfs, btrfs subvolumes, network filesystems) don't have
+ * a corresponding block device, in this case std::nullopt is returned.
+ *
+ * @param device_id device id as returned by {get_device_id_of}
+ * @return true the device is a spinning disk
+ * @return false the device is a solid state drive
+ * @return std::nullopt unknown device or not supported on this platform
+ */
+std::optional<bool> is_rotational_device(std::uint64_t device_id) noexcept;
+
 /**
  * Get the current user id.
  *
@@ -134,4 +181,43 @@ std::uint64_t get_user_id();
  */
 std::uint64_t get_group_id();
 
+/**
+ * Starts the given program in the background, without waiting for it.
+ *
+ * The program is executed with `posix_spawn`, nothing of the calling process runs in the child besides
+ * the exec, so this is safe in multithreaded processes. It starts a new session and its standard input
+ * and output are redirected to `/dev/null`, it keeps running after the caller exits and is reaped by
+ * init then. The caller is expected to exit soon, it doesn't wait for the child.
+ *
+ * @param arguments the path of the program followed by its arguments
+ * @return error code if the program couldn't be started
+ */
+std::error_code spawn_detached(const std::vector<std::string> &arguments) noexcept;
+
+/**
+ * Returns a path which can be used to execute the running program again.
+ *
+ * @return the path of the executable, empty if it can't be determined on this platform
+ */
+std::string get_executable_path() noexcept;
+
+/**
+ * Lowers the CPU and I/O priority of the calling process to idle.
+ *
+ * I/O is only scheduled when no other process needs the disk (`IOPRIO_CLASS_IDLE`),
+ * supported on Linux only.
+ *
+ * @return true if the I/O priority was lowered
+ */
+bool set_idle_priority() noexcept;
+
+/**
+ * Raises the soft limit of open files to the hard limit, only the first call has an effect.
+ *
+ * Used by the parallel directory walks, every worker keeps one descriptor per level of its stack open.
+ *
+ * @return true if the first call raised the limit
+ */
+bool raise_open_file_limit() noexcept;
+
 } // namespace os_utils
@@ -0,0 +1,191 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+/// the pool the current thread belongs to (nullptr for threads outside of any pool)
+thread_local const threading::work_stealing_pool_t *current_pool = nullptr;
+
+/// the worker index of the current thread inside of {current_pool}
+thread_local unsigned current_worker_index = 0;
+
+} // anonymous namespace
+
+namespace threading {
+
+work_stealing_pool_t::work_stealing_pool_t(unsigned thread_count)
+{
+    thread_count = resolve_thread_count(thread_count);
+
+    this->_workers.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+        this->_workers.emplace_back(std::make_unique<worker_t>());
+    }
+
+    // start the threads after all workers are constructed, workers access each other when stealing
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+        this->_workers[i]->thread = std::thread(&work_stealing_pool_t::worker_loop, this, i);
+    }
+}
+
+work_stealing_pool_t::~work_stealing_pool_t()
+{
+    this->wait();
+
+    {
+        std::lock_guard<std::mutex> lock(this->_sleep_mutex);
+        this->_stop = true;
+    }
+    this->_sleep_cv.notify_all();
+
+    for (auto &worker : this->_workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+unsigned work_stealing_pool_t::resolve_thread_count(unsigned thread_count) noexcept
+{
+    if (thread_count == 0)
+    {
+        // hardware_concurrency() is allowed to return 0 if the value is not computable
+        thread_count = std::thread::hardware_concurrency();
+    }
+
+    return thread_count == 0 ? 1 : std::min(thread_count, max_thread_count());
+}
+
+unsigned work_stealing_pool_t::max_thread_count() noexcept
+{
+    return std::max(64u, 8 * std::thread::hardware_concurrency());
+}
+
+void work_stealing_pool_t::submit(task_t task)
+{
+    this->_pending.fetch_add(1, std::memory_order_relaxed);
+
+    // tasks spawned from inside a worker stay local to that worker
+    if (current_pool == this)
+    {
+        this->push(current_worker_index, std::move(task));
+    }
+    else
+    {
+        const auto worker_index = this->_next_worker.fetch_add(1, std::memory_order_relaxed) % this->thread_count();
+        this->push(worker_index, std::move(task));
+    }
+}
+
+void work_stealing_pool_t::wait()
+{
+    std::unique_lock<std::mutex> lock(this->_sleep_mutex);
+    this->_done_cv.wait(lock, [this]{
+        return this->_pending.load() == 0;
+    });
+}
+
+std::size_t work_stealing_pool_t::queued_tasks(unsigned worker_index) const noexcept
+{
+    const auto &worker = this->_workers[worker_index];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    return worker->tasks.size();
+}
+
+void work_stealing_pool_t::push(unsigned worker_index, task_t &&task)
+{
+    {
+        auto &worker = this->_workers[worker_index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.emplace_back(std::move(task));
+    }
+
+    // wake up a sleeping worker, the woken up worker will steal the task if it isn't its own
+    {
+        std::lock_guard<std::mutex> lock(this->_sleep_mutex);
+        this->_generation.fetch_add(1);
+    }
+    this->_sleep_cv.notify_one();
+}
+
+bool work_stealing_pool_t::pop_local(unsigned worker_index, task_t &task)
+{
+    auto &worker = this->_workers[worker_index];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty())
+    {
+        return false;
+    }
+
+    // newest task first
+    task = std::move(worker->tasks.back());
+    worker->tasks.pop_back();
+    return true;
+}
+
+bool work_stealing_pool_t::steal(unsigned thief_index, task_t &task)
+{
+    const auto count = this->thread_count();
+
+    // start with the right neighbor to spread the thieves across all victims
+    for (unsigned offset = 1; offset < count; ++offset)
+    {
+        auto &victim = this->_workers[(thief_index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty())
+        {
+            // oldest task first
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void work_stealing_pool_t::worker_loop(unsigned worker_index)
+{
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    task_t task;
+    while (true)
+    {
+        // remember the generation before searching for work to avoid lost wake-ups
+        const auto generation = this->_generation.load();
+
+        if (this->pop_local(worker_index, task) || this->steal(worker_index, task))
+        {
+            task(worker_index);
+            task = nullptr;
+
+            // the last finished task wakes up all waiters
+            if (this->_pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(this->_sleep_mutex);
+                this->_done_cv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->_sleep_mutex);
+        this->_sleep_cv.wait(lock, [&]{
+            return this->_stop || this->_generation.load() != generation;
+        });
+
+        if (this->_stop)
+        {
+            break;
+        }
+    }
+
+    current_pool = nullptr;
+}
+
+} // namespace threading
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace threading {
+
+/**
+ * Thread pool with one task deque per worker thread.
+ *
+ * Tasks submitted from inside a worker are pushed to the back of the deque of that worker
+ * and popped again from the back (LIFO), which keeps the working set of a worker hot.
+ * Workers running out of tasks steal from the front of the deques of other workers (FIFO),
+ * which takes the oldest and usually largest chunks of work.
+ *
+ * Tasks submitted from outside of the pool are distributed round-robin across all workers.
+ *
+ * The pool is designed for recursive workloads like directory traversals, where the
+ * amount of work is unknown upfront and tasks spawn new tasks.
+ *
+ * Implementation notice:
+ *   Tasks must not throw exceptions (the library is compiled without exception support).
+ */
+class work_stealing_pool_t final
+{
+public:
+    /**
+     * Signature of a task.
+     *
+     * The index of the worker which executes the task is passed to the task.
+     * The index is in the range of [0, thread_count) and can be used to access
+     * per-thread data without synchronization.
+     */
+    using task_t = std::function<void(unsigned worker_index)>;
+
+    /**
+     * Creates a new thread pool and starts all worker threads.
+     *
+     * @param thread_count number of worker threads, 0 means one thread per hardware thread
+     */
+    explicit work_stealing_pool_t(unsigned thread_count = 0);
+
+    /**
+     * Waits for all pending tasks and joins all worker threads.
+     */
+    ~work_stealing_pool_t();
+
+    work_stealing_pool_t(const work_stealing_pool_t &) = delete;
+    work_stealing_pool_t &operator=(const work_stealing_pool_t &) = delete;
+
+    /**
+     * Submits a new task to the pool.
+     *
+     * This method can be called from inside a running task to spawn subtasks.
+     *
+     * @param task the task to execute
+     */
+    void submit(task_t task);
+
+    /**
+     * Blocks until all submitted tasks (including spawned subtasks) are finished.
+     *
+     * Must not be called from inside a worker thread.
+     */
+    void wait();
+
+    /**
+     * Returns the number of worker threads in this pool.
+     */
+    inline unsigned thread_count() const noexcept {
+        return static_cast<unsigned>(this->_workers.size());
+    }
+
+    /**
+     * Returns the approximate number of tasks queued in the deque of the given worker.
+     *
+     * Useful to decide whether splitting work into a new task is worth it.
+     */
+    std::size_t queued_tasks(unsigned worker_index) const noexcept;
+
+    /**
+     * Resolves the requested thread count into an actual thread count.
+     *
+     * 0 is resolved into the number of hardware threads (at least 1), larger requests are limited
+     * to {max_thread_count}.
+     */
+    static unsigned resolve_thread_count(unsigned thread_count) noexcept;
+
+    /**
+     * The largest thread count which is accepted, a small multiple of the number of hardware threads.
+     *
+     * More threads than hardware threads only help while they wait for I/O (e.g. network filesystems).
+     */
+    static unsigned max_thread_count() noexcept;
+
+private:
+    /**
+     * Per-worker state.
+     * Aligned to avoid false sharing between neighboring workers.
+     */
+    struct alignas(64) worker_t
+    {
+        mutable std::mutex mutex;
+        std::deque<task_t> tasks;
+        std::thread thread;
+    };
+
+    void worker_loop(unsigned worker_index);
+    bool pop_local(unsigned worker_index, task_t &task);
+    bool steal(unsigned thief_index, task_t &task);
+    void push(unsigned worker_index, task_t &&task);
+
+    std::vector<std::unique_ptr<worker_t>> _workers;
+
+    /// number of submitted tasks which are not finished yet
+    std::atomic<std::uint64_t> _pending{0};
+
+    /// round-robin counter for external submissions
+    std::atomic<unsigned> _next_worker{0};
+
+    /// sleeping workers and waiters are woken up through this condition variable
+    std::mutex _sleep_mutex;
+    std::condition_variable _sleep_cv;
+    std::condition_variable _done_cv;
+    std::atomic<std::uint64_t> _generation{0};
+    bool _stop{false};
+};
+
+} // namespace threading
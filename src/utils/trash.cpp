@@ -0,0 +1,495 @@
+#include "trash.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string_view>
+
+#include "threading/work_stealing_pool.hpp"
+#include "os_utils.hpp"
+#include "disk_usage/error_utils.hpp"
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(PROJECT_PLATFORM_LINUX)
+#include <sys/syscall.h>
+#endif
+
+// added in Linux 3.15, the value is part of the kernel ABI
+#if defined(PROJECT_PLATFORM_LINUX) && !defined(RENAME_EXCHANGE)
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+namespace {
+
+namespace fs = std::filesystem;
+
+using disk_usage::last_error;
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+
+/**
+ * A unique name for an entry in the trash, entries of concurrent runs must not collide.
+ */
+std::string unique_trash_entry_name(std::string_view directory_name)
+{
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::string{directory_name} + "." + std::to_string(::getpid()) + "." +
+        std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+/**
+ * Atomically exchanges two paths, `ENOSYS` or `EINVAL` if the kernel or filesystem doesn't support it.
+ */
+int exchange_paths(const char *a, const char *b) noexcept
+{
+#if defined(PROJECT_PLATFORM_LINUX) && defined(SYS_renameat2)
+    return static_cast<int>(::syscall(SYS_renameat2, AT_FDCWD, a, AT_FDCWD, b, RENAME_EXCHANGE));
+#else
+    (void) a;
+    (void) b;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Moves the directory into the trash next to it and leaves an empty directory in its place.
+ */
+std::error_code swap_out_into_parent(const std::string &directory, const struct stat &st,
+    const std::string &trash_name, std::string &trash_path)
+{
+    const fs::path directory_path{directory};
+    const auto trash_directory = (directory_path.parent_path() / trash_name).string();
+    if (::mkdir(trash_directory.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+        return last_error();
+    }
+
+    // the trash is removed again when the directory can't be swapped out, unless it holds other entries
+    const auto remove_empty_trash = [&](std::error_code ec) {
+        ::rmdir(trash_directory.c_str());
+        return ec;
+    };
+
+    const auto entry = trash_directory + "/" + unique_trash_entry_name(directory_path.filename().string());
+    if (::mkdir(entry.c_str(), st.st_mode & 07777) != 0)
+    {
+        return remove_empty_trash(last_error());
+    }
+    // mkdir applies the umask, the ownership is only restored when running with enough privileges
+    ::chmod(entry.c_str(), st.st_mode & 07777);
+    [[maybe_unused]] const int chown_result = ::chown(entry.c_str(), st.st_uid, st.st_gid);
+
+    if (exchange_paths(entry.c_str(), directory.c_str()) == 0)
+    {
+        trash_path = entry;
+        return {};
+    }
+    else if (errno != ENOSYS && errno != EINVAL)
+    {
+        const auto ec = last_error();
+        ::rmdir(entry.c_str());
+        return remove_empty_trash(ec);
+    }
+
+    // the directory doesn't exist for a short moment without support for exchanges
+    ::rmdir(entry.c_str());
+    if (::rename(directory.c_str(), entry.c_str()) != 0)
+    {
+        return remove_empty_trash(last_error());
+    }
+    if (::mkdir(directory.c_str(), st.st_mode & 07777) != 0)
+    {
+        const auto ec = last_error();
+        ::rename(entry.c_str(), directory.c_str());
+        return remove_empty_trash(ec);
+    }
+    ::chmod(directory.c_str(), st.st_mode & 07777);
+    [[maybe_unused]] const int chown_directory_result = ::chown(directory.c_str(), st.st_uid, st.st_gid);
+
+    trash_path = entry;
+    return {};
+}
+
+/**
+ * Moves all entries of the directory into a trash inside of it, used for mount points.
+ */
+std::error_code swap_out_contents(const std::string &directory, const std::string &trash_name,
+    std::string &trash_path)
+{
+    const int directory_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0)
+    {
+        return last_error();
+    }
+
+    std::error_code ec;
+    const auto entry_name = trash_name + "/" + unique_trash_entry_name(fs::path{directory}.filename().string());
+    if ((::mkdirat(directory_fd, trash_name.c_str(), 0700) != 0 && errno != EEXIST) ||
+        ::mkdirat(directory_fd, entry_name.c_str(), 0700) != 0)
+    {
+        ec = last_error();
+        ::close(directory_fd);
+        return ec;
+    }
+
+    // the directory stream gets its own descriptor, the renames use the original one
+    DIR *dir = ::fdopendir(::dup(directory_fd));
+    if (dir == nullptr)
+    {
+        ec = last_error();
+        ::close(directory_fd);
+        return ec;
+    }
+
+    const int entry_fd = ::openat(directory_fd, entry_name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (entry_fd < 0)
+    {
+        ec = last_error();
+    }
+
+    while (entry_fd >= 0)
+    {
+        errno = 0;
+        const struct dirent *dirent = ::readdir(dir);
+        if (dirent == nullptr)
+        {
+            if (errno != 0)
+            {
+                ec = last_error();
+            }
+            break;
+        }
+
+        const std::string_view name{dirent->d_name};
+        if (name == "." || name == ".." || name == trash_name)
+        {
+            continue;
+        }
+        if (::renameat(directory_fd, dirent->d_name, entry_fd, dirent->d_name) != 0 && errno != ENOENT && !ec)
+        {
+            ec = last_error();
+        }
+    }
+
+    if (entry_fd >= 0)
+    {
+        ::close(entry_fd);
+    }
+    ::closedir(dir);
+    ::close(directory_fd);
+
+    trash_path = directory + "/" + entry_name;
+    return ec;
+}
+
+/**
+ * A directory which is removed once all of its subdirectories are removed.
+ *
+ * Directories are opened and removed relative to their parent, full paths are never resolved,
+ * so the depth of the tree is not limited by `PATH_MAX` and symbolic links are never followed.
+ */
+struct remove_node_t final
+{
+    remove_node_t *parent;
+
+    /// the open parent directory, owned by the parent node or by {remove_all_parallel} for the root
+    int parent_fd;
+    std::string name;
+
+    /// the open directory, kept open until all subdirectories are removed
+    int fd{-1};
+
+    /// the listing of the directory itself and all subdirectories which are not removed yet
+    std::atomic<std::size_t> pending{1};
+};
+
+struct remove_state_t final
+{
+    threading::work_stealing_pool_t &pool;
+
+    std::mutex error_mutex;
+    std::error_code first_error;
+
+    void report_error(int error)
+    {
+        // entries which are removed concurrently are not an error
+        if (error == ENOENT)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(this->error_mutex);
+        if (!this->first_error)
+        {
+            this->first_error = std::error_code{error, std::generic_category()};
+        }
+    }
+};
+
+/**
+ * Removes the directories whose last pending entry was finished, walking up the tree.
+ */
+void release_node(remove_state_t &state, remove_node_t *node)
+{
+    while (node != nullptr && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        if (node->fd >= 0)
+        {
+            ::close(node->fd);
+        }
+        if (::unlinkat(node->parent_fd, node->name.c_str(), AT_REMOVEDIR) != 0)
+        {
+            state.report_error(errno);
+        }
+
+        auto *parent = node->parent;
+        delete node;
+        node = parent;
+    }
+}
+
+/**
+ * Opens the directory relative to its parent for removal and makes sure its entries can be removed.
+ */
+int open_for_removal(int parent_fd, const std::string &name)
+{
+    constexpr int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+    int fd = ::openat(parent_fd, name.c_str(), flags);
+    if (fd < 0 && errno == EACCES)
+    {
+        // directories without read permission, the parent is already writable
+#if defined(PROJECT_PLATFORM_LINUX)
+        // pin the directory itself, chmod must not follow a symbolic link which replaced it
+        const int path_fd = ::openat(parent_fd, name.c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (path_fd >= 0)
+        {
+            const auto fd_path = "/proc/self/fd/" + std::to_string(path_fd);
+            if (::chmod(fd_path.c_str(), S_IRWXU) == 0)
+            {
+                fd = ::openat(path_fd, ".", flags);
+            }
+            ::close(path_fd);
+        }
+#else
+        if (::fchmodat(parent_fd, name.c_str(), S_IRWXU, 0) == 0)
+        {
+            fd = ::openat(parent_fd, name.c_str(), flags);
+        }
+#endif
+    }
+
+    // read-only directories, like the ones of the Go module cache
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0 && (st.st_mode & S_IRWXU) != S_IRWXU)
+    {
+        ::fchmod(fd, (st.st_mode & 07777) | S_IRWXU);
+    }
+    return fd;
+}
+
+void remove_directory_task(remove_state_t &state, remove_node_t *node)
+{
+    node->fd = open_for_removal(node->parent_fd, node->name);
+    const int list_fd = node->fd >= 0 ? ::fcntl(node->fd, F_DUPFD_CLOEXEC, 0) : -1;
+    DIR *dir = list_fd >= 0 ? ::fdopendir(list_fd) : nullptr;
+    if (dir == nullptr)
+    {
+        state.report_error(errno);
+        if (list_fd >= 0)
+        {
+            ::close(list_fd);
+        }
+        release_node(state, node);
+        return;
+    }
+
+    while (true)
+    {
+        errno = 0;
+        const struct dirent *dirent = ::readdir(dir);
+        if (dirent == nullptr)
+        {
+            if (errno != 0)
+            {
+                state.report_error(errno);
+            }
+            break;
+        }
+
+        const std::string_view name{dirent->d_name};
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        bool is_directory = dirent->d_type == DT_DIR;
+        if (dirent->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            is_directory = ::fstatat(node->fd, dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if (is_directory)
+        {
+            node->pending.fetch_add(1, std::memory_order_relaxed);
+            auto *child = new remove_node_t{.parent = node, .parent_fd = node->fd, .name = dirent->d_name};
+            state.pool.submit([&state, child](unsigned) {
+                remove_directory_task(state, child);
+            });
+        }
+        else if (::unlinkat(node->fd, dirent->d_name, 0) != 0)
+        {
+            state.report_error(errno);
+        }
+    }
+
+    ::closedir(dir);
+    release_node(state, node);
+}
+
+#endif
+
+} // anonymous namespace
+
+namespace fs_utils {
+
+std::error_code swap_out_directory(const std::string &directory, const std::string &trash_name,
+    std::string &trash_path) noexcept
+{
+    trash_path.clear();
+
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    if (trash_name.empty() || trash_name.find('/') != std::string::npos)
+    {
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    struct stat st;
+    if (::stat(directory.c_str(), &st) != 0)
+    {
+        return last_error();
+    }
+    else if (!S_ISDIR(st.st_mode))
+    {
+        return std::make_error_code(std::errc::not_a_directory);
+    }
+
+    // normalize the path, otherwise the parent of `dir/` would be `dir`
+    std::string normalized = fs::path{directory}.lexically_normal().string();
+    while (normalized.size() > 1 && normalized.back() == '/')
+    {
+        normalized.pop_back();
+    }
+
+    // mount points can't be renamed (EBUSY, EXDEV) and read-only parents can't hold a trash
+    if (const auto ec = swap_out_into_parent(normalized, st, trash_name, trash_path);
+        !ec || (ec != std::errc::device_or_resource_busy && ec != std::errc::cross_device_link &&
+            ec != std::errc::permission_denied && ec != std::errc::read_only_file_system))
+    {
+        return ec;
+    }
+    return swap_out_contents(normalized, trash_name, trash_path);
+#else
+    (void) directory;
+    (void) trash_name;
+    return std::make_error_code(std::errc::not_supported);
+#endif
+}
+
+std::error_code remove_all_parallel(const std::string &path, unsigned thread_count) noexcept
+{
+#if !defined(PROJECT_PLATFORM_WINDOWS)
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0)
+    {
+        return errno == ENOENT ? std::error_code{} : last_error();
+    }
+    else if (!S_ISDIR(st.st_mode))
+    {
+        return ::unlink(path.c_str()) != 0 && errno != ENOENT ? last_error() : std::error_code{};
+    }
+
+    // the root is removed relative to its parent as well
+    auto root_path = fs::path{path}.lexically_normal();
+    if (!root_path.has_filename())
+    {
+        root_path = root_path.parent_path();
+    }
+    const auto root_name = root_path.filename().string();
+    const auto parent_path = root_path.parent_path();
+    const int parent_fd = ::open(parent_path.empty() ? "." : parent_path.c_str(),
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parent_fd < 0)
+    {
+        return last_error();
+    }
+
+    os_utils::raise_open_file_limit();
+    std::error_code ec;
+    {
+        threading::work_stealing_pool_t pool(thread_count);
+        remove_state_t state{.pool = pool, .error_mutex = {}, .first_error = {}};
+        auto *root = new remove_node_t{.parent = nullptr, .parent_fd = parent_fd, .name = root_name};
+        pool.submit([&state, root](unsigned) {
+            remove_directory_task(state, root);
+        });
+        pool.wait();
+        ec = state.first_error;
+    }
+    ::close(parent_fd);
+
+    return ec;
+#else
+    (void) thread_count;
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+    return ec;
+#endif
+}
+
+std::error_code empty_trash(const std::string &directory, const std::string &trash_name,
+    unsigned thread_count) noexcept
+{
+    if (trash_name.empty() || trash_name.find('/') != std::string::npos)
+    {
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    auto directory_path = fs::path{directory}.lexically_normal();
+    if (!directory_path.has_filename())
+    {
+        directory_path = directory_path.parent_path();
+    }
+
+    std::error_code first_error;
+    for (const auto &trash_directory : {directory_path.parent_path() / trash_name, directory_path / trash_name})
+    {
+        // a missing trash leaves the iterator at its end
+        std::error_code ec;
+        for (fs::directory_iterator it{trash_directory, ec}; !ec && it != fs::directory_iterator{}; it.increment(ec))
+        {
+            if (const auto ec_remove = remove_all_parallel(it->path().string(), thread_count); ec_remove && !first_error)
+            {
+                first_error = ec_remove;
+            }
+        }
+        if (ec && ec != std::errc::no_such_file_or_directory && !first_error)
+        {
+            first_error = ec;
+        }
+
+        // concurrent swaps may have added new entries in the meantime
+        fs::remove(trash_directory, ec);
+    }
+    return first_error;
+}
+
+} // namespace fs_utils
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <system_error>
+
+namespace fs_utils {
+
+/**
+ * Replaces the given directory with an empty one and moves its previous contents into a trash directory.
+ *
+ * The trash directory {trash_name} is created next to the directory, on the same filesystem, and the
+ * previous contents end up in a uniquely named entry inside of it. On Linux, an empty directory with the
+ * same permissions is prepared in the trash and exchanged atomically with `renameat2(RENAME_EXCHANGE)`,
+ * so the directory never disappears for processes which are using it. Filesystems without support for
+ * exchanges fall back to a rename followed by the creation of the empty directory.
+ *
+ * Mount points can't be renamed and directories in read-only parents don't allow a trash next to them,
+ * in both cases the trash directory is created inside of the directory and all other entries are moved
+ * into it one by one.
+ *
+ * Nothing is deleted, the returned trash entry must be removed afterwards, see {remove_all_parallel}
+ * and {empty_trash}.
+ * The cost doesn't depend on the size of the directory.
+ *
+ * @param directory the directory to swap out
+ * @param trash_name the name of the trash directory
+ * @param trash_path receives the path of the trash entry which contains the previous contents
+ * @return error code if the directory couldn't be swapped out, the directory is unchanged in this case
+ */
+std::error_code swap_out_directory(const std::string &directory, const std::string &trash_name,
+    std::string &trash_path) noexcept;
+
+/**
+ * Removes the given path recursively with one worker per hardware thread (or @p thread_count).
+ *
+ * Every directory is read once and its entries are removed with `unlinkat` relative to it, subdirectories
+ * are removed in parallel and a directory is removed as soon as its last subdirectory is gone.
+ * Read-only directories (like the Go module cache) are made writable before their entries are removed.
+ * Symbolic links are removed, never followed. Entries which are removed concurrently are ignored.
+ *
+ * @param path the file or directory to remove, a path which doesn't exist is not an error
+ * @param thread_count number of worker threads, 0 means one thread per hardware thread
+ * @return the first error encountered, removal continues after errors
+ */
+std::error_code remove_all_parallel(const std::string &path, unsigned thread_count = 0) noexcept;
+
+/**
+ * Deletes all entries of the trash directories of the given directory, see {swap_out_directory}.
+ *
+ * Both the trash next to the directory and the trash inside of it are emptied, including entries of
+ * earlier swaps whose deletion was interrupted, and removed once they are empty. The trash next to
+ * the directory is shared with its siblings, their entries are deleted as well.
+ *
+ * @param directory the directory whose trash is deleted
+ * @param trash_name the name of the trash directory
+ * @param thread_count number of worker threads, 0 means one thread per hardware thread
+ * @return the first error encountered, a trash which doesn't exist is not an error
+ */
+std::error_code empty_trash(const std::string &directory, const std::string &trash_name,
+    unsigned thread_count = 0) noexcept;
+
+} // namespace fs_utils
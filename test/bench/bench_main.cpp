@@ -0,0 +1,406 @@
+/**
+ * Scanner benchmarks on synthetic cache trees.
+ *
+ * Generates reproducible npm-, go-build- and cargo-shaped trees in a temporary directory
+ * and measures the scanner entry points on them. For every benchmark, the median wall time,
+ * the throughput, the number of system calls per directory entry and the peak RSS are reported.
+ *
+ * The system calls are counted in a forked child under ptrace, so the counting doesn't
+ * distort the timing. If ptrace is not permitted, the column shows `n/a`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#include <fmt/format.h>
+
+#include <argparse/argparse.hpp>
+
+#include <utils/os_utils.hpp>
+#include <utils/fs_utils.hpp>
+#include <utils/number_utils.hpp>
+
+#include <libcachemgr/logging.hpp>
+#include <libcachemgr/cachemgr.hpp>
+
+#include "tree_generator.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+using configuration_t = libcachemgr::configuration_t;
+using libcachemgr::directory_type_t;
+
+/**
+ * A single measured operation.
+ */
+struct benchmark_t final
+{
+    std::string name;
+
+    /// number of entries which are processed by one run of the operation
+    std::uint64_t entries;
+
+    std::function<void()> run;
+};
+
+/**
+ * Resets the peak RSS of the process (`VmHWM`), supported since Linux 4.0.
+ */
+void reset_peak_rss()
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+/**
+ * Returns the peak RSS of the process in KiB.
+ */
+std::uint64_t peak_rss_kib()
+{
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+    {
+        if (line.starts_with("VmHWM:"))
+        {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs the function in a forked child and counts the system calls of all its threads with ptrace.
+ *
+ * @return the number of system calls, std::nullopt if the child couldn't be traced
+ */
+std::optional<std::uint64_t> count_syscalls(const std::function<void()> &fn)
+{
+    const pid_t child = ::fork();
+    if (child < 0)
+    {
+        return std::nullopt;
+    }
+    else if (child == 0)
+    {
+        if (::ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0)
+        {
+            ::_exit(1);
+        }
+        ::raise(SIGSTOP);
+        fn();
+
+        // don't run the atexit handlers of the parent, the logging backend thread doesn't exist in the child
+        ::_exit(0);
+    }
+
+    int status = 0;
+    if (::waitpid(child, &status, 0) != child || !WIFSTOPPED(status) ||
+        ::ptrace(PTRACE_SETOPTIONS, child, nullptr,
+            PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL) != 0)
+    {
+        ::kill(child, SIGKILL);
+        ::waitpid(child, &status, 0);
+        return std::nullopt;
+    }
+
+    // syscall stops alternate between entry and exit for every thread
+    std::unordered_map<pid_t, bool> is_in_syscall{{child, false}};
+    std::uint64_t syscalls = 0;
+    bool is_complete = false;
+
+    ::ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+    while (true)
+    {
+        const pid_t pid = ::waitpid(-1, &status, __WALL);
+        if (pid < 0)
+        {
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            is_in_syscall.erase(pid);
+            if (pid == child)
+            {
+                is_complete = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                break;
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status))
+        {
+            continue;
+        }
+
+        int signal = 0;
+        const int stop_signal = WSTOPSIG(status);
+        if (stop_signal == (SIGTRAP | 0x80))
+        {
+            auto &in_syscall = is_in_syscall[pid];
+            syscalls += in_syscall ? 0 : 1;
+            in_syscall = !in_syscall;
+        }
+        else if (stop_signal == SIGTRAP && (status >> 16) != 0)
+        {
+            // clone event, the new thread is traced automatically
+        }
+        else if (stop_signal == SIGSTOP && !is_in_syscall.contains(pid))
+        {
+            // initial stop of a new thread
+            is_in_syscall[pid] = false;
+        }
+        else
+        {
+            signal = stop_signal;
+        }
+        ::ptrace(PTRACE_SYSCALL, pid, nullptr, signal);
+    }
+
+    return is_complete ? std::optional{syscalls} : std::nullopt;
+}
+
+/**
+ * Measures the benchmark and prints a single report line.
+ */
+void run_benchmark(const benchmark_t &benchmark, unsigned iterations, bool count_system_calls)
+{
+    using clock = std::chrono::steady_clock;
+
+    // warm up the dentry and inode caches
+    benchmark.run();
+
+    reset_peak_rss();
+    std::vector<double> durations;
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        const auto start = clock::now();
+        benchmark.run();
+        durations.emplace_back(std::chrono::duration<double>(clock::now() - start).count());
+    }
+    const auto peak_rss = peak_rss_kib();
+
+    std::sort(durations.begin(), durations.end());
+    const double median = durations[durations.size() / 2];
+    const double entries_per_second = median > 0 ? static_cast<double>(benchmark.entries) / median : 0.0;
+
+    std::string syscalls_per_entry = "n/a";
+    if (count_system_calls)
+    {
+        if (const auto syscalls = count_syscalls(benchmark.run); syscalls && benchmark.entries > 0)
+        {
+            syscalls_per_entry = fmt::format("{:.2f}",
+                static_cast<double>(*syscalls) / static_cast<double>(benchmark.entries));
+        }
+    }
+
+    fmt::print("  {:<32} {:>10} {:>10.3f} ms {:>14.0f} {:>15} {:>9.1f} MiB\n",
+        benchmark.name, benchmark.entries, median * 1000.0, entries_per_second,
+        syscalls_per_entry, static_cast<double>(peak_rss) / 1024.0);
+}
+
+/**
+ * Creates the cache mappings for {cachemgr_t::find_mapped_cache_directories}:
+ * every top-level directory as standalone mapping, a wildcard pattern and a symbolic link.
+ */
+configuration_t::cache_mappings_t make_cache_mappings(const bench::tree_profile_t &profile,
+    const bench::generated_tree_t &tree, const fs::path &links_directory)
+{
+    configuration_t::cache_mappings_t cache_mappings;
+    for (const auto &directory : tree.top_level_directories)
+    {
+        cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+            .id = profile.name + "/" + directory.filename().string(),
+            .type = directory_type_t::standalone,
+            .package_manager = libcachemgr::package_manager_t{nullptr},
+            .source = {},
+            .target = directory.string(),
+        });
+    }
+
+    cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+        .id = profile.name + "/wildcard",
+        .type = directory_type_t::wildcard,
+        .package_manager = libcachemgr::package_manager_t{nullptr},
+        .source = {},
+        .target = (tree.root / profile.wildcard_pattern).string(),
+    });
+
+    if (!tree.top_level_directories.empty())
+    {
+        const auto link = links_directory / profile.name;
+        std::error_code ec;
+        fs::create_directories(links_directory, ec);
+        fs::remove(link, ec);
+        fs::create_directory_symlink(tree.top_level_directories.front(), link, ec);
+
+        cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+            .id = profile.name + "/symlink",
+            .type = directory_type_t::symbolic_link,
+            .package_manager = libcachemgr::package_manager_t{nullptr},
+            .source = link.string(),
+            .target = tree.top_level_directories.front().string(),
+        });
+    }
+
+    return cache_mappings;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser parser(argc, argv);
+    parser.addArgument("h", "help", "print this help message and exit", "", argparse::Argument::Type::Boolean, false);
+    parser.addArgument("p", "profile", "tree profile: npm, go-build, cargo or all (default: all)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("s", "scale", "multiplies the number of files per directory (default: 1)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("j", "threads", "number of scanner threads (default: 0 = all hardware threads)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("n", "iterations", "number of measured runs per benchmark (default: 5)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("d", "directory", "directory in which the trees are generated (default: temporary directory)",
+        "", argparse::Argument::Type::String, false);
+    parser.addArgument("", "dense", "write the file contents instead of creating sparse files",
+        "", argparse::Argument::Type::Boolean, false);
+    parser.addArgument("", "keep", "don't remove the generated trees", "", argparse::Argument::Type::Boolean, false);
+    parser.addArgument("", "no-syscalls", "don't count the system calls with ptrace",
+        "", argparse::Argument::Type::Boolean, false);
+
+    if (parser.parse() != argparse::ArgumentParser::Result::Success)
+    {
+        return 2;
+    }
+    if (parser.exists("help"))
+    {
+        fmt::print("cachemgr-bench\n\n  Options:\n{}\n", parser.help());
+        return 0;
+    }
+
+    const auto parse_option = [&parser](const char *name, std::uint32_t default_value, std::uint32_t min_value)
+        -> std::optional<std::uint32_t> {
+        if (!parser.exists(name))
+        {
+            return default_value;
+        }
+        bool is_ok = false;
+        const auto value = number_utils::parse_integer<std::uint32_t>(parser.get(name), &is_ok);
+        if (!is_ok || value < min_value)
+        {
+            fmt::print(stderr, "error: option '{}' expects an integer >= {}\n", name, min_value);
+            return std::nullopt;
+        }
+        return value;
+    };
+
+    const auto scale = parse_option("scale", 1, 1);
+    const auto threads = parse_option("threads", 0, 0);
+    const auto iterations = parse_option("iterations", 5, 1);
+    if (!scale || !threads || !iterations)
+    {
+        return 1;
+    }
+
+    std::vector<bench::tree_profile_t> profiles;
+    const std::string profile_name = parser.exists("profile") ? parser.get<std::string>("profile") : "all";
+    for (const auto &profile : {bench::npm_profile(*scale), bench::go_build_profile(*scale), bench::cargo_profile(*scale)})
+    {
+        if (profile_name == "all" || profile_name == profile.name)
+        {
+            profiles.emplace_back(profile);
+            profiles.back().dense_files = parser.exists("dense");
+        }
+    }
+    if (profiles.empty())
+    {
+        fmt::print(stderr, "error: unknown profile '{}'\n", profile_name);
+        return 1;
+    }
+
+#ifndef CACHEMGR_PROFILING_BUILD
+    libcachemgr::init_logging(libcachemgr::logging_config{
+        .log_to_console = true,
+        .log_to_file = false,
+        .log_level_console = quill::LogLevel::Warning,
+        .log_os_release_on_startup = false,
+    });
+#endif
+
+    const fs::path directory = parser.exists("directory") ?
+        fs::path{parser.get<std::string>("directory")} : fs::temp_directory_path() / "cachemgr-bench";
+    const bool count_system_calls = !parser.exists("no-syscalls");
+
+    for (const auto &profile : profiles)
+    {
+        bench::generated_tree_t tree;
+        if (const auto ec = bench::generate_tree(profile, directory, tree); ec)
+        {
+            fmt::print(stderr, "error: failed to generate the '{}' tree in '{}': {}\n",
+                profile.name, directory.string(), ec.message());
+            return 1;
+        }
+
+        fmt::print("\n{}: {} files, {} hardlinks, {} directories, {} bytes in '{}'\n",
+            profile.name, tree.file_count, tree.hardlink_count, tree.directory_count,
+            tree.apparent_size, tree.root.string());
+        fmt::print("  {:<32} {:>10} {:>13} {:>14} {:>15} {:>13}\n",
+            "benchmark", "entries", "median", "entries/s", "syscalls/entry", "peak RSS");
+
+        const auto root = tree.root.string();
+        const auto pattern = (tree.root / profile.wildcard_pattern).string();
+        const auto matches = fs_utils::resolve_wildcard_pattern(pattern).size();
+        const auto cache_mappings = make_cache_mappings(profile, tree, directory / "links");
+
+        const std::vector<benchmark_t> benchmarks{
+            {
+                .name = "os_utils::get_used_disk_space_of",
+                .entries = tree.entry_count(),
+                .run = [&root, &threads]{
+                    static_cast<void>(os_utils::get_used_disk_space_of(root, *threads));
+                },
+            },
+            {
+                .name = "fs_utils::resolve_wildcard_pattern",
+                .entries = matches,
+                .run = [&pattern]{
+                    static_cast<void>(fs_utils::resolve_wildcard_pattern(pattern));
+                },
+            },
+            {
+                .name = "find_mapped_cache_directories",
+                .entries = cache_mappings.size(),
+                .run = [&cache_mappings]{
+                    cachemgr_t cachemgr;
+                    static_cast<void>(cachemgr.find_mapped_cache_directories(cache_mappings));
+                },
+            },
+        };
+
+        for (const auto &benchmark : benchmarks)
+        {
+            run_benchmark(benchmark, *iterations, count_system_calls);
+        }
+
+        if (!parser.exists("keep"))
+        {
+            std::error_code ec;
+            fs::remove_all(tree.root, ec);
+            fs::remove(directory / "links" / profile.name, ec);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include "tree_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+namespace fs = std::filesystem;
+using bench::tree_profile_t;
+
+/**
+ * splitmix64, the standard library distributions are not guaranteed to produce
+ * the same sequence on every implementation.
+ */
+class random_t final
+{
+public:
+    explicit random_t(std::uint64_t seed) noexcept
+        : _state(seed)
+    {
+    }
+
+    std::uint64_t next() noexcept
+    {
+        std::uint64_t z = (this->_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /// uniform in [0, 1)
+    double next_double() noexcept
+    {
+        return static_cast<double>(this->next() >> 11) * 0x1.0p-53;
+    }
+
+    /// uniform in [0, bound)
+    std::uint64_t next_below(std::uint64_t bound) noexcept
+    {
+        return bound == 0 ? 0 : this->next() % bound;
+    }
+
+private:
+    std::uint64_t _state;
+};
+
+/**
+ * Recursive generator state of a single tree.
+ */
+class generator_t final
+{
+public:
+    generator_t(const tree_profile_t &profile, bench::generated_tree_t &tree)
+        : _profile(profile), _tree(tree), _random(profile.seed)
+    {
+    }
+
+    std::error_code populate(const fs::path &directory, unsigned level)
+    {
+        const bool is_leaf = level == this->_profile.depth;
+        if (is_leaf || !this->_profile.files_at_leaves_only)
+        {
+            for (unsigned i = 0; i < this->_profile.files_per_directory; ++i)
+            {
+                if (const auto ec = this->create_file(directory / this->file_name()); ec)
+                {
+                    return ec;
+                }
+            }
+        }
+
+        if (is_leaf)
+        {
+            return {};
+        }
+
+        for (unsigned i = 0; i < this->_profile.fan_out; ++i)
+        {
+            const auto subdirectory = directory / this->directory_name(i);
+
+            std::error_code ec;
+            fs::create_directory(subdirectory, ec);
+            if (ec)
+            {
+                return ec;
+            }
+            ++this->_tree.directory_count;
+            if (level == 0)
+            {
+                this->_tree.top_level_directories.emplace_back(subdirectory);
+            }
+
+            if (ec = this->populate(subdirectory, level + 1); ec)
+            {
+                return ec;
+            }
+        }
+        return {};
+    }
+
+private:
+    std::string directory_name(unsigned index) const
+    {
+        static constexpr const char *hex_digits = "0123456789abcdef";
+        if (this->_profile.hex_directory_names)
+        {
+            return std::string{hex_digits[(index >> 4) & 0xf], hex_digits[index & 0xf]};
+        }
+        return this->_profile.name + "-" + std::to_string(index);
+    }
+
+    /// a content hash like name, optionally with a suffix
+    std::string file_name()
+    {
+        static constexpr const char *hex_digits = "0123456789abcdef";
+        std::string name;
+        name.reserve(40);
+        for (int i = 0; i < 5; ++i)
+        {
+            auto bits = this->_random.next();
+            for (int j = 0; j < 8; ++j, bits >>= 4)
+            {
+                name += hex_digits[bits & 0xf];
+            }
+        }
+
+        const auto &suffixes = this->_profile.file_suffixes;
+        if (!suffixes.empty())
+        {
+            name += suffixes[this->_random.next_below(suffixes.size())];
+        }
+        return name;
+    }
+
+    std::uint64_t file_size()
+    {
+        const double low = std::log(static_cast<double>(std::max<std::uint64_t>(1, this->_profile.min_file_size)));
+        const double high = std::log(static_cast<double>(std::max<std::uint64_t>(1, this->_profile.max_file_size)));
+        const double size = std::exp(low + (high - low) * this->_random.next_double());
+        return this->_profile.min_file_size == 0 && this->_random.next_below(16) == 0 ?
+            0 : static_cast<std::uint64_t>(size);
+    }
+
+    std::error_code create_file(const fs::path &path)
+    {
+        // link to one of the previous files
+        if (!this->_files.empty() && this->_random.next_double() < this->_profile.hardlink_ratio)
+        {
+            const auto &target = this->_files[this->_random.next_below(this->_files.size())];
+            if (::link(target.c_str(), path.c_str()) != 0)
+            {
+                return std::error_code{errno, std::generic_category()};
+            }
+            ++this->_tree.hardlink_count;
+            return {};
+        }
+
+        const auto size = this->file_size();
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return std::error_code{errno, std::generic_category()};
+        }
+
+        int error = 0;
+        if (this->_profile.dense_files)
+        {
+            static char buffer[64 * 1024];
+            std::memset(buffer, 'x', sizeof(buffer));
+            for (std::uint64_t written = 0; written < size && error == 0;)
+            {
+                const auto chunk = std::min<std::uint64_t>(sizeof(buffer), size - written);
+                const auto result = ::write(fd, buffer, chunk);
+                if (result < 0)
+                {
+                    error = errno;
+                }
+                written += result < 0 ? 0 : static_cast<std::uint64_t>(result);
+            }
+        }
+        else if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            error = errno;
+        }
+        ::close(fd);
+
+        if (error != 0)
+        {
+            return std::error_code{error, std::generic_category()};
+        }
+
+        ++this->_tree.file_count;
+        this->_tree.apparent_size += size;
+        this->_files.emplace_back(path.string());
+        return {};
+    }
+
+    const tree_profile_t &_profile;
+    bench::generated_tree_t &_tree;
+    random_t _random;
+
+    /// all regular files which were created, candidates for hardlinks
+    std::vector<std::string> _files;
+};
+
+} // anonymous namespace
+
+namespace bench {
+
+tree_profile_t npm_profile(unsigned scale)
+{
+    return tree_profile_t{
+        .name = "npm",
+        .depth = 2,
+        .fan_out = 16,
+        .files_per_directory = 8 * scale,
+        .files_at_leaves_only = true,
+        .hex_directory_names = true,
+        .file_suffixes = {},
+        .min_file_size = 200,
+        .max_file_size = 2 * 1024 * 1024,
+        .hardlink_ratio = 0.0,
+        .dense_files = false,
+        .wildcard_pattern = "00/00/*",
+        .seed = 0x6e706d,
+    };
+}
+
+tree_profile_t go_build_profile(unsigned scale)
+{
+    return tree_profile_t{
+        .name = "go-build",
+        .depth = 1,
+        .fan_out = 256,
+        .files_per_directory = 16 * scale,
+        .files_at_leaves_only = true,
+        .hex_directory_names = true,
+        .file_suffixes = {"-a", "-d"},
+        .min_file_size = 64,
+        .max_file_size = 512 * 1024,
+        .hardlink_ratio = 0.0,
+        .dense_files = false,
+        .wildcard_pattern = "00/*-d",
+        .seed = 0x676f,
+    };
+}
+
+tree_profile_t cargo_profile(unsigned scale)
+{
+    return tree_profile_t{
+        .name = "cargo",
+        .depth = 4,
+        .fan_out = 6,
+        .files_per_directory = 6 * scale,
+        .files_at_leaves_only = false,
+        .hex_directory_names = false,
+        .file_suffixes = {".rs", ".rs", ".toml", ".md"},
+        .min_file_size = 100,
+        .max_file_size = 64 * 1024,
+        .hardlink_ratio = 0.2,
+        .dense_files = false,
+        .wildcard_pattern = "cargo-0/*.rs",
+        .seed = 0x6361726f,
+    };
+}
+
+std::error_code generate_tree(const tree_profile_t &profile, const std::filesystem::path &parent,
+    generated_tree_t &tree)
+{
+    tree = generated_tree_t{};
+    tree.root = parent / profile.name;
+
+    std::error_code ec;
+    fs::remove_all(tree.root, ec);
+    if (fs::create_directories(tree.root, ec); ec)
+    {
+        return ec;
+    }
+
+    generator_t generator(profile, tree);
+    return generator.populate(tree.root, 0);
+}
+
+} // namespace bench
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace bench {
+
+/**
+ * Shape of a synthetic cache directory tree.
+ *
+ * The generator is deterministic, the same profile always produces the same tree.
+ */
+struct tree_profile_t final
+{
+    /// name of the profile, also used as the directory name of the tree
+    std::string name;
+
+    /// number of directory levels below the root
+    unsigned depth{1};
+
+    /// number of subdirectories of every directory above the deepest level
+    unsigned fan_out{1};
+
+    /// number of files in every directory, see {files_at_leaves_only}
+    unsigned files_per_directory{0};
+
+    /// only the directories on the deepest level contain files (content-addressed caches)
+    bool files_at_leaves_only{false};
+
+    /// directory names are two hex digits (`00`..`ff`) instead of package-like names
+    bool hex_directory_names{false};
+
+    /// file names are suffixed with one of these suffixes, chosen at random
+    std::vector<std::string> file_suffixes;
+
+    /// file sizes are distributed log-uniformly in [min_file_size, max_file_size]
+    std::uint64_t min_file_size{0};
+    std::uint64_t max_file_size{0};
+
+    /// share of the files which are created as hardlinks to a previously created file
+    double hardlink_ratio{0.0};
+
+    /// write the file contents instead of creating sparse files
+    bool dense_files{false};
+
+    /// the relative wildcard pattern which is resolved by the benchmarks
+    std::string wildcard_pattern;
+
+    /// seed of the random number generator
+    std::uint64_t seed{0};
+};
+
+/**
+ * Statistics of a generated tree.
+ */
+struct generated_tree_t final
+{
+    std::filesystem::path root;
+    std::uint64_t file_count{0};
+    std::uint64_t hardlink_count{0};
+    std::uint64_t directory_count{0};
+    std::uint64_t apparent_size{0};
+
+    /// the direct subdirectories of the root
+    std::vector<std::filesystem::path> top_level_directories;
+
+    /// inline helper which returns the number of directory entries of the tree (without the root)
+    inline std::uint64_t entry_count() const noexcept {
+        return this->file_count + this->hardlink_count + this->directory_count;
+    }
+};
+
+/**
+ * npm `_cacache`: content-addressed files below two levels of hex directories.
+ */
+tree_profile_t npm_profile(unsigned scale);
+
+/**
+ * `go-build`: 256 hex buckets with action and output files.
+ */
+tree_profile_t go_build_profile(unsigned scale);
+
+/**
+ * cargo registry sources: deep crate source trees with small files on every level, many shared files.
+ */
+tree_profile_t cargo_profile(unsigned scale);
+
+/**
+ * Generates the tree of the given profile in `parent / profile.name`, an existing tree is replaced.
+ *
+ * @param profile the shape of the tree
+ * @param parent the directory in which the tree is created
+ * @param tree receives the statistics of the generated tree
+ * @return error code if the tree couldn't be created completely
+ */
+std::error_code generate_tree(const tree_profile_t &profile, const std::filesystem::path &parent,
+    generated_tree_t &tree);
+
+} // namespace bench
@@ -52,6 +52,7 @@ int main(int argc, char **argv)
             //.package_manager = "'; drop table cache_trends;",
             .package_manager = std::nullopt,
             .cache_size = 2048,
+            .allocated_size = 4096,
         }));
 
     return 0;
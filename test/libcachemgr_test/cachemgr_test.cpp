@@ -0,0 +1,216 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libcachemgr/cachemgr.hpp>
+#include <libcachemgr/logging.hpp>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+static constexpr const char *tag_name_cachemgr = "[libcachemgr::cachemgr]";
+
+using configuration_t = libcachemgr::configuration_t;
+using libcachemgr::directory_type_t;
+
+TEST_CASE("calculate disk usage of multiple cache directories concurrently", tag_name_cachemgr) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-cachemgr-disk-usage";
+        fs::remove_all(root);
+
+        // standalone cache directories with a known size each
+        configuration_t::cache_mappings_t cache_mappings;
+        const std::array<std::uintmax_t, 5> expected_sizes{3000, 100, 5000, 0, 1200};
+        for (std::size_t i = 0; i < expected_sizes.size(); ++i)
+        {
+            const auto target = root / ("cache" + std::to_string(i));
+            fs::create_directories(target / "nested");
+            std::ofstream(target / "nested" / "file") << std::string(expected_sizes[i], 'x');
+
+            cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+                .id = "cache" + std::to_string(i),
+                .type = directory_type_t::standalone,
+                .package_manager = libcachemgr::package_manager_t{nullptr},
+                .source = {},
+                .target = target,
+            });
+        }
+
+        cachemgr_t cachemgr;
+        REQUIRE(!cachemgr.find_mapped_cache_directories(cache_mappings));
+        REQUIRE(cachemgr.mapped_cache_directories_count() == expected_sizes.size());
+
+        // calculate twice to ensure previous results are reset
+        disk_usage::inode_set_t hardlinks;
+        cachemgr.calculate_disk_usage(disk_usage::scan_options{
+            .thread_count = 4,
+            .hardlinks = &hardlinks,
+        });
+        cachemgr.calculate_disk_usage(disk_usage::scan_options{
+            .thread_count = 4,
+        });
+
+        fs::remove_all(root);
+
+        // results are written back in configuration order
+        std::size_t index = 0;
+        for (const auto &dir : cachemgr.mapped_cache_directories())
+        {
+            LOG_INFO(libcachemgr::log_test, "{}: {} = {}", tag_name_cachemgr, dir.id, dir.disk_size);
+            REQUIRE(dir.disk_size == expected_sizes[index]);
+            REQUIRE(dir.unique_disk_size == expected_sizes[index]);
+            ++index;
+        }
+
+        // sorting is not affected by the concurrent calculation
+        const auto sorted = cachemgr.sorted_mapped_cache_directories();
+        std::uintmax_t previous_size = UINTMAX_MAX;
+        for (const auto *dir : sorted)
+        {
+            REQUIRE(dir->disk_size <= previous_size);
+            previous_size = dir->disk_size;
+        }
+        REQUIRE(sorted.front()->id == "cache2");
+        REQUIRE(sorted.back()->id == "cache3");
+    }
+}
+
+TEST_CASE("write and open the scan snapshot", tag_name_cachemgr) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-cachemgr-snapshot";
+        const auto snapshot_file = (root / "scan-snapshot.bin").string();
+        fs::remove_all(root);
+
+        configuration_t::cache_mappings_t cache_mappings;
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            const auto target = root / ("cache" + std::to_string(i));
+            fs::create_directories(target / "nested");
+            std::ofstream(target / "nested" / "file") << std::string(1000 * (i + 1), 'x');
+
+            cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+                .id = "cache" + std::to_string(i),
+                .type = directory_type_t::standalone,
+                .package_manager = libcachemgr::package_manager_t{nullptr},
+                .source = {},
+                .target = target,
+            });
+        }
+
+        // first run without a snapshot
+        {
+            cachemgr_t cachemgr;
+            REQUIRE(!cachemgr.find_mapped_cache_directories(cache_mappings));
+            REQUIRE(cachemgr.open_snapshot(snapshot_file));
+
+            disk_usage::directory_index_t directory_index;
+            cachemgr.calculate_disk_usage(disk_usage::scan_options{.index = &directory_index});
+            REQUIRE(!cachemgr.write_snapshot(snapshot_file, directory_index));
+        }
+
+        // second run reuses the directories of the snapshot
+        cachemgr_t cachemgr;
+        REQUIRE(!cachemgr.find_mapped_cache_directories(cache_mappings));
+        REQUIRE(!cachemgr.open_snapshot(snapshot_file));
+
+        const auto &snapshot = cachemgr.snapshot();
+        REQUIRE(snapshot.generation() == 1);
+        REQUIRE(snapshot.timestamp() > 0);
+        REQUIRE(snapshot.mapping_count() == cache_mappings.size());
+        REQUIRE(snapshot.directories().size == 2 * cache_mappings.size());
+        std::size_t mapping_index = 0;
+        for (const auto &mapping : cache_mappings)
+        {
+            REQUIRE(snapshot.mapping_id(mapping_index) == mapping.id);
+            REQUIRE(snapshot.mapping_path(mapping_index) == mapping.target);
+            REQUIRE(snapshot.mapping_totals(mapping_index).apparent_size == 1000 * (mapping_index + 1));
+            ++mapping_index;
+        }
+
+        disk_usage::directory_index_t directory_index;
+        directory_index.attach(snapshot.directories(), snapshot.generation());
+        cachemgr.calculate_disk_usage(disk_usage::scan_options{.index = &directory_index});
+
+        fs::remove_all(root);
+
+        std::size_t index = 0;
+        for (const auto &dir : cachemgr.mapped_cache_directories())
+        {
+            REQUIRE(dir.disk_size == 1000 * (index + 1));
+            ++index;
+        }
+    }
+}
+
+TEST_CASE("validate cache mappings in parallel", tag_name_cachemgr) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-cachemgr-validate";
+        fs::remove_all(root);
+        fs::create_directories(root / "target");
+
+        // every third symbolic link points to an unexpected target
+        configuration_t::cache_mappings_t cache_mappings;
+        for (std::size_t i = 0; i < 64; ++i)
+        {
+            const auto source = root / ("link" + std::to_string(i));
+            const auto target = root / "target";
+            fs::create_directory_symlink(i % 3 == 0 ? root : target, source);
+
+            cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+                .id = "link" + std::to_string(i),
+                .type = directory_type_t::symbolic_link,
+                .package_manager = libcachemgr::package_manager_t{nullptr},
+                .source = source,
+                .target = target,
+            });
+        }
+
+        // a regular directory is not a bind mount
+        cache_mappings.emplace_back(configuration_t::cache_mapping_t{
+            .id = "bind",
+            .type = directory_type_t::bind_mount,
+            .package_manager = libcachemgr::package_manager_t{nullptr},
+            .source = root / "target",
+            .target = root / "target",
+        });
+
+        cachemgr_t sequential;
+        const auto sequential_results = sequential.find_mapped_cache_directories(cache_mappings, 1);
+
+        cachemgr_t parallel;
+        const auto parallel_results = parallel.find_mapped_cache_directories(cache_mappings, 8);
+
+        fs::remove_all(root);
+
+        REQUIRE(sequential_results.count() == 23);
+        REQUIRE(parallel_results.count() == sequential_results.count());
+        REQUIRE(parallel.mapped_cache_directories_count() == 42);
+
+        // both the differences and the mapped cache directories are in configuration order
+        auto sequential_difference = sequential_results.differences().begin();
+        for (const auto &difference : parallel_results.differences())
+        {
+            REQUIRE(difference.expected.id == sequential_difference->expected.id);
+            REQUIRE(difference.actual.target == sequential_difference->actual.target);
+            ++sequential_difference;
+        }
+        REQUIRE(parallel_results.differences().back().expected.id == "bind");
+
+        std::size_t index = 1;
+        for (const auto &dir : parallel.mapped_cache_directories())
+        {
+            if (index % 3 == 0)
+            {
+                ++index;
+            }
+            REQUIRE(dir.id == "link" + std::to_string(index));
+            ++index;
+        }
+    }
+}
@@ -81,7 +81,15 @@ TEST_CASE("parse config file", tag_name_config) {
         assert_cache_mapping("zig-lsp", home_dir + "/.cache/zls", caches_dir + "/zls");
         assert_cache_mapping("example-standalone", {}, caches_dir + "/standalone_cache");
 
+        // size limits
+        REQUIRE(config.find_cache_mapping("go-build-cache")->max_size == 10'000'000'000);
+        REQUIRE(config.find_cache_mapping("go-build-cache")->target_size == 8ull * 1024 * 1024 * 1024);
+        REQUIRE(config.find_cache_mapping("go-cache")->max_size == 0);
+        REQUIRE(config.find_cache_mapping("go-cache")->target_size == 0);
+
         REQUIRE(config.cache_root() == "/caches/" + std::to_string(uid));
+        REQUIRE(config.scan_threads() == 4);
+        REQUIRE(config.scan_io_uring() == true);
     }
 }
 
@@ -149,3 +157,27 @@ TEST_CASE("config file contains duplicated unique ids") {
         REQUIRE(config.cache_mappings().size() == 0);
     }
 }
+
+TEST_CASE("config file with a size limit on a wildcard mapping", tag_name_config) {
+    {
+        configuration_t::file_error file_error;
+        configuration_t::parse_error parse_error;
+        configuration_t config(cachemgr_tests_assets_dir + "/wildcard-max-size.yaml", &file_error, &parse_error);
+
+        REQUIRE(file_error == configuration_t::file_error::no_error);
+        REQUIRE(parse_error == configuration_t::parse_error::invalid_value);
+
+        REQUIRE(config.cache_mappings().size() == 0);
+    }
+}
+
+TEST_CASE("config file with a negative number of scan threads", tag_name_config) {
+    {
+        configuration_t::file_error file_error;
+        configuration_t::parse_error parse_error;
+        configuration_t config(cachemgr_tests_assets_dir + "/negative-scan-threads.yaml", &file_error, &parse_error);
+
+        REQUIRE(file_error == configuration_t::file_error::no_error);
+        REQUIRE(parse_error == configuration_t::parse_error::invalid_value);
+    }
+}
@@ -0,0 +1,151 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libcachemgr/daemon/client.hpp>
+#include <libcachemgr/daemon/server.hpp>
+#include <libcachemgr/logging.hpp>
+
+#include <filesystem>
+#include <string>
+#include <thread>
+
+static constexpr const char *tag_name_daemon = "[libcachemgr::daemon]";
+
+using libcachemgr::directory_type_t;
+
+TEST_CASE("encode and decode daemon messages", tag_name_daemon) {
+    {
+        const libcachemgr::daemon::sizes_response_t sizes{
+            .timestamp = 1700000000,
+            .available_disk_space = 4096,
+            .is_live = true,
+            .mappings = {
+                libcachemgr::daemon::mapping_sizes_t{
+                    .id = "npm",
+                    .directory_type = directory_type_t::symbolic_link,
+                    .original_path = "/home/user/.npm",
+                    .target_path = "/caches/npm",
+                    .wildcard_pattern = {},
+                    .resolved_source_file_count = 0,
+                    .disk_size = 1000,
+                    .allocated_disk_size = 4096,
+                    .unique_disk_size = 900,
+                    .unique_allocated_disk_size = 4000,
+                },
+                libcachemgr::daemon::mapping_sizes_t{
+                    .id = "logs",
+                    .directory_type = directory_type_t::wildcard,
+                    .original_path = {},
+                    .target_path = {},
+                    .wildcard_pattern = "/var/log/*.log",
+                    .resolved_source_file_count = 3,
+                    .disk_size = 30,
+                    .allocated_disk_size = 12288,
+                    .unique_disk_size = 30,
+                    .unique_allocated_disk_size = 12288,
+                },
+            },
+        };
+
+        const auto message = libcachemgr::daemon::encode_response(sizes);
+        libcachemgr::daemon::sizes_response_t decoded;
+        REQUIRE(!libcachemgr::daemon::decode_response(message, decoded));
+        REQUIRE(decoded.timestamp == sizes.timestamp);
+        REQUIRE(decoded.available_disk_space == sizes.available_disk_space);
+        REQUIRE(decoded.is_live);
+        REQUIRE(decoded.mappings.size() == 2);
+        REQUIRE(decoded.mappings[0].original_path == "/home/user/.npm");
+        REQUIRE(decoded.mappings[0].unique_allocated_disk_size == 4000);
+        REQUIRE(decoded.mappings[1].directory_type == directory_type_t::wildcard);
+        REQUIRE(decoded.mappings[1].wildcard_pattern == "/var/log/*.log");
+
+        const auto dir = libcachemgr::daemon::make_mapped_cache_directory(decoded.mappings[1]);
+        REQUIRE(dir.resolved_source_files.size() == 3);
+        REQUIRE(dir.disk_size == 30);
+
+        // truncated messages and unsuccessful responses are rejected
+        REQUIRE(libcachemgr::daemon::decode_response(std::string_view(message).substr(0, message.size() - 1), decoded));
+        REQUIRE(libcachemgr::daemon::decode_response(libcachemgr::daemon::encode_response(libcachemgr::daemon::response_status_t::not_ready), decoded) ==
+            std::errc::resource_unavailable_try_again);
+
+        libcachemgr::daemon::request_t request;
+        REQUIRE(!libcachemgr::daemon::decode_request(libcachemgr::daemon::encode_request(libcachemgr::daemon::request_t{
+            .type = libcachemgr::daemon::request_type_t::trend,
+            .mapping_id = "npm",
+        }), request));
+        REQUIRE(request.type == libcachemgr::daemon::request_type_t::trend);
+        REQUIRE(request.mapping_id == "npm");
+    }
+}
+
+TEST_CASE("query sizes and trends from the daemon server", tag_name_daemon) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-daemon";
+        const auto socket_file = (root / "cachemgrd.sock").string();
+        fs::remove_all(root);
+        fs::create_directories(root);
+
+        const libcachemgr::daemon::daemon_client_t client(socket_file);
+        libcachemgr::daemon::sizes_response_t sizes;
+
+        // no daemon running
+        REQUIRE(client.query_sizes(sizes));
+
+        libcachemgr::daemon::daemon_server_t server(std::chrono::seconds(10));
+        REQUIRE(!server.listen(socket_file));
+        std::thread server_thread([&server]{
+            server.run();
+        });
+
+        // a second daemon can't take over the socket
+        {
+            libcachemgr::daemon::daemon_server_t second_server;
+            REQUIRE(second_server.listen(socket_file) == std::errc::address_in_use);
+        }
+
+        // nothing published yet
+        REQUIRE(client.query_sizes(sizes) == std::errc::resource_unavailable_try_again);
+
+        for (std::int64_t timestamp : {100, 105, 120})
+        {
+            server.publish(libcachemgr::daemon::sizes_response_t{
+                .timestamp = timestamp,
+                .available_disk_space = 0,
+                .is_live = false,
+                .mappings = {libcachemgr::daemon::mapping_sizes_t{
+                    .id = "go",
+                    .directory_type = directory_type_t::standalone,
+                    .original_path = {},
+                    .target_path = "/caches/go",
+                    .wildcard_pattern = {},
+                    .resolved_source_file_count = 0,
+                    .disk_size = static_cast<std::uint64_t>(timestamp) * 10,
+                    .allocated_disk_size = 0,
+                    .unique_disk_size = 0,
+                    .unique_allocated_disk_size = 0,
+                }},
+            });
+        }
+
+        REQUIRE(!client.query_sizes(sizes));
+        REQUIRE(sizes.timestamp == 120);
+        REQUIRE(sizes.mappings.size() == 1);
+        REQUIRE(sizes.mappings[0].target_path == "/caches/go");
+        REQUIRE(sizes.mappings[0].disk_size == 1200);
+
+        // samples within the trend interval are replaced by newer ones, 105 is replaced by 120
+        libcachemgr::daemon::trend_response_t trend;
+        REQUIRE(!client.query_trend("go", trend));
+        REQUIRE(trend.samples.size() == 2);
+        REQUIRE(trend.samples[0].timestamp == 100);
+        REQUIRE(trend.samples[1].timestamp == 120);
+        REQUIRE(trend.samples[1].disk_size == 1200);
+
+        REQUIRE(client.query_trend("unknown", trend) == std::errc::no_such_file_or_directory);
+
+        server.stop();
+        server_thread.join();
+        fs::remove_all(root);
+    }
+}
@@ -0,0 +1,108 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libcachemgr/fs_watcher/fs_watcher.hpp>
+#include <libcachemgr/logging.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+static constexpr const char *tag_name_fs_watcher = "[libcachemgr::fs_watcher]";
+
+using libcachemgr::directory_type_t;
+using libcachemgr::fs_watcher::fs_watcher_t;
+
+namespace {
+
+/**
+ * Applies the deltas of the watcher until the size reaches the expected value or the timeout expires.
+ */
+bool wait_for_size(fs_watcher_t &watcher, const libcachemgr::mapped_cache_directory_t &dir, std::uintmax_t expected)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        watcher.apply_deltas();
+        if (dir.disk_size == expected)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    LOG_INFO(libcachemgr::log_test, "{}: expected {}, got {}", tag_name_fs_watcher, expected, dir.disk_size);
+    return false;
+}
+
+} // anonymous namespace
+
+TEST_CASE("track sizes of a watched directory", tag_name_fs_watcher) {
+    {
+        namespace fs = std::filesystem;
+
+        fs_watcher_t watcher(2, std::chrono::milliseconds(20));
+        if (!watcher.is_available())
+        {
+            LOG_INFO(libcachemgr::log_test, "{}: skipped, backend '{}' is not available",
+                tag_name_fs_watcher, fs_watcher_t::backend_name());
+            return;
+        }
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-fs-watcher";
+        fs::remove_all(root);
+        fs::create_directories(root / "existing" / "nested");
+        std::ofstream(root / "existing" / "nested" / "file") << std::string(1000, 'x');
+
+        const libcachemgr::mapped_cache_directory_t dir{
+            .id = "watched",
+            .directory_type = directory_type_t::standalone,
+            .original_path = {},
+            .target_path = root.string(),
+            .package_manager = libcachemgr::package_manager_t{nullptr},
+            .resolved_source_files = {},
+            .wildcard_pattern = {},
+            .disk_size = 1000,
+        };
+
+        REQUIRE(watcher.watch(dir));
+        REQUIRE(watcher.watch_count() == 3);
+        REQUIRE(watcher.start());
+
+        // new files in a watched directory
+        std::ofstream(root / "existing" / "new") << std::string(500, 'x');
+        REQUIRE(wait_for_size(watcher, dir, 1500));
+
+        // new directories are watched automatically, files created right after the directory are not lost
+        fs::create_directories(root / "created" / "deep");
+        std::ofstream(root / "created" / "deep" / "file") << std::string(200, 'x');
+        REQUIRE(wait_for_size(watcher, dir, 1700));
+        std::ofstream(root / "created" / "deep" / "file", std::ios::app) << std::string(300, 'x');
+        REQUIRE(wait_for_size(watcher, dir, 2000));
+
+        // files which are removed
+        fs::remove(root / "existing" / "new");
+        REQUIRE(wait_for_size(watcher, dir, 1500));
+
+        // directories which are moved out of the watched tree
+        const auto outside = fs::temp_directory_path() / "cachemgr-tests-fs-watcher-outside";
+        fs::remove_all(outside);
+        fs::rename(root / "existing", outside);
+        REQUIRE(wait_for_size(watcher, dir, 500));
+        std::ofstream(outside / "untracked") << std::string(100, 'x');
+
+        // and moved back in
+        fs::rename(outside, root / "moved");
+        REQUIRE(wait_for_size(watcher, dir, 1600));
+
+        // removed directories
+        fs::remove_all(root / "created");
+        REQUIRE(wait_for_size(watcher, dir, 1100));
+        REQUIRE(watcher.watch_count() == 3);
+
+        watcher.stop();
+        fs::remove_all(root);
+
+        REQUIRE(!watcher.is_degraded());
+    }
+}
@@ -0,0 +1,1046 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <utils/os_utils.hpp>
+#include <utils/disk_usage/cold_archive.hpp>
+#include <utils/disk_usage/compressibility.hpp>
+#include <utils/disk_usage/dedupe.hpp>
+#include <utils/disk_usage/disk_usage.hpp>
+#include <utils/disk_usage/inode_set.hpp>
+#include <utils/disk_usage/directory_index.hpp>
+#include <utils/disk_usage/eviction.hpp>
+#include <utils/disk_usage/subtree_breakdown.hpp>
+
+#include <libcachemgr/logging.hpp>
+
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static constexpr const char *tag_name_scan_directory = "[disk_usage::scan_directory]";
+static constexpr const char *tag_name_estimate_directory = "[disk_usage::estimate_directory]";
+static constexpr const char *tag_name_inode_set = "[disk_usage::inode_set_t]";
+static constexpr const char *tag_name_directory_index = "[disk_usage::directory_index_t]";
+static constexpr const char *tag_name_subtree_breakdown = "[disk_usage::subtree_breakdown_t]";
+static constexpr const char *tag_name_file_histograms = "[disk_usage::file_histograms]";
+static constexpr const char *tag_name_eviction = "[disk_usage::plan_eviction]";
+static constexpr const char *tag_name_dedupe = "[disk_usage::deduplicate]";
+static constexpr const char *tag_name_compressibility = "[disk_usage::estimate_compressibility]";
+static constexpr const char *tag_name_cold_archive = "[disk_usage::pack_cold_subtrees]";
+
+namespace {
+
+/// creates a small directory tree with a known total size in a temporary directory
+struct temporary_tree_t final
+{
+    std::filesystem::path root;
+    std::uintmax_t expected_size{0};
+
+    temporary_tree_t(const std::string &name)
+    {
+        namespace fs = std::filesystem;
+
+        this->root = fs::temp_directory_path() / name;
+        fs::remove_all(this->root);
+
+        // 3 levels with a fan-out of 4 and 3 files per directory
+        const auto populate = [this](const auto &self, const fs::path &dir, unsigned depth) -> void {
+            fs::create_directories(dir);
+            for (unsigned f = 0; f < 3; ++f)
+            {
+                const std::string content((depth + 1) * 100 + f, 'x');
+                std::ofstream(dir / ("file" + std::to_string(f))) << content;
+                this->expected_size += content.size();
+            }
+            if (depth < 3)
+            {
+                for (unsigned d = 0; d < 4; ++d)
+                {
+                    self(self, dir / ("dir" + std::to_string(d)), depth + 1);
+                }
+            }
+        };
+        populate(populate, this->root, 0);
+
+        // symlinks to directories must not be followed
+        fs::create_directory_symlink(this->root / "dir0", this->root / "dir0-link");
+    }
+
+    ~temporary_tree_t()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(this->root, ec);
+    }
+};
+
+/// owns the columns of directory records, the snapshot file does this in production
+struct directory_columns_storage_t final
+{
+    explicit directory_columns_storage_t(const std::vector<disk_usage::directory_record_t> &records)
+    {
+        for (const auto &record : records)
+        {
+            path_hash.emplace_back(record.path_hash);
+            mtime_sec.emplace_back(record.mtime_sec);
+            ctime_sec.emplace_back(record.ctime_sec);
+            mtime_nsec.emplace_back(record.mtime_nsec);
+            ctime_nsec.emplace_back(record.ctime_nsec);
+            apparent_size.emplace_back(record.apparent_size);
+            allocated_size.emplace_back(record.allocated_size);
+            entry_count.emplace_back(record.entry_count);
+            flags.emplace_back(record.flags);
+        }
+    }
+
+    disk_usage::directory_columns_t columns() const
+    {
+        return disk_usage::directory_columns_t{
+            .path_hash = path_hash.data(),
+            .mtime_sec = mtime_sec.data(),
+            .ctime_sec = ctime_sec.data(),
+            .mtime_nsec = mtime_nsec.data(),
+            .ctime_nsec = ctime_nsec.data(),
+            .apparent_size = apparent_size.data(),
+            .allocated_size = allocated_size.data(),
+            .entry_count = entry_count.data(),
+            .flags = flags.data(),
+            .size = path_hash.size(),
+        };
+    }
+
+    std::vector<std::uint64_t> path_hash;
+    std::vector<std::int64_t> mtime_sec;
+    std::vector<std::int64_t> ctime_sec;
+    std::vector<std::uint32_t> mtime_nsec;
+    std::vector<std::uint32_t> ctime_nsec;
+    std::vector<std::uint64_t> apparent_size;
+    std::vector<std::uint64_t> allocated_size;
+    std::vector<std::uint32_t> entry_count;
+    std::vector<std::uint32_t> flags;
+};
+
+} // anonymous namespace
+
+TEST_CASE("scan directory with multiple threads", tag_name_scan_directory) {
+    {
+        const temporary_tree_t tree("cachemgr-tests-disk-usage");
+
+        for (const unsigned thread_count : {1u, 2u, 8u, 0u})
+        {
+            const auto result = disk_usage::scan_directory(tree.root, disk_usage::scan_options{
+                .thread_count = thread_count,
+            });
+
+            LOG_INFO(libcachemgr::log_test, "{}: threads = {}, size = {}",
+                tag_name_scan_directory, thread_count, result.apparent_size);
+
+            REQUIRE(!result.ec);
+            REQUIRE(result.apparent_size == tree.expected_size);
+            REQUIRE(result.allocated_size > 0);
+        }
+
+        const auto [size, allocated_size, ec] = os_utils::get_used_disk_space_of(tree.root);
+        REQUIRE(!ec);
+        REQUIRE(size == tree.expected_size);
+        REQUIRE(allocated_size > 0);
+    }
+}
+
+TEST_CASE("scan directory with sparse files", tag_name_scan_directory) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-disk-usage-sparse";
+        fs::remove_all(root);
+        fs::create_directories(root);
+
+        // 8 MiB hole followed by a single byte
+        const auto sparse_file = root / "sparse";
+        std::ofstream(sparse_file) << 'x';
+        fs::resize_file(sparse_file, 8 * 1024 * 1024);
+
+        const auto result = disk_usage::scan_directory(root);
+        const auto file_result = disk_usage::stat_file(sparse_file);
+
+        LOG_INFO(libcachemgr::log_test, "{}: apparent size = {}, allocated size = {}",
+            tag_name_scan_directory, result.apparent_size, result.allocated_size);
+
+        fs::remove_all(root);
+
+        REQUIRE(!result.ec);
+        REQUIRE(result.apparent_size == 8 * 1024 * 1024);
+        REQUIRE(result.allocated_size < result.apparent_size);
+
+        REQUIRE(!file_result.ec);
+        REQUIRE(file_result.apparent_size == result.apparent_size);
+        REQUIRE(file_result.allocated_size == result.allocated_size);
+    }
+}
+
+TEST_CASE("scan directory with io_uring", tag_name_scan_directory) {
+    {
+        namespace fs = std::filesystem;
+
+        const temporary_tree_t tree("cachemgr-tests-disk-usage-io-uring");
+
+        // more files than fit into a single io_uring batch
+        std::uintmax_t expected_size = tree.expected_size;
+        for (unsigned f = 0; f < 1000; ++f)
+        {
+            const std::string content(f % 7, 'x');
+            std::ofstream(tree.root / "dir1" / ("many" + std::to_string(f))) << content;
+            expected_size += content.size();
+        }
+
+        // symlinks to regular files are counted with the size of the file they point to
+        fs::create_symlink(tree.root / "file0", tree.root / "dir2" / "file0-link");
+        expected_size += fs::file_size(tree.root / "file0");
+
+        const auto sync_result = disk_usage::scan_directory(tree.root, disk_usage::scan_options{
+            .thread_count = 2,
+            .use_io_uring = false,
+        });
+        const auto io_uring_result = disk_usage::scan_directory(tree.root, disk_usage::scan_options{
+            .thread_count = 2,
+            .use_io_uring = true,
+        });
+
+        LOG_INFO(libcachemgr::log_test, "{}: io_uring available = {}, size = {}",
+            tag_name_scan_directory, disk_usage::io_uring_available(), io_uring_result.apparent_size);
+
+        // the results must be identical, regardless of io_uring support
+        REQUIRE(!sync_result.ec);
+        REQUIRE(!io_uring_result.ec);
+        REQUIRE(sync_result.apparent_size == expected_size);
+        REQUIRE(io_uring_result.apparent_size == sync_result.apparent_size);
+        REQUIRE(io_uring_result.allocated_size == sync_result.allocated_size);
+    }
+}
+
+TEST_CASE("scan directory with progress counters", tag_name_scan_directory) {
+    const temporary_tree_t tree("cachemgr-disk-usage-progress-test");
+
+    // every directory and file is published exactly once, regardless of the number of workers
+    {
+        disk_usage::scan_progress progress;
+        const auto result = disk_usage::scan_directory(tree.root.string(), {
+            .thread_count = 4,
+            .progress = &progress,
+        });
+
+        REQUIRE(!result.ec);
+        REQUIRE(progress.files == 3 * (1 + 4 + 16 + 64));
+        REQUIRE(progress.directories == 1 + 4 + 16 + 64);
+        REQUIRE(progress.apparent_size == result.apparent_size);
+    }
+}
+
+TEST_CASE("collect age and size histograms", tag_name_file_histograms) {
+    const temporary_tree_t tree("cachemgr-disk-usage-histograms-test");
+
+    // root/file0 (100 bytes) was accessed 10 days ago and modified 100 days ago
+    constexpr std::int64_t day = 24 * 3600;
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    const struct timespec times[2] = {
+        {.tv_sec = now - 10 * day, .tv_nsec = 0},
+        {.tv_sec = now - 100 * day, .tv_nsec = 0},
+    };
+    REQUIRE(::utimensat(AT_FDCWD, (tree.root / "file0").c_str(), times, 0) == 0);
+
+    REQUIRE(disk_usage::file_histograms::age_bucket_of(-1) == 0);
+    REQUIRE(disk_usage::file_histograms::age_bucket_of(day) == 1);
+    REQUIRE(disk_usage::file_histograms::age_bucket_of(1000 * day) == 4);
+    REQUIRE(disk_usage::file_histograms::size_bucket_of(0) == 0);
+    REQUIRE(disk_usage::file_histograms::size_bucket_of(1) == 1);
+    REQUIRE(disk_usage::file_histograms::size_bucket_of(4096) == 13);
+    REQUIRE(disk_usage::file_histograms::size_bucket_of(~std::uint64_t{0}) ==
+        disk_usage::file_histograms::size_bucket_count - 1);
+
+    for (const unsigned threads : {1u, 4u})
+    {
+        disk_usage::file_histograms histograms{.reference_time = now};
+        const auto result = disk_usage::scan_directory(tree.root.string(), {
+            .thread_count = threads,
+            .histograms = &histograms,
+        });
+        REQUIRE(!result.ec);
+
+        REQUIRE(histograms.accessed_bytes[2] == 100);
+        REQUIRE(histograms.modified_bytes[4] == 100);
+        REQUIRE(histograms.modified_bytes[0] == result.apparent_size - 100);
+
+        std::uint64_t accessed_bytes = 0, size_files = 0, size_bytes = 0;
+        for (const auto bytes : histograms.accessed_bytes)
+        {
+            accessed_bytes += bytes;
+        }
+        for (std::size_t i = 0; i < disk_usage::file_histograms::size_bucket_count; ++i)
+        {
+            size_files += histograms.size_files[i];
+            size_bytes += histograms.size_bytes[i];
+        }
+        REQUIRE(accessed_bytes == result.apparent_size);
+        REQUIRE(size_bytes == result.apparent_size);
+        REQUIRE(size_files == 3 * (1 + 4 + 16 + 64));
+
+        // the files of the root are 100 to 102 bytes, the files on level 1 are 200 to 202 bytes
+        REQUIRE(histograms.size_files[7] == 3);
+        REQUIRE(histograms.size_files[8] == 4 * 3);
+    }
+}
+
+TEST_CASE("collect all statistics in a single scan", tag_name_scan_directory) {
+    const temporary_tree_t tree("cachemgr-disk-usage-all-statistics-test");
+
+    disk_usage::scan_progress progress;
+    disk_usage::subtree_breakdown_t breakdown(1);
+    disk_usage::file_histograms histograms;
+    const auto result = disk_usage::scan_directory(tree.root.string(), {
+        .thread_count = 4,
+        .progress = &progress,
+        .breakdown = &breakdown,
+        .histograms = &histograms,
+    });
+    REQUIRE(!result.ec);
+    REQUIRE(result.apparent_size == tree.expected_size);
+
+    // every statistic saw the same files
+    std::uint64_t modified_bytes = 0;
+    for (const auto bytes : histograms.modified_bytes)
+    {
+        modified_bytes += bytes;
+    }
+    REQUIRE(modified_bytes == result.apparent_size);
+    REQUIRE(progress.apparent_size == result.apparent_size);
+    REQUIRE(breakdown.top(4).apparent_size == result.apparent_size);
+}
+
+TEST_CASE("break down the largest subdirectories", tag_name_subtree_breakdown) {
+    const temporary_tree_t tree("cachemgr-disk-usage-breakdown-test");
+
+    // make dir2 and dir2/dir1 the largest subdirectories on their levels
+    std::ofstream(tree.root / "dir2" / "dir1" / "dir3" / "large") << std::string(5000, 'x');
+
+    // subtree of a directory on level 1: 3 files on every level, fan-out of 4
+    constexpr std::uint64_t level_1_size = 603 + 4 * 903 + 16 * 1203;
+    constexpr std::uint64_t level_2_size = 903 + 4 * 1203;
+
+    for (const unsigned threads : {1u, 4u})
+    {
+        disk_usage::subtree_breakdown_t breakdown(2);
+        const auto result = disk_usage::scan_directory(tree.root.string(), {
+            .thread_count = threads,
+            .breakdown = &breakdown,
+        });
+        REQUIRE(!result.ec);
+        REQUIRE(breakdown.size() == 1 + 4 + 16);
+
+        const auto report = breakdown.top(2);
+        REQUIRE(report.path == tree.root.string());
+        REQUIRE(report.apparent_size == result.apparent_size);
+        REQUIRE(report.children.size() == 2);
+
+        // the levels below the maximum depth are aggregated into their ancestor
+        const auto &largest = report.children[0];
+        REQUIRE(largest.path == "dir2");
+        REQUIRE(largest.apparent_size == level_1_size + 5000);
+        REQUIRE(largest.children.size() == 2);
+        REQUIRE(largest.children[0].path == "dir2/dir1");
+        REQUIRE(largest.children[0].apparent_size == level_2_size + 5000);
+        REQUIRE(largest.children[0].children.empty());
+        REQUIRE(largest.children[1].apparent_size == level_2_size);
+
+        REQUIRE(report.children[1].apparent_size == level_1_size);
+    }
+}
+
+TEST_CASE("scan directory which does not exist", tag_name_scan_directory) {
+    {
+        const auto result = disk_usage::scan_directory("/this/directory/does/not/exist");
+
+        REQUIRE(result.ec);
+        REQUIRE(result.apparent_size == 0);
+    }
+}
+
+TEST_CASE("scan directories with shared hardlinks", tag_name_scan_directory) {
+    {
+        namespace fs = std::filesystem;
+
+        const auto root = fs::temp_directory_path() / "cachemgr-tests-disk-usage-hardlinks";
+        fs::remove_all(root);
+        fs::create_directories(root / "a");
+        fs::create_directories(root / "b");
+
+        // one file with 3 links, two of them in the same directory tree
+        const std::string content(1000, 'x');
+        std::ofstream(root / "a" / "file") << content;
+        fs::create_hard_link(root / "a" / "file", root / "a" / "link");
+        fs::create_hard_link(root / "a" / "file", root / "b" / "link");
+
+        disk_usage::inode_set_t hardlinks;
+        const auto result_a = disk_usage::scan_directory(root / "a", {.thread_count = 2, .hardlinks = &hardlinks});
+        const auto result_b = disk_usage::scan_directory(root / "b", {.thread_count = 2, .hardlinks = &hardlinks});
+        const auto result_no_dedup = disk_usage::scan_directory(root / "a");
+
+        fs::remove_all(root);
+
+        REQUIRE(!result_a.ec);
+        REQUIRE(!result_b.ec);
+        REQUIRE(hardlinks.size() == 1);
+
+        // every link is attributed to the directory tree it was found in
+        REQUIRE(result_a.apparent_size == 2 * content.size());
+        REQUIRE(result_b.apparent_size == content.size());
+
+        // the unique size only counts the first link
+        REQUIRE(result_a.unique_apparent_size == content.size());
+        REQUIRE(result_b.unique_apparent_size == 0);
+        REQUIRE(result_a.unique_allocated_size == result_a.allocated_size / 2);
+        REQUIRE(result_b.unique_allocated_size == 0);
+
+        // without a set of hardlinks, there is no deduplication
+        REQUIRE(result_no_dedup.unique_apparent_size == result_no_dedup.apparent_size);
+    }
+}
+
+TEST_CASE("insert inodes into the set", tag_name_inode_set) {
+    {
+        disk_usage::inode_set_t inodes;
+
+        // enough inodes to grow every shard multiple times
+        constexpr std::uint64_t count = 200000;
+        for (std::uint64_t ino = 0; ino < count; ++ino)
+        {
+            REQUIRE(inodes.insert(ino % 3, ino));
+        }
+        REQUIRE(inodes.size() == count);
+
+        for (std::uint64_t ino = 0; ino < count; ++ino)
+        {
+            REQUIRE(!inodes.insert(ino % 3, ino));
+        }
+        REQUIRE(inodes.size() == count);
+
+        // same inode number on a different device is a different file
+        REQUIRE(inodes.insert(42, 1));
+        REQUIRE(inodes.size() == count + 1);
+
+        inodes.clear();
+        REQUIRE(inodes.size() == 0);
+        REQUIRE(inodes.insert(0, 0));
+        REQUIRE(!inodes.insert(0, 0));
+    }
+}
+
+TEST_CASE("rescan directory incrementally", tag_name_directory_index) {
+    {
+        const temporary_tree_t tree("cachemgr-tests-disk-usage-index");
+
+        // the first scan has nothing to reuse
+        disk_usage::directory_index_t first_index;
+        const auto first_result = disk_usage::scan_directory(tree.root, {.thread_count = 2, .index = &first_index});
+
+        REQUIRE(!first_result.ec);
+        REQUIRE(first_result.apparent_size == tree.expected_size);
+        REQUIRE(first_result.reused_directories == 0);
+
+        // a new file changes the mtime of its directory, all other directories are reused
+        const std::string content(4321, 'x');
+        std::ofstream(tree.root / "dir3" / "dir0" / "new-file") << content;
+
+        const directory_columns_storage_t previous(first_index.current_records());
+        disk_usage::directory_index_t second_index;
+        second_index.attach(previous.columns(), first_index.generation() + 1);
+        REQUIRE(second_index.size() > 0);
+        const auto second_result = disk_usage::scan_directory(tree.root, {.thread_count = 2, .index = &second_index});
+
+        LOG_INFO(libcachemgr::log_test, "{}: directories = {}, reused = {}",
+            tag_name_directory_index, second_index.size(), second_result.reused_directories);
+
+        REQUIRE(!second_result.ec);
+        REQUIRE(second_result.apparent_size == tree.expected_size + content.size());
+        REQUIRE(second_result.allocated_size == first_result.allocated_size +
+            disk_usage::stat_file(tree.root / "dir3" / "dir0" / "new-file").allocated_size);
+        REQUIRE(second_result.reused_directories > 0);
+        REQUIRE(second_result.reused_directories < second_index.size());
+        REQUIRE(second_index.current_records().size() == second_index.size());
+    }
+}
+
+TEST_CASE("hash paths incrementally", tag_name_directory_index) {
+    {
+        using disk_usage::directory_index_t;
+
+        const auto parent = directory_index_t::hash_path("/caches/npm");
+        REQUIRE(directory_index_t::hash_child(parent, "_cacache") == directory_index_t::hash_path("/caches/npm/_cacache"));
+        REQUIRE(directory_index_t::hash_child(parent, "a") != directory_index_t::hash_child(parent, "b"));
+    }
+}
+
+TEST_CASE("estimate directory within the budget", tag_name_estimate_directory) {
+    const temporary_tree_t tree("cachemgr-disk-usage-estimate-test");
+
+    // the budget is sufficient to read every directory, the estimate is exact
+    {
+        const auto result = disk_usage::estimate_directory(tree.root.string(), {
+            .time_budget = std::chrono::seconds(10),
+        });
+
+        REQUIRE(!result.ec);
+        REQUIRE(result.is_exact);
+        REQUIRE(result.apparent_size == tree.expected_size);
+        REQUIRE(result.apparent_size_margin == 0);
+        REQUIRE(result.directories_listed == 1 + 4 + 16 + 64);
+    }
+
+    // every directory on the same level has the same content, every probe hits the exact size
+    {
+        const auto result = disk_usage::estimate_directory(tree.root.string(), {
+            .time_budget = std::chrono::milliseconds(0),
+            .stat_budget = 20,
+        });
+
+        REQUIRE(!result.ec);
+        REQUIRE(!result.is_exact);
+        REQUIRE(result.probes >= 1);
+        REQUIRE(result.directories_listed < 1 + 4 + 16 + 64);
+        REQUIRE(result.apparent_size == tree.expected_size);
+        REQUIRE(result.apparent_size_margin == 0);
+    }
+}
+
+TEST_CASE("estimate directory without files within the budget", tag_name_estimate_directory) {
+    namespace fs = std::filesystem;
+
+    // 4 levels of 4 directories each, nothing needs a stat call
+    const auto root = fs::temp_directory_path() / "cachemgr-disk-usage-estimate-directories-test";
+    fs::remove_all(root);
+    std::vector<fs::path> level{root};
+    for (int depth = 0; depth < 4; ++depth)
+    {
+        std::vector<fs::path> next;
+        for (const auto &parent : level)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                next.emplace_back(parent / ("dir" + std::to_string(i)));
+                fs::create_directories(next.back());
+            }
+        }
+        level = std::move(next);
+    }
+
+    // the directories which are read count against the budget
+    const auto result = disk_usage::estimate_directory(root.string(), {
+        .time_budget = std::chrono::milliseconds(0),
+        .stat_budget = 10,
+    });
+    fs::remove_all(root);
+
+    REQUIRE(!result.ec);
+    REQUIRE(!result.is_exact);
+    REQUIRE(result.stat_calls == 0);
+    REQUIRE(result.directories_listed <= 10 + 4);
+    REQUIRE(result.apparent_size == 0);
+}
+
+TEST_CASE("estimate directory which does not exist", tag_name_estimate_directory) {
+    const auto result = disk_usage::estimate_directory("/this/directory/does/not/exist");
+
+    REQUIRE(result.ec);
+    REQUIRE(result.apparent_size == 0);
+}
+
+TEST_CASE("evict the least recently used files", tag_name_eviction) {
+    namespace fs = std::filesystem;
+
+    const auto base = fs::temp_directory_path() / "cachemgr-disk-usage-eviction-test";
+    const auto root = base / "cache";
+    const auto outside = base / "outside";
+    fs::remove_all(base);
+    fs::create_directories(root / "a");
+    fs::create_directories(root / "b");
+    fs::create_directories(outside);
+
+    constexpr std::int64_t day = 24 * 3600;
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    const auto create_file = [](const fs::path &path, std::size_t size, std::int64_t last_used) {
+        std::ofstream(path) << std::string(size, 'x');
+        const struct timespec times[2] = {
+            {.tv_sec = last_used, .tv_nsec = 0},
+            {.tv_sec = last_used, .tv_nsec = 0},
+        };
+        REQUIRE(::utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+    };
+
+    // 3500 bytes in total, the hardlinked file is accounted once and never planned
+    create_file(root / "a" / "old", 1000, now - 30 * day);
+    create_file(root / "a" / "mid", 1000, now - 20 * day);
+    create_file(root / "b" / "new", 1000, now);
+    create_file(root / "b" / "link1", 500, now - 40 * day);
+    fs::create_hard_link(root / "b" / "link1", root / "b" / "link2");
+
+    // files behind symbolic links are never planned
+    create_file(outside / "old", 1000, now - 50 * day);
+    fs::create_directory_symlink(outside, root / "outside");
+
+    {
+        // below the limit
+        const auto plan = disk_usage::plan_eviction(root.string(), {.max_size = 4000, .thread_count = 2});
+        REQUIRE(!plan.ec);
+        REQUIRE(plan.current_size == 3500);
+        REQUIRE(!plan.is_over_limit());
+        REQUIRE(plan.files.empty());
+    }
+
+    const auto plan = disk_usage::plan_eviction(root.string(), {
+        .max_size = 3000,
+        .target_size = 2000,
+        .thread_count = 2,
+    });
+    REQUIRE(!plan.ec);
+    REQUIRE(plan.current_size == 3500);
+    REQUIRE(plan.target_size == 2000);
+    REQUIRE(plan.is_over_limit());
+    REQUIRE(plan.reaches_target());
+    REQUIRE(plan.planned_size == 2000);
+    REQUIRE(plan.files.size() == 2);
+    REQUIRE(plan.files[0].relative_path == "a/old");
+    REQUIRE(plan.files[1].relative_path == "a/mid");
+
+    // planning doesn't delete anything (dry run)
+    REQUIRE(fs::exists(root / "a" / "old"));
+
+    // files which were used since planning are skipped
+    create_file(root / "a" / "mid", 1000, now);
+
+    auto result = disk_usage::execute_eviction(plan, 2);
+    REQUIRE(!result.ec);
+    REQUIRE(result.deleted_files == 1);
+    REQUIRE(result.freed_size == 1000);
+    REQUIRE(result.skipped_files == 1);
+    REQUIRE(!fs::exists(root / "a" / "old"));
+    REQUIRE(fs::exists(root / "a" / "mid"));
+    REQUIRE(fs::exists(outside / "old"));
+
+    // a directory which is replaced with a symbolic link can't redirect the deletion outside of the root
+    const auto second_plan = disk_usage::plan_eviction(root.string(), {.max_size = 1000, .thread_count = 1});
+    REQUIRE(second_plan.files.size() == 2);
+    fs::rename(root / "a", base / "a");
+    fs::create_directory_symlink(base / "a", root / "a");
+
+    result = disk_usage::execute_eviction(second_plan, 1);
+    REQUIRE(!result.ec);
+    REQUIRE(result.deleted_files == 1);
+    REQUIRE(result.skipped_files == 1);
+    REQUIRE(fs::exists(base / "a" / "mid"));
+    REQUIRE(!fs::exists(root / "b" / "new"));
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("hash contents incrementally", tag_name_dedupe) {
+    std::string data(1000, '\0');
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i * 7);
+    }
+
+    const auto hash = disk_usage::content_hash_t::hash(data.data(), data.size());
+    for (const std::size_t split : {1, 31, 32, 33, 500, 999})
+    {
+        disk_usage::content_hash_t incremental;
+        incremental.update(data.data(), split);
+        incremental.update(data.data() + split, data.size() - split);
+        REQUIRE(incremental.digest() == hash);
+    }
+
+    REQUIRE(disk_usage::content_hash_t::hash(data.data(), data.size(), 1) != hash);
+    REQUIRE(disk_usage::content_hash_t::hash(data.data(), data.size() - 1) != hash);
+    data[500] ^= 1;
+    REQUIRE(disk_usage::content_hash_t::hash(data.data(), data.size()) != hash);
+}
+
+TEST_CASE("deduplicate files across directories", tag_name_dedupe) {
+    namespace fs = std::filesystem;
+
+    const auto base = fs::temp_directory_path() / "cachemgr-disk-usage-dedupe-test";
+    const auto first = base / "first";
+    const auto second = base / "second";
+    fs::remove_all(base);
+    fs::create_directories(first);
+    fs::create_directories(second);
+
+    std::string large(20000, '\0');
+    for (std::size_t i = 0; i < large.size(); ++i)
+    {
+        large[i] = static_cast<char>(i * 13);
+    }
+    auto large_changed = large;
+    large_changed[10000] ^= 1;
+
+    std::ofstream(first / "large") << large;
+    std::ofstream(second / "large") << large;
+    fs::create_hard_link(second / "large", second / "large_link");
+    std::ofstream(first / "small") << std::string(5000, 's');
+    std::ofstream(second / "small") << std::string(5000, 's');
+    fs::permissions(second / "small", fs::perms::owner_read | fs::perms::group_read | fs::perms::others_read);
+    std::ofstream(first / "tiny") << std::string(100, 't');
+    std::ofstream(second / "tiny") << std::string(100, 't');
+
+    // same size, first and last bytes, differs in the middle
+    std::ofstream(first / "changed") << large_changed;
+
+    const std::vector<std::string> roots{first.string(), second.string()};
+
+    const auto dry_run = disk_usage::deduplicate(roots, {.thread_count = 2, .dry_run = true});
+    REQUIRE(!dry_run.ec);
+    REQUIRE(dry_run.partially_hashed_files == 5);
+    REQUIRE(dry_run.fully_hashed_files == 3);
+    REQUIRE(dry_run.groups.size() == 2);
+    REQUIRE(dry_run.groups[0].size == 5000);
+    REQUIRE(dry_run.groups[0].files[0].path == (first / "small").string());
+    REQUIRE(dry_run.groups[0].files[1].path == (second / "small").string());
+    REQUIRE(dry_run.groups[1].size == 20000);
+    REQUIRE(dry_run.groups[1].files[0].path == (first / "large").string());
+    REQUIRE(dry_run.groups[1].files[1].path == (second / "large").string());
+    REQUIRE(dry_run.roots.size() == 2);
+    REQUIRE(dry_run.roots[0].duplicate_files == 0);
+    REQUIRE(dry_run.roots[1].duplicate_files == 2);
+    REQUIRE(dry_run.roots[1].reflinked_files == 0);
+    REQUIRE(dry_run.roots[1].hardlinked_files == 0);
+    REQUIRE(dry_run.roots[1].reclaimed_size >= 25000);
+    REQUIRE(fs::hard_link_count(first / "large") == 1);
+
+    // reflinks where supported, hardlinks otherwise
+    const auto result = disk_usage::deduplicate(roots, {.allow_hardlinks = true, .thread_count = 2});
+    REQUIRE(!result.ec);
+    REQUIRE(result.skipped_files == 0);
+    REQUIRE(result.roots[1].reflinked_files + result.roots[1].hardlinked_files == 2);
+    if (result.roots[1].hardlinked_files > 0)
+    {
+        REQUIRE(fs::equivalent(first / "small", second / "small"));
+    }
+
+    const auto read_file = [](const fs::path &path) {
+        std::ifstream file(path);
+        return std::string{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    };
+    REQUIRE(read_file(second / "large") == large);
+    REQUIRE(read_file(second / "large_link") == large);
+    REQUIRE(read_file(second / "small") == std::string(5000, 's'));
+    REQUIRE(read_file(first / "changed") == large_changed);
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("calculate the entropy of byte histograms", tag_name_compressibility) {
+    disk_usage::byte_histogram constant;
+    constant.add(std::string(1000, 'x').data(), 1000);
+    REQUIRE(constant.total == 1000);
+    REQUIRE(constant.counts['x'] == 1000);
+    REQUIRE(constant.entropy() == 0);
+
+    std::string all_bytes(256 * 4 + 3, '\0');
+    for (std::size_t i = 0; i < all_bytes.size(); ++i)
+    {
+        all_bytes[i] = static_cast<char>(i);
+    }
+    disk_usage::byte_histogram uniform;
+    uniform.add(all_bytes.data(), 256 * 4);
+    REQUIRE(uniform.entropy() > 7.999);
+
+    // the tail which doesn't fill all sub-histograms is counted as well
+    uniform.add(all_bytes.data() + 256 * 4, 3);
+    REQUIRE(uniform.total == 256 * 4 + 3);
+    REQUIRE(uniform.counts[0] == 5);
+    REQUIRE(uniform.counts[3] == 4);
+
+    disk_usage::byte_histogram two_values;
+    two_values.add("abababab", 8);
+    REQUIRE(two_values.entropy() > 0.999);
+    REQUIRE(two_values.entropy() < 1.001);
+}
+
+TEST_CASE("estimate the compressibility of a directory", tag_name_compressibility) {
+    namespace fs = std::filesystem;
+
+    const auto base = fs::temp_directory_path() / "cachemgr-disk-usage-compressibility-test";
+    fs::remove_all(base);
+    fs::create_directories(base / "random" / "nested");
+    fs::create_directories(base / "zeros");
+
+    // xorshift output is incompressible for an order-0 model
+    std::uint64_t state = 0x2545F4914F6CDD1DULL;
+    std::string random(512 * 1024, '\0');
+    for (auto &c : random)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        c = static_cast<char>(state >> 56);
+    }
+    std::ofstream(base / "random" / "large") << random;
+    std::ofstream(base / "random" / "nested" / "small") << random.substr(0, 1000);
+    std::ofstream(base / "zeros" / "large") << std::string(512 * 1024, '\0');
+
+    const auto incompressible = disk_usage::estimate_compressibility((base / "random").string(), {.thread_count = 2});
+    REQUIRE(!incompressible.ec);
+    REQUIRE(incompressible.has_samples());
+    REQUIRE(incompressible.sampled_size == 512 * 1024 + 1000);
+    REQUIRE(incompressible.sampled_files == 2);
+    REQUIRE(incompressible.entropy > 7.9);
+    REQUIRE(incompressible.compression_ratio < 1.05);
+    REQUIRE(incompressible.incompressible_share == 1);
+
+    // at most 3 blocks are read, spread over the whole directory: 2 of the random file, 1 of the zeros
+    const auto sampled = disk_usage::estimate_compressibility(base.string(), {
+        .max_read_size = 3 * 64 * 1024,
+        .block_size = 64 * 1024,
+        .thread_count = 2,
+    });
+    REQUIRE(!sampled.ec);
+    REQUIRE(sampled.sampled_blocks == 3);
+    REQUIRE(sampled.sampled_files == 2);
+    REQUIRE(sampled.sampled_size == 3 * 64 * 1024);
+    REQUIRE(sampled.incompressible_share > 0.6);
+    REQUIRE(sampled.incompressible_share < 0.7);
+
+    const auto zeros = disk_usage::estimate_compressibility((base / "zeros").string(), {.thread_count = 1});
+    REQUIRE(!zeros.ec);
+    REQUIRE(zeros.entropy == 0);
+    REQUIRE(zeros.compression_ratio == 64);
+    REQUIRE(zeros.incompressible_share == 0);
+
+    const auto missing = disk_usage::estimate_compressibility((base / "missing").string(), {});
+    REQUIRE(missing.ec);
+    REQUIRE(!missing.has_samples());
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("pack cold subtrees and restore them", tag_name_cold_archive) {
+    namespace fs = std::filesystem;
+
+    const auto base = fs::temp_directory_path() / "cachemgr-disk-usage-cold-archive-test";
+    const auto root = base / "cache";
+    const auto long_name = std::string(60, 'n');
+    const auto deep = root / "cold" / "nested" / long_name / long_name;
+    fs::remove_all(base);
+    fs::create_directories(deep);
+    fs::create_directories(root / "warm" / "old");
+    fs::create_directories(root / "linked");
+
+    constexpr std::int64_t day = 24 * 3600;
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    const auto set_last_used = [](const fs::path &path, std::int64_t last_used) {
+        const struct timespec times[2] = {
+            {.tv_sec = last_used, .tv_nsec = 0},
+            {.tv_sec = last_used, .tv_nsec = 0},
+        };
+        REQUIRE(::utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW) == 0);
+    };
+
+    std::ofstream(root / "cold" / "empty");
+    std::ofstream(root / "cold" / "large") << std::string(100 * 1000, 'x');
+    std::ofstream(root / "cold" / "nested" / "small") << "small";
+    std::ofstream(deep / "deep") << "deep";
+    fs::permissions(root / "cold" / "nested" / "small", fs::perms::owner_read | fs::perms::owner_write);
+    fs::create_symlink("large", root / "cold" / "link");
+    std::ofstream(root / "warm" / "new") << "new";
+    std::ofstream(root / "warm" / "old" / "file") << "old";
+    std::ofstream(root / "linked" / "file1") << "linked";
+    std::ofstream(root / "linked" / "file2") << "file2";
+    fs::create_hard_link(root / "linked" / "file1", root / "linked" / "link");
+
+    // the directories are made cold after their entries, the deepest first
+    for (const auto &path : {
+        root / "cold" / "empty", root / "cold" / "large", root / "cold" / "nested" / "small", deep / "deep",
+        root / "cold" / "link", deep, deep.parent_path(), root / "cold" / "nested", root / "cold",
+        root / "warm" / "old" / "file", root / "warm" / "old",
+        root / "linked" / "file1", root / "linked" / "file2", root / "linked"})
+    {
+        set_last_used(path, now - 60 * day);
+    }
+
+    const disk_usage::packing_options options{
+        .min_idle_time = std::chrono::seconds{30 * day},
+        .min_entries = 4,
+        .thread_count = 2,
+    };
+
+    {
+        // the warm subtree is too small, the hardlinked one can't be packed
+        auto dry_run_options = options;
+        dry_run_options.dry_run = true;
+        const auto result = disk_usage::pack_cold_subtrees(root.string(), dry_run_options);
+        REQUIRE(!result.ec);
+        REQUIRE(result.subtrees.size() == 1);
+        REQUIRE(result.subtrees[0].path == (root / "cold").string());
+        REQUIRE(result.subtrees[0].entries == 9);
+        REQUIRE(result.subtrees[0].apparent_size == 100 * 1000 + 5 + 4);
+        REQUIRE(result.subtrees[0].archive_size == 0);
+        REQUIRE(fs::is_directory(root / "cold"));
+    }
+
+    {
+        // a failed packing renames the subtree back
+        std::ofstream(root / "cold.cachemgr.tar.tmp") << "x";
+        const auto result = disk_usage::pack_cold_subtrees(root.string(), options);
+        REQUIRE(result.subtrees.size() == 1);
+        REQUIRE(result.subtrees[0].ec == std::errc::file_exists);
+        REQUIRE(result.subtrees[0].staging_path.empty());
+        REQUIRE(fs::file_size(root / "cold" / "large") == 100 * 1000);
+        REQUIRE(!fs::exists(root / "cold.cachemgr-packing"));
+        fs::remove(root / "cold.cachemgr.tar.tmp");
+    }
+
+    {
+        // an empty directory in place of the staging path is never replaced
+        fs::create_directory(root / "cold.cachemgr-packing");
+        const auto result = disk_usage::pack_cold_subtrees(root.string(), options);
+        REQUIRE(result.subtrees.size() == 1);
+        REQUIRE(result.subtrees[0].ec == std::errc::file_exists);
+        REQUIRE(fs::is_empty(root / "cold.cachemgr-packing"));
+        REQUIRE(fs::file_size(root / "cold" / "large") == 100 * 1000);
+        fs::remove(root / "cold.cachemgr-packing");
+    }
+
+    {
+        const auto result = disk_usage::pack_cold_subtrees(root.string(), options);
+        REQUIRE(!result.ec);
+        REQUIRE(result.subtrees.size() == 1);
+        REQUIRE(!result.subtrees[0].ec);
+        REQUIRE(!fs::exists(root / "cold"));
+        REQUIRE(fs::file_size(root / "cold.cachemgr.tar") == result.subtrees[0].archive_size);
+        REQUIRE(result.subtrees[0].archive_size > 100 * 1000);
+        REQUIRE(fs::is_directory(root / "warm" / "old"));
+        REQUIRE(fs::is_directory(root / "linked"));
+    }
+
+    std::vector<std::string> archives;
+    REQUIRE(!disk_usage::find_cold_archives(root.string(), archives, 2));
+    REQUIRE(archives == std::vector<std::string>{(root / "cold.cachemgr.tar").string()});
+
+    {
+        const auto result = disk_usage::restore_archive(archives[0], 2);
+        REQUIRE(!result.ec);
+        REQUIRE(result.entries == 9);
+        REQUIRE(result.apparent_size == 100 * 1000 + 5 + 4);
+        REQUIRE(!fs::exists(archives[0]));
+
+        REQUIRE(fs::file_size(root / "cold" / "empty") == 0);
+        REQUIRE(fs::file_size(root / "cold" / "large") == 100 * 1000);
+        REQUIRE(fs::read_symlink(root / "cold" / "link") == "large");
+        std::string contents;
+        std::ifstream(deep / "deep") >> contents;
+        REQUIRE(contents == "deep");
+        REQUIRE(fs::status(root / "cold" / "nested" / "small").permissions() ==
+            (fs::perms::owner_read | fs::perms::owner_write));
+
+        // modification times are preserved, restored files count as used
+        struct stat st;
+        REQUIRE(::stat((root / "cold" / "large").c_str(), &st) == 0);
+        REQUIRE(st.st_mtime == now - 60 * day);
+        REQUIRE(st.st_atime >= now);
+        REQUIRE(::stat((root / "cold" / "nested").c_str(), &st) == 0);
+        REQUIRE(st.st_mtime == now - 60 * day);
+    }
+
+    {
+        // invalid archives are kept
+        std::ofstream(root / "invalid.cachemgr.tar") << std::string(1000, 'x');
+        const auto result = disk_usage::restore_archive((root / "invalid.cachemgr.tar").string(), 2);
+        REQUIRE(result.ec);
+        REQUIRE(fs::exists(root / "invalid.cachemgr.tar"));
+        REQUIRE(!fs::exists(root / "invalid"));
+    }
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("reject archives with entries outside of the restored directory", tag_name_cold_archive) {
+    namespace fs = std::filesystem;
+
+    const auto base = fs::temp_directory_path() / "cachemgr-disk-usage-cold-archive-escape-test";
+    const auto root = base / "cache";
+    const auto outside = base / "outside";
+    fs::remove_all(base);
+    fs::create_directories(root);
+    fs::create_directories(outside);
+
+    struct index_entry_t final
+    {
+        char type;
+        std::string path;
+        std::string link_target;
+    };
+
+    // an archive with only the mode of the root directory in its tar stream, all files are empty
+    const auto write_archive = [](const fs::path &path, const std::vector<index_entry_t> &entries) {
+        const auto append = [](std::string &buffer, const auto value) {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        std::string archive(1024, '\0');
+        archive.replace(100, 7, "0000755");
+        std::string index;
+        for (const auto &entry : entries)
+        {
+            append(index, std::uint64_t{0});
+            append(index, std::uint64_t{0});
+            append(index, std::int64_t{0});
+            append(index, std::uint32_t{0644});
+            append(index, static_cast<std::uint16_t>(entry.path.size()));
+            append(index, static_cast<std::uint16_t>(entry.link_target.size()));
+            append(index, static_cast<std::uint8_t>(entry.type));
+            index.append(entry.path).append(entry.link_target);
+        }
+        const auto index_offset = static_cast<std::uint64_t>(archive.size());
+        archive.append(index).append("CMGRIDX1");
+        append(archive, index_offset);
+        append(archive, static_cast<std::uint64_t>(index.size()));
+        append(archive, static_cast<std::uint64_t>(entries.size()));
+        std::ofstream(path, std::ios::binary) << archive;
+    };
+
+    const std::vector<std::vector<index_entry_t>> malicious_indexes = {
+        // a file below a symbolic link which points outside
+        {{'l', "a", outside.string()}, {'f', "a/x", ""}},
+        // a directory below a symbolic link
+        {{'l', "a", outside.string()}, {'d', "a/x", ""}},
+        // a file whose parent directory is not part of the archive
+        {{'f', "missing/x", ""}},
+        // the same path twice
+        {{'d', "a", ""}, {'l', "a", outside.string()}, {'f', "a/x", ""}},
+    };
+
+    for (const auto &entries : malicious_indexes)
+    {
+        const auto archive = root / "evil.cachemgr.tar";
+        write_archive(archive, entries);
+
+        const auto result = disk_usage::restore_archive(archive.string(), 2);
+        REQUIRE(result.ec == std::errc::illegal_byte_sequence);
+        REQUIRE(fs::exists(archive));
+        REQUIRE(!fs::exists(root / "evil"));
+        REQUIRE(!fs::exists(root / "evil.cachemgr-restoring"));
+        REQUIRE(fs::is_empty(outside));
+    }
+
+    // the same layout with a real directory is fine
+    write_archive(root / "good.cachemgr.tar", {{'d', "a", ""}, {'f', "a/x", ""}, {'l', "a/link", "x"}});
+    const auto result = disk_usage::restore_archive((root / "good.cachemgr.tar").string(), 2);
+    REQUIRE(!result.ec);
+    REQUIRE(result.entries == 4);
+    REQUIRE(fs::is_regular_file(root / "good" / "a" / "x"));
+    REQUIRE(fs::read_symlink(root / "good" / "a" / "link") == "x");
+    REQUIRE(fs::is_empty(outside));
+
+    fs::remove_all(base);
+}
@@ -0,0 +1,271 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <utils/fs_utils.hpp>
+#include <utils/trash.hpp>
+
+#include <libcachemgr/logging.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+static constexpr const char *tag_name_glob_pattern = "[fs_utils::glob_pattern_t]";
+static constexpr const char *tag_name_resolve_wildcard_pattern = "[fs_utils::resolve_wildcard_pattern]";
+static constexpr const char *tag_name_trash = "[fs_utils::swap_out_directory]";
+
+TEST_CASE("match glob pattern components", tag_name_glob_pattern) {
+    using fs_utils::glob_pattern_t;
+
+    REQUIRE(glob_pattern_t("/cache/*.log").match("/cache/app.log"));
+    REQUIRE(glob_pattern_t("/cache/*.log").match("/cache/.log"));
+    REQUIRE(!glob_pattern_t("/cache/*.log").match("/cache/app.log.1"));
+    REQUIRE(!glob_pattern_t("/cache/*.log").match("/cache/sub/app.log"));
+    REQUIRE(!glob_pattern_t("/cache/*.log").match("cache/app.log"));
+
+    REQUIRE(glob_pattern_t("/cache/file?.txt").match("/cache/file1.txt"));
+    REQUIRE(!glob_pattern_t("/cache/file?.txt").match("/cache/file.txt"));
+
+    REQUIRE(glob_pattern_t("/cache/[a-c]x").match("/cache/bx"));
+    REQUIRE(!glob_pattern_t("/cache/[a-c]x").match("/cache/dx"));
+    REQUIRE(glob_pattern_t("/cache/[!a-c]x").match("/cache/dx"));
+    REQUIRE(glob_pattern_t("/cache/[]]").match("/cache/]"));
+    REQUIRE(glob_pattern_t("/cache/[abc").match("/cache/[abc"));
+    REQUIRE(glob_pattern_t("/cache/\\*").match("/cache/*"));
+    REQUIRE(!glob_pattern_t("/cache/\\*").match("/cache/x"));
+
+    // the star restarts only once per mismatch
+    REQUIRE(glob_pattern_t("/cache/*a*b*c").match("/cache/xaxbxaxbxc"));
+    REQUIRE(!glob_pattern_t("/cache/a*a*a*a*a*a*a*a*b").match("/cache/" + std::string(100, 'a')));
+}
+
+TEST_CASE("match recursive glob patterns", tag_name_glob_pattern) {
+    using fs_utils::glob_pattern_t;
+
+    const glob_pattern_t pattern("/home/user/build/**/node_modules");
+    REQUIRE(pattern.is_recursive());
+    REQUIRE(pattern.base_directory() == "/home/user/build");
+    REQUIRE(pattern.match("/home/user/build/node_modules"));
+    REQUIRE(pattern.match("/home/user/build/a/b/c/node_modules"));
+    REQUIRE(!pattern.match("/home/user/build/a/node_modules/x"));
+    REQUIRE(!pattern.match("/home/user/node_modules"));
+
+    REQUIRE(glob_pattern_t("/a/**/**/b/*.o").match("/a/x/y/b/z.o"));
+    REQUIRE(glob_pattern_t("/a/**").match("/a/x"));
+    REQUIRE(!glob_pattern_t("/a/*.o").is_recursive());
+    REQUIRE(!glob_pattern_t("/a/b").has_wildcards());
+}
+
+TEST_CASE("resolve wildcard patterns", tag_name_resolve_wildcard_pattern) {
+    namespace fs = std::filesystem;
+
+    const auto root = fs::temp_directory_path() / "cachemgr_test_resolve_wildcard_pattern";
+    fs::remove_all(root);
+    fs::create_directories(root / "a" / "node_modules" / "nested" / "node_modules");
+    fs::create_directories(root / "b" / "c" / "node_modules");
+    std::ofstream(root / "one.log") << "x";
+    std::ofstream(root / "two.log") << "x";
+    std::ofstream(root / "three.txt") << "x";
+    std::ofstream(root / "b" / "four.log") << "x";
+    fs::create_symlink(root / "one.log", root / "link.log");
+    fs::create_symlink(root / "b", root / "dir.log");
+
+    std::error_code ec;
+
+    // symbolic links to regular files are matches, symbolic links to directories are not
+    const auto logs = fs_utils::resolve_wildcard_pattern((root / "*.log").string(), &ec);
+    REQUIRE(!ec);
+    REQUIRE(logs == std::list<std::string>{
+        (root / "link.log").string(), (root / "one.log").string(), (root / "two.log").string(),
+    });
+
+    // matched directories are not descended into
+    const auto node_modules = fs_utils::resolve_wildcard_pattern((root / "**" / "node_modules").string(), &ec);
+    REQUIRE(!ec);
+    REQUIRE(node_modules == std::list<std::string>{
+        (root / "a" / "node_modules").string(), (root / "b" / "c" / "node_modules").string(),
+    });
+
+    const auto all_logs = fs_utils::resolve_wildcard_pattern((root / "**" / "*.log").string(), &ec);
+    REQUIRE(!ec);
+    REQUIRE(all_logs.size() == 4);
+
+    const auto missing = fs_utils::resolve_wildcard_pattern((root / "missing" / "*").string(), &ec);
+    REQUIRE(!ec);
+    REQUIRE(missing.empty());
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("resolve wildcard matches with their sizes", tag_name_resolve_wildcard_pattern) {
+    namespace fs = std::filesystem;
+
+    const auto root = fs::temp_directory_path() / "cachemgr_test_resolve_wildcard_matches";
+    fs::remove_all(root);
+    fs::create_directories(root / "dir.cache");
+    std::ofstream(root / "small.cache") << std::string(100, 'x');
+    std::ofstream(root / "large.cache") << std::string(5000, 'x');
+    fs::create_hard_link(root / "large.cache", root / "link.cache");
+
+    std::error_code ec;
+    const auto matches = fs_utils::resolve_wildcard_matches(fs_utils::glob_pattern_t((root / "*.cache").string()), &ec);
+    REQUIRE(!ec);
+    REQUIRE(matches.size() == 4);
+
+    // sorted by path
+    REQUIRE(matches[0].path == (root / "dir.cache").string());
+    REQUIRE(matches[0].is_directory);
+    REQUIRE(matches[1].path == (root / "large.cache").string());
+    REQUIRE(!matches[1].is_directory);
+    REQUIRE(matches[1].apparent_size == 5000);
+    REQUIRE(matches[1].allocated_size >= 4096);
+    REQUIRE(matches[1].mtime > 0);
+    REQUIRE(matches[1].link_count == 2);
+    REQUIRE(matches[2].inode == matches[1].inode);
+    REQUIRE(matches[2].device == matches[1].device);
+    REQUIRE(matches[3].apparent_size == 100);
+
+    // a pattern without wildcards is stat'ed directly
+    const auto plain = fs_utils::resolve_wildcard_matches(fs_utils::glob_pattern_t((root / "small.cache").string()), &ec);
+    REQUIRE(!ec);
+    REQUIRE(plain.size() == 1);
+    REQUIRE(plain[0].apparent_size == 100);
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("swap out and remove directory", tag_name_trash) {
+    namespace fs = std::filesystem;
+
+    const auto root = fs::temp_directory_path() / "cachemgr_test_swap_out_directory";
+    const auto outside = fs::temp_directory_path() / "cachemgr_test_swap_out_directory_outside";
+    fs::remove_all(root);
+    fs::remove_all(outside);
+    fs::create_directories(root / "cache" / "a" / "b");
+    fs::create_directories(root / "cache" / "readonly" / "nested");
+    fs::create_directories(outside);
+    std::ofstream(root / "cache" / "one") << "x";
+    std::ofstream(root / "cache" / "a" / "b" / "two") << "x";
+    std::ofstream(root / "cache" / "readonly" / "nested" / "three") << "x";
+    std::ofstream(outside / "keep") << "x";
+    fs::create_symlink(outside, root / "cache" / "a" / "link");
+
+    // like the Go module cache
+    fs::permissions(root / "cache" / "readonly" / "nested", fs::perms::owner_read | fs::perms::owner_exec);
+    fs::permissions(root / "cache" / "readonly", fs::perms::owner_read | fs::perms::owner_exec);
+
+    std::string trash_path;
+    REQUIRE(!fs_utils::swap_out_directory((root / "cache").string(), ".trash", trash_path));
+    REQUIRE(fs::path(trash_path).parent_path() == root / ".trash");
+
+    // the directory is empty and the previous contents are in the trash
+    REQUIRE(fs::is_directory(root / "cache"));
+    REQUIRE(fs::is_empty(root / "cache"));
+    REQUIRE(fs::exists(fs::path(trash_path) / "a" / "b" / "two"));
+
+    REQUIRE(!fs_utils::remove_all_parallel(trash_path, 4));
+    REQUIRE(!fs::exists(trash_path));
+
+    // symbolic links are removed, never followed
+    REQUIRE(fs::exists(outside / "keep"));
+
+    // paths which don't exist are not an error
+    REQUIRE(!fs_utils::remove_all_parallel(trash_path));
+
+    // trees deeper than PATH_MAX are removed relative to their parents
+    fs::create_directories(root / "deep");
+    int deep_fd = ::open((root / "deep").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    const std::string long_name(200, 'd');
+    for (int depth = 0; depth < 32 && deep_fd >= 0; ++depth)
+    {
+        REQUIRE(::mkdirat(deep_fd, long_name.c_str(), 0700) == 0);
+        const int child_fd = ::openat(deep_fd, long_name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ::close(deep_fd);
+        deep_fd = child_fd;
+    }
+    REQUIRE(deep_fd >= 0);
+    ::close(deep_fd);
+    REQUIRE(!fs_utils::remove_all_parallel((root / "deep").string(), 4));
+    REQUIRE(!fs::exists(root / "deep"));
+
+    std::string missing_trash_path;
+    REQUIRE(fs_utils::swap_out_directory((root / "missing").string(), ".trash", missing_trash_path));
+    REQUIRE(missing_trash_path.empty());
+
+    fs::remove_all(root);
+    fs::remove_all(outside);
+}
+
+TEST_CASE("swap out mount points into a trash inside of them", tag_name_trash) {
+    namespace fs = std::filesystem;
+
+    const auto root = fs::temp_directory_path() / "cachemgr_test_swap_out_mount_point";
+    fs::remove_all(root);
+    fs::create_directories(root / "cache");
+
+    std::string trash_path;
+    if (::geteuid() == 0 && ::mount("none", (root / "cache").c_str(), "tmpfs", 0, nullptr) == 0)
+    {
+        fs::create_directories(root / "cache" / "a");
+        std::ofstream(root / "cache" / "a" / "one") << "x";
+
+        // the mount point can't be exchanged (EBUSY), the entries are moved into a trash inside of it
+        REQUIRE(!fs_utils::swap_out_directory((root / "cache").string(), ".trash", trash_path));
+        REQUIRE(fs::path(trash_path).parent_path() == root / "cache" / ".trash");
+        REQUIRE(fs::exists(fs::path(trash_path) / "a" / "one"));
+        REQUIRE(!fs::exists(root / "cache" / "a"));
+
+        REQUIRE(!fs_utils::remove_all_parallel(trash_path));
+        REQUIRE(::umount((root / "cache").c_str()) == 0);
+    }
+    else if (::geteuid() != 0)
+    {
+        // directories without write permission can neither be exchanged (EACCES) nor emptied
+        fs::permissions(root / "cache", fs::perms::owner_read | fs::perms::owner_exec);
+        REQUIRE(fs_utils::swap_out_directory((root / "cache").string(), ".trash", trash_path));
+        REQUIRE(trash_path.empty());
+        fs::permissions(root / "cache", fs::perms::owner_all);
+    }
+
+    // the trash next to the directory is not left behind
+    REQUIRE(!fs::exists(root / ".trash"));
+
+    fs::remove_all(root);
+}
+
+TEST_CASE("empty the trash of a directory", tag_name_trash) {
+    namespace fs = std::filesystem;
+
+    const auto root = fs::temp_directory_path() / "cachemgr_test_empty_trash";
+    fs::remove_all(root);
+    fs::create_directories(root / "cache" / "a");
+    std::ofstream(root / "cache" / "a" / "one") << "x";
+
+    // a stale entry of an interrupted deletion next to the directory
+    fs::create_directories(root / ".trash" / "cache.1.1" / "b");
+    std::ofstream(root / ".trash" / "cache.1.1" / "b" / "two") << "x";
+
+    std::string trash_path;
+    REQUIRE(!fs_utils::swap_out_directory((root / "cache").string(), ".trash", trash_path));
+    REQUIRE(fs::exists(fs::path(trash_path) / "a" / "one"));
+
+    // and one inside of it, left by an earlier fallback
+    fs::create_directories(root / "cache" / ".trash" / "cache.1.2");
+    std::ofstream(root / "cache" / ".trash" / "cache.1.2" / "three") << "x";
+
+    REQUIRE(!fs_utils::empty_trash((root / "cache").string(), ".trash", 4));
+    REQUIRE(!fs::exists(root / ".trash"));
+    REQUIRE(!fs::exists(root / "cache" / ".trash"));
+    REQUIRE(fs::is_directory(root / "cache"));
+
+    // a missing trash is not an error
+    REQUIRE(!fs_utils::empty_trash((root / "cache").string(), ".trash"));
+    REQUIRE(fs_utils::empty_trash((root / "cache").string(), "../trash"));
+
+    fs::remove_all(root);
+}
@@ -1,14 +1,21 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include <utils/os_utils.hpp>
+#include <utils/mount_table.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
 
 #include <libcachemgr/logging.hpp>
 
 static constexpr const char *tag_name_getenv = "[os_utils::getenv]";
 static constexpr const char *tag_name_get_home_directory = "[os_utils::get_home_directory]";
 static constexpr const char *tag_name_is_mount_point = "[os_utils::is_mount_point]";
+static constexpr const char *tag_name_mount_table = "[os_utils::mount_table_t]";
 static constexpr const char *tag_name_get_user_id = "[os_utils::get_user_id]";
 static constexpr const char *tag_name_get_group_id = "[os_utils::get_group_id]";
+static constexpr const char *tag_name_spawn_detached = "[os_utils::spawn_detached]";
 
 TEST_CASE("get environment variable success", tag_name_getenv) {
     {
@@ -101,9 +108,76 @@ TEST_CASE("get home directory", tag_name_get_home_directory) {
     }
 }
 
-// TODO[is mount point]: how could this test be implemented?
-// TEST_CASE("is mount point", tag_name_is_mount_point) {
-// }
+TEST_CASE("is mount point", tag_name_is_mount_point) {
+    {
+        // the root directory is always a mount point
+        std::string mount_target;
+        REQUIRE(os_utils::is_mount_point("/", &mount_target));
+        REQUIRE(mount_target.length() > 0);
+    }
+    {
+        // a freshly created directory can't be a mount point
+        const auto directory = std::filesystem::temp_directory_path() / "cachemgr_is_mount_point_test";
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        REQUIRE(!ec);
+
+        std::string mount_target = "not cleared";
+        REQUIRE(!os_utils::is_mount_point(directory.string(), &mount_target));
+        REQUIRE(mount_target.empty());
+
+        std::filesystem::remove(directory, ec);
+    }
+}
+
+TEST_CASE("parse mount table", tag_name_mount_table) {
+    os_utils::mount_table_t mount_table;
+    mount_table.parse(
+        "22 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+        "23 22 0:21 / /proc rw,nosuid shared:2 - proc proc rw\n"
+        "30 22 8:1 /data/cache /home/user/.cache rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+        "31 22 8:2 / /mnt/with\\040space rw - xfs /dev/sda2 rw\n"
+        "32 31 8:2 /npm /home/user/.npm rw - xfs /dev/sda2 rw\n"
+        "33 22 0:40 / /proc rw - tmpfs none rw\n"
+        "malformed line\n");
+
+    REQUIRE(mount_table.size() == 6);
+
+    {
+        // exact lookups
+        REQUIRE(mount_table.find_mount_point("/") != nullptr);
+        REQUIRE(mount_table.find_mount_point("/home/user") == nullptr);
+        REQUIRE(mount_table.find_mount_point("/home/user/.cache/") != nullptr);
+
+        // escaped mount point
+        const auto *mount = mount_table.find_mount_point("/mnt/with space");
+        REQUIRE(mount != nullptr);
+        REQUIRE(mount->filesystem_type == "xfs");
+
+        // the last mount hides the previous mount on the same mount point
+        const auto *proc = mount_table.find_mount_point("/proc");
+        REQUIRE(proc != nullptr);
+        REQUIRE(proc->mount_id == 33);
+    }
+    {
+        // longest prefix lookups
+        const auto *mount = mount_table.find_containing_mount("/home/user/.cache/go-build/00");
+        REQUIRE(mount != nullptr);
+        REQUIRE(mount->mount_id == 30);
+
+        mount = mount_table.find_containing_mount("/home/user/.cachex");
+        REQUIRE(mount != nullptr);
+        REQUIRE(mount->mount_id == 22);
+
+        REQUIRE(mount_table.find_containing_mount("relative/path") == nullptr);
+    }
+    {
+        // bind sources
+        REQUIRE(mount_table.bind_source_of(*mount_table.find_mount_point("/home/user/.cache")) == "/data/cache");
+        REQUIRE(mount_table.bind_source_of(*mount_table.find_mount_point("/home/user/.npm")) == "/mnt/with space/npm");
+        REQUIRE(mount_table.bind_source_of(*mount_table.find_mount_point("/")) == "/dev/sda1");
+    }
+}
 
 TEST_CASE("get user id", tag_name_get_user_id) {
     {
@@ -120,3 +194,23 @@ TEST_CASE("get group id", tag_name_get_group_id) {
         LOG_INFO(libcachemgr::log_test, "{}: gid = {}", tag_name_get_group_id, gid);
     }
 }
+
+TEST_CASE("spawn detached process", tag_name_spawn_detached) {
+    namespace fs = std::filesystem;
+
+    const auto marker = fs::temp_directory_path() / "cachemgr_test_spawn_detached";
+    fs::remove(marker);
+
+    REQUIRE(!os_utils::spawn_detached({"/bin/sh", "-c", "echo done > \"$0\"", marker.string()}));
+
+    // the caller doesn't wait for the process
+    for (int i = 0; i < 500 && !fs::exists(marker); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    REQUIRE(fs::exists(marker));
+    fs::remove(marker);
+
+    REQUIRE(os_utils::spawn_detached({}));
+    REQUIRE(os_utils::spawn_detached({"/nonexistent/cachemgr_test_program"}));
+}